@@ -0,0 +1,2860 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "depth_scanner.h"
+#include "distance_field.h"
+#include "entity_world.h"
+#include "floor_caster.h"
+#include "frame_buffer.h"
+#include "frame_capture.h"
+#include "game_log.h"
+#include "level.h"
+#include "level_editor.h"
+#include "lightmap.h"
+#include "line_of_sight.h"
+#include "profiler.h"
+#include "ray_cache.h"
+#include "ray_caster.h"
+#include "ray_packet.h"
+#include "renderer.h"
+#include "resolution_scaler.h"
+#include "simulation.h"
+#include "sprite_renderer.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include "tile_collision.h"
+#include "tiled_level.h"
+#include "trace.h"
+#include "visibility_set.h"
+
+/*
+ * bench.cc
+ *
+ * Headless benchmarks of the ray caster. They need no window and print their
+ * results as JSON Lines (see bench_util.h).
+ *
+ * The microbenchmarks time DDAData, Camera::CalculateRay (with and without
+ * empty-space skipping), the packet traversal, wall column shading, floor
+ * casting, the preset screen sizes, sprites, the fixed-step simulation, the
+ * frame profiler, the game log formatter, the row-major and tiled level
+ * layouts, the depth scans of many agents, line-of-sight queries, entity
+ * collision, the potentially visible sets and level edits in isolation. The
+ * flights render complete frames along fixed camera paths through
+ * level::kLevelData, so the results are reproducible from run to run. The ray
+ * cache is checked against casting every ray along the same paths, and the
+ * resolution scaler renders a flight within a target frame cost.
+ */
+
+namespace {
+
+constexpr int kScreenWidth = 1920;
+constexpr int kScreenHeight = 1080;
+constexpr float kFovDegrees = 90.0f;
+
+// Minimum duration of a microbenchmark, long enough to smooth out noise.
+constexpr double kMinBenchmarkSeconds = 0.25;
+
+struct BenchOptions {
+  int num_threads = ThreadPool::DefaultNumThreads();
+  int num_frames = 240;
+};
+
+// Camera pose along a path. The angle is in degrees, 0 facing +X.
+struct Waypoint {
+  float x, y, angle;
+};
+
+// Path made of straight segments between waypoints, each segment taking the
+// same share of the frames.
+struct CameraPath {
+  const char* name;
+  std::vector<Waypoint> waypoints;
+};
+
+const CameraPath kCameraPaths[] = {
+  // Walks down the long open hall (rows 9-15), then turns and walks back.
+  { "open_hall", {
+      { 12.5f, 1.5f, 90.0f },
+      { 12.5f, 22.5f, 90.0f },
+      { 12.5f, 22.5f, 270.0f },
+      { 12.5f, 1.5f, 270.0f } } },
+  // Enters the nested green room through its door and looks around inside.
+  { "green_room", {
+      { 12.5f, 8.5f, 180.0f },
+      { 6.5f, 8.5f, 180.0f },
+      { 6.5f, 8.5f, 540.0f } } },
+  // Walks into the corner of the white maze and along its innermost corridor.
+  { "maze_corner", {
+      { 21.5f, 12.5f, 270.0f },
+      { 21.5f, 2.5f, 270.0f },
+      { 21.5f, 2.5f, 180.0f },
+      { 17.5f, 2.5f, 180.0f },
+      { 17.5f, 2.5f, 90.0f } } }
+};
+
+// Returns the level all cameras are placed in.
+const Level& BenchLevel() {
+  static const Level level = level::BuiltinLevel();
+
+  return level;
+}
+
+float DegreesToRadians(float degrees) {
+  static constexpr float kPi = 2.0f * std::acos(0.0f);
+
+  return std::fmod(degrees, 360.0f) * (kPi / 180.0f);
+}
+
+// Returns the camera at the point t in [0, 1] along the path.
+Camera CameraAt(const CameraPath& path, float t) {
+  const int num_segments = static_cast<int>(path.waypoints.size()) - 1;
+  const float segment_t = t * num_segments;
+  const int segment = std::min(static_cast<int>(segment_t), num_segments - 1);
+  const float s = segment_t - segment;
+
+  const Waypoint& from = path.waypoints[segment];
+  const Waypoint& to = path.waypoints[segment + 1];
+
+  return Camera(
+      BenchLevel(),
+      from.x + (to.x - from.x) * s,
+      from.y + (to.y - from.y) * s,
+      DegreesToRadians(from.angle + (to.angle - from.angle) * s),
+      DegreesToRadians(kFovDegrees));
+}
+
+std::vector<float> ScreenPlaneScalars() {
+  std::vector<float> plane_scalars(kScreenWidth);
+
+  for (int x = 0; x < kScreenWidth; ++x) {
+    plane_scalars[x] = rendering::CalculatePlaneScalar(x, kScreenWidth);
+  }
+
+  return plane_scalars;
+}
+
+// Cameras sampled along every path, used by the microbenchmarks.
+std::vector<Camera> SampleCameras() {
+  constexpr int kSamplesPerPath = 16;
+
+  std::vector<Camera> cameras;
+
+  for (const CameraPath& path : kCameraPaths) {
+    for (int i = 0; i < kSamplesPerPath; ++i) {
+      cameras.push_back(CameraAt(path, (i + 0.5f) / kSamplesPerPath));
+    }
+  }
+
+  return cameras;
+}
+
+// Holds the structure-of-arrays buffers for one row of screen rays.
+struct ScreenRays {
+  std::vector<float> distance = std::vector<float>(kScreenWidth);
+  std::vector<int> wall_id = std::vector<int>(kScreenWidth);
+  std::vector<raycasting::WallSide> wall_side =
+      std::vector<raycasting::WallSide>(kScreenWidth);
+  std::vector<float> wall_x = std::vector<float>(kScreenWidth);
+  std::vector<int> num_steps = std::vector<int>(kScreenWidth);
+
+  raycasting::RayBatch Batch() {
+    return raycasting::RayBatch{
+      distance.data(), wall_id.data(), wall_side.data(), wall_x.data(),
+      num_steps.data()
+    };
+  }
+};
+
+void BenchmarkDDAData() {
+  constexpr int kNumInputs = 4096;
+
+  std::vector<float> positions(kNumInputs);
+  std::vector<float> directions(kNumInputs);
+
+  for (int i = 0; i < kNumInputs; ++i) {
+    positions[i] = 1.0f + 22.0f * i / kNumInputs;
+    directions[i] = std::sin(i * 0.37f);
+  }
+
+  int64_t num_ops = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (int i = 0; i < kNumInputs; ++i) {
+      raycasting::DDAData dda_data(positions[i], directions[i]);
+      bench::DoNotOptimize(dda_data);
+    }
+    num_ops += kNumInputs;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("dda_data")
+      .Add("ops", num_ops)
+      .Add("ns_per_op", seconds * 1e9 / num_ops)
+      .Print();
+}
+
+// Returns copies of the cameras that skip empty space with the distance
+// field, or plain copies if it is null.
+std::vector<Camera> WithDistanceField(const std::vector<Camera>& cameras,
+                                      const DistanceField* distance_field) {
+  std::vector<Camera> result = cameras;
+
+  for (Camera& camera : result) {
+    camera.SetDistanceField(distance_field);
+  }
+
+  return result;
+}
+
+// Checks that empty-space skipping changes nothing but the number of steps.
+bool SkippingMatchesPlain(const std::vector<Camera>& cameras,
+                          const DistanceField& distance_field) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  for (const Camera& camera : cameras) {
+    Camera skipping_camera = camera;
+    skipping_camera.SetDistanceField(&distance_field);
+
+    for (float plane_scalar : plane_scalars) {
+      const raycasting::RayData plain = camera.CalculateRay(plane_scalar);
+      const raycasting::RayData skipping =
+          skipping_camera.CalculateRay(plane_scalar);
+
+      if (std::memcmp(&plain.distance, &skipping.distance,
+                      sizeof(float)) != 0 ||
+          std::memcmp(&plain.wall_x, &skipping.wall_x, sizeof(float)) != 0 ||
+          plain.wall_id != skipping.wall_id ||
+          plain.wall_side != skipping.wall_side) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void BenchmarkCalculateRay(const std::string& name,
+                           const std::vector<Camera>& cameras,
+                           const DistanceField* distance_field) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+  const std::vector<Camera> bench_cameras =
+      WithDistanceField(cameras, distance_field);
+
+  int64_t num_rays = 0;
+  int64_t num_steps = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (const Camera& camera : bench_cameras) {
+      for (float plane_scalar : plane_scalars) {
+        const raycasting::RayData ray_data = camera.CalculateRay(plane_scalar);
+        num_steps += ray_data.num_steps;
+      }
+      num_rays += kScreenWidth;
+    }
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine line(name);
+  line.Add("empty_space_skipping", distance_field != nullptr)
+      .Add("rays", num_rays)
+      .Add("rays_per_s", num_rays / seconds)
+      .Add("dda_steps_per_ray", static_cast<double>(num_steps) / num_rays);
+
+  if (distance_field != nullptr) {
+    line.Add("matches_plain", SkippingMatchesPlain(cameras, *distance_field));
+  }
+
+  line.Print();
+}
+
+// Times the DDA with the fixed-point axis type against the float DDA on the
+// same rays, and measures how far the fixed-point results stray from the
+// float ones. The checksum of the fixed-point results is the same on every
+// compiler and CPU.
+template <typename Axis>
+void BenchmarkFixedPointDDA(const std::string& name,
+                            int fraction_bits,
+                            const std::vector<Camera>& cameras,
+                            const DistanceField& distance_field) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  int64_t num_rays = 0;
+  int64_t num_same_wall = 0;
+  double max_distance_error = 0.0;
+  double max_relative_error = 0.0;
+  double sum_distance_error = 0.0;
+  bool skipping_matches_plain = true;
+  uint64_t checksum = 14695981039346656037u;
+
+  const auto hash = [&checksum](const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; ++i) {
+      checksum = (checksum ^ bytes[i]) * 1099511628211u;
+    }
+  };
+
+  for (const Camera& camera : cameras) {
+    for (float plane_scalar : plane_scalars) {
+      const Vector ray_direction =
+          camera.Direction() + camera.Plane() * plane_scalar;
+
+      raycasting::HitTile float_tile;
+      raycasting::HitTile fixed_tile;
+      const raycasting::RayData float_ray = raycasting::CastRay(
+          camera.GetLevel(), nullptr, camera.Position(), ray_direction,
+          &float_tile);
+      const raycasting::RayData fixed_ray = raycasting::CastRay<Axis>(
+          camera.GetLevel(), nullptr, camera.Position(), ray_direction,
+          &fixed_tile);
+      const raycasting::RayData skipping_ray = raycasting::CastRay<Axis>(
+          camera.GetLevel(), &distance_field, camera.Position(),
+          ray_direction);
+
+      ++num_rays;
+
+      hash(&fixed_ray.distance, sizeof(float));
+      hash(&fixed_ray.wall_x, sizeof(float));
+      hash(&fixed_ray.num_steps, sizeof(int));
+
+      skipping_matches_plain =
+          skipping_matches_plain &&
+          std::memcmp(&fixed_ray.distance, &skipping_ray.distance,
+                      sizeof(float)) == 0 &&
+          std::memcmp(&fixed_ray.wall_x, &skipping_ray.wall_x,
+                      sizeof(float)) == 0 &&
+          fixed_ray.wall_side == skipping_ray.wall_side;
+
+      // Distances are only comparable if both rays hit the same side of the
+      // same tile, which fails where a ray grazes a corner.
+      if (float_tile.x != fixed_tile.x || float_tile.y != fixed_tile.y ||
+          float_ray.wall_side != fixed_ray.wall_side) {
+        continue;
+      }
+
+      const double error = std::abs(static_cast<double>(fixed_ray.distance) -
+                                    float_ray.distance);
+
+      ++num_same_wall;
+      sum_distance_error += error;
+      max_distance_error = std::max(max_distance_error, error);
+      max_relative_error =
+          std::max(max_relative_error, error / float_ray.distance);
+    }
+  }
+
+  // Times both DDAs on the same rays.
+  const auto time_rays = [&](auto cast_ray) {
+    int64_t num_timed = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      for (const Camera& camera : cameras) {
+        for (float plane_scalar : plane_scalars) {
+          const raycasting::RayData ray_data = cast_ray(
+              camera, camera.Direction() + camera.Plane() * plane_scalar);
+          bench::DoNotOptimize(ray_data.distance);
+        }
+        num_timed += kScreenWidth;
+      }
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    return num_timed / bench::SecondsSince(start);
+  };
+
+  const double fixed_rays_per_s =
+      time_rays([](const Camera& camera, const Vector& ray_direction) {
+        return raycasting::CastRay<Axis>(camera.GetLevel(), nullptr,
+                                         camera.Position(), ray_direction);
+      });
+  const double float_rays_per_s =
+      time_rays([](const Camera& camera, const Vector& ray_direction) {
+        return raycasting::CastRay(camera.GetLevel(), nullptr,
+                                   camera.Position(), ray_direction);
+      });
+
+  char checksum_text[17];
+  std::snprintf(checksum_text, sizeof(checksum_text), "%016llx",
+                static_cast<unsigned long long>(checksum));
+
+  bench::JsonLine(name)
+      .Add("fraction_bits", fraction_bits)
+      .Add("rays", num_rays)
+      .Add("rays_per_s", fixed_rays_per_s)
+      .Add("float_rays_per_s", float_rays_per_s)
+      .Add("same_wall_fraction", static_cast<double>(num_same_wall) / num_rays)
+      .Add("mean_distance_error", sum_distance_error / num_same_wall)
+      .Add("max_distance_error", max_distance_error)
+      .Add("max_relative_error", max_relative_error)
+      .Add("checksum", std::string(checksum_text))
+      .Add("matches_plain", skipping_matches_plain)
+      .Print();
+}
+
+// Checks that the packet traversal returns exactly what the scalar path
+// returns for every column of every sampled camera.
+bool PacketMatchesScalar(const std::vector<Camera>& cameras) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  ScreenRays rays;
+  raycasting::RayBatch batch = rays.Batch();
+
+  for (const Camera& camera : cameras) {
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+
+    for (int x = 0; x < kScreenWidth; ++x) {
+      const raycasting::RayData ray_data =
+          camera.CalculateRay(plane_scalars[x]);
+
+      if (std::memcmp(&ray_data.distance, &rays.distance[x],
+                      sizeof(float)) != 0 ||
+          ray_data.wall_id != rays.wall_id[x] ||
+          std::memcmp(&ray_data.wall_x, &rays.wall_x[x],
+                      sizeof(float)) != 0 ||
+          ray_data.wall_side != rays.wall_side[x] ||
+          ray_data.num_steps != rays.num_steps[x]) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void BenchmarkCalculateRays(const std::vector<Camera>& cameras) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  ScreenRays rays;
+  raycasting::RayBatch batch = rays.Batch();
+
+  int64_t num_rays = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (const Camera& camera : cameras) {
+      camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+      bench::DoNotOptimize(rays.distance[0]);
+      num_rays += kScreenWidth;
+    }
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double packet_seconds = bench::SecondsSince(start);
+
+  // Times the scalar path over the same number of rays for comparison.
+  const bench::Clock::time_point scalar_start = bench::Clock::now();
+
+  for (int64_t i = 0; i < num_rays / kScreenWidth; ++i) {
+    const Camera& camera = cameras[i % cameras.size()];
+
+    for (float plane_scalar : plane_scalars) {
+      bench::DoNotOptimize(camera.CalculateRay(plane_scalar));
+    }
+  }
+
+  const double scalar_seconds = bench::SecondsSince(scalar_start);
+
+  bench::JsonLine("calculate_rays")
+      .Add("avx2", raycasting::HasAVX2())
+      .Add("rays", num_rays)
+      .Add("rays_per_s", num_rays / packet_seconds)
+      .Add("scalar_rays_per_s", num_rays / scalar_seconds)
+      .Add("speedup", scalar_seconds / packet_seconds)
+      .Add("matches_scalar", PacketMatchesScalar(cameras))
+      .Print();
+}
+
+// Times drawing the wall segments, textured if the atlas is not null and flat
+// shaded otherwise.
+void BenchmarkWallShading(const std::vector<Camera>& cameras,
+                          const TextureAtlas* texture_atlas) {
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  // Casts the rays up front so only the shading is timed.
+  std::vector<raycasting::RayData> ray_data;
+
+  for (const Camera& camera : cameras) {
+    for (float plane_scalar : plane_scalars) {
+      ray_data.push_back(camera.CalculateRay(plane_scalar));
+    }
+  }
+
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+
+  int64_t num_columns = 0;
+  int64_t num_pixels = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (size_t i = 0; i < ray_data.size(); ++i) {
+      const int x = static_cast<int>(i % kScreenWidth);
+
+      if (texture_atlas != nullptr) {
+        rendering::RenderTexturedWallSegment(
+            &frame_buffer, *texture_atlas, ray_data[i], x);
+      } else {
+        rendering::RenderWallSegment(&frame_buffer, ray_data[i], x);
+      }
+
+      const rendering::WallSpan wall_span =
+          rendering::CalculateWallSpan(ray_data[i].distance, kScreenHeight);
+      num_pixels += wall_span.draw_end - wall_span.draw_start + 1;
+    }
+    num_columns += ray_data.size();
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("wall_shading")
+      .Add("textured", texture_atlas != nullptr)
+      .Add("columns", num_columns)
+      .Add("columns_per_s", num_columns / seconds)
+      .Add("pixels_per_s", num_pixels / seconds)
+      .Print();
+}
+
+// Times the floor and ceiling casting stage alone, after a wall pass has
+// filled the column buffers of each camera.
+void BenchmarkFloorCasting(const std::vector<Camera>& cameras,
+                           const TextureAtlas& texture_atlas) {
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  std::vector<rendering::ColumnBuffers> column_buffers;
+
+  for (const Camera& camera : cameras) {
+    column_buffers.emplace_back(kScreenWidth);
+    rendering::RenderColumns(camera, &texture_atlas, nullptr, nullptr,
+                             nullptr, 0, kScreenWidth, &column_buffers.back(),
+                             &frame_buffer);
+  }
+
+  int64_t num_frames = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (size_t i = 0; i < cameras.size(); ++i) {
+      rendering::RenderFloorAndCeiling(cameras[i], texture_atlas, nullptr,
+                                       column_buffers[i], kScreenHeight / 2,
+                                       kScreenHeight, &frame_buffer);
+    }
+    num_frames += cameras.size();
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("floor_casting")
+      .Add("avx2", raycasting::HasAVX2())
+      .Add("frames", num_frames)
+      .Add("frame_ms", seconds * 1e3 / num_frames)
+      .Add("rows_per_s", num_frames * kScreenHeight / seconds)
+      .Print();
+}
+
+// Times the sprite stage alone for the specified number of sprites scattered
+// over the level, after a textured frame has filled the column buffers.
+void BenchmarkSprites(const std::vector<Camera>& cameras,
+                      const TextureAtlas& texture_atlas,
+                      int num_sprites) {
+  const std::vector<rendering::Sprite> sprites =
+      rendering::ScatterSprites(BenchLevel(), num_sprites);
+
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  std::vector<rendering::ColumnBuffers> column_buffers;
+
+  for (const Camera& camera : cameras) {
+    column_buffers.emplace_back(kScreenWidth);
+    rendering::RenderColumns(camera, &texture_atlas, nullptr, nullptr,
+                             nullptr, 0, kScreenWidth, &column_buffers.back(),
+                             &frame_buffer);
+  }
+
+  rendering::SpriteRenderer sprite_renderer;
+  int64_t num_frames = 0;
+  int64_t num_visible = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (size_t i = 0; i < cameras.size(); ++i) {
+      sprite_renderer.Render(cameras[i], texture_atlas, sprites,
+                             column_buffers[i], nullptr, &frame_buffer);
+      num_visible += sprite_renderer.NumVisible();
+    }
+    num_frames += cameras.size();
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("sprites")
+      .Add("sprites", static_cast<int>(sprites.size()))
+      .Add("visible_per_frame", static_cast<double>(num_visible) / num_frames)
+      .Add("frame_ms", seconds * 1e3 / num_frames)
+      .Print();
+}
+
+// Runs the simulation inline for the same span of time, once with updates
+// every millisecond and once with irregular stalls like slow frames, and
+// checks that both end in exactly the same state.
+bool SimulationIgnoresStalls(const Camera& start_camera) {
+  const Simulation::Clock::time_point start = Simulation::Clock::time_point();
+  const Simulation::Clock::time_point end = start + std::chrono::seconds(5);
+
+  Simulation smooth(start_camera, start);
+  Simulation stalling(start_camera, start);
+
+  for (Simulation* simulation : { &smooth, &stalling }) {
+    simulation->SetAcceleration(motion::AccelState::kAccelerate,
+                                motion::AccelDirection::kForward);
+    simulation->SetRotationSpeed(motion::RotationDirection::kClockwise);
+  }
+
+  for (Simulation::Clock::time_point now = start; now <= end;
+       now += std::chrono::milliseconds(1)) {
+    smooth.Update(now);
+  }
+
+  int stall_ms = 0;
+
+  for (Simulation::Clock::time_point now = start; now <= end;
+       now += std::chrono::milliseconds(stall_ms)) {
+    stalling.Update(now);
+    stall_ms = 1 + (stall_ms * 37 + 11) % 60;
+  }
+  stalling.Update(end);
+
+  const Vector poses[] = {
+    smooth.CameraAt(end).Position(), smooth.CameraAt(end).Direction(),
+    stalling.CameraAt(end).Position(), stalling.CameraAt(end).Direction()
+  };
+
+  return std::memcmp(&poses[0], &poses[2], 2 * sizeof(Vector)) == 0;
+}
+
+void BenchmarkSimulation(const Camera& start_camera) {
+  Simulation simulation(start_camera, Simulation::Clock::time_point());
+  simulation.SetAcceleration(motion::AccelState::kAccelerate,
+                             motion::AccelDirection::kForward);
+
+  // Simulated time advances a second per update, the most ticks one update
+  // runs, so the timing covers ticks and publishing only.
+  int64_t num_ticks = 0;
+  Simulation::Clock::time_point now = Simulation::Clock::time_point();
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    now += std::chrono::seconds(1);
+    simulation.Update(now);
+    bench::DoNotOptimize(simulation.CameraAt(now));
+    num_ticks += Simulation::kMaxTicksPerUpdate;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("simulation")
+      .Add("ticks_per_s", num_ticks / seconds)
+      .Add("matches_with_stalls", SimulationIgnoresStalls(start_camera))
+      .Print();
+}
+
+// Records the samples 1 to 1000 and checks their nearest-rank percentiles.
+bool ProfilerPercentilesExact() {
+  profiling::Profiler profiler;
+
+  // Recorded in a scrambled order, as 7 and 1000 have no common factor.
+  for (int i = 0; i < 1000; ++i) {
+    profiler.Record(profiling::Stage::kWalls, 1.0f + (i * 7) % 1000);
+  }
+
+  const profiling::StageSummary summary =
+      profiler.Summarize(profiling::Stage::kWalls, profiling::Profiler::kCapacity);
+
+  return summary.num_samples == 1000 && summary.p50 == 500.0f &&
+         summary.p95 == 950.0f && summary.p99 == 990.0f &&
+         summary.max == 1000.0f;
+}
+
+void BenchmarkProfiler() {
+  profiling::Profiler profiler;
+
+  // Times the scoped timers around no work at all, which is the overhead
+  // every profiled stage pays per frame.
+  int64_t num_timers = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (int i = 0; i < 1000; ++i) {
+      profiling::ScopedTimer timer(&profiler, profiling::Stage::kEvents);
+    }
+    num_timers += 1000;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double timer_seconds = bench::SecondsSince(start);
+
+  // Summarizes as many frames as the game log does.
+  int64_t num_summaries = 0;
+  const bench::Clock::time_point summary_start = bench::Clock::now();
+
+  do {
+    bench::DoNotOptimize(profiler.Summarize(profiling::Stage::kEvents, 1024));
+    ++num_summaries;
+  } while (bench::SecondsSince(summary_start) < kMinBenchmarkSeconds);
+
+  const double summary_seconds = bench::SecondsSince(summary_start);
+
+  bench::JsonLine("profiler")
+      .Add("timer_ns", timer_seconds * 1e9 / num_timers)
+      .Add("summary_1024_us", summary_seconds * 1e6 / num_summaries)
+      .Add("percentiles_exact", ProfilerPercentilesExact())
+      .Print();
+}
+
+void BenchmarkGameLog(const Camera& camera) {
+  const game_log::RenderStats render_stats = { 8, 4.0f, 0.25f, 0.75f, 0, {} };
+  const game_log::Snapshot snapshot =
+      game_log::TakeSnapshot(1.0f / 60.0f, camera, render_stats);
+  game_log::LogBuffer buffer;
+
+  int64_t num_logs = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    game_log::FormatGameLog(snapshot, &buffer);
+    bench::DoNotOptimize(buffer);
+    ++num_logs;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  bench::JsonLine("game_log")
+      .Add("format_us", seconds * 1e6 / num_logs)
+      .Add("bytes", static_cast<int64_t>(buffer.View().size()))
+      .Add("fits", buffer.View().size() < game_log::LogBuffer::kCapacity)
+      .Print();
+}
+
+// Times the textured wall stage on the preset screen against the runtime
+// screen of the same size, and checks that both draw the same pixels. The two
+// are timed in alternating rounds, so drift in the clock speed of the CPU
+// affects both alike, and the median round of each is compared.
+template <typename Screen>
+void BenchmarkRenderPreset(const char* name,
+                           const std::vector<Camera>& cameras,
+                           const TextureAtlas& texture_atlas) {
+  const Screen screen;
+  const rendering::RuntimeScreen runtime_screen(screen.Width(),
+                                                screen.Height());
+
+  FrameBuffer preset_frame(screen.Width(), screen.Height());
+  FrameBuffer runtime_frame(screen.Width(), screen.Height());
+  rendering::ColumnBuffers column_buffers(screen.Width());
+
+  const size_t frame_bytes =
+      static_cast<size_t>(preset_frame.Pitch()) * screen.Height();
+  bool matches = true;
+
+  for (const Camera& camera : cameras) {
+    rendering::RenderColumns(screen, camera, &texture_atlas, nullptr, nullptr,
+                             nullptr, 0, screen.Width(), &column_buffers,
+                             &preset_frame);
+    rendering::RenderColumns(runtime_screen, camera, &texture_atlas, nullptr,
+                             nullptr, nullptr, 0, screen.Width(),
+                             &column_buffers, &runtime_frame);
+
+    matches = matches && std::memcmp(preset_frame.Pixels(),
+                                     runtime_frame.Pixels(),
+                                     frame_bytes) == 0;
+  }
+
+  const auto time_frames = [&](const auto& frame_screen, FrameBuffer* frame) {
+    int64_t num_frames = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      for (const Camera& camera : cameras) {
+        rendering::RenderColumns(frame_screen, camera, &texture_atlas,
+                                 nullptr, nullptr, nullptr, 0,
+                                 frame_screen.Width(), &column_buffers, frame);
+      }
+      num_frames += cameras.size();
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    return bench::SecondsSince(start) * 1e3 / num_frames;
+  };
+
+  constexpr int kRounds = 8;
+  std::vector<double> preset_times;
+  std::vector<double> runtime_times;
+
+  for (int round = 0; round < kRounds; ++round) {
+    preset_times.push_back(time_frames(screen, &preset_frame));
+    runtime_times.push_back(time_frames(runtime_screen, &runtime_frame));
+  }
+
+  const bench::Percentiles preset_ms =
+      bench::CalculatePercentiles(&preset_times);
+  const bench::Percentiles runtime_ms =
+      bench::CalculatePercentiles(&runtime_times);
+
+  bench::JsonLine("render_preset")
+      .Add("preset", name)
+      .Add("rounds", kRounds)
+      .Add("walls_ms", preset_ms.p50)
+      .Add("runtime_walls_ms", runtime_ms.p50)
+      .Add("speedup", runtime_ms.p50 / preset_ms.p50)
+      .Add("matches_runtime", matches)
+      .Print();
+}
+
+void BenchmarkRenderPresets(const std::vector<Camera>& cameras,
+                            const TextureAtlas& texture_atlas) {
+#ifdef RENDER_PRESET_720p
+  BenchmarkRenderPreset<rendering::Screen720p>("720p", cameras, texture_atlas);
+#endif
+#ifdef RENDER_PRESET_1080p
+  BenchmarkRenderPreset<rendering::Screen1080p>("1080p", cameras,
+                                                texture_atlas);
+#endif
+#ifdef RENDER_PRESET_1440p
+  BenchmarkRenderPreset<rendering::Screen1440p>("1440p", cameras,
+                                                texture_atlas);
+#endif
+  static_cast<void>(cameras);
+  static_cast<void>(texture_atlas);
+}
+
+// Renders the frames of a flight with textured walls and returns the time of
+// each in milliseconds. If the pool is null, frames are rendered on this
+// thread only.
+std::vector<double> RenderFlight(const CameraPath& path,
+                                 const TextureAtlas& texture_atlas,
+                                 int num_frames,
+                                 ThreadPool* thread_pool,
+                                 FrameBuffer* frame_buffer) {
+  rendering::ColumnBuffers column_buffers(frame_buffer->Width());
+  std::vector<double> frame_times;
+  frame_times.reserve(num_frames);
+
+  for (int frame = 0; frame < num_frames; ++frame) {
+    const Camera camera =
+        CameraAt(path, frame / std::max(1.0f, num_frames - 1.0f));
+
+    const bench::Clock::time_point start = bench::Clock::now();
+    rendering::RenderFrame(camera, &texture_atlas, nullptr, nullptr, nullptr,
+                           thread_pool, &column_buffers, frame_buffer,
+                           nullptr);
+    frame_times.push_back(bench::SecondsSince(start) * 1e3);
+  }
+
+  return frame_times;
+}
+
+void BenchmarkFlight(const CameraPath& path,
+                     const BenchOptions& options,
+                     ThreadPool* thread_pool) {
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+
+  // Counts the DDA steps of every ray along the path, with and without
+  // empty-space skipping, outside the timing.
+  ScreenRays rays;
+  raycasting::RayBatch batch = rays.Batch();
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+  const DistanceField distance_field(BenchLevel());
+  int64_t num_steps = 0;
+  int64_t num_skipping_steps = 0;
+
+  for (int frame = 0; frame < options.num_frames; ++frame) {
+    Camera camera =
+        CameraAt(path, frame / std::max(1.0f, options.num_frames - 1.0f));
+
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+    for (int steps : rays.num_steps) num_steps += steps;
+
+    camera.SetDistanceField(&distance_field);
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+    for (int steps : rays.num_steps) num_skipping_steps += steps;
+  }
+
+  const TextureAtlas texture_atlas;
+
+  // Warms up the caches and the thread pool before timing.
+  RenderFlight(path, texture_atlas, 8, thread_pool, &frame_buffer);
+
+  std::vector<double> frame_times = RenderFlight(
+      path, texture_atlas, options.num_frames, thread_pool, &frame_buffer);
+  std::vector<double> single_thread_frame_times = RenderFlight(
+      path, texture_atlas, options.num_frames, nullptr, &frame_buffer);
+
+  const bench::Percentiles percentiles =
+      bench::CalculatePercentiles(&frame_times);
+  const bench::Percentiles single_thread_percentiles =
+      bench::CalculatePercentiles(&single_thread_frame_times);
+
+  const int64_t num_rays =
+      static_cast<int64_t>(options.num_frames) * kScreenWidth;
+  const double render_seconds = percentiles.mean * options.num_frames / 1e3;
+
+  bench::JsonLine("flight")
+      .Add("path", path.name)
+      .Add("threads", thread_pool->NumThreads())
+      .Add("frames", options.num_frames)
+      .Add("rays_per_s", num_rays / render_seconds)
+      .Add("dda_steps_per_ray", static_cast<double>(num_steps) / num_rays)
+      .Add("dda_steps_per_ray_skipping",
+           static_cast<double>(num_skipping_steps) / num_rays)
+      .Add("frame_ms", percentiles)
+      .Add("single_thread_frame_ms", single_thread_percentiles)
+      .Add("speedup", single_thread_percentiles.mean / percentiles.mean)
+      .Print();
+}
+
+// Scans the agents scattered over the level with every ray, and checks the
+// results against the single-threaded scan, the ray-by-ray scan with
+// empty-space skipping and rays cast along the exact angle of each ray.
+void BenchmarkDepthScans(const char* name,
+                         float fov,
+                         int num_agents,
+                         int num_rays,
+                         ThreadPool* thread_pool) {
+  const Level& level = BenchLevel();
+  const std::vector<rendering::Sprite> sprites =
+      rendering::ScatterSprites(level, num_agents);
+  num_agents = static_cast<int>(sprites.size());
+
+  std::vector<float> x(num_agents);
+  std::vector<float> y(num_agents);
+  std::vector<float> heading(num_agents);
+
+  for (int agent = 0; agent < num_agents; ++agent) {
+    x[agent] = sprites[agent].position.x;
+    y[agent] = sprites[agent].position.y;
+    heading[agent] = DegreesToRadians(std::fmod(agent * 137.5f, 360.0f));
+  }
+
+  const sensing::AgentPoses poses = {
+    x.data(), y.data(), heading.data(), num_agents
+  };
+
+  // Result arrays of one scan, allocated once.
+  struct ScanBuffers {
+    std::vector<float> distance;
+    std::vector<int> wall_id;
+    std::vector<raycasting::WallSide> wall_side;
+
+    explicit ScanBuffers(size_t size)
+        : distance(size), wall_id(size), wall_side(size) {}
+
+    sensing::ScanResults Results() {
+      return sensing::ScanResults{
+        distance.data(), wall_id.data(), wall_side.data()
+      };
+    }
+
+    bool operator==(const ScanBuffers& other) const {
+      return std::memcmp(distance.data(), other.distance.data(),
+                         distance.size() * sizeof(float)) == 0 &&
+             wall_id == other.wall_id && wall_side == other.wall_side;
+    }
+  };
+
+  const size_t num_results = static_cast<size_t>(num_agents) * num_rays;
+  ScanBuffers pooled(num_results);
+  ScanBuffers single_thread(num_results);
+  ScanBuffers skipping(num_results);
+
+  DepthScanner scanner(level);
+  scanner.SetPattern(fov, num_rays);
+
+  const auto time_scans = [&](ThreadPool* scan_thread_pool,
+                              ScanBuffers* buffers) {
+    int64_t num_scans = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      scanner.Scan(poses, scan_thread_pool, buffers->Results());
+      ++num_scans;
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    return num_scans / bench::SecondsSince(start);
+  };
+
+  const double scans_per_s = time_scans(thread_pool, &pooled);
+  const double single_thread_scans_per_s =
+      time_scans(nullptr, &single_thread);
+
+  const DistanceField distance_field(level);
+  scanner.SetDistanceField(&distance_field);
+  scanner.Scan(poses, thread_pool, skipping.Results());
+
+  // Rays cast along the cosine and sine of their angle differ from the scan
+  // only in the rounding of the direction.
+  double max_relative_error = 0.0;
+  int64_t num_same_wall = 0;
+
+  for (int agent = 0; agent < num_agents; ++agent) {
+    for (int ray = 0; ray < num_rays; ++ray) {
+      const float angle = heading[agent] + scanner.RayAngle(ray);
+      const raycasting::RayData ray_data = raycasting::CastRay(
+          level, nullptr, Vector(x[agent], y[agent]),
+          Vector(std::cos(angle), std::sin(angle)));
+
+      const size_t index = static_cast<size_t>(agent) * num_rays + ray;
+      const double error =
+          std::abs(pooled.distance[index] - ray_data.distance) /
+          ray_data.distance;
+
+      if (pooled.wall_id[index] == ray_data.wall_id &&
+          pooled.wall_side[index] == ray_data.wall_side) {
+        ++num_same_wall;
+        max_relative_error = std::max(max_relative_error, error);
+      }
+    }
+  }
+
+  bench::JsonLine("depth_scan")
+      .Add("pattern", name)
+      .Add("threads", thread_pool->NumThreads())
+      .Add("agents", num_agents)
+      .Add("rays_per_scan", num_rays)
+      .Add("scans_per_s", scans_per_s)
+      .Add("agent_scans_per_s", scans_per_s * num_agents)
+      .Add("rays_per_s", scans_per_s * num_results)
+      .Add("single_thread_scans_per_s", single_thread_scans_per_s)
+      .Add("matches_single_thread", pooled == single_thread)
+      .Add("matches_skipping", pooled == skipping)
+      .Add("same_wall_fraction",
+           static_cast<double>(num_same_wall) / num_results)
+      .Add("max_relative_error", max_relative_error)
+      .Print();
+}
+
+// Answers line-of-sight queries from agents scattered over the level to
+// other agents, with the queries of each source consecutive. Checks that the
+// pooled, single-threaded and distance field answers agree, and compares them
+// with casting a ray past the target, which is what the queries replace.
+void BenchmarkLineOfSight(const char* name,
+                          const Level& level,
+                          int num_sources,
+                          int targets_per_source,
+                          ThreadPool* thread_pool) {
+  const std::vector<rendering::Sprite> agents =
+      rendering::ScatterSprites(level, num_sources);
+  num_sources = static_cast<int>(agents.size());
+
+  const int num_queries = num_sources * targets_per_source;
+  std::vector<float> source_x(num_queries);
+  std::vector<float> source_y(num_queries);
+  std::vector<float> target_x(num_queries);
+  std::vector<float> target_y(num_queries);
+
+  for (int source = 0; source < num_sources; ++source) {
+    for (int i = 0; i < targets_per_source; ++i) {
+      const int query = source * targets_per_source + i;
+      const Vector target =
+          agents[(source + 1 + i * 131) % num_sources].position;
+
+      source_x[query] = agents[source].position.x;
+      source_y[query] = agents[source].position.y;
+      target_x[query] = target.x;
+      target_y[query] = target.y;
+    }
+  }
+
+  const sensing::SightQueries queries = {
+    source_x.data(), source_y.data(), target_x.data(), target_y.data(),
+    num_queries
+  };
+
+  const int num_words = sensing::NumSightWords(num_queries);
+  const DistanceField distance_field(level);
+
+  const auto time_queries = [&](const DistanceField* query_distance_field,
+                                ThreadPool* query_thread_pool,
+                                std::vector<uint64_t>* visible) {
+    visible->assign(num_words, 0);
+    int64_t num_batches = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      sensing::CheckLinesOfSight(level, query_distance_field, queries,
+                                 query_thread_pool, visible->data());
+      ++num_batches;
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    return num_batches * num_queries / bench::SecondsSince(start);
+  };
+
+  std::vector<uint64_t> pooled;
+  std::vector<uint64_t> single_thread;
+  std::vector<uint64_t> skipping;
+
+  const double queries_per_s = time_queries(nullptr, thread_pool, &pooled);
+  const double single_thread_queries_per_s =
+      time_queries(nullptr, nullptr, &single_thread);
+  const double skipping_queries_per_s =
+      time_queries(&distance_field, thread_pool, &skipping);
+
+  // A ray cast toward the target sees it if the wall it hits lies beyond
+  // the target, which is one ray direction length away.
+  int64_t num_visible = 0;
+  int64_t num_same_as_ray = 0;
+  const bench::Clock::time_point cast_start = bench::Clock::now();
+
+  for (int query = 0; query < num_queries; ++query) {
+    const Vector source(source_x[query], source_y[query]);
+    const Vector target(target_x[query], target_y[query]);
+    const raycasting::RayData ray_data =
+        raycasting::CastRay(level, nullptr, source, target - source);
+
+    const bool ray_visible = ray_data.distance >= 1.0f;
+    const bool visible =
+        (pooled[query / sensing::kQueriesPerWord] >>
+         (query % sensing::kQueriesPerWord)) & 1;
+
+    num_visible += visible ? 1 : 0;
+    num_same_as_ray += visible == ray_visible ? 1 : 0;
+  }
+
+  const double cast_ray_queries_per_s =
+      num_queries / bench::SecondsSince(cast_start);
+
+  bench::JsonLine("line_of_sight")
+      .Add("level", name)
+      .Add("threads", thread_pool->NumThreads())
+      .Add("queries", num_queries)
+      .Add("targets_per_source", targets_per_source)
+      .Add("queries_per_s", queries_per_s)
+      .Add("single_thread_queries_per_s", single_thread_queries_per_s)
+      .Add("distance_field_queries_per_s", skipping_queries_per_s)
+      .Add("cast_ray_queries_per_s", cast_ray_queries_per_s)
+      .Add("visible_fraction", static_cast<double>(num_visible) / num_queries)
+      .Add("matches_single_thread", pooled == single_thread)
+      .Add("matches_distance_field", pooled == skipping)
+      .Add("same_as_cast_ray_fraction",
+           static_cast<double>(num_same_as_ray) / num_queries)
+      .Print();
+}
+
+// Builds the visible sets of the level and checks them against
+// line-of-sight queries between the centers of empty tiles, every stride-th
+// target from every source. Rays are samples, so a few pairs may be missed.
+void BenchmarkVisibilitySet(const char* name,
+                            const Level& level,
+                            int target_stride,
+                            ThreadPool* thread_pool) {
+  const bench::Clock::time_point build_start = bench::Clock::now();
+  const VisibilitySet visibility_set(level, thread_pool);
+  const double build_seconds = bench::SecondsSince(build_start);
+
+  const int64_t num_tiles = static_cast<int64_t>(level.Width()) * level.Height();
+  int64_t num_empty = 0;
+  int64_t num_visible = 0;
+  int64_t num_pairs = 0;
+  int64_t num_missed = 0;
+  bool lookup_matches = true;
+  VisibleTiles visible_tiles;
+
+  for (int x = 0; x < level.Width(); ++x) {
+    for (int y = 0; y < level.Height(); ++y) {
+      if (level.IsSolid(x, y)) continue;
+
+      visibility_set.Decode(x, y, &visible_tiles);
+      ++num_empty;
+      num_visible += visible_tiles.Count();
+
+      const Vector source(x + 0.5f, y + 0.5f);
+      int64_t target = (x * level.Height() + y) % target_stride;
+
+      for (; target < num_tiles; target += target_stride) {
+        const int target_x = static_cast<int>(target / level.Height());
+        const int target_y = static_cast<int>(target % level.Height());
+
+        lookup_matches &=
+            visibility_set.IsVisible(x, y, target_x, target_y) ==
+            visible_tiles.Contains(target_x, target_y);
+
+        if (level.IsSolid(target_x, target_y)) continue;
+
+        ++num_pairs;
+
+        if (sensing::HasLineOfSight(level, nullptr, source,
+                                    Vector(target_x + 0.5f, target_y + 0.5f)) &&
+            !visible_tiles.Contains(target_x, target_y)) {
+          ++num_missed;
+        }
+      }
+    }
+  }
+
+  bench::JsonLine("visibility_set")
+      .Add("level", name)
+      .Add("tiles", num_tiles)
+      .Add("threads", thread_pool->NumThreads())
+      .Add("build_ms", build_seconds * 1e3)
+      .Add("compressed_bytes", static_cast<int64_t>(visibility_set.CompressedSize()))
+      .Add("bitset_bytes", num_tiles * num_tiles / 8)
+      .Add("visible_fraction",
+           static_cast<double>(num_visible) / (num_empty * num_tiles))
+      .Add("lookup_matches_decode", lookup_matches)
+      .Add("sight_pairs", num_pairs)
+      .Add("missed_sight_fraction",
+           static_cast<double>(num_missed) / std::max<int64_t>(num_pairs, 1))
+      .Print();
+}
+
+// Saves the visible sets of the level and loads them back, then changes a
+// tile of the level and checks that the cache is rebuilt.
+void BenchmarkVisibilityCache(ThreadPool* thread_pool) {
+  const Level& level = BenchLevel();
+  const std::string path = "/tmp/ray-casting-bench-level.rclv.pvs";
+  std::remove(path.c_str());
+
+  VisibilitySet cached;
+  bool built_first = false;
+  bool rebuilt_unchanged = true;
+  bool rebuilt_changed = false;
+  std::string error;
+
+  const bool saved = cached.LoadOrBuild(level, path, thread_pool,
+                                        &built_first, &error);
+
+  const bench::Clock::time_point load_start = bench::Clock::now();
+  const bool loaded = saved && cached.LoadOrBuild(level, path, thread_pool,
+                                                  &rebuilt_unchanged, &error);
+  const double load_seconds = bench::SecondsSince(load_start);
+
+  const VisibilitySet built(level, nullptr);
+  bool same_as_built = cached.CompressedSize() == built.CompressedSize();
+  VisibleTiles cached_tiles;
+  VisibleTiles built_tiles;
+
+  for (int x = 0; same_as_built && x < level.Width(); ++x) {
+    for (int y = 0; same_as_built && y < level.Height(); ++y) {
+      cached.Decode(x, y, &cached_tiles);
+      built.Decode(x, y, &built_tiles);
+      same_as_built = cached_tiles.Count() == built_tiles.Count();
+    }
+  }
+
+  // Opens the first wall of the inner area.
+  std::vector<uint8_t> tiles(
+      level.Tiles(),
+      level.Tiles() + static_cast<size_t>(level.Width()) * level.Height());
+  for (size_t i = level.Height() + 1; i < tiles.size(); ++i) {
+    if (tiles[i] != 0) {
+      tiles[i] = 0;
+      break;
+    }
+  }
+  const Level changed(level.Width(), level.Height(), std::move(tiles));
+
+  const bool saved_changed = cached.LoadOrBuild(changed, path, thread_pool,
+                                                &rebuilt_changed, &error);
+  std::remove(path.c_str());
+
+  bench::JsonLine("visibility_cache")
+      .Add("built_first", built_first)
+      .Add("loaded", loaded && !rebuilt_unchanged)
+      .Add("load_ms", load_seconds * 1e3)
+      .Add("same_as_built", same_as_built)
+      .Add("rebuilt_after_change", saved_changed && rebuilt_changed &&
+                                       cached.LevelHash() ==
+                                           level::HashLevel(changed))
+      .Print();
+}
+
+// Draws the sprites from every camera with and without culling by the
+// visible sets, which must not change a single pixel.
+void BenchmarkSpriteVisibility(const std::vector<Camera>& cameras,
+                               const TextureAtlas& texture_atlas,
+                               int num_sprites,
+                               ThreadPool* thread_pool) {
+  const std::vector<rendering::Sprite> sprites =
+      rendering::ScatterSprites(BenchLevel(), num_sprites);
+  const VisibilitySet visibility_set(BenchLevel(), thread_pool);
+
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  FrameBuffer culled_frame_buffer(kScreenWidth, kScreenHeight);
+  rendering::ColumnBuffers column_buffers(kScreenWidth);
+  rendering::SpriteRenderer sprite_renderer;
+  rendering::SpriteRenderer culling_sprite_renderer;
+  culling_sprite_renderer.SetVisibilitySet(&visibility_set);
+
+  const size_t frame_bytes =
+      static_cast<size_t>(kScreenWidth) * kScreenHeight * sizeof(uint32_t);
+  bool identical = true;
+  int64_t num_projected = 0;
+  int64_t num_hidden = 0;
+
+  for (const Camera& camera : cameras) {
+    rendering::RenderColumns(camera, &texture_atlas, nullptr, nullptr,
+                             nullptr, 0, kScreenWidth, &column_buffers,
+                             &frame_buffer);
+    std::memcpy(culled_frame_buffer.Pixels(), frame_buffer.Pixels(),
+                frame_bytes);
+
+    sprite_renderer.Render(camera, texture_atlas, sprites, column_buffers,
+                           nullptr, &frame_buffer);
+    culling_sprite_renderer.Render(camera, texture_atlas, sprites,
+                                   column_buffers, nullptr,
+                                   &culled_frame_buffer);
+
+    identical &= std::memcmp(frame_buffer.Pixels(),
+                             culled_frame_buffer.Pixels(), frame_bytes) == 0;
+    num_projected += sprite_renderer.NumVisible();
+    num_hidden += culling_sprite_renderer.NumHidden();
+  }
+
+  const int num_frames = static_cast<int>(cameras.size());
+
+  bench::JsonLine("sprite_visibility")
+      .Add("sprites", static_cast<int>(sprites.size()))
+      .Add("hidden_per_frame", static_cast<double>(num_hidden) / num_frames)
+      .Add("projected_per_frame",
+           static_cast<double>(num_projected) / num_frames)
+      .Add("identical_frames", identical)
+      .Print();
+}
+
+// Feeds the resolution scaler a synthetic frame cost that grows with the
+// number of pixels, with up to 20% noise, and returns the number of scale
+// changes. A cost of 1.5 times the target at full scale fits the target at
+// 0.75, while 0.875 exceeds it, so the scale must settle after one step.
+int CountSyntheticScaleChanges(int num_frames, float* final_scale) {
+  constexpr float kTargetMs = 10.0f;
+  constexpr float kFullScaleMs = 1.5f * kTargetMs;
+
+  ResolutionScaler scaler(kTargetMs, kScreenWidth, kScreenHeight);
+  uint32_t random_state = 1;
+
+  for (int frame = 0; frame < num_frames; ++frame) {
+    random_state = random_state * 1664525u + 1013904223u;
+    const float noise = (random_state >> 8) / 16777216.0f * 2.0f - 1.0f;
+
+    scaler.Update(kFullScaleMs * scaler.Scale() * scaler.Scale() *
+                  (1.0f + 0.2f * noise));
+  }
+
+  *final_scale = scaler.Scale();
+  return scaler.NumChanges();
+}
+
+// Renders a flight with the resolution scaler, with a target of 60% of the
+// cost of a full-size frame, reallocating the buffers on every scale change
+// like the game does. The cost of the flight swings between views, so the
+// scale has to follow it, but during the measured pass it may change at most
+// once per two settle periods.
+void BenchmarkResolutionScaler(const CameraPath& path,
+                               const BenchOptions& options,
+                               ThreadPool* thread_pool) {
+  const TextureAtlas texture_atlas;
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+
+  RenderFlight(path, texture_atlas, 8, thread_pool, &frame_buffer);
+
+  std::vector<double> full_frame_times = RenderFlight(
+      path, texture_atlas, options.num_frames, thread_pool, &frame_buffer);
+  const double full_frame_ms =
+      bench::CalculatePercentiles(&full_frame_times).mean;
+
+  ResolutionScaler scaler(static_cast<float>(0.6 * full_frame_ms),
+                          kScreenWidth, kScreenHeight);
+  rendering::ColumnBuffers column_buffers(kScreenWidth);
+
+  // The flight is flown twice, and the second time is measured, after the
+  // scale had time to settle.
+  const int num_frames = 2 * options.num_frames;
+  const int max_measured_changes =
+      options.num_frames / (2 * ResolutionScaler::kSettleFrames);
+  std::vector<double> frame_times;
+  int num_within_target = 0;
+  int first_pass_changes = 0;
+
+  for (int frame = 0; frame < num_frames; ++frame) {
+    if (frame == options.num_frames) {
+      first_pass_changes = scaler.NumChanges();
+    }
+
+    const Camera camera = CameraAt(
+        path, (frame % options.num_frames) /
+                  std::max(1.0f, options.num_frames - 1.0f));
+
+    const bench::Clock::time_point start = bench::Clock::now();
+    rendering::RenderFrame(camera, &texture_atlas, nullptr, nullptr, nullptr,
+                           thread_pool, &column_buffers, &frame_buffer,
+                           nullptr);
+    const double frame_ms = bench::SecondsSince(start) * 1e3;
+
+    if (frame >= options.num_frames) {
+      frame_times.push_back(frame_ms);
+      num_within_target += frame_ms <= scaler.TargetMs() ? 1 : 0;
+    }
+
+    if (scaler.Update(static_cast<float>(frame_ms))) {
+      frame_buffer = FrameBuffer(scaler.Width(), scaler.Height());
+      column_buffers = rendering::ColumnBuffers(scaler.Width());
+    }
+  }
+
+  float synthetic_scale = 0.0f;
+  const int synthetic_changes =
+      CountSyntheticScaleChanges(10000, &synthetic_scale);
+
+  bench::JsonLine("resolution_scaler")
+      .Add("path", path.name)
+      .Add("target_ms", static_cast<double>(scaler.TargetMs()))
+      .Add("full_frame_ms", full_frame_ms)
+      .Add("frame_ms", bench::CalculatePercentiles(&frame_times))
+      .Add("within_target_fraction",
+           static_cast<double>(num_within_target) / options.num_frames)
+      .Add("scale", static_cast<double>(scaler.Scale()))
+      .Add("scale_changes", scaler.NumChanges())
+      .Add("measured_scale_changes", scaler.NumChanges() - first_pass_changes)
+      .Add("measured_changes_bounded",
+           scaler.NumChanges() - first_pass_changes <= max_measured_changes)
+      .Add("synthetic_scale", static_cast<double>(synthetic_scale))
+      .Add("synthetic_scale_changes", synthetic_changes)
+      .Print();
+}
+
+// Returns true if the cached rays equal the cast ones bit for bit. The steps
+// are only compared without empty-space skipping, as rays the cache did not
+// cast report the tile sides crossed.
+bool CacheMatchesCast(const RayCache& ray_cache,
+                      const ScreenRays& rays,
+                      bool compare_steps) {
+  for (int x = 0; x < kScreenWidth; ++x) {
+    const raycasting::RayData ray_data = ray_cache.Ray(x);
+
+    if (std::memcmp(&ray_data.distance, &rays.distance[x], sizeof(float)) != 0 ||
+        ray_data.wall_id != rays.wall_id[x] ||
+        ray_data.wall_side != rays.wall_side[x] ||
+        std::memcmp(&ray_data.wall_x, &rays.wall_x[x], sizeof(float)) != 0 ||
+        (compare_steps && ray_data.num_steps != rays.num_steps[x])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Updates a ray cache camera by camera on this thread, and compares every
+// frame with casting all rays, with and without empty-space skipping. The
+// cameras are consecutive frames, all in the same level.
+void BenchmarkRayCache(const char* name, const std::vector<Camera>& cameras) {
+  ScreenRays rays;
+  raycasting::RayBatch batch = rays.Batch();
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+  const DistanceField distance_field(cameras.front().GetLevel());
+
+  RayCache ray_cache(kScreenWidth);
+  RayCache skipping_ray_cache(kScreenWidth);
+
+  bool matches = true;
+  bool matches_skipping = true;
+  int64_t num_cast = 0;
+  int num_cast_all = 0;
+  double update_seconds = 0.0;
+  double cast_seconds = 0.0;
+
+  for (Camera camera : cameras) {
+    bench::Clock::time_point start = bench::Clock::now();
+    ray_cache.Update(camera, nullptr);
+    update_seconds += bench::SecondsSince(start);
+    num_cast += ray_cache.NumCast();
+    num_cast_all += ray_cache.CastAll() ? 1 : 0;
+
+    start = bench::Clock::now();
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+    cast_seconds += bench::SecondsSince(start);
+
+    matches = matches && CacheMatchesCast(ray_cache, rays, true);
+
+    camera.SetDistanceField(&distance_field);
+    skipping_ray_cache.Update(camera, nullptr);
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+
+    matches_skipping =
+        matches_skipping && CacheMatchesCast(skipping_ray_cache, rays, false);
+  }
+
+  // A camera that did not move casts no rays.
+  ray_cache.Update(cameras.back(), nullptr);
+
+  const int num_frames = static_cast<int>(cameras.size());
+  const int64_t num_rays = static_cast<int64_t>(num_frames) * kScreenWidth;
+
+  bench::JsonLine("ray_cache")
+      .Add("path", name)
+      .Add("frames", num_frames)
+      .Add("recast_fraction", static_cast<double>(num_cast) / num_rays)
+      .Add("cast_all_frames", num_cast_all)
+      .Add("update_ms", update_seconds * 1e3 / num_frames)
+      .Add("cast_all_ms", cast_seconds * 1e3 / num_frames)
+      .Add("still_camera_cast", ray_cache.NumCast())
+      .Add("matches", matches)
+      .Add("matches_skipping", matches_skipping)
+      .Print();
+}
+
+void BenchmarkRayCache(const CameraPath& path, const BenchOptions& options) {
+  std::vector<Camera> cameras;
+
+  for (int frame = 0; frame < options.num_frames; ++frame) {
+    cameras.push_back(
+        CameraAt(path, frame / std::max(1.0f, options.num_frames - 1.0f)));
+  }
+
+  BenchmarkRayCache(path.name, cameras);
+}
+
+// Generates a large square map without a border wall, so rays that leave it
+// end at the out-of-bounds check. Pillars are placed every pillar_spacing
+// tiles, or the map is left empty if the spacing is zero.
+Level GenerateOpenLevel(int size, int pillar_spacing) {
+  std::vector<uint8_t> tiles(static_cast<size_t>(size) * size, 0);
+
+  for (int x = 0; pillar_spacing > 0 && x < size; x += pillar_spacing) {
+    for (int y = 0; y < size; y += pillar_spacing) {
+      tiles[static_cast<size_t>(x) * size + y] = 3;
+    }
+  }
+
+  return Level(size, size, std::move(tiles));
+}
+
+// Compares the row-major and tiled level layouts with the generic ray caster
+// and tile collision. Every step along X moves a whole row of the row-major
+// level, so rays that mostly run along X are the worst case for its cache
+// usage, while the tiled layout treats both axes alike.
+void BenchmarkLevelLayout(const Level& level, const char* rays) {
+  const TiledLevel tiled_level(level);
+  const float center_angle = std::strcmp(rays, "along_x") == 0 ? 0.0f : 90.0f;
+
+  std::vector<Vector> positions;
+  std::vector<Vector> directions;
+
+  for (int i = 0; i < 4096; ++i) {
+    const float angle = DegreesToRadians(center_angle + (i % 64 - 32) * 0.7f);
+
+    positions.emplace_back(
+        level.Width() * (0.05f + 0.9f * (i * 37 % 101) / 101.0f),
+        level.Height() * (0.05f + 0.9f * (i * 53 % 97) / 97.0f));
+    directions.emplace_back(std::cos(angle), std::sin(angle));
+  }
+
+  bool matches = true;
+
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const raycasting::RayData row_major = raycasting::CastRay(
+        level, nullptr, positions[i], directions[i]);
+    const raycasting::RayData tiled = raycasting::CastRay(
+        tiled_level, nullptr, positions[i], directions[i]);
+
+    matches = matches && row_major.distance == tiled.distance &&
+              row_major.wall_id == tiled.wall_id &&
+              row_major.wall_side == tiled.wall_side &&
+              row_major.wall_x == tiled.wall_x &&
+              row_major.num_steps == tiled.num_steps;
+  }
+
+  const auto time_rays = [&](const auto& storage, const char* layout) {
+    int64_t num_rays = 0;
+    int64_t num_steps = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      for (size_t i = 0; i < positions.size(); ++i) {
+        const raycasting::RayData ray_data = raycasting::CastRay(
+            storage, nullptr, positions[i], directions[i]);
+
+        num_steps += ray_data.num_steps;
+        bench::DoNotOptimize(ray_data.distance);
+      }
+      num_rays += positions.size();
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    const double seconds = bench::SecondsSince(start);
+
+    bench::JsonLine("level_layout")
+        .Add("layout", layout)
+        .Add("rays", rays)
+        .Add("rays_per_s", num_rays / seconds)
+        .Add("ns_per_dda_step", seconds * 1e9 / num_steps)
+        .Add("matches_row_major", matches)
+        .Print();
+  };
+
+  const auto time_collision = [&](const auto& storage, const char* layout) {
+    std::vector<Vector> moving = positions;
+    int64_t num_moves = 0;
+    const bench::Clock::time_point start = bench::Clock::now();
+
+    do {
+      for (size_t i = 0; i < moving.size(); ++i) {
+        moving[i] = collision::MoveWithTileCollision(
+            storage, moving[i], directions[i] * 0.37f);
+      }
+      num_moves += moving.size();
+    } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+    bench::DoNotOptimize(moving.front().x);
+
+    bench::JsonLine("tile_collision")
+        .Add("layout", layout)
+        .Add("rays", rays)
+        .Add("moves_per_s", num_moves / bench::SecondsSince(start))
+        .Print();
+  };
+
+  time_rays(level, "row_major");
+  time_rays(tiled_level, "tiled");
+  time_collision(level, "row_major");
+  time_collision(tiled_level, "tiled");
+}
+
+// Compares the DDA with and without empty-space skipping on a large open map,
+// where rays travel far between walls.
+void BenchmarkOpenMap() {
+  constexpr int kSize = 4096;
+  constexpr int kPillarSpacing = 97;
+
+  const Level open_level = GenerateOpenLevel(kSize, kPillarSpacing);
+
+  const bench::Clock::time_point build_start = bench::Clock::now();
+  const DistanceField distance_field(open_level);
+  const double build_seconds = bench::SecondsSince(build_start);
+
+  std::vector<Camera> cameras;
+
+  for (int i = 0; i < 16; ++i) {
+    cameras.emplace_back(open_level,
+                         kSize * (0.2f + 0.04f * i) + 0.5f,
+                         kSize * (0.7f - 0.03f * i) + 0.5f,
+                         DegreesToRadians(23.0f * i),
+                         DegreesToRadians(kFovDegrees));
+  }
+
+  bench::JsonLine("distance_field_build")
+      .Add("tiles", static_cast<int64_t>(kSize) * kSize)
+      .Add("build_ms", build_seconds * 1e3)
+      .Print();
+
+  BenchmarkCalculateRay("open_map_calculate_ray", cameras, nullptr);
+  BenchmarkCalculateRay("open_map_calculate_ray", cameras, &distance_field);
+  BenchmarkFixedPointDDA<raycasting::FixedDDAData16>(
+      "open_map_fixed_point_dda", 16, cameras, distance_field);
+
+  // Walks slowly while turning, as a player looking around would.
+  std::vector<Camera> walk;
+
+  for (int frame = 0; frame < 32; ++frame) {
+    walk.emplace_back(open_level,
+                      kSize * 0.5f + 0.5f + 0.02f * frame,
+                      kSize * 0.5f + 0.5f,
+                      DegreesToRadians(10.0f + 0.5f * frame),
+                      DegreesToRadians(kFovDegrees));
+  }
+
+  BenchmarkRayCache("open_map_walk", walk);
+
+  BenchmarkLevelLayout(open_level, "along_x");
+  BenchmarkLevelLayout(open_level, "along_y");
+}
+
+// Moves the specified number of entities through an open map sized for one
+// entity per eight tiles, so the density, and with it the work of a move,
+// stays the same for every count. Entities walk straight and turn when they
+// are blocked. Every entity moves at least kMinTicks times, so it leaves the
+// tile it started in.
+void BenchmarkEntityWorld(int num_entities) {
+  constexpr float kRadius = 0.25f;
+  constexpr float kStep = 2.5f / Simulation::kTicksPerSecond;
+  constexpr int kMinTicks = 120;
+
+  const int size =
+      std::max(16, static_cast<int>(std::ceil(std::sqrt(num_entities * 8.0))));
+  const Level level = GenerateOpenLevel(size, 7);
+
+  EntityWorld world(level);
+  std::vector<float> headings;
+  uint32_t random_state = 1;
+
+  const auto next_random = [&random_state] {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state >> 8;
+  };
+
+  while (world.NumEntities() < num_entities) {
+    const int x = static_cast<int>(next_random() % size);
+    const int y = static_cast<int>(next_random() % size);
+
+    if (level.IsSolid(x, y)) continue;
+
+    world.Add(Vector(x + 0.5f, y + 0.5f), kRadius);
+    headings.push_back((next_random() % 6283) / 1000.0f);
+  }
+
+  // Brute-force check of the neighbor query on a sample of entities.
+  bool matches_brute_force = true;
+
+  for (int i = 0; i < 1000; ++i) {
+    const int entity = static_cast<int>(next_random() % num_entities);
+    const Vector position = world.Position(entity);
+
+    int64_t num_near = 0;
+    world.ForEachNear(position, kRadius, [&](int) { ++num_near; });
+
+    int64_t num_overlapping = 0;
+    for (int other = 0; other < num_entities; ++other) {
+      num_overlapping += collision::CirclesOverlap(
+          position, kRadius, world.Position(other), world.Radius(other));
+    }
+
+    matches_brute_force = matches_brute_force && num_near == num_overlapping;
+  }
+
+  int num_ticks = 0;
+  int64_t num_moves = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (int entity = 0; entity < num_entities; ++entity) {
+      const Vector offset(std::cos(headings[entity]) * kStep,
+                          std::sin(headings[entity]) * kStep);
+      const Vector before = world.Position(entity);
+
+      world.Move(entity, offset);
+
+      const Vector moved = world.Position(entity) - before;
+
+      if (moved.x * moved.x + moved.y * moved.y < 0.25f * kStep * kStep) {
+        headings[entity] += 2.0f;
+      }
+    }
+
+    ++num_ticks;
+    num_moves += num_entities;
+  } while (num_ticks < kMinTicks ||
+           bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  const double seconds = bench::SecondsSince(start);
+
+  // Moves push the moving entity out of the others and keep it out of the
+  // walls, so after the run no entity may be inside a wall and hardly any
+  // may overlap another.
+  int num_in_walls = 0;
+  int num_overlapping = 0;
+
+  for (int entity = 0; entity < num_entities; ++entity) {
+    const Vector position = world.Position(entity);
+
+    num_in_walls +=
+        collision::CircleOverlapsSolidTile(level, position, kRadius) ? 1 : 0;
+
+    int num_near = 0;
+    world.ForEachNear(position, kRadius * 0.9f, [&](int) { ++num_near; });
+    num_overlapping += num_near > 1 ? 1 : 0;
+  }
+
+  bench::JsonLine("entity_world")
+      .Add("entities", num_entities)
+      .Add("level_size", size)
+      .Add("moves_per_s", num_moves / seconds)
+      .Add("ns_per_move", seconds * 1e9 / num_moves)
+      .Add("rebins_per_move",
+           static_cast<double>(world.NumRebins()) / num_moves)
+      .Add("in_walls", num_in_walls)
+      .Add("overlapping_fraction",
+           static_cast<double>(num_overlapping) / num_entities)
+      .Add("matches_brute_force", matches_brute_force)
+      .Print();
+}
+
+// Returns a copy of the level that can be edited.
+Level CopyLevel(const Level& level) {
+  return Level(level.Width(), level.Height(),
+               std::vector<uint8_t>(level.Tiles(),
+                                    level.Tiles() + static_cast<size_t>(
+                                        level.Width()) * level.Height()));
+}
+
+// Returns true if every tile visible in the set of a rebuild is in the
+// updated set too.
+bool VisibilityCovers(const VisibilitySet& updated,
+                      const VisibilitySet& rebuilt,
+                      int64_t* num_extra) {
+  VisibleTiles updated_tiles;
+  VisibleTiles rebuilt_tiles;
+  *num_extra = 0;
+
+  for (int x = 0; x < rebuilt.Width(); ++x) {
+    for (int y = 0; y < rebuilt.Height(); ++y) {
+      updated.Decode(x, y, &updated_tiles);
+      rebuilt.Decode(x, y, &rebuilt_tiles);
+
+      for (int to_x = 0; to_x < rebuilt.Width(); ++to_x) {
+        for (int to_y = 0; to_y < rebuilt.Height(); ++to_y) {
+          const bool in_updated = updated_tiles.Contains(to_x, to_y);
+
+          if (rebuilt_tiles.Contains(to_x, to_y) && !in_updated) return false;
+          *num_extra += in_updated ? 1 : 0;
+        }
+      }
+
+      *num_extra -= rebuilt_tiles.Count();
+    }
+  }
+
+  return true;
+}
+
+// Toggles pseudo-random tiles of a large open map one edit at a time and
+// checks the locally updated distance field against a rebuild and the tiled
+// copy against the level.
+void BenchmarkDistanceFieldEdits(ThreadPool* thread_pool) {
+  constexpr int kSize = 1024;
+  constexpr int kNumEdits = 256;
+
+  Level level = GenerateOpenLevel(kSize, 97);
+  TiledLevel tiled_level(level);
+  DistanceField distance_field(level);
+  LevelEditor level_editor(&level);
+  level_editor.SetTiledLevel(&tiled_level);
+  level_editor.SetDistanceField(&distance_field);
+
+  std::vector<double> edit_times;
+  uint32_t random_state = 1;
+
+  for (int edit = 0; edit < kNumEdits; ++edit) {
+    random_state = random_state * 1664525u + 1013904223u;
+    const int x = static_cast<int>((random_state >> 8) % kSize);
+    const int y = static_cast<int>((random_state * 31u >> 8) % kSize);
+
+    level_editor.SetTile(x, y, level.IsSolid(x, y) ? 0 : 3);
+
+    const bench::Clock::time_point start = bench::Clock::now();
+    level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+    edit_times.push_back(bench::SecondsSince(start) * 1e3);
+  }
+
+  const bench::Clock::time_point rebuild_start = bench::Clock::now();
+  const DistanceField rebuilt(level);
+  const double rebuild_seconds = bench::SecondsSince(rebuild_start);
+
+  bool matches = true;
+  bool tiled_matches = true;
+
+  for (int x = 0; x < kSize; ++x) {
+    for (int y = 0; y < kSize; ++y) {
+      matches = matches && distance_field.At(x, y) == rebuilt.At(x, y);
+      tiled_matches = tiled_matches &&
+                      tiled_level.At(x, y) == level.At(x, y) &&
+                      tiled_level.IsSolid(x, y) == level.IsSolid(x, y);
+    }
+  }
+
+  // Edits beyond the per-call bound wait for the next calls.
+  for (int edit = 0; edit < 2 * LevelEditor::kMaxChangesPerApply; ++edit) {
+    level_editor.SetTile(edit, 0, 3);
+  }
+
+  const int first_changes = level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+  const int second_changes =
+      level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+
+  bench::JsonLine("distance_field_edits")
+      .Add("tiles", static_cast<int64_t>(kSize) * kSize)
+      .Add("edits", kNumEdits)
+      .Add("edit_ms", bench::CalculatePercentiles(&edit_times))
+      .Add("rebuild_ms", rebuild_seconds * 1e3)
+      .Add("matches_rebuild", matches)
+      .Add("tiled_level_matches", tiled_matches)
+      .Add("changes_per_apply", first_changes)
+      .Add("changes_next_apply", second_changes)
+      .Print();
+}
+
+// Opens and closes walls of the built-in level with the visible sets, a
+// door and a body standing in it, and the ray cache.
+void BenchmarkVisibilityEdits(ThreadPool* thread_pool) {
+  constexpr int kNumEdits = 16;
+
+  Level level = CopyLevel(BenchLevel());
+  DistanceField distance_field(level);
+  VisibilitySet visibility_set(level, thread_pool);
+  LevelEditor level_editor(&level);
+  level_editor.SetDistanceField(&distance_field);
+  level_editor.SetVisibilitySet(&visibility_set);
+
+  // Alternately opens an inner wall and fills an empty tile.
+  std::vector<double> open_times;
+  std::vector<double> close_times;
+  int tile = 0;
+
+  for (int edit = 0; edit < kNumEdits; ++edit) {
+    const bool open = edit % 2 == 0;
+    int x;
+    int y;
+
+    do {
+      tile = (tile + 37) % (level.Width() * level.Height());
+      x = tile / level.Height();
+      y = tile % level.Height();
+    } while (x == 0 || y == 0 || x == level.Width() - 1 ||
+             y == level.Height() - 1 || level.IsSolid(x, y) != open);
+
+    level_editor.SetTile(x, y, open ? 0 : 4);
+
+    const bench::Clock::time_point start = bench::Clock::now();
+    level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+    (open ? open_times : close_times)
+        .push_back(bench::SecondsSince(start) * 1e3);
+  }
+
+  const VisibilitySet rebuilt(level, thread_pool);
+  int64_t num_extra = 0;
+  const bool covers = VisibilityCovers(visibility_set, rebuilt, &num_extra);
+
+  // A door in a wall with an empty tile on its left, with a body standing
+  // in the doorway once it is open.
+  int door_x = 2;
+  int door_y = 1;
+
+  while (!level.IsSolid(door_x, door_y) || level.IsSolid(door_x - 1, door_y)) {
+    if (++door_y == level.Height() - 1) {
+      door_y = 1;
+      ++door_x;
+    }
+  }
+
+  EntityWorld entity_world(level);
+  level_editor.SetEntityWorld(&entity_world);
+  level_editor.OpenDoor(door_x, door_y);
+
+  constexpr float kStepSeconds = 0.05f;
+  int open_steps = 0;
+
+  while (level.IsSolid(door_x, door_y) && open_steps < 100) {
+    level_editor.ApplyEdits(kStepSeconds, nullptr, thread_pool);
+    ++open_steps;
+  }
+
+  const int body =
+      entity_world.Add(Vector(door_x + 0.5f, door_y + 0.5f), 0.2f);
+  level_editor.CloseDoor(door_x, door_y);
+
+  for (int step = 0; step < 20; ++step) {
+    level_editor.ApplyEdits(kStepSeconds, nullptr, thread_pool);
+  }
+
+  const bool waited_for_body = !level.IsSolid(door_x, door_y);
+
+  entity_world.Move(body, Vector(-1.0f, 0.0f));
+
+  for (int step = 0; step < 20; ++step) {
+    level_editor.ApplyEdits(kStepSeconds, nullptr, thread_pool);
+  }
+
+  const bool closed_after_body_left = level.IsSolid(door_x, door_y);
+
+  // The ray cache casts every ray again after an edit in view. It is
+  // invalidated the way the game does, only when tiles changed, and updated
+  // on every frame while the door opens in front of the still camera.
+  const Camera camera(level, door_x - 0.5f, door_y + 0.5f, 0.0f,
+                      DegreesToRadians(kFovDegrees));
+  ScreenRays rays;
+  raycasting::RayBatch batch = rays.Batch();
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+  RayCache ray_cache(kScreenWidth);
+
+  ray_cache.Update(camera, nullptr);
+  level_editor.OpenDoor(door_x, door_y);
+
+  for (int step = 0; step < 100 && level.IsSolid(door_x, door_y); ++step) {
+    if (level_editor.ApplyEdits(kStepSeconds, nullptr, thread_pool) > 0) {
+      ray_cache.Invalidate();
+    }
+
+    ray_cache.Update(camera, nullptr);
+  }
+
+  camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+
+  bench::JsonLine("visibility_edits")
+      .Add("tiles", static_cast<int64_t>(level.Width()) * level.Height())
+      .Add("open_wall_ms", bench::CalculatePercentiles(&open_times))
+      .Add("fill_tile_ms", bench::CalculatePercentiles(&close_times))
+      .Add("covers_rebuild", covers)
+      .Add("extra_visible_fraction",
+           static_cast<double>(num_extra) /
+               (static_cast<int64_t>(level.Width()) * level.Height() *
+                level.Width() * level.Height()))
+      .Add("door_open_steps", open_steps)
+      .Add("door_waited_for_body", waited_for_body)
+      .Add("door_closed_after_body_left", closed_after_body_left)
+      .Add("ray_cache_matches_after_edit",
+           CacheMatchesCast(ray_cache, rays, true))
+      .Print();
+}
+
+// Opens and fills walls next to the rooms of a large map of small rooms in
+// solid rock, whose sets are cheap to build, and checks that every update
+// stays local: its cost must not grow with the size of the map.
+void BenchmarkLargeVisibilityEdits(ThreadPool* thread_pool) {
+  constexpr int kSize = 1024;
+  constexpr int kRoomSpacing = 128;
+  constexpr int kRoomSize = 4;
+  constexpr int kNumEdits = 32;
+
+  std::vector<uint8_t> tiles(static_cast<size_t>(kSize) * kSize, 3);
+
+  for (int room_x = 8; room_x < kSize; room_x += kRoomSpacing) {
+    for (int room_y = 8; room_y < kSize; room_y += kRoomSpacing) {
+      for (int x = room_x; x < room_x + kRoomSize; ++x) {
+        for (int y = room_y; y < room_y + kRoomSize; ++y) {
+          tiles[static_cast<size_t>(x) * kSize + y] = 0;
+        }
+      }
+    }
+  }
+
+  Level level(kSize, kSize, std::move(tiles));
+
+  const bench::Clock::time_point build_start = bench::Clock::now();
+  VisibilitySet visibility_set(level, thread_pool);
+  const double build_seconds = bench::SecondsSince(build_start);
+
+  LevelEditor level_editor(&level);
+  level_editor.SetVisibilitySet(&visibility_set);
+
+  // Every other edit opens the wall east of a room, the next fills it again.
+  std::vector<double> open_times;
+  std::vector<double> fill_times;
+  bool sees_through_opened = true;
+
+  for (int edit = 0; edit < kNumEdits; ++edit) {
+    const int room = edit / 2;
+    const int room_x = 8 + kRoomSpacing * (room % (kSize / kRoomSpacing));
+    const int room_y = 8 + kRoomSpacing * (room / (kSize / kRoomSpacing));
+    const int x = room_x + kRoomSize;
+    const int y = room_y + 1;
+    const bool open = edit % 2 == 0;
+
+    level_editor.SetTile(x, y, open ? 0 : 3);
+
+    const bench::Clock::time_point start = bench::Clock::now();
+    level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+    (open ? open_times : fill_times)
+        .push_back(bench::SecondsSince(start) * 1e3);
+
+    // The room sees the wall behind the opened tile.
+    if (open) {
+      sees_through_opened = sees_through_opened &&
+                            visibility_set.IsVisible(room_x, y, x + 1, y);
+    }
+  }
+
+  bench::JsonLine("large_visibility_edits")
+      .Add("tiles", static_cast<int64_t>(kSize) * kSize)
+      .Add("build_ms", build_seconds * 1e3)
+      .Add("open_wall_ms", bench::CalculatePercentiles(&open_times))
+      .Add("fill_tile_ms", bench::CalculatePercentiles(&fill_times))
+      .Add("sees_through_opened", sees_through_opened)
+      .Print();
+}
+
+// Opens a door between two empty tiles of the built-in level, with a sprite
+// behind it that the camera tile does not see, and renders it without moving
+// the camera, invalidating the sprite renderer the way the game does. The
+// culled frames must match those drawn without the visibility set, and while
+// the door slides open, exactly the columns whose rays hit the open part of
+// its face must see past it.
+void BenchmarkSpriteVisibilityEdits(const TextureAtlas& texture_atlas,
+                                    ThreadPool* thread_pool) {
+  Level level = CopyLevel(BenchLevel());
+  VisibilitySet visibility_set(level, thread_pool);
+  LevelEditor level_editor(&level);
+  level_editor.SetVisibilitySet(&visibility_set);
+
+  int door_x = 1;
+  int door_y = 1;
+
+  while (!level.IsSolid(door_x, door_y) ||
+         level.IsSolid(door_x - 1, door_y) ||
+         level.IsSolid(door_x + 1, door_y) ||
+         visibility_set.IsVisible(door_x - 1, door_y, door_x + 1, door_y)) {
+    if (++door_y == level.Height() - 1) {
+      door_y = 1;
+      ++door_x;
+    }
+  }
+
+  const std::vector<rendering::Sprite> sprites = {
+    { Vector(door_x + 1.5f, door_y + 0.5f), 0 }
+  };
+  const Camera camera(level, door_x - 0.5f, door_y + 0.5f, 0.0f,
+                      DegreesToRadians(kFovDegrees));
+
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  FrameBuffer culled_frame_buffer(kScreenWidth, kScreenHeight);
+  rendering::ColumnBuffers column_buffers(kScreenWidth);
+  rendering::SpriteRenderer sprite_renderer;
+  rendering::SpriteRenderer culling_sprite_renderer;
+  culling_sprite_renderer.SetVisibilitySet(&visibility_set);
+
+  const size_t frame_bytes =
+      static_cast<size_t>(kScreenWidth) * kScreenHeight * sizeof(uint32_t);
+
+  const auto render = [&]() {
+    rendering::RenderColumns(camera, &texture_atlas, nullptr, &level_editor,
+                             nullptr, 0, kScreenWidth, &column_buffers,
+                             &frame_buffer);
+    std::memcpy(culled_frame_buffer.Pixels(), frame_buffer.Pixels(),
+                frame_bytes);
+
+    sprite_renderer.Render(camera, texture_atlas, sprites, column_buffers,
+                           nullptr, &frame_buffer);
+    culling_sprite_renderer.Render(camera, texture_atlas, sprites,
+                                   column_buffers, nullptr,
+                                   &culled_frame_buffer);
+
+    return std::memcmp(frame_buffer.Pixels(), culled_frame_buffer.Pixels(),
+                       frame_bytes) == 0;
+  };
+
+  bool identical = render();
+  const bool hidden_before = culling_sprite_renderer.NumHidden() == 1;
+
+  level_editor.OpenDoor(door_x, door_y);
+
+  bool visible_while_opening = false;
+  bool gap_matches = true;
+  int num_gap_columns = 0;
+
+  for (int step = 0; step < 100 && level.IsSolid(door_x, door_y); ++step) {
+    if (level_editor.ApplyEdits(0.05f, nullptr, thread_pool) > 0) {
+      culling_sprite_renderer.InvalidateVisibility();
+    }
+
+    identical &= render();
+
+    if (!level.IsSolid(door_x, door_y)) break;
+
+    visible_while_opening = visible_while_opening ||
+                            culling_sprite_renderer.NumVisible() == 1;
+
+    // The face of the door is half a tile ahead, and its open part runs
+    // from its lower Y edge up to the open fraction.
+    const float open_fraction = level_editor.DoorOpenFraction(door_x, door_y);
+
+    for (int x = 0; x < kScreenWidth; ++x) {
+      const Vector ray_direction =
+          camera.Direction() +
+          camera.Plane() * rendering::CalculatePlaneScalar(x, kScreenWidth);
+      const float along = camera.Position().y + 0.5f * ray_direction.y /
+                                                    ray_direction.x - door_y;
+      const bool through = column_buffers.depth[x] > 0.5f + 1e-3f;
+
+      // Rays right at the edge of the panel may go either way.
+      if (std::fabs(along - open_fraction) > 1e-3f) {
+        gap_matches = gap_matches && through == (along < open_fraction);
+      }
+
+      num_gap_columns += through ? 1 : 0;
+    }
+  }
+
+  identical &= render();
+
+  bench::JsonLine("sprite_visibility_edits")
+      .Add("hidden_before_open", hidden_before)
+      .Add("door_open", !level.IsSolid(door_x, door_y))
+      .Add("visible_while_opening", visible_while_opening)
+      .Add("visible_after_open", culling_sprite_renderer.NumVisible() == 1)
+      .Add("gap_columns", num_gap_columns)
+      .Add("gap_matches_open_fraction", gap_matches)
+      .Add("identical_frames", identical)
+      .Print();
+}
+
+// Returns true if every texel of every tile of the level is the same in both
+// lightmaps, and counts the texels lit above the ambient light in the first.
+bool SameLight(const Lightmap& a,
+               const Lightmap& b,
+               const Level& level,
+               int64_t* num_lit) {
+  constexpr uint32_t kAmbientTexel = Lightmap::kAmbient << 16 |
+                                     Lightmap::kAmbient << 8 |
+                                     Lightmap::kAmbient;
+  bool same = true;
+  *num_lit = 0;
+
+  const auto compare = [&](uint32_t a_light, uint32_t b_light) {
+    same = same && a_light == b_light;
+    *num_lit += a_light != kAmbientTexel ? 1 : 0;
+  };
+
+  for (int x = 0; x < level.Width(); ++x) {
+    for (int y = 0; y < level.Height(); ++y) {
+      for (int face = 0; face < 4; ++face) {
+        for (int i = 0; i < Lightmap::kFaceTexels; ++i) {
+          const float wall_x = (i + 0.5f) / Lightmap::kFaceTexels;
+
+          compare(a.FaceLight(x, y, static_cast<Lightmap::Face>(face), wall_x),
+                  b.FaceLight(x, y, static_cast<Lightmap::Face>(face), wall_x));
+        }
+      }
+
+      for (int u = 0; u < Lightmap::kFloorTexels; ++u) {
+        for (int v = 0; v < Lightmap::kFloorTexels; ++v) {
+          const Vector position(x + (u + 0.5f) / Lightmap::kFloorTexels,
+                                y + (v + 0.5f) / Lightmap::kFloorTexels);
+
+          compare(a.FloorLight(position), b.FloorLight(position));
+        }
+      }
+    }
+  }
+
+  return same;
+}
+
+// Bakes the lights of the level on the calling thread and on the threads of
+// the pool, which must give the same texels.
+void BenchmarkLightmapBake(const char* name,
+                           const Level& level,
+                           int num_lights,
+                           ThreadPool* thread_pool) {
+  const std::vector<PointLight> lights =
+      lighting::ScatterLights(level, num_lights);
+
+  bench::Clock::time_point start = bench::Clock::now();
+  const Lightmap single_thread(level, lights, nullptr);
+  const double single_thread_seconds = bench::SecondsSince(start);
+
+  start = bench::Clock::now();
+  const Lightmap lightmap(level, lights, thread_pool);
+  const double pool_seconds = bench::SecondsSince(start);
+
+  int64_t num_lit = 0;
+  const bool same = SameLight(lightmap, single_thread, level, &num_lit);
+
+  bench::JsonLine("lightmap_bake")
+      .Add("level", name)
+      .Add("tiles", static_cast<int64_t>(level.Width()) * level.Height())
+      .Add("lights", static_cast<int>(lights.size()))
+      .Add("threads", thread_pool->NumThreads())
+      .Add("single_thread_ms", single_thread_seconds * 1e3)
+      .Add("pool_ms", pool_seconds * 1e3)
+      .Add("speedup", single_thread_seconds / pool_seconds)
+      .Add("baked_chunks", lightmap.NumBakedChunks())
+      .Add("texel_bytes", static_cast<int64_t>(lightmap.TexelSize()))
+      .Add("lit_texels", num_lit)
+      .Add("same_as_single_thread", same)
+      .Print();
+}
+
+// Returns true if every floor and ceiling pixel of the lit frame is that of
+// the unlit frame multiplied by the floor light at its world position, or at
+// that of a pixel next to it, where the walk of the floor caster may round
+// into the neighboring texel.
+bool FloorLightMatchesLookup(const Camera& camera,
+                             const Lightmap& lightmap,
+                             const rendering::ColumnBuffers& column_buffers,
+                             const FrameBuffer& unlit_frame_buffer,
+                             const FrameBuffer& lit_frame_buffer) {
+  const int width = lit_frame_buffer.Width();
+  const int max_y = lit_frame_buffer.Height() - 1;
+  const float horizon = max_y / 2.0f;
+  const Vector left_ray = camera.Direction() - camera.Plane();
+  const Vector right_ray = camera.Direction() + camera.Plane();
+
+  for (int y = (max_y + 1) / 2; y <= max_y; ++y) {
+    const float rows_below_horizon = y - horizon;
+
+    if (rows_below_horizon <= 0.0f) continue;
+
+    const float row_distance = horizon / rows_below_horizon;
+    const Vector start = camera.Position() + left_ray * row_distance;
+    const Vector step =
+        (right_ray - left_ray) * (row_distance / (width - 1.0f));
+
+    for (const int row : { y, max_y - y }) {
+      const uint32_t* unlit =
+          unlit_frame_buffer.Pixels() + static_cast<size_t>(row) * width;
+      const uint32_t* lit =
+          lit_frame_buffer.Pixels() + static_cast<size_t>(row) * width;
+
+      for (int x = 0; x < width; ++x) {
+        if (row <= column_buffers.draw_end[x] &&
+            row >= column_buffers.draw_start[x]) {
+          continue;
+        }
+
+        bool matches = false;
+
+        for (int dx = 0; dx <= 2 && !matches; ++dx) {
+          const int neighbor_x = x + (dx == 2 ? -1 : dx);
+          const uint32_t light = lightmap.FloorLight(
+              start + step * static_cast<float>(neighbor_x));
+
+          matches = lit[x] == lighting::Modulate(unlit[x], light);
+        }
+
+        if (!matches) return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Checks that the light looked up from every ray is that of the face the
+// ray hit and that the floor and ceiling are lit from the floor texels,
+// renders lit frames from cast and cached rays, which must be the same, and
+// times frames with and without the lightmap.
+void BenchmarkLightmapRendering(const std::vector<Camera>& cameras,
+                                const TextureAtlas& texture_atlas,
+                                ThreadPool* thread_pool) {
+  const Level& level = BenchLevel();
+  const Lightmap lightmap(level, lighting::ScatterLights(level, 8),
+                          thread_pool);
+  const std::vector<float> plane_scalars = ScreenPlaneScalars();
+
+  bool lookup_matches = true;
+
+  for (const Camera& camera : cameras) {
+    for (const float plane_scalar : plane_scalars) {
+      const Vector ray_direction =
+          camera.Direction() + camera.Plane() * plane_scalar;
+      raycasting::HitTile hit_tile;
+      const raycasting::RayData ray_data = raycasting::CastRay(
+          level, nullptr, camera.Position(), ray_direction, &hit_tile);
+
+      Lightmap::Face face;
+
+      if (ray_data.wall_side == raycasting::WallSide::kXSide) {
+        face = ray_direction.x > 0.0f ? Lightmap::Face::kNegativeX
+                                      : Lightmap::Face::kPositiveX;
+      } else {
+        face = ray_direction.y > 0.0f ? Lightmap::Face::kNegativeY
+                                      : Lightmap::Face::kPositiveY;
+      }
+
+      lookup_matches =
+          lookup_matches &&
+          lightmap.WallLight(camera.Position(), ray_direction, ray_data) ==
+              lightmap.FaceLight(hit_tile.x, hit_tile.y, face,
+                                 ray_data.wall_x);
+    }
+  }
+
+  FrameBuffer unlit_frame_buffer(kScreenWidth, kScreenHeight);
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  FrameBuffer cached_frame_buffer(kScreenWidth, kScreenHeight);
+  rendering::ColumnBuffers column_buffers(kScreenWidth);
+  RayCache ray_cache(kScreenWidth);
+
+  const size_t frame_bytes =
+      static_cast<size_t>(kScreenWidth) * kScreenHeight * sizeof(uint32_t);
+  bool floor_matches = true;
+  bool cached_matches = true;
+  std::vector<double> unlit_times;
+  std::vector<double> lit_times;
+
+  for (const Camera& camera : cameras) {
+    bench::Clock::time_point start = bench::Clock::now();
+    rendering::RenderFrame(camera, &texture_atlas, nullptr, nullptr, nullptr,
+                           thread_pool, &column_buffers, &unlit_frame_buffer,
+                           nullptr);
+    unlit_times.push_back(bench::SecondsSince(start) * 1e3);
+
+    start = bench::Clock::now();
+    rendering::RenderFrame(camera, &texture_atlas, &lightmap, nullptr, nullptr,
+                           thread_pool, &column_buffers, &frame_buffer,
+                           nullptr);
+    lit_times.push_back(bench::SecondsSince(start) * 1e3);
+
+    floor_matches =
+        floor_matches &&
+        FloorLightMatchesLookup(camera, lightmap, column_buffers,
+                                unlit_frame_buffer, frame_buffer);
+
+    rendering::RenderFrame(camera, &texture_atlas, &lightmap, nullptr,
+                           &ray_cache, thread_pool, &column_buffers,
+                           &cached_frame_buffer, nullptr);
+    cached_matches =
+        cached_matches && std::memcmp(frame_buffer.Pixels(),
+                                      cached_frame_buffer.Pixels(),
+                                      frame_bytes) == 0;
+  }
+
+  bench::JsonLine("lightmap_rendering")
+      .Add("frames", static_cast<int>(cameras.size()))
+      .Add("lookup_matches_hit_face", lookup_matches)
+      .Add("floor_matches_lookup", floor_matches)
+      .Add("cached_rays_match_cast", cached_matches)
+      .Add("unlit_frame_ms", bench::CalculatePercentiles(&unlit_times))
+      .Add("lit_frame_ms", bench::CalculatePercentiles(&lit_times))
+      .Print();
+}
+
+// Saves the lightmap of the built-in level and loads it back, then changes
+// the lights and a tile of the level and checks that it is baked again.
+// Finally edits tiles near the lights and checks the locally updated
+// lightmap against a new bake.
+void BenchmarkLightmapCache(ThreadPool* thread_pool) {
+  const Level& level = BenchLevel();
+  const std::vector<PointLight> lights = lighting::ScatterLights(level, 8);
+  const std::string path = "/tmp/ray-casting-bench-level.rclv.light";
+  std::remove(path.c_str());
+
+  Lightmap cached;
+  bool built_first = false;
+  bool rebuilt_unchanged = true;
+  bool rebuilt_lights = false;
+  bool rebuilt_level = false;
+  std::string error;
+
+  const bool saved = cached.LoadOrBuild(level, lights, path, thread_pool,
+                                        &built_first, &error);
+
+  const bench::Clock::time_point load_start = bench::Clock::now();
+  const bool loaded =
+      saved && cached.LoadOrBuild(level, lights, path, thread_pool,
+                                  &rebuilt_unchanged, &error);
+  const double load_seconds = bench::SecondsSince(load_start);
+
+  const Lightmap built(level, lights, thread_pool);
+  int64_t num_lit = 0;
+  const bool same_as_built = SameLight(cached, built, level, &num_lit);
+
+  std::vector<PointLight> moved_lights = lights;
+  moved_lights.front().red *= 0.5f;
+
+  const bool saved_lights = cached.LoadOrBuild(
+      level, moved_lights, path, thread_pool, &rebuilt_lights, &error);
+  const bool rebaked_lights =
+      saved_lights && rebuilt_lights &&
+      cached.LightsHash() == lighting::HashLights(moved_lights);
+
+  // Opens the walls next to the first light one at a time.
+  Level changed = CopyLevel(level);
+  Lightmap lightmap(changed, lights, thread_pool);
+  LevelEditor level_editor(&changed);
+  level_editor.SetLightmap(&lightmap);
+
+  std::vector<double> edit_times;
+  const int light_x = static_cast<int>(lights.front().position.x);
+  const int light_y = static_cast<int>(lights.front().position.y);
+
+  for (int x = light_x - 3; x <= light_x + 3; ++x) {
+    for (int y = light_y - 3; y <= light_y + 3; ++y) {
+      if (x <= 0 || y <= 0 || x >= changed.Width() - 1 ||
+          y >= changed.Height() - 1 || !changed.IsSolid(x, y)) {
+        continue;
+      }
+
+      level_editor.SetTile(x, y, 0);
+
+      const bench::Clock::time_point start = bench::Clock::now();
+      level_editor.ApplyEdits(0.0f, nullptr, thread_pool);
+      edit_times.push_back(bench::SecondsSince(start) * 1e3);
+    }
+  }
+
+  const Lightmap rebaked(changed, lights, thread_pool);
+  const bool matches_rebake = SameLight(lightmap, rebaked, changed, &num_lit);
+
+  const bool saved_level = cached.LoadOrBuild(changed, lights, path,
+                                              thread_pool, &rebuilt_level,
+                                              &error);
+  std::remove(path.c_str());
+
+  bench::JsonLine("lightmap_cache")
+      .Add("built_first", built_first)
+      .Add("loaded", loaded && !rebuilt_unchanged)
+      .Add("load_ms", load_seconds * 1e3)
+      .Add("same_as_built", same_as_built)
+      .Add("rebuilt_after_light_change", rebaked_lights)
+      .Add("rebuilt_after_level_change",
+           saved_level && rebuilt_level &&
+               cached.LevelHash() == level::HashLevel(changed))
+      .Add("edits", static_cast<int>(edit_times.size()))
+      .Add("edit_ms", bench::CalculatePercentiles(&edit_times))
+      .Add("edits_match_rebake", matches_rebake)
+      .Print();
+}
+
+// Returns the size of the file in bytes, or -1 if it cannot be read.
+int64_t FileSize(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+  return file ? static_cast<int64_t>(file.tellg()) : -1;
+}
+
+// Times the RGB to YUV conversion of a frame with and without AVX2.
+double ConvertMegapixelsPerSecond(const FrameBuffer& frame_buffer,
+                                  bool use_avx2,
+                                  std::vector<uint8_t>* out) {
+  int64_t num_frames = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    if (use_avx2) {
+      capture::ConvertToI420AVX2(frame_buffer.Pixels(), frame_buffer.Width(),
+                                 frame_buffer.Height(), out->data());
+    } else {
+      capture::ConvertToI420Scalar(frame_buffer.Pixels(),
+                                   frame_buffer.Width(),
+                                   frame_buffer.Height(), out->data());
+    }
+    ++num_frames;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  return static_cast<double>(num_frames) * frame_buffer.Width() *
+         frame_buffer.Height() / bench::SecondsSince(start) / 1e6;
+}
+
+// Converts a rendered frame and an odd-sized one to YUV with and without
+// AVX2, which must match, then records frames in bursts faster than the
+// writer thread keeps up with and paced to the frame rate, and checks the
+// size of the files written.
+void BenchmarkFrameCapture(const std::vector<Camera>& cameras,
+                           const TextureAtlas& texture_atlas,
+                           ThreadPool* thread_pool) {
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+  rendering::ColumnBuffers column_buffers(kScreenWidth);
+  rendering::RenderFrame(cameras.front(), &texture_atlas, nullptr, nullptr,
+                         nullptr, thread_pool, &column_buffers, &frame_buffer,
+                         nullptr);
+
+  const size_t frame_size = capture::I420Size(kScreenWidth, kScreenHeight);
+  std::vector<uint8_t> scalar_out(frame_size);
+  std::vector<uint8_t> avx2_out(frame_size);
+
+  const double scalar_rate =
+      ConvertMegapixelsPerSecond(frame_buffer, false, &scalar_out);
+  double avx2_rate = 0.0;
+  bool avx2_matches = true;
+
+  // An odd size leaves columns and rows for the scalar code at every edge.
+  FrameBuffer odd_frame(333, 201);
+
+  for (int i = 0; i < odd_frame.Width() * odd_frame.Height(); ++i) {
+    odd_frame.Pixels()[i] = static_cast<uint32_t>(i) * 2654435761u;
+  }
+
+  std::vector<uint8_t> odd_scalar_out(
+      capture::I420Size(odd_frame.Width(), odd_frame.Height()));
+  std::vector<uint8_t> odd_avx2_out(odd_scalar_out.size());
+
+  if (raycasting::HasAVX2()) {
+    avx2_rate = ConvertMegapixelsPerSecond(frame_buffer, true, &avx2_out);
+
+    capture::ConvertToI420Scalar(odd_frame.Pixels(), odd_frame.Width(),
+                                 odd_frame.Height(), odd_scalar_out.data());
+    capture::ConvertToI420AVX2(odd_frame.Pixels(), odd_frame.Width(),
+                               odd_frame.Height(), odd_avx2_out.data());
+
+    avx2_matches = scalar_out == avx2_out && odd_scalar_out == odd_avx2_out;
+  }
+
+  // White and black map to the ends of the limited range, without color.
+  FrameBuffer levels_frame(2, 2);
+  uint8_t white[6];
+  uint8_t black[6];
+
+  levels_frame.FillRows(0, 2, 0xffffffff);
+  capture::ConvertToI420(levels_frame.Pixels(), 2, 2, white);
+  levels_frame.FillRows(0, 2, 0xff000000);
+  capture::ConvertToI420(levels_frame.Pixels(), 2, 2, black);
+
+  const bool levels_exact = white[0] == 235 && white[4] == 128 &&
+                            white[5] == 128 && black[0] == 16 &&
+                            black[4] == 128 && black[5] == 128;
+
+  // Bursts of frames submitted back to back overrun the buffers, and every
+  // frame beyond them is dropped instead of waited for.
+  const std::string y4m_path = "/tmp/ray-casting-bench-capture.y4m";
+  FrameCapture frame_capture(kScreenWidth, kScreenHeight);
+  std::string error;
+  bool opened = frame_capture.Open(y4m_path, &error);
+  frame_capture.Start();
+
+  std::vector<double> submit_times;
+  int num_burst_frames = 0;
+
+  for (const Camera& camera : cameras) {
+    rendering::RenderFrame(camera, &texture_atlas, nullptr, nullptr, nullptr,
+                           thread_pool, &column_buffers, &frame_buffer,
+                           nullptr);
+
+    for (int i = 0; i < 4; ++i) {
+      const bench::Clock::time_point start = bench::Clock::now();
+      frame_capture.Submit(frame_buffer);
+      submit_times.push_back(bench::SecondsSince(start) * 1e3);
+      ++num_burst_frames;
+    }
+  }
+
+  const int64_t burst_dropped = frame_capture.NumDropped();
+
+  // Frames paced to the frame rate all get written, including frames of
+  // half the size, which are scaled up.
+  constexpr int kNumPacedFrames = 30;
+  FrameBuffer half_frame(kScreenWidth / 2, kScreenHeight / 2);
+
+  for (int i = 0; i < kNumPacedFrames; ++i) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(1000 / FrameCapture::kFrameRate));
+    frame_capture.Submit(i % 2 == 0 ? frame_buffer : half_frame);
+  }
+
+  const int64_t paced_dropped = frame_capture.NumDropped() - burst_dropped;
+  const bool y4m_closed = opened && frame_capture.Close(&error);
+  const int64_t num_written = frame_capture.NumWritten();
+
+  const std::string y4m_header = "YUV4MPEG2 W" + std::to_string(kScreenWidth) +
+                                 " H" + std::to_string(kScreenHeight) +
+                                 " F60:1 Ip A1:1 C420jpeg\n";
+  const bool y4m_size_matches =
+      FileSize(y4m_path) ==
+      static_cast<int64_t>(y4m_header.size()) +
+          num_written * static_cast<int64_t>(6 + frame_size);
+  std::remove(y4m_path.c_str());
+
+  // Raw RGB frames are written as they are.
+  const std::string rgb_path = "/tmp/ray-casting-bench-capture.rgb";
+  FrameCapture rgb_capture(kScreenWidth, kScreenHeight);
+  opened = rgb_capture.Open(rgb_path, &error);
+  rgb_capture.Start();
+
+  for (int i = 0; i < 4; ++i) {
+    rgb_capture.Submit(frame_buffer);
+  }
+
+  const bool rgb_closed = opened && rgb_capture.Close(&error);
+  const bool rgb_size_matches =
+      FileSize(rgb_path) ==
+      rgb_capture.NumWritten() * kScreenWidth * kScreenHeight * 3;
+  std::remove(rgb_path.c_str());
+
+  bench::JsonLine("frame_capture")
+      .Add("avx2", raycasting::HasAVX2())
+      .Add("convert_scalar_mpixels_per_s", scalar_rate)
+      .Add("convert_avx2_mpixels_per_s", avx2_rate)
+      .Add("avx2_matches_scalar", avx2_matches)
+      .Add("levels_exact", levels_exact)
+      .Add("burst_frames", num_burst_frames)
+      .Add("burst_dropped", burst_dropped)
+      .Add("submit_ms", bench::CalculatePercentiles(&submit_times))
+      .Add("paced_frames", kNumPacedFrames)
+      .Add("paced_dropped", paced_dropped)
+      .Add("written", num_written)
+      .Add("y4m_size_matches", y4m_closed && y4m_size_matches)
+      .Add("rgb_size_matches", rgb_closed && rgb_size_matches)
+      .Print();
+}
+
+// Times saving and memory-mapping a large generated level, and casting a
+// frame of rays into it right after loading.
+void BenchmarkLevelLoad() {
+  constexpr int kSize = 4096;
+
+  const Level generated = GenerateOpenLevel(kSize, 7);
+  const std::string path = "/tmp/ray-casting-bench-level.rclv";
+  std::string error;
+
+  const bench::Clock::time_point save_start = bench::Clock::now();
+  const bool saved = level::SaveBinaryLevel(generated, path, &error);
+  const double save_seconds = bench::SecondsSince(save_start);
+
+  Level loaded;
+
+  const bench::Clock::time_point load_start = bench::Clock::now();
+  const bool loaded_ok = saved && level::LoadLevel(path, &loaded, &error);
+  const double load_seconds = bench::SecondsSince(load_start);
+
+  double first_frame_seconds = 0.0;
+
+  if (loaded_ok) {
+    const Camera camera(loaded, kSize / 2 + 0.5f, kSize / 2 + 0.5f,
+                        DegreesToRadians(30.0f),
+                        DegreesToRadians(kFovDegrees));
+    const std::vector<float> plane_scalars = ScreenPlaneScalars();
+    ScreenRays rays;
+    raycasting::RayBatch batch = rays.Batch();
+
+    const bench::Clock::time_point frame_start = bench::Clock::now();
+    camera.CalculateRays(plane_scalars.data(), kScreenWidth, &batch);
+    first_frame_seconds = bench::SecondsSince(frame_start);
+  }
+
+  std::remove(path.c_str());
+
+  bench::JsonLine("level_load")
+      .Add("tiles", static_cast<int64_t>(kSize) * kSize)
+      .Add("ok", loaded_ok)
+      .Add("save_ms", save_seconds * 1e3)
+      .Add("load_ms", load_seconds * 1e3)
+      .Add("first_frame_rays_ms", first_frame_seconds * 1e3)
+      .Print();
+}
+
+// Returns the nanoseconds one empty trace scope takes.
+double TimeTraceScope() {
+  int64_t num_scopes = 0;
+  const bench::Clock::time_point start = bench::Clock::now();
+
+  do {
+    for (int i = 0; i < 1000; ++i) {
+      tracing::ScopedTrace trace("bench");
+    }
+    num_scopes += 1000;
+  } while (bench::SecondsSince(start) < kMinBenchmarkSeconds);
+
+  return bench::SecondsSince(start) * 1e9 / num_scopes;
+}
+
+// Renders the first flight untraced and traced, and writes the trace. Tracing
+// stays enabled afterwards, so this runs last.
+void BenchmarkTrace(const BenchOptions& options, ThreadPool* thread_pool) {
+  const CameraPath& path = kCameraPaths[0];
+  const TextureAtlas texture_atlas;
+  FrameBuffer frame_buffer(kScreenWidth, kScreenHeight);
+
+  const double disabled_ns = TimeTraceScope();
+  std::vector<double> untraced_frame_times = RenderFlight(
+      path, texture_atlas, options.num_frames, thread_pool, &frame_buffer);
+
+  tracing::Enable();
+  tracing::SetThreadName("main");
+
+  std::vector<double> traced_frame_times = RenderFlight(
+      path, texture_atlas, options.num_frames, thread_pool, &frame_buffer);
+
+  const std::string trace_path = "/tmp/ray-casting-bench-trace.json";
+  std::string error;
+  const bool written = tracing::WriteTrace(trace_path, &error);
+  std::remove(trace_path.c_str());
+
+  const int64_t dropped_events = tracing::NumDroppedEvents();
+  const double enabled_ns = TimeTraceScope();
+
+  bench::JsonLine("trace")
+      .Add("path", path.name)
+      .Add("disabled_scope_ns", disabled_ns)
+      .Add("enabled_scope_ns", enabled_ns)
+      .Add("untraced_frame_ms", bench::CalculatePercentiles(&untraced_frame_times))
+      .Add("traced_frame_ms", bench::CalculatePercentiles(&traced_frame_times))
+      .Add("dropped_events", dropped_events)
+      .Add("written", written)
+      .Print();
+}
+
+bool ParseBenchOptions(int argc, char* argv[], BenchOptions* options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+
+    if (argument.rfind("--threads=", 0) == 0) {
+      options->num_threads = std::atoi(argument.c_str() + 10);
+    } else if (argument.rfind("--frames=", 0) == 0) {
+      options->num_frames = std::atoi(argument.c_str() + 9);
+    } else {
+      return false;
+    }
+  }
+
+  return options->num_threads > 0 && options->num_frames > 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchOptions options;
+
+  if (!ParseBenchOptions(argc, argv, &options)) {
+    std::cerr << "Usage: ray-casting-bench [--threads=N] [--frames=N]\n";
+    return 1;
+  }
+
+  ThreadPool thread_pool(options.num_threads);
+  const std::vector<Camera> cameras = SampleCameras();
+
+  BenchmarkDDAData();
+  const DistanceField distance_field(BenchLevel());
+
+  BenchmarkCalculateRay("calculate_ray", cameras, nullptr);
+  BenchmarkCalculateRay("calculate_ray", cameras, &distance_field);
+  BenchmarkCalculateRays(cameras);
+  BenchmarkFixedPointDDA<raycasting::FixedDDAData16>(
+      "fixed_point_dda", 16, cameras, distance_field);
+  BenchmarkFixedPointDDA<raycasting::FixedDDAData<20>>(
+      "fixed_point_dda", 20, cameras, distance_field);
+  const TextureAtlas texture_atlas;
+
+  BenchmarkWallShading(cameras, nullptr);
+  BenchmarkWallShading(cameras, &texture_atlas);
+  BenchmarkRenderPresets(cameras, texture_atlas);
+  BenchmarkFloorCasting(cameras, texture_atlas);
+  BenchmarkSprites(cameras, texture_atlas, 100);
+  BenchmarkSprites(cameras, texture_atlas, 1000);
+  BenchmarkSimulation(cameras.front());
+  BenchmarkProfiler();
+  BenchmarkGameLog(cameras.front());
+  BenchmarkLevelLoad();
+  BenchmarkOpenMap();
+
+  for (int num_entities : { 100, 1000, 10000, 100000 }) {
+    BenchmarkEntityWorld(num_entities);
+  }
+
+  BenchmarkDepthScans("360", sensing::kFullTurn, 10000, 64,
+                      &thread_pool);
+  BenchmarkDepthScans("frustum_90", DegreesToRadians(90.0f), 10000, 64,
+                      &thread_pool);
+  BenchmarkLineOfSight("default", BenchLevel(), 4096, 16, &thread_pool);
+  BenchmarkLineOfSight("open_map", GenerateOpenLevel(1024, 97), 4096, 16,
+                       &thread_pool);
+  BenchmarkVisibilitySet("default", BenchLevel(), 1, &thread_pool);
+  BenchmarkVisibilitySet("open_map", GenerateOpenLevel(48, 7), 5,
+                         &thread_pool);
+  BenchmarkVisibilityCache(&thread_pool);
+  BenchmarkDistanceFieldEdits(&thread_pool);
+  BenchmarkVisibilityEdits(&thread_pool);
+  BenchmarkLargeVisibilityEdits(&thread_pool);
+  BenchmarkSpriteVisibility(cameras, texture_atlas, 1000, &thread_pool);
+  BenchmarkSpriteVisibilityEdits(texture_atlas, &thread_pool);
+  BenchmarkLightmapBake("default", BenchLevel(), 8, &thread_pool);
+  BenchmarkLightmapBake("open_map", GenerateOpenLevel(256, 7), 64,
+                        &thread_pool);
+  BenchmarkLightmapRendering(cameras, texture_atlas, &thread_pool);
+  BenchmarkLightmapCache(&thread_pool);
+  BenchmarkFrameCapture(cameras, texture_atlas, &thread_pool);
+
+  for (const CameraPath& path : kCameraPaths) {
+    BenchmarkFlight(path, options, &thread_pool);
+  }
+
+  for (const CameraPath& path : kCameraPaths) {
+    BenchmarkRayCache(path, options);
+  }
+
+  BenchmarkResolutionScaler(kCameraPaths[0], options, &thread_pool);
+
+  BenchmarkTrace(options, &thread_pool);
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+
+double bench::SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bench::Percentiles bench::CalculatePercentiles(std::vector<double>* samples) {
+  if (samples->empty()) return Percentiles{ 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+  std::sort(samples->begin(), samples->end());
+
+  const auto rank = [&](double percentile) {
+    const size_t index = static_cast<size_t>(
+        std::ceil(percentile / 100.0 * samples->size()));
+    return (*samples)[std::max<size_t>(index, 1) - 1];
+  };
+
+  const double sum = std::accumulate(samples->begin(), samples->end(), 0.0);
+
+  return Percentiles{
+    rank(50.0),
+    rank(95.0),
+    rank(99.0),
+    samples->back(),
+    sum / samples->size()
+  };
+}
+
+bench::JsonLine::JsonLine(const std::string& benchmark) {
+  buffer_ = "{\"benchmark\":\"" + benchmark + "\"";
+}
+
+void bench::JsonLine::AddName(const std::string& name) {
+  buffer_ += ",\"" + name + "\":";
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name, double value) {
+  char number[32];
+
+  // JSON has no representation for infinity or NaN.
+  if (std::isfinite(value)) {
+    std::snprintf(number, sizeof(number), "%.6g", value);
+  } else {
+    std::snprintf(number, sizeof(number), "null");
+  }
+
+  AddName(name);
+  buffer_ += number;
+  return *this;
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name, int64_t value) {
+  AddName(name);
+  buffer_ += std::to_string(value);
+  return *this;
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name, int value) {
+  return Add(name, static_cast<int64_t>(value));
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name, bool value) {
+  AddName(name);
+  buffer_ += value ? "true" : "false";
+  return *this;
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name,
+                                      const std::string& value) {
+  AddName(name);
+  buffer_ += "\"" + value + "\"";
+  return *this;
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name,
+                                      const char* value) {
+  return Add(name, std::string(value));
+}
+
+bench::JsonLine& bench::JsonLine::Add(const std::string& name,
+                                      const Percentiles& percentiles) {
+  JsonLine nested("");
+
+  // Reuses the number formatting and strips the benchmark name again.
+  nested.buffer_ = "{";
+  nested.Add("p50", percentiles.p50)
+        .Add("p95", percentiles.p95)
+        .Add("p99", percentiles.p99)
+        .Add("max", percentiles.max)
+        .Add("mean", percentiles.mean);
+  nested.buffer_.erase(1, 1);
+
+  AddName(name);
+  buffer_ += nested.buffer_ + "}";
+  return *this;
+}
+
+void bench::JsonLine::Print() const {
+  std::cout << buffer_ << "}\n" << std::flush;
+}
@@ -0,0 +1,71 @@
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * bench_util.h
+ *
+ * This header file defines helpers shared by the headless benchmarks: a
+ * stopwatch, percentile summaries of timing samples, and a writer for the
+ * machine-readable results.
+ *
+ * Every benchmark prints a single JSON object per line (JSON Lines), so the
+ * output can be collected and compared between builds to catch regressions.
+ */
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// Returns the seconds elapsed since the specified start time.
+double SecondsSince(Clock::time_point start);
+
+// Prevents the compiler from optimizing away a computed value.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Percentiles {
+  double p50;
+  double p95;
+  double p99;
+  double max;
+  double mean;
+};
+
+// Summarizes the samples using the nearest-rank method. The samples are
+// sorted in place.
+Percentiles CalculatePercentiles(std::vector<double>* samples);
+
+// Builds a single line of JSON from name and value pairs.
+class JsonLine {
+ private:
+  std::string buffer_;
+
+  void AddName(const std::string& name);
+
+ public:
+  explicit JsonLine(const std::string& benchmark);
+
+  JsonLine& Add(const std::string& name, double value);
+  JsonLine& Add(const std::string& name, int64_t value);
+  JsonLine& Add(const std::string& name, int value);
+  JsonLine& Add(const std::string& name, bool value);
+  JsonLine& Add(const std::string& name, const std::string& value);
+  JsonLine& Add(const std::string& name, const char* value);
+
+  // Adds the percentiles as a nested object.
+  JsonLine& Add(const std::string& name, const Percentiles& percentiles);
+
+  // Writes the line to the standard output stream.
+  void Print() const;
+};
+
+}  // namespace bench
+
+#endif  // BENCH_UTIL_H_
@@ -5,7 +5,9 @@
 #include <cmath>
 #include <limits>
 
-#include "level_data.h"
+#include "distance_field.h"
+#include "entity_world.h"
+#include "level.h"
 #include "vector.h"
 
 /*
@@ -56,18 +58,78 @@ struct RayData {
   float distance;
   int wall_id;
   WallSide wall_side;
+
+  // Position of the hit along the wall in the range [0, 1], used as the
+  // horizontal texture coordinate. It is mirrored where needed, so textures
+  // read left to right on every side of a tile.
+  float wall_x;
+
+  // Number of iterations the DDA needed to hit the wall. Without empty-space
+  // skipping this is the number of tile sides crossed.
+  int num_steps;
+};
+
+// Number of rays traced together by the SIMD packet traversal.
+constexpr int kPacketSize = 8;
+
+// Results of several rays stored as a structure of arrays. The arrays are
+// owned by the caller and must hold at least as many elements as there are
+// rays.
+struct RayBatch {
+  float* distance;
+  int* wall_id;
+  WallSide* wall_side;
+  float* wall_x;
+  int* num_steps;
 };
 
 // Data required for the DDA algorithm is separated for the X and Y axes.
 // This data is used to calculate distances to tile sides during the algorithm's
 // execution.
+//
+// The distance to a tile side is calculated from the number of sides crossed
+// (init_dist + num_crossed * delta_dist) rather than accumulated step by step.
+// That way the DDA can jump over several tiles at once and still arrive at
+// bit-identical distances.
 struct DDAData {
   int tile;
   int step;
   float delta_dist;
   float init_dist;
 
+  // Number of tile sides crossed along this axis and the distance to the next
+  // one.
+  int num_crossed = 0;
+  float side_dist;
+
   DDAData(float position, float ray_direction);
+
+  // Returns the distance to the side crossed after the specified number of
+  // other sides. Zero is handled separately, as multiplying an infinite delta
+  // by zero would give NaN.
+  float SideDist(int num_sides) const {
+    return num_sides == 0 ? init_dist : init_dist + num_sides * delta_dist;
+  }
+
+  // Moves to the next tile along this axis.
+  void Advance() {
+    tile += step;
+    ++num_crossed;
+    side_dist = SideDist(num_crossed);
+  }
+
+  // Moves over the specified number of tiles along this axis at once.
+  void Advance(int num_tiles) {
+    tile += step * num_tiles;
+    num_crossed += num_tiles;
+    side_dist = SideDist(num_crossed);
+  }
+
+  // Returns the distance to the last side crossed, which is where the ray
+  // hit the wall if the DDA ended on this axis.
+  float HitDist() const {
+    return SideDist(num_crossed - 1);
+  }
 };
 
 }  // namespace ray
@@ -77,6 +139,16 @@ class Camera {
   static constexpr float kMaxMovementSpeed = 2.5f;
   static constexpr float kMaxRotationSpeed = 1.5f;
 
+  const Level* level_;
+
+  // Optional acceleration structure used to skip over empty space.
+  const DistanceField* distance_field_ = nullptr;
+
+  // Optional entity the camera moves as, colliding with the walls and the
+  // other entities of its world.
+  EntityWorld* entity_world_ = nullptr;
+  int entity_ = 0;
+
   float plane_length_;
 
   Vector position_;
@@ -90,7 +162,8 @@ class Camera {
   float rotation_speed_ = 0.0f;
 
  public:
-  Camera(float x, float y, float angle, float fov);
+  // The camera keeps a reference to the level, which must outlive it.
+  Camera(const Level& level, float x, float y, float angle, float fov);
 
   // Updates the camera plane to be a vector perpendicular to the camera's
   // direction and ensures it has the specified plane length.
@@ -100,6 +173,19 @@ class Camera {
   Vector Position() const;
   Vector Direction() const;
   Vector Plane() const;
+  const Level& GetLevel() const;
+  const DistanceField* GetDistanceField() const;
+
+  // Enables empty-space skipping with the distance field of the camera's
+  // level, or disables it if the field is null. The field must outlive the
+  // camera. Skipping changes only the number of DDA steps, never the result.
+  void SetDistanceField(const DistanceField* distance_field);
+
+  // Makes the camera move as the entity of the world, or as a point that
+  // collides with walls only if the world is null. The entity must be at the
+  // camera position, and the world must outlive the camera. Copies of the
+  // camera share the entity, so only one of them should move.
+  void SetEntity(EntityWorld* entity_world, int entity);
   motion::AccelState AccelState() const;
   motion::AccelDirection AccelDirection() const;
   float MovementSpeed() const;
@@ -119,6 +205,10 @@ class Camera {
   // direction.
   void SetRotationSpeed(motion::RotationDirection rotation_direction);
 
+  // Places the camera at the position, looking along the direction, which
+  // must be a unit vector. Used to interpolate between simulated states.
+  void SetPose(const Vector& position, const Vector& direction);
+
   // Updates the camera's position, direction, and plane based on the current
   // movement and rotation speeds, scaled by frame time to maintain consistent
   // behavior.
@@ -127,6 +217,14 @@ class Camera {
   // Performs the DDA algorithm and returns ray information, including distance
   // to the wall, the wall ID, and the side (X or Y) that was hit.
   raycasting::RayData CalculateRay(float plane_scalar) const;
+
+  // Performs the DDA algorithm for count rays at once and stores the results
+  // in the batch. Rays are traced in packets of kPacketSize SIMD lanes when
+  // the CPU supports AVX2 and no distance field is set, otherwise one by one.
+  // Both paths return exactly the same results as CalculateRay.
+  void CalculateRays(const float* plane_scalars,
+                     int count,
+                     raycasting::RayBatch* out) const;
 };
 
 #endif  // CAMERA_H_
@@ -0,0 +1,121 @@
+#ifndef DEPTH_SCANNER_H_
+#define DEPTH_SCANNER_H_
+
+#include <vector>
+
+#include "camera.h"
+#include "distance_field.h"
+#include "level.h"
+#include "thread_pool.h"
+
+/*
+ * depth_scanner.h
+ *
+ * This header file defines the DepthScanner class, which casts the depth
+ * scans of many agents at once, like a lidar mounted on each of them.
+ *
+ * Every agent casts the same fan of rays, spread evenly over the field of
+ * view around its heading, or all the way around it. Angles are in radians,
+ * 0 facing +X and growing from +X toward +Y, like the angle of a Camera. A
+ * scan of less than a full turn has its first and last rays at the edges of
+ * the field of view. A full turn starts at the heading and leaves out the
+ * duplicate ray at its end.
+ *
+ * The rays of a scan are split into groups of raycasting::kPacketSize. Within
+ * a group, every ray direction is the direction to the middle of the group
+ * plus a multiple of its perpendicular, the form the SIMD packet traversal
+ * takes, so each group of an agent is traced as one packet. Groups wider than
+ * kMaxPacketAngle are traced ray by ray. Distances are converted from units
+ * of the ray direction's length to tiles, so they are the Euclidean distance
+ * from the agent to the wall.
+ *
+ * The tables of the scan pattern are kept from one scan to the next, and the
+ * results are written to arrays owned by the caller, so a scan allocates
+ * nothing unless the pattern grows.
+ */
+
+namespace sensing {
+
+// Field of view of a scan all the way around, 2 pi.
+constexpr float kFullTurn = 6.28318530718f;
+
+// Angle a group of rays traced as one packet may span at most.
+constexpr float kMaxPacketAngle = 2.0f;
+
+// Minimum number of agents handed to a thread at once.
+constexpr int kMinAgentChunk = 16;
+
+// Positions and headings of the agents, one element per agent.
+struct AgentPoses {
+  const float* x;
+  const float* y;
+  const float* heading;
+  int num_agents;
+};
+
+// Results of the rays of every agent, stored as a structure of arrays. The
+// rays of an agent are consecutive, so ray i of agent a is element
+// a * num_rays + i. The arrays are owned by the caller and must hold at least
+// num_agents * num_rays elements.
+struct ScanResults {
+  float* distance;
+  int* wall_id;
+  raycasting::WallSide* wall_side;
+};
+
+}  // namespace sensing
+
+class DepthScanner {
+ private:
+  const Level* level_;
+
+  // Optional acceleration structure used to skip over empty space.
+  const DistanceField* distance_field_ = nullptr;
+
+  float fov_ = 0.0f;
+  int num_rays_ = 0;
+
+  // Number of leading rays that are traced in packets. The rest are traced
+  // ray by ray.
+  int num_packet_rays_ = 0;
+
+  // Direction to the middle of the group of every ray, relative to a heading
+  // of 0, the multiple of the perpendicular added to it, and the length of
+  // the resulting ray direction.
+  std::vector<Vector> group_directions_;
+  std::vector<float> perpendicular_scalars_;
+  std::vector<float> direction_lengths_;
+
+  // Scans the agents in the range [agent_begin, agent_end).
+  void ScanAgents(const sensing::AgentPoses& poses,
+                  int agent_begin,
+                  int agent_end,
+                  const sensing::ScanResults& out) const;
+
+ public:
+  // The scanner keeps a reference to the level, which must outlive it.
+  explicit DepthScanner(const Level& level);
+
+  // Enables empty-space skipping with the distance field of the level, or
+  // disables it if the field is null. The field must outlive the scanner.
+  // Rays with skipping are traced one by one.
+  void SetDistanceField(const DistanceField* distance_field);
+
+  // Sets the field of view of the scans and the number of rays per agent.
+  // A field of view of kFullTurn or more scans all the way around.
+  void SetPattern(float fov, int num_rays);
+
+  float Fov() const;
+  int NumRays() const;
+
+  // Returns the angle of the ray relative to the heading of the agent.
+  float RayAngle(int ray) const;
+
+  // Casts the rays of every agent and stores the results. Agents are scanned
+  // on the threads of the pool, or on the calling thread if it is null.
+  void Scan(const sensing::AgentPoses& poses,
+            ThreadPool* thread_pool,
+            const sensing::ScanResults& out) const;
+};
+
+#endif  // DEPTH_SCANNER_H_
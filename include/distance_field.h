@@ -0,0 +1,63 @@
+#ifndef DISTANCE_FIELD_H_
+#define DISTANCE_FIELD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "level.h"
+
+/*
+ * distance_field.h
+ *
+ * This header file defines the DistanceField class, an acceleration structure
+ * for the DDA on large open maps.
+ *
+ * For every tile it stores the Chebyshev distance to the nearest wall, where
+ * tiles outside the level count as walls. A tile with distance d is the center
+ * of a square of (2d - 1) x (2d - 1) empty tiles, which a ray can cross in a
+ * single jump instead of one tile side at a time.
+ *
+ * When a tile of the level changes, only the tiles closer to it than
+ * kMaxDistance can change, and the nearest wall of each of them lies within
+ * kMaxDistance of it, so the field is updated by rerunning the transform on a
+ * window around the tile, whatever the size of the level.
+ */
+
+class DistanceField {
+ public:
+  // Distances are capped so they fit in a byte. Larger values would only
+  // allow longer jumps in maps with very large open areas.
+  static constexpr int kMaxDistance = 64;
+
+ private:
+  int width_;
+  int height_;
+
+  // Distances stored at x * height + y, like the level tiles.
+  std::vector<uint8_t> distances_;
+
+ public:
+  // Builds the distance field of the level with two raster passes.
+  explicit DistanceField(const Level& level);
+
+  // Updates the distances after the tile of the level changed. Reruns the
+  // transform on at most (4 * kMaxDistance - 1)^2 tiles.
+  void Update(const Level& level, int x, int y);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  // Returns the distance of the tile to the nearest wall, or 0 for tiles
+  // outside the level. Defined here so the DDA loop can inline it.
+  int At(int x, int y) const {
+    if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+        static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+      return 0;
+    }
+
+    return distances_[static_cast<size_t>(x) * height_ + y];
+  }
+};
+
+#endif  // DISTANCE_FIELD_H_
@@ -0,0 +1,120 @@
+#ifndef ENTITY_WORLD_H_
+#define ENTITY_WORLD_H_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "level.h"
+#include "tile_collision.h"
+#include "vector.h"
+
+/*
+ * entity_world.h
+ *
+ * This header file defines the EntityWorld class, which moves round bodies
+ * through a level, colliding them with the walls and with each other.
+ *
+ * Every entity is a circle. Entities are binned by the level tile their
+ * center lies in, in a spatial hash: the tile coordinates are hashed to one
+ * of a power-of-two number of buckets, and the entities of a bucket form a
+ * doubly linked list threaded through the entity arrays. The hash grows with
+ * the number of entities rather than with the level, and an entity that
+ * moves to another tile is unlinked from one bucket and linked into another
+ * in constant time, without allocating.
+ *
+ * As no radius exceeds kMaxRadius, half a tile, two entities can only overlap
+ * if their tiles are neighbors, so finding the entities near a point visits
+ * only a few tiles, however many entities there are in total.
+ */
+
+class EntityWorld {
+ public:
+  // Largest radius of an entity, in tiles.
+  static constexpr float kMaxRadius = 0.5f;
+
+  // The world keeps a reference to the level, which must outlive it.
+  explicit EntityWorld(const Level& level);
+
+  // Adds an entity of the radius centered at the position and returns its
+  // index. Radii larger than kMaxRadius are clamped to it. Indices are
+  // assigned in order, starting at zero. Adding may grow the hash, which
+  // allocates.
+  int Add(const Vector& position, float radius);
+
+  int NumEntities() const;
+  Vector Position(int entity) const;
+  float Radius(int entity) const;
+
+  // Number of times an entity moved to another tile.
+  int64_t NumRebins() const;
+
+  // Moves the entity by the offset. The entity slides along the walls it
+  // runs into, then is pushed out of every entity it overlaps, which stay
+  // where they are.
+  void Move(int entity, const Vector& offset);
+
+  // Calls the callback with the index of every entity whose circle overlaps
+  // the circle of the radius centered at the position.
+  template <typename Callback>
+  void ForEachNear(const Vector& position,
+                   float radius,
+                   Callback&& callback) const;
+
+ private:
+  // Index of no entity, which ends a bucket list.
+  static constexpr int kNone = -1;
+
+  const Level* level_;
+
+  // Entity state, one element per entity.
+  std::vector<Vector> positions_;
+  std::vector<float> radii_;
+  std::vector<int> tile_x_;
+  std::vector<int> tile_y_;
+
+  // Neighbors of every entity in the list of its bucket.
+  std::vector<int> next_;
+  std::vector<int> previous_;
+
+  // First entity of every bucket.
+  std::vector<int> bucket_heads_;
+  uint32_t bucket_mask_ = 0;
+
+  int64_t num_rebins_ = 0;
+
+  int Bucket(int tile_x, int tile_y) const;
+  void Link(int entity);
+  void Unlink(int entity);
+
+  // Rebuilds the hash with the specified number of buckets.
+  void Rehash(int num_buckets);
+};
+
+template <typename Callback>
+void EntityWorld::ForEachNear(const Vector& position,
+                              float radius,
+                              Callback&& callback) const {
+  const float reach = radius + kMaxRadius;
+  const int first_x = static_cast<int>(std::floor(position.x - reach));
+  const int last_x = static_cast<int>(std::floor(position.x + reach));
+  const int first_y = static_cast<int>(std::floor(position.y - reach));
+  const int last_y = static_cast<int>(std::floor(position.y + reach));
+
+  for (int x = first_x; x <= last_x; ++x) {
+    for (int y = first_y; y <= last_y; ++y) {
+      // Tiles that share the bucket are skipped, so every entity is visited
+      // once, from its own tile.
+      for (int entity = bucket_heads_[Bucket(x, y)]; entity != kNone;
+           entity = next_[entity]) {
+        if (tile_x_[entity] == x && tile_y_[entity] == y &&
+            collision::CirclesOverlap(positions_[entity], radii_[entity],
+                                      position, radius)) {
+          callback(entity);
+        }
+      }
+    }
+  }
+}
+
+#endif  // ENTITY_WORLD_H_
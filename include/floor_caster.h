@@ -0,0 +1,51 @@
+#ifndef FLOOR_CASTER_H_
+#define FLOOR_CASTER_H_
+
+#include "camera.h"
+#include "frame_buffer.h"
+#include "lightmap.h"
+#include "renderer.h"
+#include "texture_atlas.h"
+
+/*
+ * floor_caster.h
+ *
+ * This header file declares the floor and ceiling casting stage of the CPU
+ * renderer.
+ *
+ * Every point of the floor seen on one screen row is at the same distance, so
+ * the world position under the row varies linearly between the rays through
+ * the left and right screen edges (Camera::Direction() -/+ Camera::Plane()).
+ * A row is therefore set up once and then walked with a constant texture
+ * coordinate step in 16.16 fixed point, eight pixels at a time with AVX2 if
+ * available. The ceiling row mirrored across the horizon is at the same
+ * distance and samples the same texture coordinates, so both are drawn in one
+ * pass.
+ *
+ * With a Lightmap, a lit row is drawn in blocks of pixels. The light of the
+ * floor texels under a block is looked up into a buffer on the stack first,
+ * only once per floor texel the row crosses, and multiplies the floor and
+ * ceiling pixels, so lighting does not allocate. Lights
+ * hang at half the wall height, so the ceiling above a tile receives the
+ * same light as the floor below it.
+ */
+
+namespace rendering {
+
+// Draws the floor for the lower-half rows in the range [y_begin, y_end) and
+// the ceiling for the mirrored upper-half rows, skipping pixels covered by
+// the wall segments in the column buffers. A row exactly at the horizon of a
+// screen with an odd height is infinitely far away and gets the flat floor
+// color. If the lightmap is not null, it lights the floor and ceiling.
+void RenderFloorAndCeiling(
+    const Camera& camera,
+    const TextureAtlas& texture_atlas,
+    const Lightmap* lightmap,
+    const ColumnBuffers& column_buffers,
+    int y_begin,
+    int y_end,
+    FrameBuffer* frame_buffer);
+
+}  // namespace rendering
+
+#endif  // FLOOR_CASTER_H_
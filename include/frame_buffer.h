@@ -0,0 +1,45 @@
+#ifndef FRAME_BUFFER_H_
+#define FRAME_BUFFER_H_
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * frame_buffer.h
+ *
+ * This header file defines the FrameBuffer class, a contiguous block of
+ * ARGB8888 pixels owned by the process.
+ *
+ * The renderer draws the floor, ceiling and walls into it on the CPU, and the
+ * finished frame is uploaded to the screen with a single texture update.
+ */
+
+class FrameBuffer {
+ private:
+  int width_;
+  int height_;
+
+  // Pixels are stored row by row, each one packed as 0xAARRGGBB.
+  std::vector<uint32_t> pixels_;
+
+ public:
+  FrameBuffer(int width, int height);
+
+  // Basic getters that simply return the current value.
+  int Width() const;
+  int Height() const;
+  uint32_t* Pixels();
+  const uint32_t* Pixels() const;
+
+  // Returns the number of bytes between the starts of two consecutive rows.
+  int Pitch() const;
+
+  // Fills the rows in the range [y_begin, y_end) with the specified color.
+  void FillRows(int y_begin, int y_end, uint32_t color);
+
+  // Draws a vertical line in column x from y_begin to y_end (both inclusive),
+  // matching the endpoints of SDL_RenderDrawLine.
+  void DrawColumn(int x, int y_begin, int y_end, uint32_t color);
+};
+
+#endif  // FRAME_BUFFER_H_
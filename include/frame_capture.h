@@ -0,0 +1,153 @@
+#ifndef FRAME_CAPTURE_H_
+#define FRAME_CAPTURE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_buffer.h"
+
+/*
+ * frame_capture.h
+ *
+ * This header file defines the FrameCapture class, which records the
+ * finished frames of a session to an uncompressed video file without
+ * slowing down the render loop.
+ *
+ * The render thread only copies every frame into the next of kNumBuffers
+ * buffers allocated up front, which form a ring shared with a writer thread
+ * without locks. The writer thread converts the frames and writes them to
+ * the file in order. If the disk falls behind and every buffer still holds a
+ * frame waiting to be written, the new frame is dropped and counted instead
+ * of waiting.
+ *
+ * Files are written as YUV4MPEG2 (Y4M) at a nominal kFrameRate frames per
+ * second, with BT.601 limited range 4:2:0 planes whose chroma is the average
+ * of every 2 x 2 block of pixels, or as raw RGB24 frames, one after the
+ * other, if the path ends in .rgb. Frames smaller than the capture size,
+ * rendered by the resolution scaler, are scaled up to it with the nearest
+ * pixel. The RGB to YUV conversion runs eight pixels at a time with AVX2 if
+ * available.
+ */
+
+namespace capture {
+
+// Returns the size in bytes of the Y, U and V planes of a 4:2:0 frame of the
+// specified size. Odd sizes round the chroma planes up.
+size_t I420Size(int width, int height);
+
+// Converts 0xAARRGGBB pixels to BT.601 limited range Y, U and V planes,
+// stored one after the other in the output. Uses AVX2 if available.
+void ConvertToI420(const uint32_t* pixels,
+                   int width,
+                   int height,
+                   uint8_t* out);
+
+// Same as above, one pixel at a time.
+void ConvertToI420Scalar(const uint32_t* pixels,
+                         int width,
+                         int height,
+                         uint8_t* out);
+
+// Same as above, eight pixels at a time, with the same results. Must only
+// be called if raycasting::HasAVX2() returns true.
+void ConvertToI420AVX2(const uint32_t* pixels,
+                       int width,
+                       int height,
+                       uint8_t* out);
+
+}  // namespace capture
+
+class FrameCapture {
+ public:
+  // Frames that may wait for the writer thread at once.
+  static constexpr int kNumBuffers = 8;
+
+  // Frame rate written to the Y4M header. Frames are written as they come,
+  // so the real rate of a session may differ.
+  static constexpr int kFrameRate = 60;
+
+ private:
+  enum class Format { kY4M, kRawRGB };
+
+  // How often the writer thread checks for a new frame while idle.
+  static constexpr std::chrono::milliseconds kPollInterval{2};
+
+  // A frame copied by the render thread, no larger than the capture size.
+  struct Slot {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels;
+  };
+
+  int width_;
+  int height_;
+  Format format_ = Format::kY4M;
+  std::ofstream file_;
+
+  Slot slots_[kNumBuffers];
+
+  // Number of frames submitted and written so far. Frame i is held by slot
+  // i % kNumBuffers from its submission until it is written. Each counter is
+  // advanced by one thread only, on its own cache line.
+  alignas(64) std::atomic<int64_t> num_submitted_{0};
+  alignas(64) std::atomic<int64_t> num_written_{0};
+
+  // Owned by the render thread.
+  alignas(64) int64_t num_dropped_ = 0;
+
+  std::atomic<bool> write_failed_{false};
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+
+  // Owned by the writer thread: the frame scaled up to the capture size and
+  // the converted frame.
+  std::vector<uint32_t> scaled_;
+  std::vector<uint8_t> output_;
+
+  void Run();
+
+  // Converts the frame and writes it to the file.
+  void WriteFrame(const Slot& slot);
+
+ public:
+  // Captures frames of the specified size. All buffers are allocated here.
+  FrameCapture(int width, int height);
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  // Creates the file and writes its header. Returns false and sets the error
+  // message if the file could not be written.
+  bool Open(const std::string& path, std::string* error);
+
+  // Starts writing on a separate thread, or stops after every frame
+  // submitted so far has been written.
+  void Start();
+  void Stop();
+
+  // Stops writing and closes the file. Returns false and sets the error
+  // message if a frame could not be written.
+  bool Close(std::string* error);
+
+  // Copies the frame for the writer thread without waiting. Returns false
+  // and counts the frame as dropped if every buffer is still waiting to be
+  // written or the frame is larger than the capture size. Must always be
+  // called from the same thread.
+  bool Submit(const FrameBuffer& frame);
+
+  // Returns the number of frames written to the file so far.
+  int64_t NumWritten() const;
+
+  // Returns the number of frames dropped so far. Must be called from the
+  // thread submitting the frames.
+  int64_t NumDropped() const;
+};
+
+#endif  // FRAME_CAPTURE_H_
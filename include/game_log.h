@@ -1,21 +1,34 @@
 #ifndef GAME_LOG_H_
 #define GAME_LOG_H_
 
-#include <iostream>
-#include <iomanip>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <thread>
 
 #include "vector.h"
 #include "camera.h"
+#include "profiler.h"
+#include "triple_buffer.h"
 
 /*
  * game_log.h
  *
  * This header defines logging utilities for the game, including formatting
- * and outputting game-related data such as frame timing, camera state.
+ * and outputting game-related data such as frame timing, camera state and
+ * the latency percentiles of every frame stage.
  *
  * It supports various data types like floats, vectors, and enumerations,
  * using escape codes for terminal formatting to enhance readability.
+ *
+ * The render loop only copies a Snapshot of the game state into a lock-free
+ * slot. A GameLogWriter thread formats the latest snapshot into a fixed
+ * buffer, with every escape sequence precomputed, and writes it to the
+ * terminal. Formatting never allocates, and a slow terminal never stalls a
+ * frame.
  */
 
 namespace escape_codes {
@@ -32,27 +45,30 @@ enum class DisplayMode {
   kBrightGreenFg = 92,
   kBrightYellowFg = 93,
   kBrightBlueFg = 94,
+  kBrightMagentaFg = 95,
   kBrightWhiteFg = 97,
 
   kBlackBg = 40
 };
 
 // Control Sequence Introducer ESC [
-const std::string kCSI = "\033[";
+constexpr std::string_view kCSI = "\033[";
 
 // ANSI escape sequences for clearing display or line content.
-const std::string kEraseInDisplay = kCSI + 'J';
-const std::string kEraseInLine = kCSI + 'K';
+constexpr std::string_view kEraseInDisplay = "\033[J";
+constexpr std::string_view kEraseInLine = "\033[K";
 
 // ANSI escape sequences for showing and hiding the cursor.
-const std::string kShowTheCursor = kCSI + "?25h";
-const std::string kHideTheCursor = kCSI + "?25l";
+constexpr std::string_view kShowTheCursor = "\033[?25h";
+constexpr std::string_view kHideTheCursor = "\033[?25l";
 
-// Moves the cursor up by a specified number of cells.
-std::string CursorUp(int num_cells);
+// Returns the ANSI escape sequence that sets the text graphic rendition to the
+// specified display mode. The sequences are string literals, so this never
+// allocates.
+std::string_view GraphicRendition(DisplayMode display_mode);
 
-// Returns an ANSI escape sequence to set text graphic rendition based on the
-// specified display mode.
+// Returns a copy of GraphicRendition(display_mode), for building messages
+// outside the game log.
 std::string SelectGraphicRendition(DisplayMode display_mode);
 
 }  // namespace escape_codes
@@ -60,42 +76,141 @@ std::string SelectGraphicRendition(DisplayMode display_mode);
 namespace game_log {
 
 // Right-Pointing Double Angle Quotation Mark »
-const std::string kLogEntrySeperator = u8"\u00BB";
+constexpr std::string_view kLogEntrySeperator = u8"\u00BB";
 
 constexpr int kDecimalPlaces = 2;
 constexpr int kNumberFieldWidth = 5;
 constexpr int kHeaderFieldWidth = 15;
 
-struct LogEntry {
-  std::string header;
-  std::string value;
+// Statistics about how frames are rendered.
+struct RenderStats {
+  // Number of threads that render a frame, including the main thread.
+  int num_threads;
+
+  // How many times faster a frame renders on all threads than on the main
+  // thread alone, or 0 if it is not measured.
+  float speedup;
+
+  // Share of the screen columns whose rays were cast in the latest frame,
+  // rather than reused from the frame before.
+  float recast_fraction;
+
+  // Scale of the window size the latest frame rendered at.
+  float resolution_scale;
+
+  // Number of frames the capture dropped so far because the file writer fell
+  // behind.
+  int64_t dropped_frames;
+
+  // Latency percentiles of the latest frames, one summary per stage.
+  profiling::StageSummary stages[profiling::kNumStages];
+};
+
+// State of the game at one moment, copied by value to the log thread.
+struct Snapshot {
+  float frame_time;
+
+  Vector position;
+  Vector direction;
+  Vector plane;
+
+  motion::AccelState accel_state;
+  motion::AccelDirection accel_direction;
+  float movement_speed;
+  float rotation_speed;
+
+  RenderStats render_stats;
 };
 
-// Returns a formatted string representation of a float value.
-// The number is formatted in fixed-point notation with a specified number of
-// decimal places, justified within a defined field width.
-std::string FloatToString(float number);
+// Returns the snapshot of the camera state, the frame time and the render
+// statistics.
+Snapshot TakeSnapshot(
+    float frame_time,
+    const Camera& camera,
+    const RenderStats& render_stats);
+
+// Text buffer of a fixed size, which never allocates. Text that does not fit
+// is cut off.
+class LogBuffer {
+ public:
+  // Large enough for the whole game log with all its escape sequences.
+  static constexpr size_t kCapacity = 4096;
 
-// Returns a formatted string representation of a vector in the format:
-// ([x], [y]).
-std::string VectorToString(const Vector& vector);
+  void Clear() { size_ = 0; }
 
-std::string AccelStateToString(motion::AccelState accel_state);
-std::string AccelDirectionToString(motion::AccelDirection accel_direction);
+  void Append(std::string_view text);
 
-// Returns a formatted string representation of a log entry.
-// The format includes a header styled with bold and a specified color, followed
-// by a separator and a value styled in bright white.
-std::string GenerateLogEntry(
-    escape_codes::DisplayMode header_color_fg,
-    const LogEntry& log_entry);
+  // Appends the number padded to kNumberFieldWidth, with kDecimalPlaces
+  // decimal places and the sign in front of the padding.
+  void AppendFloat(float number);
 
-// Outputs game log entries to the standard output stream.
-// This function retrieves various game-related data (such as frame time and
-// camera state), formats it appropriately, and displays it in a readable format
-// using ANSI escape sequences.
-void OutputGameLog(float frame_time, const Camera& camera);
+  void AppendInt(int number);
+
+  // Appends the vector in the format: ([x], [y]).
+  void AppendVector(const Vector& vector);
+
+  // Appends the percentiles of a stage in the format:
+  // [p50] / [p95] / [p99] / [max] ms.
+  void AppendStageSummary(const profiling::StageSummary& summary);
+
+  std::string_view View() const { return { bytes_.data(), size_ }; }
+
+ private:
+  std::array<char, kCapacity> bytes_;
+  size_t size_ = 0;
+};
+
+std::string_view AccelStateToString(motion::AccelState accel_state);
+std::string_view AccelDirectionToString(motion::AccelDirection accel_direction);
+
+// Formats the game log of the snapshot into the buffer, replacing its
+// contents. Every log entry has a header styled with bold and a color,
+// followed by a separator and a value styled in bright white. The output
+// ends by moving the cursor back to the start of the log, so the next log
+// overwrites it in place.
+void FormatGameLog(const Snapshot& snapshot, LogBuffer* buffer);
 
 }  // namespace game_log
 
+// Writes the game log to the standard output stream on its own thread.
+class GameLogWriter {
+ private:
+  // How often the thread checks for a new snapshot.
+  static constexpr std::chrono::milliseconds kPollInterval{10};
+
+  // Number of latest frames the stage percentiles are taken from.
+  static constexpr int kProfileFrames = 1024;
+
+  TripleBuffer<game_log::Snapshot> snapshots_;
+
+  // Optional profiler whose stage percentiles are added to every log.
+  profiling::Profiler* profiler_;
+
+  // Owned by the writer thread.
+  game_log::LogBuffer buffer_;
+
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+
+  void Run();
+
+ public:
+  // If the profiler is not null, the writer thread summarizes its stages for
+  // every log, so nothing else may summarize them while the writer runs.
+  explicit GameLogWriter(profiling::Profiler* profiler);
+  ~GameLogWriter();
+
+  GameLogWriter(const GameLogWriter&) = delete;
+  GameLogWriter& operator=(const GameLogWriter&) = delete;
+
+  // Starts or stops writing on a separate thread.
+  void Start();
+  void Stop();
+
+  // Hands a snapshot to the writer thread without waiting. Snapshots posted
+  // faster than they are written are skipped. Must always be called from the
+  // same thread.
+  void Post(const game_log::Snapshot& snapshot);
+};
+
 #endif
@@ -0,0 +1,127 @@
+#ifndef LEVEL_H_
+#define LEVEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * level.h
+ *
+ * This header file defines the Level class, the grid of tiles the camera moves
+ * through and casts rays against, along with functions to load levels at
+ * runtime.
+ *
+ * Levels are stored in a compact binary format that is memory-mapped from
+ * disk, so even very large maps load without parsing. All values are little
+ * endian:
+ *
+ *   offset  0  char[4]   magic "RCLV"
+ *   offset  4  uint32    format version (1)
+ *   offset  8  uint32    width
+ *   offset 12  uint32    height
+ *   offset 16  uint8[]   width * height tile IDs, tile (x, y) at x * height + y
+ *
+ * A text importer reads the layout used by level_data.h: one line per X
+ * coordinate, with tile IDs separated by whitespace or commas.
+ */
+
+class Level {
+ public:
+  // Tiles outside the level read as this wall, so rays and collisions stop at
+  // the edge of a map that has no border wall of its own.
+  static constexpr int kOutOfBoundsTile = 1;
+
+  // Largest supported number of tiles. Tile indices must fit in a signed
+  // 32-bit integer for the SIMD traversal.
+  static constexpr int64_t kMaxNumTiles = INT32_MAX;
+
+ private:
+  int width_ = 0;
+  int height_ = 0;
+  const uint8_t* tiles_ = nullptr;
+
+  // Backing storage of the tiles, either owned by the level or mapped from a
+  // file.
+  std::vector<uint8_t> owned_tiles_;
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+  void Release();
+
+ public:
+  Level() = default;
+
+  // Creates a level that owns the specified tiles, stored at x * height + y.
+  Level(int width, int height, std::vector<uint8_t> tiles);
+
+  // Creates a level that views tiles inside a memory mapping and unmaps it
+  // when destroyed.
+  Level(int width, int height, void* mapping, size_t mapping_size,
+        size_t tiles_offset);
+
+  ~Level();
+
+  Level(Level&& other) noexcept;
+  Level& operator=(Level&& other) noexcept;
+  Level(const Level&) = delete;
+  Level& operator=(const Level&) = delete;
+
+  // Basic getters that simply return the current value.
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+  const uint8_t* Tiles() const { return tiles_; }
+
+  // Returns true if the tile lies inside the level. Negative coordinates wrap
+  // around to large unsigned values, so one comparison per axis suffices.
+  bool Contains(int x, int y) const {
+    return static_cast<unsigned>(x) < static_cast<unsigned>(width_) &&
+           static_cast<unsigned>(y) < static_cast<unsigned>(height_);
+  }
+
+  // Returns the ID of the tile, or kOutOfBoundsTile outside the level.
+  // Defined here so the DDA loop can inline it.
+  int At(int x, int y) const {
+    if (!Contains(x, y)) return kOutOfBoundsTile;
+
+    return tiles_[static_cast<size_t>(x) * height_ + y];
+  }
+
+  // Returns true if the tile is a wall, including tiles outside the level.
+  bool IsSolid(int x, int y) const { return At(x, y) != 0; }
+
+  // Sets the ID of a tile inside the level and ignores tiles outside it. A
+  // level mapped from a file is copied into memory of its own on the first
+  // change, which leaves the file untouched. No other thread may read the
+  // level meanwhile (see LevelEditor).
+  void SetTile(int x, int y, uint8_t tile);
+};
+
+namespace level {
+
+// Creates a level from the layout compiled into level_data.h.
+Level BuiltinLevel();
+
+// Memory-maps a level in the binary format. Only the header is read, the
+// tiles are paged in as rays touch them.
+bool LoadBinaryLevel(const std::string& path, Level* level, std::string* error);
+
+// Parses a level in the text format.
+bool ImportTextLevel(const std::string& path, Level* level, std::string* error);
+
+// Loads a level in either format, telling them apart by the magic number.
+bool LoadLevel(const std::string& path, Level* level, std::string* error);
+
+// Writes the level in the binary format.
+bool SaveBinaryLevel(const Level& level,
+                     const std::string& path,
+                     std::string* error);
+
+// Returns the 64-bit FNV-1a hash of the width, the height and the tiles of
+// the level, which identifies the layout data derived from it was built for.
+uint64_t HashLevel(const Level& level);
+
+}  // namespace level
+
+#endif  // LEVEL_H_
@@ -0,0 +1,170 @@
+#ifndef LEVEL_EDITOR_H_
+#define LEVEL_EDITOR_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "distance_field.h"
+#include "entity_world.h"
+#include "level.h"
+#include "lightmap.h"
+#include "tiled_level.h"
+#include "thread_pool.h"
+#include "visibility_set.h"
+
+/*
+ * level_editor.h
+ *
+ * This header file defines the LevelEditor class, which changes the tiles of
+ * a level while the game runs: walls that are built or knocked down, and
+ * doors that slide open and shut.
+ *
+ * Edits may be requested from any thread and are queued. The render thread
+ * applies them between two frames, when the threads of the pool wait for the
+ * next frame, and writes the tiles while holding the mutex the simulation
+ * holds during its ticks (Simulation::LevelMutex), so no thread ever reads a
+ * tile while it changes. The pool hands every frame to its threads through
+ * its own synchronization, which publishes the new tiles to them.
+ *
+ * A tiled copy of the level, with its occupancy bitset, gets every changed
+ * tile along with the level, under the same mutex. The structures derived
+ * from the level are updated around every tile that changed between empty
+ * and solid instead of being rebuilt: the distance field within
+ * DistanceField::kMaxDistance of the tile, the visible sets of the tiles that
+ * see it and the light baked within the range of the lights that reach it. At
+ * most kMaxChangesPerApply tiles change per frame, which bounds what a frame
+ * pays for edits; the others wait for the next frames.
+ *
+ * A door is a wall tile with an open fraction, from 0 when shut to 1 when
+ * open, that moves by kDoorSpeed per second. It stays a wall, which blocks
+ * rays and bodies, until it is fully open, and becomes one again as soon as
+ * it starts to close. Meanwhile the renderer draws it as a panel on the
+ * faces of the tile, slid aside by the open fraction, and the visible sets
+ * see through it from the moment it starts to open. A tile is never made
+ * solid while a body of the entity world overlaps it, so a closing door
+ * stays open until whoever stands in it has left, and a new wall waits until
+ * its tile is clear.
+ */
+
+class LevelEditor {
+ public:
+  // Open fraction a door moves by per second.
+  static constexpr float kDoorSpeed = 2.0f;
+
+  // Most tiles changed by one call to ApplyEdits.
+  static constexpr int kMaxChangesPerApply = 16;
+
+ private:
+  // An edit requested by any thread.
+  struct Edit {
+    enum class Type { kSetTile, kOpenDoor, kCloseDoor } type;
+    int x;
+    int y;
+    uint8_t tile;
+  };
+
+  struct Door {
+    int x;
+    int y;
+
+    // ID of the tile while the door blocks.
+    uint8_t wall;
+
+    float open_fraction;
+    bool opening;
+  };
+
+  // A tile to change, for a tile edit or for the door of the index.
+  struct Change {
+    int x;
+    int y;
+    uint8_t tile;
+    int door;
+  };
+
+  Level* level_;
+  TiledLevel* tiled_level_ = nullptr;
+  DistanceField* distance_field_ = nullptr;
+  VisibilitySet* visibility_set_ = nullptr;
+  Lightmap* lightmap_ = nullptr;
+  const EntityWorld* entity_world_ = nullptr;
+
+  // Edits requested since the last ApplyEdits. Edits are rare, so a mutex
+  // held only to append or take them is enough here.
+  std::mutex edit_mutex_;
+  std::vector<Edit> pending_edits_;
+
+  // State owned by the render thread: the edits still to apply, oldest
+  // first, the doors and the tiles changed by the current call.
+  std::vector<Edit> edits_;
+  std::vector<Door> doors_;
+  std::vector<Change> changes_;
+  std::vector<Change> changed_solidity_;
+
+  // Doors that started to open in the current call, and doors partly open
+  // after it.
+  std::vector<int> opened_doors_;
+  int num_moving_doors_ = 0;
+
+  int64_t num_changes_ = 0;
+
+  void QueueEdit(const Edit& edit);
+
+  // Returns the index of the door of the tile, or -1 if it has none.
+  int FindDoor(int x, int y) const;
+
+  // Returns true if a body of the entity world overlaps the tile.
+  bool Occupied(int x, int y) const;
+
+ public:
+  // The editor keeps a pointer to the level, which must outlive it.
+  explicit LevelEditor(Level* level);
+
+  // Sets the structures updated along with the level, or none if null. They
+  // must have been built for the level and outlive their use.
+  void SetTiledLevel(TiledLevel* tiled_level);
+  void SetDistanceField(DistanceField* distance_field);
+  void SetVisibilitySet(VisibilitySet* visibility_set);
+  void SetLightmap(Lightmap* lightmap);
+
+  // Sets the world whose bodies tiles are never made solid over, or none if
+  // null. It is only read while holding the mutex passed to ApplyEdits.
+  void SetEntityWorld(const EntityWorld* entity_world);
+
+  // Queues setting the ID of a tile, which removes its door, if any. May be
+  // called from any thread.
+  void SetTile(int x, int y, uint8_t tile);
+
+  // Queue opening or closing the door of a tile. A wall tile without a door
+  // first becomes a shut door, other tiles are left alone. May be called from
+  // any thread.
+  void OpenDoor(int x, int y);
+  void CloseDoor(int x, int y);
+
+  // Applies the queued edits and moves the doors by the elapsed time. Tiles
+  // are written while holding the level mutex, if not null, and the
+  // structures are updated afterwards, on the threads of the pool, or on the
+  // calling thread if it is null. Must be called from one thread, while no
+  // other thread reads the structures. Returns the number of tiles changed
+  // plus the number of doors that started to open, which change what can be
+  // seen without changing a tile.
+  int ApplyEdits(float elapsed_seconds,
+                 std::mutex* level_mutex,
+                 ThreadPool* thread_pool);
+
+  // Returns the open fraction of the door of the tile, or 0 if the tile has
+  // no door. May be called from any thread while no edits are applied.
+  float DoorOpenFraction(int x, int y) const;
+
+  // Returns the number of doors partly open, neither shut nor fully open,
+  // after the last ApplyEdits. Those are still walls, drawn as slid open by
+  // their open fraction. May be called from any thread while no edits are
+  // applied.
+  int NumMovingDoors() const;
+
+  // Returns the number of tiles changed so far.
+  int64_t NumChanges() const;
+};
+
+#endif  // LEVEL_EDITOR_H_
@@ -0,0 +1,237 @@
+#ifndef LIGHTMAP_H_
+#define LIGHTMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "level.h"
+#include "thread_pool.h"
+#include "vector.h"
+
+/*
+ * lightmap.h
+ *
+ * This header file defines point lights and the Lightmap class, the light
+ * baked from them onto every exposed wall face and floor tile of a level, so
+ * lighting a wall column at run time costs a single lookup.
+ *
+ * Lights hang at half the wall height, the height of the camera. A wall face
+ * receives light by the cosine between its normal and the direction to the
+ * light in the plane of the level, and the floor by the cosine between the
+ * vertical and the light half a tile above. Light falls off with
+ * (1 - distance / range)^2 and ends at the range of the light.
+ *
+ * A light is a disk of its radius, which casts soft shadows: every texel
+ * casts kShadowRays shadow rays to points spread over the disk with the
+ * line-of-sight DDA of the ray caster, and receives the share of the light
+ * whose rays reach it. Light outside the range of every light is the ambient
+ * light kAmbient, and so are the faces of walls that border other walls.
+ *
+ * Every wall face has kFaceTexels texels along RayData::wall_x and every
+ * floor tile kFloorTexels x kFloorTexels, all stored as 0x00RRGGBB where a
+ * channel of 255 draws the texture at full brightness. Texels are baked and
+ * stored only for the chunks of kChunkSize x kChunkSize tiles within the
+ * range of a light, so maps far larger than what the lights reach cost no
+ * memory beyond one index per chunk. Chunks are baked on all threads of the
+ * pool.
+ *
+ * When a tile of the level changes, Update bakes again the tiles within the
+ * range of the lights that reach it, whose shadows may have changed.
+ *
+ * The lightmap is cached in a file next to the level, along with the hash of
+ * the level and of the lights it was baked for. All values are little
+ * endian:
+ *
+ *   offset  0  char[4]    magic "RCLM"
+ *   offset  4  uint32     format version (1)
+ *   offset  8  uint32     width
+ *   offset 12  uint32     height
+ *   offset 16  uint64     level::HashLevel of the level
+ *   offset 24  uint64     lighting::HashLights of the lights
+ *   offset 32  uint32     number of lights
+ *   offset 36  uint32     number of baked chunks
+ *   offset 40  float[7][] every light as x, y, radius, range, red, green and
+ *                         blue
+ *   then       uint32[]   index of the baked chunk of every chunk, in the
+ *                         order of the level tiles, or 0xffffffff if none
+ *   then       uint32[]   texels of the baked chunks
+ */
+
+// A light in the level: a disk that lights up to its range.
+struct PointLight {
+  Vector position;
+
+  // Radius of the disk, which sets the softness of the shadows. At most
+  // half a tile, so a light in the middle of an empty tile is not in a wall.
+  float radius;
+
+  // Distance at which the light has fallen off to nothing.
+  float range;
+
+  // Light added per channel, from 0 to 1, at the light.
+  float red;
+  float green;
+  float blue;
+};
+
+namespace lighting {
+
+// Places the specified number of lights in the middle of empty tiles of the
+// level, with colors and ranges spread pseudo-randomly but the same on every
+// run. Returns fewer lights if the level has hardly any empty tiles.
+std::vector<PointLight> ScatterLights(const Level& level, int count);
+
+// Returns the 64-bit FNV-1a hash of the lights, which identifies the light
+// a lightmap was baked for.
+uint64_t HashLights(const std::vector<PointLight>& lights);
+
+// Multiplies every channel of the 0xAARRGGBB color by the channel of the
+// light, where 255 keeps the color. The result is opaque.
+inline uint32_t Modulate(uint32_t color, uint32_t light) {
+  const uint32_t red =
+      ((color >> 16 & 0xff) * ((light >> 16 & 0xff) + 1)) >> 8;
+  const uint32_t green =
+      ((color >> 8 & 0xff) * ((light >> 8 & 0xff) + 1)) >> 8;
+  const uint32_t blue = ((color & 0xff) * ((light & 0xff) + 1)) >> 8;
+
+  return 0xff000000 | red << 16 | green << 8 | blue;
+}
+
+}  // namespace lighting
+
+class Lightmap {
+ public:
+  // Faces of a wall tile, named after their normal. The face with the -X
+  // normal is hit by rays moving toward +X.
+  enum class Face { kNegativeX = 0, kPositiveX = 1, kNegativeY = 2,
+                    kPositiveY = 3 };
+
+  // Texels along every wall face and along each side of every floor tile.
+  static constexpr int kFaceTexels = 8;
+  static constexpr int kFloorTexels = 4;
+
+  // Shadow rays cast from every texel to every light that reaches it.
+  static constexpr int kShadowRays = 16;
+
+  // Tiles along each side of a chunk.
+  static constexpr int kChunkSize = 16;
+
+  // Light of every channel where no light reaches.
+  static constexpr uint32_t kAmbient = 64;
+
+ private:
+  // Texels of a tile: the four faces, in the order of Face, then the floor.
+  static constexpr int kTexelsPerTile =
+      4 * kFaceTexels + kFloorTexels * kFloorTexels;
+  static constexpr size_t kTexelsPerChunk =
+      static_cast<size_t>(kChunkSize) * kChunkSize * kTexelsPerTile;
+
+  static constexpr uint32_t kNoChunk = 0xffffffff;
+  static constexpr uint32_t kAmbientTexel =
+      kAmbient << 16 | kAmbient << 8 | kAmbient;
+
+  int width_ = 0;
+  int height_ = 0;
+  uint64_t level_hash_ = 0;
+  uint64_t lights_hash_ = 0;
+  std::vector<PointLight> lights_;
+
+  // Chunks along each axis of the level.
+  int chunks_x_ = 0;
+  int chunks_y_ = 0;
+
+  // Index of the baked chunk of every chunk, at chunk_x * chunks_y_ +
+  // chunk_y, or kNoChunk if no light reaches it.
+  std::vector<uint32_t> chunk_indices_;
+
+  // Texels of the baked chunks, kTexelsPerChunk each, with the tiles of a
+  // chunk in the order of the level tiles.
+  std::vector<uint32_t> texels_;
+
+  // Returns the texels of the tile, or null if the tile is outside the level
+  // or its chunk was not baked.
+  const uint32_t* TileTexels(int x, int y) const;
+  uint32_t* TileTexels(int x, int y);
+
+  // Bakes the tiles in the range [x_begin, x_end) x [y_begin, y_end) that
+  // lie in baked chunks, on the calling thread.
+  void BakeTiles(const Level& level,
+                 int x_begin,
+                 int x_end,
+                 int y_begin,
+                 int y_end);
+
+ public:
+  Lightmap() = default;
+
+  // Bakes the light of the lights onto the level. Chunks are baked on the
+  // threads of the pool, or on the calling thread if it is null.
+  Lightmap(const Level& level,
+           const std::vector<PointLight>& lights,
+           ThreadPool* thread_pool);
+
+  // Bakes again the tiles whose light may have changed after the tile of the
+  // level changed between empty and solid, on the threads of the pool, or on
+  // the calling thread if it is null. The level hash stays that of the level
+  // the lightmap was baked for.
+  void Update(const Level& level, int x, int y, ThreadPool* thread_pool);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  // Hashes of the level and the lights the lightmap was baked for.
+  uint64_t LevelHash() const { return level_hash_; }
+  uint64_t LightsHash() const { return lights_hash_; }
+
+  const std::vector<PointLight>& Lights() const { return lights_; }
+
+  // Number of chunks baked and size of their texels in bytes.
+  int NumBakedChunks() const;
+  size_t TexelSize() const { return texels_.size() * sizeof(uint32_t); }
+
+  // Returns the light of the face of the wall tile at the position along the
+  // face, as RayData::wall_x. Faces outside the level or the baked chunks
+  // get the ambient light.
+  uint32_t FaceLight(int x, int y, Face face, float wall_x) const;
+
+  // Returns the light of the floor at the position. Positions outside the
+  // level or the baked chunks get the ambient light.
+  uint32_t FloorLight(const Vector& position) const;
+
+  // Returns the light of the floor texel at the texel coordinates, with
+  // kFloorTexels texels along each side of a tile, as the floor caster walks
+  // them. Texels outside the level or the baked chunks get the ambient light.
+  uint32_t FloorTexelLight(int texel_x, int texel_y) const;
+
+  // Returns the light of the wall a ray cast from the position along the
+  // direction hit. The tile and face are recovered from the distance and
+  // wall_x of the ray data, so any of the ray casting paths can be used.
+  uint32_t WallLight(const Vector& position,
+                     const Vector& ray_direction,
+                     const raycasting::RayData& ray_data) const;
+
+  // Reads the lightmap from a cache file. Returns false and sets the error
+  // message if the file is missing or malformed.
+  bool Load(const std::string& path, std::string* error);
+
+  // Writes the lightmap to a cache file.
+  bool Save(const std::string& path, std::string* error) const;
+
+  // Loads the lightmap of the level and lights from the cache file, or bakes
+  // it if the file is missing, malformed or was baked for a different level
+  // or different lights, and writes the new lightmap back to the file. Sets
+  // rebuilt to true if the lightmap was baked. Returns false and sets the
+  // error message only if the file could not be written; the lightmap is
+  // valid either way.
+  bool LoadOrBuild(const Level& level,
+                   const std::vector<PointLight>& lights,
+                   const std::string& path,
+                   ThreadPool* thread_pool,
+                   bool* rebuilt,
+                   std::string* error);
+};
+
+#endif  // LIGHTMAP_H_
@@ -0,0 +1,74 @@
+#ifndef LINE_OF_SIGHT_H_
+#define LINE_OF_SIGHT_H_
+
+#include <cstdint>
+
+#include "distance_field.h"
+#include "level.h"
+#include "thread_pool.h"
+#include "vector.h"
+
+/*
+ * line_of_sight.h
+ *
+ * This header file declares the line-of-sight queries, which answer whether
+ * the straight segment between two points crosses a wall.
+ *
+ * A query walks the tiles of the segment with the same DDA as the ray caster,
+ * from the source toward the target, and stops at the first wall or at the
+ * tile of the target, whichever comes first. Unlike a cast ray, it never
+ * looks past the target. The tile of the source is not checked, so an agent
+ * standing right at a wall still sees away from it.
+ *
+ * With a distance field, a query ends as soon as the target lies in the
+ * square of empty tiles around the current tile, as the segment from there
+ * on stays inside that square. Queries that share a source look up the
+ * square around the source once for the whole run of them, and targets
+ * inside it are answered without any traversal.
+ */
+
+namespace sensing {
+
+// Number of query results packed into one word of the result bitset.
+constexpr int kQueriesPerWord = 64;
+
+// Minimum number of result words handed to a thread at once.
+constexpr int kMinSightWordChunk = 4;
+
+// Points of every query, one element per query. Queries that share a source
+// should be consecutive, so the source is looked up once for all of them.
+struct SightQueries {
+  const float* source_x;
+  const float* source_y;
+  const float* target_x;
+  const float* target_y;
+  int num_queries;
+};
+
+// Returns the number of words of the result bitset of the queries.
+constexpr int NumSightWords(int num_queries) {
+  return (num_queries + kQueriesPerWord - 1) / kQueriesPerWord;
+}
+
+// Returns true if the target is visible from the source, that is if no tile
+// the segment enters, up to and including the tile of the target, is solid.
+// The distance field is optional and never changes the result.
+bool HasLineOfSight(const Level& level,
+                    const DistanceField* distance_field,
+                    const Vector& source,
+                    const Vector& target);
+
+// Answers every query and stores the results as a bitset, where bit i % 64 of
+// word i / 64 is set if the target of query i is visible. Bits past the last
+// query are cleared. The bitset holds NumSightWords(num_queries) words and is
+// owned by the caller. Queries are answered on the threads of the pool, or on
+// the calling thread if it is null.
+void CheckLinesOfSight(const Level& level,
+                       const DistanceField* distance_field,
+                       const SightQueries& queries,
+                       ThreadPool* thread_pool,
+                       uint64_t* visible);
+
+}  // namespace sensing
+
+#endif  // LINE_OF_SIGHT_H_
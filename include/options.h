@@ -0,0 +1,102 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <string>
+
+#include "renderer.h"
+#include "resolution_scaler.h"
+#include "simulation.h"
+#include "thread_pool.h"
+
+/*
+ * options.h
+ *
+ * This header file defines the command-line options of the program and the
+ * function that parses them.
+ *
+ * Options are passed in the form --name=value. Options that are not specified
+ * keep their default values.
+ */
+
+namespace options {
+
+struct Options {
+  rendering::Backend render_backend = rendering::Backend::kFrameBuffer;
+
+  // Whether the camera is simulated on its own thread or between frames.
+  simulation::Mode simulation_mode = simulation::Mode::kThread;
+
+  // Size of the window and of the rendered frame. Sizes that match a preset
+  // of the Makefile render on a specialized path.
+  int screen_width = 1920;
+  int screen_height = 1080;
+
+  // If positive, the frame buffer renderer lowers the size it renders at
+  // whenever a frame costs more than this many milliseconds, and scales the
+  // frame up to the window with the upscale filter.
+  float target_frame_ms = 0.0f;
+  resolution::Filter upscale_filter = resolution::Filter::kLinear;
+
+  // Total number of threads that render a frame, including the main thread.
+  int num_threads = ThreadPool::DefaultNumThreads();
+
+  // Whether every 60th frame renders on the main thread only, so the game
+  // log can show the speedup of the thread pool. These frames hitch.
+  bool measure_speedup = false;
+
+  // Level file to load instead of the built-in level, in the binary or text
+  // format.
+  std::string level_path;
+
+  // Whether the frame buffer renderer textures the walls. The line renderer
+  // always draws flat colors.
+  bool textures = true;
+
+  // Number of sprites scattered over the level. Sprites are only drawn with
+  // textures.
+  int num_sprites = 128;
+
+  // Whether rays skip empty space with a distance field of the level.
+  bool distance_field = false;
+
+  // Whether the frame buffer renderer reuses the rays of the last frame and
+  // casts only the ones that may have changed.
+  bool ray_cache = false;
+
+  // Whether sprites are culled with the potentially visible sets of the
+  // level, cached next to a level loaded from a file.
+  bool visibility_set = false;
+
+  // Number of point lights scattered over the level and baked into a
+  // lightmap of the walls and floor, cached next to a level loaded from a
+  // file. No lightmap is baked without lights.
+  int num_lights = 0;
+
+  // If set, the latency percentiles of every frame stage are written here on
+  // exit, as JSON if the path ends in .json and as CSV otherwise.
+  std::string profile_path;
+
+  // If set, a timeline of every frame, frame stage and thread pool chunk is
+  // written here on exit in the Chrome trace event format.
+  std::string trace_path;
+
+  // If set, every frame of the frame buffer renderer is recorded here, as raw
+  // RGB24 if the path ends in .rgb and as Y4M otherwise.
+  std::string capture_path;
+
+  // If set, the loaded level is written here in the binary format and the
+  // program exits without opening a window.
+  std::string save_level_path;
+};
+
+// Parses the command-line arguments into the options structure.
+// Returns false and sets the error message if an argument is unknown or has
+// an invalid value.
+bool ParseOptions(int argc, char* argv[], Options* options, std::string* error);
+
+// Returns a short description of all supported options.
+std::string GenerateUsageMessage();
+
+}  // namespace options
+
+#endif  // OPTIONS_H_
@@ -0,0 +1,119 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+/*
+ * profiler.h
+ *
+ * This header file defines the Profiler class, which records how long each
+ * stage of a frame takes and summarizes the timings as latency percentiles.
+ *
+ * Every stage keeps its samples in a preallocated ring buffer. Recording a
+ * sample is a single store and a release of the sample count, so it never
+ * locks or allocates, and a summary can be read while frames are recorded.
+ * The ring keeps the latest kCapacity samples of each stage; older samples
+ * are overwritten and only their count and maximum are kept.
+ */
+
+namespace profiling {
+
+// Stages of a frame, in the order the render loop runs them.
+enum class Stage {
+  kEvents = 0,      // Polling and handling SDL events.
+  kSimulation = 1,  // Simulation ticks and the interpolated camera.
+  kBackground = 2,  // Floor and ceiling, flat or cast.
+  kWalls = 3,       // The ray loop, including wall shading.
+  kSprites = 4,
+  kUpload = 5,      // Copying the frame buffer into the texture.
+  kPresent = 6,     // SDL_RenderPresent, which may wait for the display.
+  kFrame = 7        // The whole frame, from one frame start to the next.
+};
+
+constexpr int kNumStages = 8;
+
+// Returns the lowercase name of the stage, as used in the profile files.
+const char* StageName(Stage stage);
+
+// Latency percentiles of a stage, in milliseconds.
+struct StageSummary {
+  // Number of samples the percentiles are taken from.
+  int num_samples;
+
+  float p50;
+  float p95;
+  float p99;
+  float max;
+};
+
+class Profiler {
+ public:
+  // Samples kept per stage, about 18 minutes of frames at 60 FPS.
+  static constexpr int kCapacity = 1 << 16;
+
+  Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // Records how long one run of the stage took. Only one thread may record
+  // each stage.
+  void Record(Stage stage, float milliseconds);
+
+  // Returns the percentiles of the latest samples of the stage, at most
+  // max_samples of them. Uses a scratch buffer, so only one thread may
+  // summarize at a time.
+  StageSummary Summarize(Stage stage, int max_samples);
+
+  // Returns the number of samples ever recorded for the stage, including the
+  // ones the ring has overwritten.
+  int64_t NumRecorded(Stage stage) const;
+
+  // Writes the summary of every stage to the file, as JSON if the path ends
+  // in .json and as CSV otherwise. Returns false and sets the error message
+  // if the file could not be written.
+  bool WriteSummary(const std::string& path, std::string* error);
+
+ private:
+  static constexpr int kIndexMask = kCapacity - 1;
+
+  struct SampleRing {
+    std::unique_ptr<std::atomic<float>[]> samples;
+    std::atomic<int64_t> num_recorded{0};
+    std::atomic<float> max{0.0f};
+  };
+
+  SampleRing rings_[kNumStages];
+
+  // Copy of the samples being summarized, sized once for a full ring.
+  std::vector<float> scratch_;
+};
+
+// Records the time from construction to destruction as one sample of the
+// stage. Records nothing if the profiler is null. With tracing enabled, the
+// stage is also traced, even without a profiler.
+class ScopedTimer {
+ public:
+  ScopedTimer(Profiler* profiler, Stage stage);
+  ~ScopedTimer();
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Profiler* profiler_;
+  Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+  tracing::ScopedTrace trace_;
+};
+
+}  // namespace profiling
+
+#endif  // PROFILER_H_
@@ -0,0 +1,150 @@
+#ifndef RAY_CACHE_H_
+#define RAY_CACHE_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "camera.h"
+#include "ray_caster.h"
+#include "thread_pool.h"
+#include "vector.h"
+
+/*
+ * ray_cache.h
+ *
+ * This header file defines the RayCache class, which keeps the ray of every
+ * screen column from one frame to the next and casts only the rays it cannot
+ * derive from what it already knows.
+ *
+ * If the camera did not move, the cached rays are returned as they are.
+ * Otherwise the hit points of the last frame are reprojected into the new
+ * view, which predicts the wall face every column sees. Only the ends of each
+ * run of hits on the same face are reprojected, as the hits in between land
+ * between them. Each run of columns predicted to see the same face is
+ * resolved by casting its end columns. If both hit the same face and the
+ * tiles between the camera and the face are all empty, every column in
+ * between hits that face too, and its ray is calculated directly, as
+ * raycasting::CalculateHit would calculate it, eight columns at a time where
+ * the CPU supports AVX2. Otherwise the run is split in half and each half is
+ * resolved the same way.
+ *
+ * The prediction only decides where to cast. Every column is either cast or
+ * proven to hit the face, so the results are exactly those of casting every
+ * column.
+ *
+ * Where walls are small or far away, as on large open maps, the predicted
+ * runs are a column or two long and nearly every column is cast one ray at a
+ * time, which is slower than casting the whole screen in SIMD packets. When
+ * the predicted runs are shorter than kMinMeanRun columns on average, or the
+ * update before recast more than kMaxRecastFraction of the columns, the
+ * update casts every column with Camera::CalculateRays instead, and recovers
+ * the hit tiles of the next prediction from the rays.
+ */
+
+class RayCache {
+ public:
+  // Mean length of the predicted runs below which, and share of the columns
+  // recast by the last update above which, every column is cast in packets.
+  static constexpr int kMinMeanRun = 4;
+  static constexpr float kMaxRecastFraction = 0.75f;
+
+ private:
+  // Face key of columns whose face is not predicted.
+  static constexpr int64_t kUnknownFace =
+      std::numeric_limits<int64_t>::min();
+
+  int width_;
+
+  // Camera the cached rays were cast for. The cache is valid only if every
+  // value matches the next camera exactly.
+  bool valid_ = false;
+  const Level* level_ = nullptr;
+  const DistanceField* distance_field_ = nullptr;
+  Vector position_;
+  Vector direction_;
+  Vector plane_;
+
+  // Rays of every column, and the tile each ray hit.
+  std::vector<float> distance_;
+  std::vector<int> wall_id_;
+  std::vector<raycasting::WallSide> wall_side_;
+  std::vector<float> wall_x_;
+  std::vector<int> num_steps_;
+  std::vector<raycasting::HitTile> hit_tile_;
+
+  // Plane scalar of every column, as rendering::CalculatePlaneScalar returns
+  // it.
+  std::vector<float> plane_scalars_;
+
+  // Face predicted for every column by the reprojection, and the depth of the
+  // prediction, so nearer faces win.
+  std::vector<int64_t> predicted_face_;
+  std::vector<float> predicted_depth_;
+
+  int num_cast_ = 0;
+
+  // Whether the last update cast every column in packets rather than
+  // resolving the predicted runs.
+  bool cast_all_ = false;
+
+  // Returns the direction of the ray of the column for the camera direction
+  // and plane, exactly as rendering::RenderColumns casts it.
+  Vector RayDirection(const Vector& direction, const Vector& plane,
+                      int x) const;
+
+  // Returns a key that identifies the face the ray of the column hit.
+  int64_t FaceKey(int x) const;
+
+  // Predicts the face of every column from the cached rays.
+  void Reproject(const Camera& camera);
+
+  // Returns true if resolving the predicted runs is likely slower than
+  // casting every column in packets.
+  bool ShouldCastAll() const;
+
+  // Casts the columns in the range [x_begin, x_end) with
+  // Camera::CalculateRays and recovers their hit tiles.
+  void CastColumns(const Camera& camera, int x_begin, int x_end);
+
+  // Resolves the columns in the range [x_begin, x_end) and returns the
+  // number of rays cast.
+  int ResolveColumns(const Camera& camera, int x_begin, int x_end);
+
+  // Resolves the columns strictly between a and b, whose rays are already
+  // cast, and returns the number of rays cast.
+  int ResolveBetween(const Camera& camera, int a, int b);
+
+  // Calculates the rays strictly between a and b if they provably hit the
+  // same face as a and b. Returns false without changing anything otherwise.
+  bool FillBetween(const Camera& camera, int a, int b);
+
+  void Cast(const Camera& camera, int x);
+  void Store(int x, const raycasting::RayData& ray_data,
+             raycasting::HitTile hit_tile);
+
+ public:
+  explicit RayCache(int width);
+
+  // Updates the rays of every column for the camera. Columns are resolved on
+  // the threads of the pool, or on the calling thread if it is null.
+  void Update(const Camera& camera, ThreadPool* thread_pool);
+
+  // Forgets the cached rays, so the next update casts all of them. Must be
+  // called whenever the tiles of the level change.
+  void Invalidate();
+
+  // Returns the ray of the column, as of the last update.
+  raycasting::RayData Ray(int x) const;
+
+  int Width() const;
+
+  // Number of rays the last update cast, and their share of the columns.
+  int NumCast() const;
+  float RecastFraction() const;
+
+  // Whether the last update cast every column in packets.
+  bool CastAll() const;
+};
+
+#endif  // RAY_CACHE_H_
@@ -0,0 +1,216 @@
+#ifndef RAY_CASTER_H_
+#define RAY_CASTER_H_
+
+#include <cmath>
+
+#include "camera.h"
+#include "distance_field.h"
+#include "fixed_point_dda.h"
+#include "vector.h"
+
+/*
+ * ray_caster.h
+ *
+ * This header file defines the DDA ray caster as a template over the level
+ * storage, so the same traversal runs on the row-major Level and the tiled
+ * TiledLevel and the layouts can be benchmarked against each other.
+ *
+ * The ray caster is also a template over the per-axis DDA state, which
+ * selects the arithmetic: DDAData in float by default, or FixedDDAData in
+ * fixed point (see fixed_point_dda.h) for results that are the same on every
+ * compiler and CPU.
+ *
+ * A storage type must provide:
+ *   bool IsSolid(int x, int y) const  - tested on every DDA step
+ *   int At(int x, int y) const        - read once, for the tile that was hit
+ * and treat tiles outside the level as walls.
+ */
+
+namespace raycasting {
+
+// Moves the DDA state over the square of empty tiles that extends
+// empty_radius tiles in every direction from the current tile. The state ends
+// up exactly where stepping one tile side at a time would leave it right
+// before the ray leaves the square.
+void SkipEmptySpace(int empty_radius, DDAData* dda_data_x, DDAData* dda_data_y);
+
+// Returns the position along the wall where a ray hit it, in the range
+// [0, 1]. Sides facing +X and -Y are mirrored so that textures are not
+// flipped when seen from either side of a tile.
+inline float CalculateWallX(const Vector& position,
+                            const Vector& ray_direction,
+                            float distance,
+                            WallSide wall_side) {
+  float wall_x = wall_side == WallSide::kXSide
+                     ? position.y + distance * ray_direction.y
+                     : position.x + distance * ray_direction.x;
+
+  wall_x -= std::floor(wall_x);
+
+  if ((wall_side == WallSide::kXSide && ray_direction.x > 0.0f) ||
+      (wall_side == WallSide::kYSide && ray_direction.y < 0.0f)) {
+    wall_x = 1.0f - wall_x;
+  }
+
+  return wall_x;
+}
+
+// Returns the position along the wall where a ray found with the float DDA
+// data hit it. Overloaded for every DDA axis type.
+inline float CalculateWallX(const DDAData& /* dda_data_x */,
+                            const DDAData& /* dda_data_y */,
+                            const Vector& position,
+                            const Vector& ray_direction,
+                            float distance,
+                            WallSide wall_side) {
+  return CalculateWallX(position, ray_direction, distance, wall_side);
+}
+
+// Tile in which a ray stopped.
+struct HitTile {
+  int x;
+  int y;
+};
+
+// Performs the DDA algorithm from the position along the ray direction and
+// returns ray information, including the distance to the wall (in units of
+// the ray direction's length), the wall ID, the side that was hit and the
+// position of the hit along the wall.
+// If the distance field is not null, the ray jumps across empty space. If the
+// hit tile is not null, the tile that was hit is stored there.
+// The axis type selects the arithmetic of the DDA, for example
+// CastRay<FixedDDAData16>(...) for fixed point.
+template <typename Axis = DDAData, typename LevelStorage>
+RayData CastRay(const LevelStorage& level,
+                const DistanceField* distance_field,
+                const Vector& position,
+                const Vector& ray_direction,
+                HitTile* hit_tile) {
+  // Initializes DDA data for the X and Y axes.
+  Axis dda_data_x(position.x, ray_direction.x);
+  Axis dda_data_y(position.y, ray_direction.y);
+
+  int num_steps = 0;
+  WallSide wall_side;
+
+  // Performs the DDA algorithm until a wall is hit.
+  do {
+    // Jumps across empty space around the current tile first, if possible.
+    if (distance_field != nullptr) {
+      const int empty_radius =
+          distance_field->At(dda_data_x.tile, dda_data_y.tile) - 1;
+
+      if (empty_radius > 0) {
+        SkipEmptySpace(empty_radius, &dda_data_x, &dda_data_y);
+      }
+    }
+
+    // Selects the shorter distance to the next tile side.
+    if (dda_data_x.side_dist < dda_data_y.side_dist) {
+      dda_data_x.Advance();
+      wall_side = WallSide::kXSide;
+    } else {
+      dda_data_y.Advance();
+      wall_side = WallSide::kYSide;
+    }
+
+    num_steps++;
+  } while (!level.IsSolid(dda_data_x.tile, dda_data_y.tile));
+
+  // Selects the distance to the side of the tile that was hit.
+  const float distance = wall_side == WallSide::kXSide
+                             ? dda_data_x.HitDist()
+                             : dda_data_y.HitDist();
+
+  if (hit_tile != nullptr) {
+    *hit_tile = HitTile{ dda_data_x.tile, dda_data_y.tile };
+  }
+
+  return RayData{
+    distance,
+    level.At(dda_data_x.tile, dda_data_y.tile),
+    wall_side,
+    CalculateWallX(dda_data_x, dda_data_y, position, ray_direction, distance,
+                   wall_side),
+    num_steps
+  };
+}
+
+template <typename Axis = DDAData, typename LevelStorage>
+RayData CastRay(const LevelStorage& level,
+                const DistanceField* distance_field,
+                const Vector& position,
+                const Vector& ray_direction) {
+  return CastRay<Axis>(level, distance_field, position, ray_direction,
+                       nullptr);
+}
+
+// Returns the tile a ray cast from the position along the direction hit,
+// recovered from the distance and wall_x of its ray data, so it also serves
+// the ray casting paths that do not report the tile.
+inline HitTile RecoverHitTile(const Vector& position,
+                              const Vector& ray_direction,
+                              const RayData& ray_data) {
+  const float hit_x = position.x + ray_direction.x * ray_data.distance;
+  const float hit_y = position.y + ray_direction.y * ray_data.distance;
+
+  // The hit lies on a tile side across the axis of the wall side, and
+  // wall_x, unmirrored, is its position past the start of the tile along the
+  // other axis. Rounding the start recovers the tile even where the hit is
+  // right at a corner.
+  if (ray_data.wall_side == WallSide::kXSide) {
+    const bool positive = ray_direction.x > 0.0f;
+    const float along = positive ? 1.0f - ray_data.wall_x : ray_data.wall_x;
+
+    return HitTile{
+      static_cast<int>(std::floor(hit_x + 0.5f)) - (positive ? 0 : 1),
+      static_cast<int>(std::floor(hit_y - along + 0.5f))
+    };
+  }
+
+  const bool positive = ray_direction.y > 0.0f;
+  const float along = positive ? ray_data.wall_x : 1.0f - ray_data.wall_x;
+
+  return HitTile{
+    static_cast<int>(std::floor(hit_x - along + 0.5f)),
+    static_cast<int>(std::floor(hit_y + 0.5f)) - (positive ? 0 : 1)
+  };
+}
+
+// Returns the ray information of a ray that is known to reach the side of
+// the hit tile without crossing any other wall, exactly as CastRay returns
+// it, but without stepping through the tiles in between. The number of steps
+// is the number of tile sides crossed, as without empty-space skipping.
+inline RayData CalculateHit(const Vector& position,
+                            const Vector& ray_direction,
+                            HitTile hit_tile,
+                            WallSide wall_side,
+                            int wall_id) {
+  const bool x_side = wall_side == WallSide::kXSide;
+
+  // Only the axis of the hit side needs the distances to its tile sides.
+  const DDAData dda_data = x_side ? DDAData(position.x, ray_direction.x)
+                                  : DDAData(position.y, ray_direction.y);
+  const int num_crossed =
+      ((x_side ? hit_tile.x : hit_tile.y) - dda_data.tile) * dda_data.step;
+
+  // Along the other axis, the ray crosses every side between the start tile
+  // and the hit tile.
+  const int num_crossed_other =
+      x_side ? std::abs(hit_tile.y - static_cast<int>(position.y))
+             : std::abs(hit_tile.x - static_cast<int>(position.x));
+
+  const float distance = dda_data.SideDist(num_crossed - 1);
+
+  return RayData{
+    distance,
+    wall_id,
+    wall_side,
+    CalculateWallX(position, ray_direction, distance, wall_side),
+    num_crossed + num_crossed_other
+  };
+}
+
+}  // namespace raycasting
+
+#endif  // RAY_CASTER_H_
@@ -0,0 +1,40 @@
+#ifndef RAY_PACKET_H_
+#define RAY_PACKET_H_
+
+#include "camera.h"
+#include "level.h"
+#include "vector.h"
+
+/*
+ * ray_packet.h
+ *
+ * This header file declares the SIMD packet traversal used by
+ * Camera::CalculateRays.
+ *
+ * A packet traces kPacketSize rays through the DDA in AVX2 lanes. Each lane
+ * steps with the same float operations as Camera::CalculateRay, and lanes that
+ * have already hit a wall are masked out until the whole packet is done.
+ * Tiles outside the level are masked out of the gather and read as
+ * Level::kOutOfBoundsTile, as in the scalar path.
+ */
+
+namespace raycasting {
+
+// Returns true if the CPU the program runs on supports AVX2. The result is
+// detected once and cached.
+bool HasAVX2();
+
+// Traces kPacketSize rays from the camera position along direction + plane *
+// plane_scalars[i] and stores the results in the first kPacketSize elements
+// of the batch. Must only be called if HasAVX2() returns true.
+void CastRayPacketAVX2(
+    const Level& level,
+    const Vector& position,
+    const Vector& direction,
+    const Vector& plane,
+    const float* plane_scalars,
+    const RayBatch& out);
+
+}  // namespace raycasting
+
+#endif  // RAY_PACKET_H_
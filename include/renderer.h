@@ -0,0 +1,265 @@
+#ifndef RENDERER_H_
+#define RENDERER_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "frame_buffer.h"
+#include "level_editor.h"
+#include "lightmap.h"
+#include "profiler.h"
+#include "ray_cache.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+
+/*
+ * renderer.h
+ *
+ * This header file defines the CPU rendering path, which shades the floor,
+ * ceiling and walls directly into a FrameBuffer.
+ *
+ * The color and wall height calculations are shared with the line-drawing
+ * fallback in main.cc, so both backends produce the same image.
+ *
+ * Walls are either textured from a TextureAtlas or, without one, flat shaded
+ * like in the line-drawing fallback. With textures, the floor and ceiling are
+ * cast row by row after the walls (see floor_caster.h). With a Lightmap, the
+ * baked light of the wall face a ray hit is looked up once per column and
+ * multiplies every pixel of it, and the floor caster lights the floor and
+ * ceiling from the floor texels under every row. With a LevelEditor, the
+ * doors it is opening or closing are drawn slid aside by their open fraction:
+ * a ray that hits the open part of a door goes on behind it.
+ *
+ * Every screen column is independent, so a frame can be split into column
+ * ranges that are cast and shaded in parallel by a ThreadPool.
+ *
+ * The wall stage is a template over the screen. The screen sizes selected
+ * with RENDER_PRESETS in the Makefile, none by default, are compiled with
+ * their size as constants and a table of the plane scalar of every column,
+ * and other sizes fall back to a screen whose size is only known at run
+ * time. The field of
+ * view only scales the camera plane the plane scalars multiply, so it does
+ * not specialize anything.
+ */
+
+namespace rendering {
+
+// Available render backends.
+// kFrameBuffer draws into a FrameBuffer uploaded once per frame, while
+// kDrawLine issues one SDL_RenderDrawLine call per screen column.
+enum class Backend {
+  kFrameBuffer = 0,
+  kDrawLine = 1
+};
+
+struct Color {
+  uint8_t r, g, b, a;
+};
+
+constexpr Color kFloorColor = { 0x1c, 0x1c, 0x1c, 0xff };
+constexpr Color kCeilColor = { 0x12, 0x12, 0x12, 0xff };
+
+// Vertical range of a wall segment, both endpoints inclusive.
+struct WallSpan {
+  int draw_start;
+  int draw_end;
+};
+
+// Per-column results of the wall pass, read by later stages to skip pixels
+// covered by walls. Owned by the caller and reused from frame to frame, so
+// rendering does not allocate.
+struct ColumnBuffers {
+  explicit ColumnBuffers(int width)
+      : depth(width), draw_start(width), draw_end(width) {}
+
+  // Distance to the wall in every column, along the camera direction like
+  // RayData::distance. Anything farther away is hidden by the wall.
+  std::vector<float> depth;
+
+  // Rows covered by the wall segment of every column, as in WallSpan.
+  std::vector<int> draw_start;
+  std::vector<int> draw_end;
+};
+
+// Minimum number of columns or rows handed to a thread at once. Smaller
+// chunks balance better but cost more synchronization.
+constexpr int kMinColumnChunk = 16;
+constexpr int kMinRowChunk = 32;
+
+// Number of columns whose rays are cast together in one batch.
+constexpr int kColumnBlockSize = 64;
+
+// Distance below which walls are textured as if they were this close, which
+// keeps the texture coordinate step finite.
+constexpr float kMinTextureDistance = 1e-4f;
+
+// Packs a color into the 0xAARRGGBB layout used by the frame buffer.
+constexpr uint32_t ToARGB(Color color) {
+  return static_cast<uint32_t>(color.a) << 24 |
+         static_cast<uint32_t>(color.r) << 16 |
+         static_cast<uint32_t>(color.g) << 8 |
+         static_cast<uint32_t>(color.b);
+}
+
+// Returns the color of a wall based on its ID, darkened if the ray hit the
+// wall on the Y side.
+Color WallColor(const raycasting::RayData& ray_data);
+
+// Calculates which rows of a screen with the specified height a wall at the
+// given distance covers. The wall height is clamped to the screen height.
+WallSpan CalculateWallSpan(float distance, int screen_height);
+
+// Maps a screen column to a scalar in the range [-1, 1] that selects the
+// point on the camera plane the ray for this column passes through. Defined
+// here so the preset screens can build their tables at compile time.
+constexpr float CalculatePlaneScalar(int x, int screen_width) {
+  return (2.0f * x) / (screen_width - 1.0f) - 1.0f;
+}
+
+// Screen whose size is only known at run time. The plane scalars are
+// calculated column by column.
+class RuntimeScreen {
+ public:
+  RuntimeScreen(int width, int height)
+      : width_(width),
+        height_(height),
+        inverse_max_y_(1.0f / (height - 1)) {}
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  // Reciprocal of the largest row, which turns wall distances into texels
+  // per row without dividing.
+  float InverseMaxY() const { return inverse_max_y_; }
+
+  // Returns the plane scalars of the columns [x_begin, x_begin + count),
+  // calculated into the scratch array.
+  const float* PlaneScalars(int x_begin, int count, float* scratch) const {
+    for (int i = 0; i < count; ++i) {
+      scratch[i] = CalculatePlaneScalar(x_begin + i, width_);
+    }
+    return scratch;
+  }
+
+ private:
+  int width_;
+  int height_;
+  float inverse_max_y_;
+};
+
+// Screen whose size is fixed at compile time. The plane scalars of all
+// columns are a table the compiler builds, with the same values
+// CalculatePlaneScalar returns at run time.
+template <int ScreenWidth, int ScreenHeight>
+class PresetScreen {
+ public:
+  static_assert(ScreenWidth >= 2 && ScreenHeight >= 2,
+                "The plane scalars and wall heights divide by the size - 1");
+
+  static constexpr int Width() { return ScreenWidth; }
+  static constexpr int Height() { return ScreenHeight; }
+  static constexpr float InverseMaxY() { return 1.0f / (ScreenHeight - 1); }
+
+  const float* PlaneScalars(int x_begin, int /* count */,
+                            float* /* scratch */) const {
+    return kPlaneScalars.data() + x_begin;
+  }
+
+ private:
+  static constexpr std::array<float, ScreenWidth> kPlaneScalars = [] {
+    std::array<float, ScreenWidth> plane_scalars = {};
+
+    for (int x = 0; x < ScreenWidth; ++x) {
+      plane_scalars[x] = CalculatePlaneScalar(x, ScreenWidth);
+    }
+    return plane_scalars;
+  }();
+};
+
+using Screen720p = PresetScreen<1280, 720>;
+using Screen1080p = PresetScreen<1920, 1080>;
+using Screen1440p = PresetScreen<2560, 1440>;
+
+// Fills the upper half of the frame buffer with the ceiling color and the
+// lower half with the floor color.
+void RenderBackground(FrameBuffer* frame_buffer);
+
+// Draws the wall segment for a single screen column and returns the rows it
+// covers.
+WallSpan RenderWallSegment(
+    FrameBuffer* frame_buffer,
+    const raycasting::RayData& ray_data,
+    int x);
+
+// Draws the textured wall segment for a single screen column. The mip level
+// is selected by the distance, and the texture is stepped down the column in
+// 16.16 fixed point. Returns the rows the segment covers.
+WallSpan RenderTexturedWallSegment(
+    FrameBuffer* frame_buffer,
+    const TextureAtlas& texture_atlas,
+    const raycasting::RayData& ray_data,
+    int x);
+
+// Casts rays for the columns in the range [x_begin, x_end) and draws their
+// wall segments, textured if the atlas is not null. If the lightmap is not
+// null, the light of the wall face every ray hit modulates its column in
+// place of the Y side shading. If the level editor is not null, its partly
+// open doors are drawn slid open. If the ray cache is not null, its rays are
+// drawn instead of casting new ones. The wall distances and covered rows are
+// stored in the column buffers.
+// The screen must match the frame buffer. It is instantiated for
+// RuntimeScreen and for the presets enabled with RENDER_PRESET_720p,
+// RENDER_PRESET_1080p and RENDER_PRESET_1440p.
+template <typename Screen>
+void RenderColumns(
+    const Screen& screen,
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    const RayCache* ray_cache,
+    int x_begin,
+    int x_end,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer);
+
+// Same as above, on the preset screen of the frame buffer's size if there is
+// one, and on a RuntimeScreen otherwise.
+void RenderColumns(
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    const RayCache* ray_cache,
+    int x_begin,
+    int x_end,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer);
+
+// Renders a complete frame. The background or floor rows and the wall
+// columns are split between the threads of the pool. If the pool is null,
+// the frame is rendered on the calling thread only. If the atlas is null, the
+// walls are flat shaded and the floor and ceiling are flat colors. If the
+// lightmap and the level editor are not null, they light the walls and draw
+// the doors as in RenderColumns, and the lightmap also lights the textured
+// floor and ceiling. The column buffers must be as wide as the
+// frame buffer. If the ray cache is not null, it is updated for the camera
+// and only the rays it cannot reuse are cast. It must be as wide as the frame
+// buffer. If the profiler is not null, the background and wall stages are
+// timed separately.
+void RenderFrame(
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    RayCache* ray_cache,
+    ThreadPool* thread_pool,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer,
+    profiling::Profiler* profiler);
+
+}  // namespace rendering
+
+#endif  // RENDERER_H_
@@ -0,0 +1,101 @@
+#ifndef RESOLUTION_SCALER_H_
+#define RESOLUTION_SCALER_H_
+
+/*
+ * resolution_scaler.h
+ *
+ * This header file defines the ResolutionScaler class, which picks the size
+ * the frame is rendered at so its cost stays within a target, and the filters
+ * the rendered frame is scaled up to the window with.
+ *
+ * The frame renders at one of a few scales of the window size, which scale
+ * the number of cast columns and the number of rows alike. The scaler keeps a
+ * moving average of the cost of the latest frames. If it exceeds the target
+ * by a small margin, the scale steps down, in one change to the largest scale
+ * whose predicted cost, which grows with the number of pixels, fits the
+ * target. It steps up again one scale at a time, only if the cost predicted
+ * for the larger scale stays below the target with a margin to spare. After
+ * every step, the average is measured afresh for a number of frames before
+ * the next step, so the scale does not oscillate between two neighbors.
+ *
+ * A step down after a step up shows the step up was premature, so the period
+ * the scaler waits before the next step up doubles, up to a limit. Steps down
+ * keep the short period, so a frame that grows too costly is still caught
+ * quickly. The longer wait ends once the scale has held for the longest
+ * period.
+ */
+
+namespace resolution {
+
+// Filter that scales the rendered frame up to the window.
+enum class Filter {
+  kNearest,
+  kLinear,
+};
+
+}  // namespace resolution
+
+class ResolutionScaler {
+ public:
+  // Scales of the window size the frame may render at, largest first.
+  static constexpr int kNumScales = 5;
+  static constexpr float kScales[kNumScales] = {
+    1.0f, 0.875f, 0.75f, 0.625f, 0.5f
+  };
+
+  // Weight of the newest frame cost in the moving average.
+  static constexpr float kSmoothing = 0.1f;
+
+  // Number of frames measured after a step before the next one, and the
+  // most the wait before a step up grows to after premature steps up.
+  static constexpr int kSettleFrames = 30;
+  static constexpr int kMaxStepUpFrames = 16 * kSettleFrames;
+
+  // Share of the target the average cost must exceed to step down, and the
+  // predicted cost of a larger scale must stay below to step up.
+  static constexpr float kStepDownMargin = 1.05f;
+  static constexpr float kStepUpMargin = 0.85f;
+
+  ResolutionScaler(float target_ms, int window_width, int window_height);
+
+  // Takes the cost of the latest frame in milliseconds and updates the
+  // scale. Returns true if the render size changed.
+  bool Update(float frame_ms);
+
+  float TargetMs() const;
+  float Scale() const;
+
+  // Size of the frame at the current scale, at least two pixels each.
+  int Width() const;
+  int Height() const;
+
+  // Moving average of the frame cost at the current scale, or zero before the
+  // first frame.
+  float AverageMs() const;
+
+  // Number of times the scale changed.
+  int NumChanges() const;
+
+ private:
+  float target_ms_;
+  int window_width_;
+  int window_height_;
+
+  int scale_index_ = 0;
+  float average_ms_ = 0.0f;
+  int frames_at_scale_ = 0;
+  int num_changes_ = 0;
+
+  // Frames measured after a step before a step up, and whether the latest
+  // step was up.
+  int step_up_frames_ = kSettleFrames;
+  bool stepped_up_ = false;
+
+  // Returns the cost predicted for the scale from the average cost at the
+  // current scale, in proportion to the number of pixels.
+  float PredictMs(int scale_index) const;
+
+  void SetScaleIndex(int scale_index);
+};
+
+#endif  // RESOLUTION_SCALER_H_
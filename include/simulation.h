@@ -0,0 +1,149 @@
+#ifndef SIMULATION_H_
+#define SIMULATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "entity_world.h"
+#include "triple_buffer.h"
+
+/*
+ * simulation.h
+ *
+ * This header file defines the Simulation class, which advances the camera
+ * in fixed time steps, independently of the frame rate.
+ *
+ * Every tick integrates the camera motion over exactly kTimeStep seconds, so
+ * the motion does not depend on how long frames take. The simulation can run
+ * on its own thread, or be updated inline from the render loop. Either way,
+ * the last two states are published through a lock-free TripleBuffer, and the
+ * renderer interpolates between them for the moment it renders, one tick in
+ * the past. A slow frame therefore never changes the physics, and a slow tick
+ * never blocks rendering.
+ *
+ * The simulated camera is one entity of an EntityWorld, so it collides with
+ * the walls and with every obstacle added to the world as a circle.
+ *
+ * Every tick holds a mutex while it reads the level and the world, so the
+ * level can be edited between two ticks (see LevelEditor).
+ */
+
+namespace simulation {
+
+// Where the simulation ticks run.
+enum class Mode {
+  kThread = 0,
+  kInline = 1
+};
+
+}  // namespace simulation
+
+class Simulation {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr int kTicksPerSecond = 120;
+  static constexpr float kTimeStep = 1.0f / kTicksPerSecond;
+
+  // Ticks run by one update at most. If the simulation falls further behind,
+  // for example after the process was suspended, the lost time is skipped
+  // instead of being caught up all at once.
+  static constexpr int kMaxTicksPerUpdate = 8;
+
+  // Radius of the camera entity, in tiles.
+  static constexpr float kCameraRadius = 0.2f;
+
+ private:
+  // Camera states published to the renderer. The current state is the
+  // simulation at current_time, the previous one a tick earlier.
+  struct Snapshot {
+    Camera previous;
+    Camera current;
+    Clock::time_point current_time;
+  };
+
+  // A motion change requested by the render thread, applied at the start of
+  // the next tick.
+  struct Input {
+    enum class Type { kAcceleration, kRotation } type;
+    motion::AccelState accel_state;
+    motion::AccelDirection accel_direction;
+    motion::RotationDirection rotation_direction;
+  };
+
+  static constexpr Clock::duration kTickDuration =
+      std::chrono::duration_cast<Clock::duration>(
+          std::chrono::nanoseconds(1000000000 / kTicksPerSecond));
+
+  // State owned by the ticking thread. The camera is entity 0 of the world.
+  EntityWorld entity_world_;
+  Camera camera_;
+  Camera previous_camera_;
+  Clock::time_point state_time_;
+
+  // Held during every tick.
+  std::mutex level_mutex_;
+
+  // Input is rare, so a mutex held only to append or swap is enough here.
+  std::mutex input_mutex_;
+  std::vector<Input> pending_input_;
+  std::vector<Input> tick_input_;
+
+  TripleBuffer<Snapshot> snapshots_;
+
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+
+  void QueueInput(const Input& input);
+  void Tick();
+  void Run();
+
+ public:
+  // Starts the simulation from the camera state at the start time.
+  Simulation(const Camera& camera, Clock::time_point start_time);
+  ~Simulation();
+
+  Simulation(const Simulation&) = delete;
+  Simulation& operator=(const Simulation&) = delete;
+
+  // Adds a circular obstacle the camera collides with. Must be called before
+  // the simulation starts ticking.
+  void AddObstacle(const Vector& position, float radius);
+
+  // Returns the mutex held during every tick. Lock it to change the level
+  // between two ticks, or to read the entities.
+  std::mutex* LevelMutex();
+
+  // Returns the world of the camera and the obstacles. Only read it while
+  // holding the level mutex once the simulation ticks.
+  const EntityWorld& Entities() const;
+
+  // Starts or stops ticking on a separate thread.
+  void Start();
+  void Stop();
+
+  // Runs all ticks due by the specified time on the calling thread. Used
+  // instead of Start() for inline updates, and by the thread itself.
+  void Update(Clock::time_point now);
+
+  // Forward the motion controls of Camera to the simulated camera. May be
+  // called from the render thread while the simulation thread runs.
+  void SetAcceleration(motion::AccelState accel_state,
+                       motion::AccelDirection accel_direction);
+  void SetRotationSpeed(motion::RotationDirection rotation_direction);
+
+  // Returns the camera to render at the specified time, interpolated between
+  // the last two published states. Must always be called from the same
+  // thread.
+  Camera CameraAt(Clock::time_point now);
+
+  // Returns the camera blended from one state to the next by the factor in
+  // the range [0, 1]. Everything but the pose is taken from the next state.
+  static Camera Interpolate(const Camera& from, const Camera& to, float alpha);
+};
+
+#endif  // SIMULATION_H_
@@ -0,0 +1,159 @@
+#ifndef SPRITE_RENDERER_H_
+#define SPRITE_RENDERER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "frame_buffer.h"
+#include "level.h"
+#include "lightmap.h"
+#include "renderer.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include "vector.h"
+#include "visibility_set.h"
+
+/*
+ * sprite_renderer.h
+ *
+ * This header file defines the sprites, objects in the level drawn as
+ * billboards that always face the camera, and the SpriteRenderer class, the
+ * render stage that draws them over the walls, floor and ceiling.
+ *
+ * Sprites are transformed into camera space once per frame, culled if they
+ * are behind the camera or outside the screen, and sorted from far to near so
+ * nearer sprites are drawn over farther ones. Each sprite column is then
+ * tested against the wall depth of its screen column, and columns hidden by
+ * a wall are skipped before any texel is read.
+ *
+ * With a VisibilitySet, sprites are culled before projection if no tile they
+ * reach into is in the set of the tile of the camera. The set is decoded once
+ * per tile the camera enters.
+ *
+ * With a Lightmap, every sprite is lit by the baked light of the floor under
+ * it, looked up once per sprite and frame.
+ */
+
+namespace rendering {
+
+// An object in the level, one tile tall and standing on the floor.
+struct Sprite {
+  Vector position;
+
+  // Index of the sprite texture in the range
+  // [0, TextureAtlas::kNumSpriteTextures).
+  int texture;
+};
+
+// Radius of the round body of a sprite, which the camera collides with.
+constexpr float kSpriteRadius = 0.25f;
+
+// Places the specified number of sprites on empty tiles of the level, spread
+// pseudo-randomly but the same on every run. Returns fewer sprites if the
+// level has hardly any empty tiles.
+std::vector<Sprite> ScatterSprites(const Level& level, int count);
+
+class SpriteRenderer {
+ public:
+  // Sprites closer to the camera plane than this are culled, like geometry
+  // in front of the near plane of a 3D renderer.
+  static constexpr float kNearDistance = 0.05f;
+
+ private:
+  // A sprite after projection, clipped to the screen.
+  struct ProjectedSprite {
+    float depth;
+
+    // Index of the sprite in the list, which orders sprites at the same
+    // depth.
+    int index;
+
+    int texture;
+    int mip_level;
+
+    // Light multiplying the texels, from the lightmap.
+    uint32_t light;
+
+    // Screen columns [x_begin, x_end) and rows [y_begin, y_end) covered.
+    int x_begin;
+    int x_end;
+    int y_begin;
+    int y_end;
+
+    // Texture coordinates of the first covered column and row and their
+    // steps per pixel, in 16.16 fixed point texels of the mip level.
+    uint32_t u_begin;
+    uint32_t u_step;
+    uint32_t v_begin;
+    uint32_t v_step;
+  };
+
+  // Sprites that passed culling, sorted from far to near. The storage is
+  // kept between frames, so it only allocates when the number of sprites
+  // grows.
+  std::vector<ProjectedSprite> visible_;
+
+  const VisibilitySet* visibility_set_ = nullptr;
+  const Lightmap* lightmap_ = nullptr;
+
+  // Set of the camera tile, decoded from visibility_set_ when the camera
+  // enters another tile.
+  VisibleTiles camera_tiles_;
+  bool camera_tiles_valid_ = false;
+  int camera_tile_x_ = 0;
+  int camera_tile_y_ = 0;
+
+  int num_hidden_ = 0;
+
+  // Returns true if no tile the sprite reaches into can be seen from the
+  // camera tile.
+  bool HiddenByVisibilitySet(const Sprite& sprite) const;
+
+  // Transforms, culls and sorts the sprites into visible_.
+  void Project(const Camera& camera,
+               const std::vector<Sprite>& sprites,
+               int screen_width,
+               int screen_height);
+
+  // Draws the visible sprites in the columns in the range [x_begin, x_end).
+  void RenderColumns(const TextureAtlas& texture_atlas,
+                     const ColumnBuffers& column_buffers,
+                     int x_begin,
+                     int x_end,
+                     FrameBuffer* frame_buffer) const;
+
+ public:
+  // Draws the sprites over a frame rendered by RenderFrame, hidden where the
+  // column buffers hold a closer wall. The columns are split between the
+  // threads of the pool, or drawn on the calling thread if it is null.
+  void Render(const Camera& camera,
+              const TextureAtlas& texture_atlas,
+              const std::vector<Sprite>& sprites,
+              const ColumnBuffers& column_buffers,
+              ThreadPool* thread_pool,
+              FrameBuffer* frame_buffer);
+
+  // Culls sprites that cannot be seen from the tile of the camera with the
+  // visibility set, which must outlive its use, or with none if it is null.
+  void SetVisibilitySet(const VisibilitySet* visibility_set);
+
+  // Decodes the set of the camera tile again for the next frame. Must be
+  // called whenever the visibility set was updated.
+  void InvalidateVisibility();
+
+  // Lights sprites with the floor light of the lightmap, which must outlive
+  // its use, or draws them unlit if it is null.
+  void SetLightmap(const Lightmap* lightmap);
+
+  // Returns the number of sprites that passed culling in the last frame.
+  int NumVisible() const;
+
+  // Returns the number of sprites culled by the visibility set in the last
+  // frame.
+  int NumHidden() const;
+};
+
+}  // namespace rendering
+
+#endif  // SPRITE_RENDERER_H_
@@ -0,0 +1,114 @@
+#ifndef TEXTURE_ATLAS_H_
+#define TEXTURE_ATLAS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * texture_atlas.h
+ *
+ * This header file defines the TextureAtlas class, which holds the wall
+ * textures and their mip levels in a single block of ARGB8888 texels.
+ *
+ * Textures are stored column by column, so drawing a vertical wall strip
+ * reads consecutive texels. Each texture is followed by its mip levels, every
+ * one half the size of the previous, down to a single texel. Distant walls
+ * read a smaller level, which keeps the texels they touch in cache and avoids
+ * the shimmering of skipped texels.
+ *
+ * The textures are generated procedurally, one per wall ID with the same base
+ * colors as the flat-shaded walls, plus one for the floor, one for the
+ * ceiling and a few sprites. Sprite texels with an alpha below kOpaqueAlpha
+ * are transparent.
+ */
+
+class TextureAtlas {
+ public:
+  static constexpr int kSizeShift = 6;
+  static constexpr int kSize = 1 << kSizeShift;
+  static constexpr int kNumMipLevels = kSizeShift + 1;
+
+  // Wall IDs 1 to 4 have their own texture, any other ID uses texture 0.
+  static constexpr int kNumWallTextures = 5;
+  static constexpr int kFloorTexture = kNumWallTextures;
+  static constexpr int kCeilingTexture = kNumWallTextures + 1;
+  static constexpr int kFirstSpriteTexture = kNumWallTextures + 2;
+  static constexpr int kNumSpriteTextures = 3;
+  static constexpr int kNumTextures = kFirstSpriteTexture + kNumSpriteTextures;
+
+  static constexpr uint32_t kOpaqueAlpha = 0x80;
+
+  // Range of texels [begin, end) of a column that contains all of its opaque
+  // texels. Empty for fully transparent columns.
+  struct OpaqueSpan {
+    uint8_t begin;
+    uint8_t end;
+  };
+
+ private:
+  // Number of texels and columns of a texture and all of its mip levels.
+  static constexpr int kTexelsPerTexture = (kSize * kSize * 4 - 1) / 3;
+  static constexpr int kColumnsPerTexture = kSize * 2 - 1;
+
+  std::vector<uint32_t> texels_;
+
+  // Opaque span of every column of every texture and mip level, in the same
+  // order as the columns.
+  std::vector<OpaqueSpan> opaque_spans_;
+
+  // Returns the offset of a mip level from the start of its texture.
+  static int MipOffset(int mip_level) {
+    // Every level holds a quarter of the texels of the previous one, so the
+    // levels before it add up to 4 / 3 of the difference between the squared
+    // sizes of the full texture and the level.
+    return (kSize * kSize - (kSize >> mip_level) * (kSize >> mip_level)) * 4 /
+           3;
+  }
+
+  static int TextureIndex(int wall_id) {
+    return wall_id >= 1 && wall_id < kNumWallTextures ? wall_id : 0;
+  }
+
+  // Returns the index of column u of a mip level of the texture among all
+  // columns of the atlas. Every level has half the columns of the previous.
+  static size_t ColumnIndex(int texture, int mip_level, int u) {
+    return static_cast<size_t>(texture) * kColumnsPerTexture +
+           (kSize - (kSize >> mip_level)) * 2 + u;
+  }
+
+  // Returns the offset of column u of a mip level of the texture from the
+  // start of the atlas.
+  static size_t ColumnOffset(int texture, int mip_level, int u) {
+    return static_cast<size_t>(texture) * kTexelsPerTexture +
+           MipOffset(mip_level) + u * (kSize >> mip_level);
+  }
+
+ public:
+  // Generates the textures and their mip levels.
+  TextureAtlas();
+
+  // Selects the mip level for a wall on which one screen pixel covers the
+  // specified number of texels of the full-size texture.
+  static int MipLevel(float texels_per_pixel);
+
+  // Returns the column u of the texture for the wall ID at the mip level. The
+  // column holds kSize >> mip_level texels from top to bottom.
+  const uint32_t* Column(int wall_id, int mip_level, int u) const {
+    return texels_.data() + ColumnOffset(TextureIndex(wall_id), mip_level, u);
+  }
+
+  // Returns the opaque span of column u of a mip level of the texture with
+  // the index. Lets sprites skip their transparent rows without reading them.
+  OpaqueSpan ColumnOpaqueSpan(int texture, int mip_level, int u) const {
+    return opaque_spans_[ColumnIndex(texture, mip_level, u)];
+  }
+
+  // Returns a mip level of the texture with the index, such as kFloorTexture.
+  // Texel (u, v) of a level of size s is at u * s + v.
+  const uint32_t* Texels(int texture, int mip_level) const {
+    return texels_.data() + ColumnOffset(texture, mip_level, 0);
+  }
+};
+
+#endif  // TEXTURE_ATLAS_H_
@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * thread_pool.h
+ *
+ * This header file defines the ThreadPool class, a set of persistent worker
+ * threads that split a range of indices (such as screen columns) into chunks
+ * and process them in parallel.
+ *
+ * Chunks are claimed dynamically with guided scheduling: early chunks are
+ * large and later ones shrink, so threads that finish cheap chunks pick up
+ * the remaining work instead of waiting for threads stuck on expensive ones.
+ *
+ * With tracing enabled, every chunk is traced on the thread that ran it,
+ * named after the trace scope ParallelFor was called from.
+ */
+
+class ThreadPool {
+ public:
+  // Function called for each chunk with the range [begin, end).
+  using Task = std::function<void(int begin, int end)>;
+
+ private:
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_finished_;
+
+  // Incremented for every ParallelFor call so workers can tell a new job from
+  // a spurious wake-up.
+  unsigned generation_ = 0;
+  int num_busy_workers_ = 0;
+  bool stopping_ = false;
+
+  // Current job. Only valid while a ParallelFor call is in progress.
+  const Task* task_ = nullptr;
+  int end_ = 0;
+  int min_chunk_size_ = 1;
+  std::atomic<int> next_index_{0};
+
+  // Trace scope that started the current job, which names its chunks in the
+  // trace.
+  const char* trace_scope_ = nullptr;
+
+  void WorkerLoop(int worker_index);
+
+  // Claims and processes chunks until the whole range is taken.
+  void ProcessChunks();
+
+ public:
+  // Creates a pool that processes ranges on num_threads threads in total. The
+  // thread calling ParallelFor counts as one of them, so a pool with a single
+  // thread starts no workers and runs everything inline.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Returns the number of threads, including the calling thread.
+  int NumThreads() const;
+
+  // Processes the range [begin, end) in chunks of at least min_chunk_size
+  // indices and returns once every chunk is done.
+  void ParallelFor(int begin, int end, int min_chunk_size, const Task& task);
+
+  // Returns the default thread count, one per hardware thread.
+  static int DefaultNumThreads();
+};
+
+#endif  // THREAD_POOL_H_
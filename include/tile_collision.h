@@ -0,0 +1,121 @@
+#ifndef TILE_COLLISION_H_
+#define TILE_COLLISION_H_
+
+#include <cmath>
+
+#include "vector.h"
+
+/*
+ * tile_collision.h
+ *
+ * This header file defines collision of points and circles with the walls of
+ * a level, and of circles with each other. Like the ray caster, it is a
+ * template over the level storage and only needs an IsSolid(int x, int y)
+ * member that treats tiles outside the level as walls.
+ */
+
+namespace collision {
+
+// Returns the position moved by the offset. Collisions are checked
+// independently along each axis, allowing movement along one axis even if the
+// other collides with a wall.
+template <typename LevelStorage>
+Vector MoveWithTileCollision(const LevelStorage& level,
+                             const Vector& position,
+                             const Vector& offset) {
+  const Vector new_position = position + offset;
+  Vector result = position;
+
+  // Identifies the current and new tiles. Rounding down maps positions just
+  // below zero to the tile outside the level rather than tile zero.
+  const int tile_x = static_cast<int>(position.x);
+  const int tile_y = static_cast<int>(position.y);
+
+  const int tile_new_x = static_cast<int>(std::floor(new_position.x));
+  const int tile_new_y = static_cast<int>(std::floor(new_position.y));
+
+  if (!level.IsSolid(tile_new_x, tile_y)) {
+    result.x = new_position.x;
+  }
+  if (!level.IsSolid(tile_x, tile_new_y)) {
+    result.y = new_position.y;
+  }
+
+  return result;
+}
+
+// Returns true if the circle overlaps the square of the tile. Circles that
+// only touch the tile do not overlap it.
+inline bool CircleOverlapsTile(const Vector& center, float radius,
+                               int tile_x, int tile_y) {
+  // Closest point of the tile to the center of the circle.
+  const float closest_x =
+      std::fmin(std::fmax(center.x, static_cast<float>(tile_x)), tile_x + 1.0f);
+  const float closest_y =
+      std::fmin(std::fmax(center.y, static_cast<float>(tile_y)), tile_y + 1.0f);
+
+  const float dx = center.x - closest_x;
+  const float dy = center.y - closest_y;
+
+  return dx * dx + dy * dy < radius * radius;
+}
+
+// Returns true if the circle overlaps any solid tile.
+template <typename LevelStorage>
+bool CircleOverlapsSolidTile(const LevelStorage& level,
+                             const Vector& center,
+                             float radius) {
+  const int first_x = static_cast<int>(std::floor(center.x - radius));
+  const int last_x = static_cast<int>(std::floor(center.x + radius));
+  const int first_y = static_cast<int>(std::floor(center.y - radius));
+  const int last_y = static_cast<int>(std::floor(center.y + radius));
+
+  for (int x = first_x; x <= last_x; ++x) {
+    for (int y = first_y; y <= last_y; ++y) {
+      if (level.IsSolid(x, y) && CircleOverlapsTile(center, radius, x, y)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Returns the center of the circle moved by the offset. Like
+// MoveWithTileCollision, each axis is checked on its own, so a circle slides
+// along a wall it runs into, and a move along an axis is dropped entirely if
+// the circle would overlap a solid tile.
+template <typename LevelStorage>
+Vector MoveCircleWithTileCollision(const LevelStorage& level,
+                                   const Vector& center,
+                                   float radius,
+                                   const Vector& offset) {
+  Vector result = center;
+
+  if (offset.x != 0.0f &&
+      !CircleOverlapsSolidTile(level, Vector(center.x + offset.x, center.y),
+                               radius)) {
+    result.x += offset.x;
+  }
+  if (offset.y != 0.0f &&
+      !CircleOverlapsSolidTile(level, Vector(result.x, center.y + offset.y),
+                               radius)) {
+    result.y += offset.y;
+  }
+
+  return result;
+}
+
+// Returns true if the two circles overlap. Circles that only touch do not.
+inline bool CirclesOverlap(const Vector& center_a, float radius_a,
+                           const Vector& center_b, float radius_b) {
+  const float dx = center_a.x - center_b.x;
+  const float dy = center_a.y - center_b.y;
+  const float radius_sum = radius_a + radius_b;
+
+  return dx * dx + dy * dy < radius_sum * radius_sum;
+}
+
+}  // namespace collision
+
+#endif  // TILE_COLLISION_H_
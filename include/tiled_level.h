@@ -0,0 +1,95 @@
+#ifndef TILED_LEVEL_H_
+#define TILED_LEVEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "level.h"
+
+/*
+ * tiled_level.h
+ *
+ * This header file defines the TiledLevel class, a cache-friendly copy of a
+ * level for large maps.
+ *
+ * Tiles are grouped into 8 x 8 blocks, each exactly one 64-byte cache line,
+ * and ordered along a Z-order (Morton) curve inside the block. A ray stepping
+ * along either axis therefore stays in the same cache line for most steps,
+ * while the row-major Level touches a new line on every step along X.
+ *
+ * A separate occupancy bitset holds one bit per tile for the "is solid" test
+ * the DDA performs on every step, so the hot working set of a 4k x 4k map is
+ * only 2 MB. The tile IDs are read once, when a wall is hit. SetTile changes
+ * the ID and the occupancy bit of one tile, so a tiled copy of an edited
+ * level is kept in step without copying it again.
+ */
+
+class TiledLevel {
+ public:
+  static constexpr int kBlockShift = 3;
+  static constexpr int kBlockSize = 1 << kBlockShift;
+  static constexpr int kBlockMask = kBlockSize - 1;
+
+ private:
+  struct alignas(64) Block {
+    uint8_t tiles[kBlockSize * kBlockSize];
+  };
+
+  int width_;
+  int height_;
+  int blocks_y_;
+
+  std::vector<Block> blocks_;
+
+  // One 64-bit word per block with the bits in the same order as the tiles.
+  std::vector<uint64_t> occupancy_;
+
+  // Returns the index of the block holding the tile.
+  size_t BlockIndex(int x, int y) const {
+    return static_cast<size_t>(x >> kBlockShift) * blocks_y_ +
+           (y >> kBlockShift);
+  }
+
+  // Returns the Z-order position of the tile inside its block by
+  // interleaving the low three bits of both coordinates.
+  static int MortonOffset(int x, int y) {
+    const auto spread = [](int v) {
+      return (v & 1) | (v & 2) << 1 | (v & 4) << 2;
+    };
+
+    return spread(x & kBlockMask) << 1 | spread(y & kBlockMask);
+  }
+
+ public:
+  explicit TiledLevel(const Level& level);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  bool Contains(int x, int y) const {
+    return static_cast<unsigned>(x) < static_cast<unsigned>(width_) &&
+           static_cast<unsigned>(y) < static_cast<unsigned>(height_);
+  }
+
+  // Returns the ID of the tile, or Level::kOutOfBoundsTile outside the level.
+  int At(int x, int y) const {
+    if (!Contains(x, y)) return Level::kOutOfBoundsTile;
+
+    return blocks_[BlockIndex(x, y)].tiles[MortonOffset(x, y)];
+  }
+
+  // Sets the ID of the tile and its bit in the occupancy bitset. Tiles
+  // outside the level are left alone.
+  void SetTile(int x, int y, uint8_t tile);
+
+  // Returns true if the tile is a wall, including tiles outside the level.
+  // Only reads the occupancy bitset.
+  bool IsSolid(int x, int y) const {
+    if (!Contains(x, y)) return true;
+
+    return occupancy_[BlockIndex(x, y)] >> MortonOffset(x, y) & 1;
+  }
+};
+
+#endif  // TILED_LEVEL_H_
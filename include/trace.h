@@ -0,0 +1,94 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+ * trace.h
+ *
+ * This header file defines a timeline tracer, which records when each frame,
+ * frame stage and thread pool chunk ran, and on which thread.
+ *
+ * Every thread records into its own preallocated ring buffer, so recording
+ * never locks. The buffers keep the latest events of every thread and are
+ * written on exit in the Chrome trace event format, which chrome://tracing
+ * and Perfetto open directly.
+ *
+ * Tracing is off unless Enable() is called. While it is off, a ScopedTrace
+ * costs a single relaxed atomic load.
+ */
+
+namespace tracing {
+
+using Clock = std::chrono::steady_clock;
+
+// Events kept per thread, about a minute of frames on the main thread.
+constexpr int kEventsPerThread = 1 << 16;
+
+namespace internal {
+
+inline std::atomic<bool> enabled{false};
+
+// Appends a complete event to the ring buffer of the calling thread. The
+// range arguments are written only if range_end > range_begin.
+void Record(const char* name,
+            Clock::time_point begin,
+            Clock::time_point end,
+            int range_begin,
+            int range_end);
+
+}  // namespace internal
+
+// Starts recording events. Events are timed relative to the first call.
+void Enable();
+
+inline bool IsEnabled() {
+  return internal::enabled.load(std::memory_order_relaxed);
+}
+
+// Names the calling thread in the trace. Takes effect only if tracing is
+// enabled, and should be called before the thread records any events.
+void SetThreadName(const std::string& name);
+
+// Returns the name of the innermost ScopedTrace open on the calling thread,
+// or null if there is none. The thread pool labels its chunks with the scope
+// that started them.
+const char* CurrentScope();
+
+// Records the time from construction to destruction as one event. The name
+// must be a string literal, or outlive the trace.
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name) : ScopedTrace(name, 0, 0) {}
+
+  // Also records the range [range_begin, range_end) the scope worked on.
+  ScopedTrace(const char* name, int range_begin, int range_end);
+  ~ScopedTrace();
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  const char* name_;
+  const char* outer_scope_;
+  int range_begin_;
+  int range_end_;
+  bool active_;
+  Clock::time_point begin_;
+};
+
+// Writes the events of every thread to the file in the Chrome trace event
+// JSON format. Must only be called while no thread records events. Returns
+// false and sets the error message if the file could not be written.
+bool WriteTrace(const std::string& path, std::string* error);
+
+// Returns the number of events that were overwritten because a ring buffer
+// was full.
+int64_t NumDroppedEvents();
+
+}  // namespace tracing
+
+#endif  // TRACE_H_
@@ -0,0 +1,71 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * triple_buffer.h
+ *
+ * This header file defines the TripleBuffer class template, which hands the
+ * latest value from one writer thread to one reader thread without locks.
+ *
+ * The writer fills the back slot and publishes it by swapping it with the
+ * middle slot. The reader takes the middle slot by swapping it with the front
+ * slot, but only if something new was published. Each swap is a single atomic
+ * exchange, so neither thread ever waits for the other, and the reader always
+ * sees a complete value, skipping older ones it was too slow to read.
+ */
+
+template <typename T>
+class TripleBuffer {
+ private:
+  // The middle index carries this bit while it holds a value the reader has
+  // not taken yet.
+  static constexpr uint8_t kFreshBit = 4;
+  static constexpr uint8_t kIndexMask = 3;
+
+  T slots_[3];
+
+  // Slot indices of each side, on separate cache lines so the threads do not
+  // slow each other down.
+  alignas(64) uint8_t back_ = 0;
+  alignas(64) std::atomic<uint8_t> middle_{1};
+  alignas(64) uint8_t front_ = 2;
+
+ public:
+  explicit TripleBuffer(const T& initial) : slots_{initial, initial, initial} {}
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Returns the slot the writer fills before calling Publish().
+  T& Back() { return slots_[back_]; }
+
+  // Makes the back slot available to the reader. Writer thread only.
+  void Publish() {
+    const uint8_t previous =
+        middle_.exchange(back_ | kFreshBit, std::memory_order_acq_rel);
+    back_ = previous & kIndexMask;
+  }
+
+  // Returns true if a value was published since the last call to Acquire().
+  // Reader thread only.
+  bool HasNew() const {
+    return middle_.load(std::memory_order_relaxed) & kFreshBit;
+  }
+
+  // Returns the most recently published value, or the same value as the last
+  // call if nothing new was published. Reader thread only.
+  const T& Acquire() {
+    if (middle_.load(std::memory_order_relaxed) & kFreshBit) {
+      const uint8_t previous =
+          middle_.exchange(front_, std::memory_order_acq_rel);
+      front_ = previous & kIndexMask;
+    }
+
+    return slots_[front_];
+  }
+};
+
+#endif  // TRIPLE_BUFFER_H_
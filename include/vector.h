@@ -7,8 +7,8 @@
  * vector.h
  *
  * This header file defines the Vector class, which represents a two-dimensional
- * vector and provides operations such as addition, scalar multiplication, and
- * rotation.
+ * vector and provides operations such as addition, subtraction, scalar
+ * multiplication, and rotation.
  */
 
 class Vector {
@@ -19,6 +19,7 @@ class Vector {
 
   Vector operator+(const Vector& other) const;
   Vector& operator+=(const Vector& other);
+  Vector operator-(const Vector& other) const;
   Vector operator*(float scalar) const;
   Vector& operator*=(float scalar);
 
@@ -0,0 +1,165 @@
+#ifndef VISIBILITY_SET_H_
+#define VISIBILITY_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "level.h"
+#include "thread_pool.h"
+
+/*
+ * visibility_set.h
+ *
+ * This header file defines the VisibilitySet class, the potentially visible
+ * set (PVS) of every tile of a level: the tiles that can be seen from
+ * anywhere inside it.
+ *
+ * The set is built offline by casting kRaysPerSample rays all around from
+ * kSamplesPerSide points along each side of every empty tile, and marking
+ * every tile a ray enters up to and including the wall it hits. Any line of
+ * sight from inside a tile leaves it through one of its sides, so points on
+ * the sides see everything points inside do. Rays are dense, but still
+ * samples, so a tile seen only through a gap narrower than the spacing of the
+ * rays may be missed.
+ *
+ * The set of each tile is a bitset over all tiles, in the order of the level
+ * tiles (x * height + y), compressed as the lengths of its alternating runs
+ * of clear and set bits, each written as a variable-length integer of seven
+ * bits per byte, lowest bits first. Sets of solid tiles have every bit set,
+ * so whatever is looked up from inside a wall is never culled.
+ *
+ * When a tile of the level changes, Update keeps every set complete without
+ * rebuilding them all. A new wall only hides tiles, so the sets stay as they
+ * are. A tile that opens gets its own set cast, and as anything seen through
+ * it is seen from inside it too, its set is added to the set of every tile
+ * that sees it. Those tiles are looked for among the tiles it sees, as the
+ * rays that reach it from a tile reach that tile back, and their runs are
+ * merged with its runs without decoding either set. Updated sets are kept
+ * apart from the sets built or loaded, and only merged with them when the
+ * sets are saved, so the cost grows with the number of tiles seen and their
+ * runs rather than with the level.
+ *
+ * Sets are cached in a file next to the level, along with the hash of the
+ * level they were built for. All values are little endian:
+ *
+ *   offset  0  char[4]    magic "RCPV"
+ *   offset  4  uint32     format version (1)
+ *   offset  8  uint32     width
+ *   offset 12  uint32     height
+ *   offset 16  uint64     level::HashLevel of the level
+ *   offset 24  uint64[]   width * height + 1 offsets of the compressed sets
+ *                         into the data, the last one being its size
+ *   then       uint8[]    compressed sets
+ */
+
+// Set of tiles decoded from a VisibilitySet for fast lookups.
+class VisibleTiles {
+ private:
+  int width_ = 0;
+  int height_ = 0;
+
+  // One bit per tile, at x * height + y.
+  std::vector<uint64_t> words_;
+
+  friend class VisibilitySet;
+
+ public:
+  // Returns true if the tile is in the set. Tiles outside the level are not.
+  bool Contains(int x, int y) const {
+    if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+        static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+      return false;
+    }
+
+    const size_t index = static_cast<size_t>(x) * height_ + y;
+    return (words_[index / 64] >> (index % 64)) & 1;
+  }
+
+  // Returns the number of tiles in the set.
+  int64_t Count() const;
+};
+
+class VisibilitySet {
+ public:
+  // Sample points per side of every tile and rays cast from each of them.
+  static constexpr int kSamplesPerSide = 4;
+  static constexpr int kRaysPerSample = 1024;
+
+ private:
+  int width_ = 0;
+  int height_ = 0;
+  uint64_t level_hash_ = 0;
+
+  // Compressed set of every tile as built or loaded, starting at
+  // offsets_[tile] and ending at offsets_[tile + 1].
+  std::vector<uint64_t> offsets_;
+  std::vector<uint8_t> data_;
+
+  // Compressed sets changed by Update since, by tile, which replace those in
+  // the data.
+  std::unordered_map<size_t, std::vector<uint8_t>> updated_sets_;
+
+  // Returns the compressed set of the tile in [*begin, *end).
+  void SetRange(size_t tile, const uint8_t** begin, const uint8_t** end) const;
+
+ public:
+  VisibilitySet() = default;
+
+  // Builds the sets of every tile of the level. Tile columns are built on
+  // the threads of the pool, or on the calling thread if it is null.
+  VisibilitySet(const Level& level, ThreadPool* thread_pool);
+
+  // Updates the sets after the tile of the level changed between empty and
+  // solid. Sets of the tiles that see an opened tile are updated on the
+  // threads of the pool, or on the calling thread if it is null. The level
+  // hash stays that of the level the sets were built for. Returns the number
+  // of sets changed.
+  int Update(const Level& level, int x, int y, ThreadPool* thread_pool);
+
+  // Adds what can be seen through the tile, as if it were empty, to the sets
+  // of the tiles that see it, for a wall that lets light through before it
+  // becomes empty, such as a door that starts to open. Otherwise the same as
+  // Update for an empty tile.
+  int SeeThrough(const Level& level, int x, int y, ThreadPool* thread_pool);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  // Hash of the level the sets were built for.
+  uint64_t LevelHash() const { return level_hash_; }
+
+  // Size of all compressed sets in bytes.
+  size_t CompressedSize() const;
+
+  // Decodes the set of the tile into the output, which keeps its storage
+  // from one call to the next. Tiles outside the level see every tile.
+  void Decode(int x, int y, VisibleTiles* out) const;
+
+  // Returns true if the target tile is in the set of the source tile. Decodes
+  // the set up to the target, so decoding the whole set once is faster for
+  // many lookups from the same tile.
+  bool IsVisible(int from_x, int from_y, int to_x, int to_y) const;
+
+  // Reads the sets from a cache file. Returns false and sets the error
+  // message if the file is missing or malformed.
+  bool Load(const std::string& path, std::string* error);
+
+  // Writes the sets to a cache file.
+  bool Save(const std::string& path, std::string* error) const;
+
+  // Loads the sets of the level from the cache file, or builds them if the
+  // file is missing, malformed or was built for a different level, and
+  // writes the new sets back to the file. Sets rebuilt to true if the sets
+  // were built. Returns false and sets the error message only if the file
+  // could not be written; the sets are valid either way.
+  bool LoadOrBuild(const Level& level,
+                   const std::string& path,
+                   ThreadPool* thread_pool,
+                   bool* rebuilt,
+                   std::string* error);
+};
+
+#endif  // VISIBILITY_SET_H_
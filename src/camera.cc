@@ -1,5 +1,9 @@
 #include "camera.h"
 
+#include "ray_caster.h"
+#include "ray_packet.h"
+#include "tile_collision.h"
+
 raycasting::DDAData::DDAData(float position, float ray_direction) {
   tile = static_cast<int>(position);
 
@@ -19,10 +23,13 @@ raycasting::DDAData::DDAData(float position, float ray_direction) {
 
     init_dist *= delta_dist;
   }
+
+  side_dist = init_dist;
 }
 
-Camera::Camera(float x, float y, float angle, float fov)
-    : plane_length_(std::tan(fov / 2.0f)),
+Camera::Camera(const Level& level, float x, float y, float angle, float fov)
+    : level_(&level),
+      plane_length_(std::tan(fov / 2.0f)),
       position_(x, y),
       direction_(std::cos(angle), std::sin(angle)) {
   UpdatePlane();
@@ -47,6 +54,23 @@ Vector Camera::Plane() const {
   return plane_;
 }
 
+const Level& Camera::GetLevel() const {
+  return *level_;
+}
+
+const DistanceField* Camera::GetDistanceField() const {
+  return distance_field_;
+}
+
+void Camera::SetDistanceField(const DistanceField* distance_field) {
+  distance_field_ = distance_field;
+}
+
+void Camera::SetEntity(EntityWorld* entity_world, int entity) {
+  entity_world_ = entity_world;
+  entity_ = entity;
+}
+
 motion::AccelState Camera::AccelState() const {
   return accel_state_;
 }
@@ -101,27 +125,24 @@ void Camera::SetRotationSpeed(motion::RotationDirection rotation_direction) {
   rotation_speed_ = kMaxRotationSpeed * static_cast<int>(rotation_direction);
 }
 
+void Camera::SetPose(const Vector& position, const Vector& direction) {
+  position_ = position;
+  direction_ = direction;
+  UpdatePlane();
+}
+
 void Camera::HandleMotion(float frame_time) {
   if (movement_speed_ != 0.0f) {
     // Calculates the position offset by scaling the direction with the movement
     // speed.
     const Vector position_offset = direction_ * (movement_speed_ * frame_time);
-    const Vector new_position = position_ + position_offset;
-
-    // Identifies the current and new tiles based on the camera's position.
-    const int tile_x = static_cast<int>(position_.x);
-    const int tile_y = static_cast<int>(position_.y);
-
-    const int tile_new_x = static_cast<int>(new_position.x);
-    const int tile_new_y = static_cast<int>(new_position.y);
 
-    // Checks for collisions independently along each axis, allowing movement
-    // along one axis even if the other collides with a wall.
-    if (level::kLevelData[tile_new_x][tile_y] == 0) {
-      position_.x = new_position.x;
-    }
-    if (level::kLevelData[tile_x][tile_new_y] == 0) {
-      position_.y = new_position.y;
+    if (entity_world_ != nullptr) {
+      entity_world_->Move(entity_, position_offset);
+      position_ = entity_world_->Position(entity_);
+    } else {
+      position_ = collision::MoveWithTileCollision(
+          *level_, position_, position_offset);
     }
   }
 
@@ -136,40 +157,39 @@ raycasting::RayData Camera::CalculateRay(float plane_scalar) const {
   // direction vector.
   const Vector ray_direction = direction_ + plane_ * plane_scalar;
 
-  // Initializes DDA data for the X and Y axes.
-  raycasting::DDAData dda_data_x(position_.x, ray_direction.x);
-  raycasting::DDAData dda_data_y(position_.y, ray_direction.y);
-
-  int wall_id = 0;
-  raycasting::WallSide wall_side;
-
-  // Performs the DDA algorithm until a wall is hit.
-  while (wall_id == 0) {
-    // Selects the shorter distance to the next tile side.
-    if (dda_data_x.init_dist < dda_data_y.init_dist) {
-      dda_data_x.tile += dda_data_x.step;
-      dda_data_x.init_dist += dda_data_x.delta_dist;
-
-      wall_side = raycasting::WallSide::kXSide;
-    } else {
-      dda_data_y.tile += dda_data_y.step;
-      dda_data_y.init_dist += dda_data_y.delta_dist;
+  return raycasting::CastRay(*level_, distance_field_, position_,
+                             ray_direction);
+}
 
-      wall_side = raycasting::WallSide::kYSide;
+void Camera::CalculateRays(const float* plane_scalars,
+                           int count,
+                           raycasting::RayBatch* out) const {
+  int i = 0;
+
+  if (raycasting::HasAVX2() && distance_field_ == nullptr) {
+    for (; i + raycasting::kPacketSize <= count; i += raycasting::kPacketSize) {
+      const raycasting::RayBatch packet_out = {
+        out->distance + i,
+        out->wall_id + i,
+        out->wall_side + i,
+        out->wall_x + i,
+        out->num_steps + i
+      };
+
+      raycasting::CastRayPacketAVX2(
+          *level_, position_, direction_, plane_, plane_scalars + i,
+          packet_out);
     }
-
-    wall_id = level::kLevelData[dda_data_x.tile][dda_data_y.tile];
   }
 
-  float distance = 0;
+  // Traces the remaining rays that do not fill a whole packet.
+  for (; i < count; ++i) {
+    const raycasting::RayData ray_data = CalculateRay(plane_scalars[i]);
 
-  // Selects the last hit distance and compensates for overshooting by one tile
-  // during the DDA.
-  if (wall_side == raycasting::WallSide::kXSide) {
-    distance = dda_data_x.init_dist - dda_data_x.delta_dist;
-  } else if (wall_side == raycasting::WallSide::kYSide) {
-    distance = dda_data_y.init_dist - dda_data_y.delta_dist;
+    out->distance[i] = ray_data.distance;
+    out->wall_id[i] = ray_data.wall_id;
+    out->wall_side[i] = ray_data.wall_side;
+    out->wall_x[i] = ray_data.wall_x;
+    out->num_steps[i] = ray_data.num_steps;
   }
-
-  return raycasting::RayData{ distance, wall_id, wall_side };
 }
@@ -0,0 +1,165 @@
+#include "depth_scanner.h"
+
+#include <cmath>
+
+#include "ray_caster.h"
+#include "ray_packet.h"
+
+namespace {
+
+// Returns the angle of the ray relative to the heading, for a scan of the
+// field of view with the number of rays.
+float PatternRayAngle(float fov, int num_rays, int ray) {
+  using sensing::kFullTurn;
+
+  if (fov >= kFullTurn) return kFullTurn * ray / num_rays;
+  if (num_rays == 1) return 0.0f;
+
+  return fov * (static_cast<float>(ray) / (num_rays - 1) - 0.5f);
+}
+
+// Rotates the vector by the angle with the specified cosine and sine.
+Vector Rotate(const Vector& vector, float cos_angle, float sin_angle) {
+  return Vector(vector.x * cos_angle - vector.y * sin_angle,
+                vector.x * sin_angle + vector.y * cos_angle);
+}
+
+}  // namespace
+
+DepthScanner::DepthScanner(const Level& level) : level_(&level) {}
+
+void DepthScanner::SetDistanceField(const DistanceField* distance_field) {
+  distance_field_ = distance_field;
+}
+
+void DepthScanner::SetPattern(float fov, int num_rays) {
+  fov_ = fov;
+  num_rays_ = num_rays;
+
+  // Resizing keeps the capacity, so only a larger pattern allocates.
+  group_directions_.resize(num_rays);
+  perpendicular_scalars_.resize(num_rays);
+  direction_lengths_.resize(num_rays);
+
+  // Every group spans the same angle, so either all whole groups are traced
+  // in packets or none.
+  const float group_angle =
+      num_rays < raycasting::kPacketSize
+          ? 0.0f
+          : PatternRayAngle(fov, num_rays, raycasting::kPacketSize - 1) -
+                PatternRayAngle(fov, num_rays, 0);
+
+  num_packet_rays_ = num_rays < raycasting::kPacketSize ||
+                             group_angle > sensing::kMaxPacketAngle
+                         ? 0
+                         : num_rays - num_rays % raycasting::kPacketSize;
+
+  for (int ray = 0; ray < num_rays; ++ray) {
+    const float angle = PatternRayAngle(fov, num_rays, ray);
+    float group_angle_middle = angle;
+
+    if (ray < num_packet_rays_) {
+      const int group_first = ray - ray % raycasting::kPacketSize;
+      const int group_last = group_first + raycasting::kPacketSize - 1;
+
+      group_angle_middle =
+          0.5f * (PatternRayAngle(fov, num_rays, group_first) +
+                  PatternRayAngle(fov, num_rays, group_last));
+    }
+
+    const float scalar = std::tan(angle - group_angle_middle);
+
+    group_directions_[ray] =
+        Vector(std::cos(group_angle_middle), std::sin(group_angle_middle));
+    perpendicular_scalars_[ray] = scalar;
+    direction_lengths_[ray] = std::sqrt(1.0f + scalar * scalar);
+  }
+}
+
+float DepthScanner::Fov() const {
+  return fov_;
+}
+
+int DepthScanner::NumRays() const {
+  return num_rays_;
+}
+
+float DepthScanner::RayAngle(int ray) const {
+  return PatternRayAngle(fov_, num_rays_, ray);
+}
+
+void DepthScanner::Scan(const sensing::AgentPoses& poses,
+                        ThreadPool* thread_pool,
+                        const sensing::ScanResults& out) const {
+  if (thread_pool == nullptr) {
+    ScanAgents(poses, 0, poses.num_agents, out);
+    return;
+  }
+
+  thread_pool->ParallelFor(
+      0, poses.num_agents, sensing::kMinAgentChunk,
+      [&](int agent_begin, int agent_end) {
+        ScanAgents(poses, agent_begin, agent_end, out);
+      });
+}
+
+void DepthScanner::ScanAgents(const sensing::AgentPoses& poses,
+                              int agent_begin,
+                              int agent_end,
+                              const sensing::ScanResults& out) const {
+  const bool packets = raycasting::HasAVX2() && distance_field_ == nullptr;
+
+  // The packet traversal also stores the texture coordinate and the number of
+  // steps, which scans do not report.
+  float wall_x[raycasting::kPacketSize];
+  int num_steps[raycasting::kPacketSize];
+
+  for (int agent = agent_begin; agent < agent_end; ++agent) {
+    const Vector position(poses.x[agent], poses.y[agent]);
+    const float cos_heading = std::cos(poses.heading[agent]);
+    const float sin_heading = std::sin(poses.heading[agent]);
+
+    const int first = agent * num_rays_;
+    int ray = 0;
+
+    if (packets) {
+      for (; ray < num_packet_rays_; ray += raycasting::kPacketSize) {
+        const Vector direction =
+            Rotate(group_directions_[ray], cos_heading, sin_heading);
+        const Vector perpendicular(-direction.y, direction.x);
+
+        const raycasting::RayBatch packet_out = {
+          out.distance + first + ray,
+          out.wall_id + first + ray,
+          out.wall_side + first + ray,
+          wall_x,
+          num_steps
+        };
+
+        raycasting::CastRayPacketAVX2(
+            *level_, position, direction, perpendicular,
+            perpendicular_scalars_.data() + ray, packet_out);
+      }
+    }
+
+    // Traces the rays that are not traced in packets, along exactly the same
+    // directions.
+    for (; ray < num_rays_; ++ray) {
+      const Vector direction =
+          Rotate(group_directions_[ray], cos_heading, sin_heading);
+      const Vector perpendicular(-direction.y, direction.x);
+
+      const raycasting::RayData ray_data = raycasting::CastRay(
+          *level_, distance_field_, position,
+          direction + perpendicular * perpendicular_scalars_[ray]);
+
+      out.distance[first + ray] = ray_data.distance;
+      out.wall_id[first + ray] = ray_data.wall_id;
+      out.wall_side[first + ray] = ray_data.wall_side;
+    }
+
+    for (ray = 0; ray < num_rays_; ++ray) {
+      out.distance[first + ray] *= direction_lengths_[ray];
+    }
+  }
+}
@@ -0,0 +1,161 @@
+#include "distance_field.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Runs the transform on the window of tiles [x_begin, x_end) x
+// [y_begin, y_end) of the level and stores the distances at
+// (x - x_begin) * (y_end - y_begin) + y - y_begin. Tiles outside the level
+// count as walls, and tiles of the level outside the window as
+// kMaxDistance, which is never less than their actual distance.
+void Transform(const Level& level,
+               int x_begin,
+               int x_end,
+               int y_begin,
+               int y_end,
+               uint8_t* distances) {
+  constexpr int kMaxDistance = DistanceField::kMaxDistance;
+
+  // The window is surrounded by a border of one tile holding the distances
+  // of the tiles around it, so neighbors are read without any bounds checks.
+  const int window_width = x_end - x_begin;
+  const int window_height = y_end - y_begin;
+  const size_t stride = static_cast<size_t>(window_height) + 2;
+
+  std::vector<uint8_t> padded((window_width + 2) * stride);
+
+  const auto set_border = [&](int x, int y) {
+    padded[(x - x_begin + 1) * stride + (y - y_begin + 1)] =
+        level.Contains(x, y) ? kMaxDistance : 0;
+  };
+
+  for (int y = y_begin - 1; y <= y_end; ++y) {
+    set_border(x_begin - 1, y);
+    set_border(x_end, y);
+  }
+
+  for (int x = x_begin; x < x_end; ++x) {
+    set_border(x, y_begin - 1);
+    set_border(x, y_end);
+  }
+
+  // The Chebyshev distance is exact with an 8-connected two-pass chamfer
+  // transform in which every neighbor is one step away. The forward pass
+  // propagates distances from walls above and to the left, the backward pass
+  // from walls below and to the right.
+  for (int x = x_begin; x < x_end; ++x) {
+    uint8_t* column = &padded[(x - x_begin + 1) * stride + 1];
+    const uint8_t* previous = column - stride;
+
+    for (int y = 0; y < window_height; ++y) {
+      int tile_distance = 0;
+
+      if (!level.IsSolid(x, y_begin + y)) {
+        const int nearest = std::min({ previous[y - 1], previous[y],
+                                       previous[y + 1], column[y - 1] });
+        tile_distance = std::min(nearest + 1, kMaxDistance);
+      }
+
+      column[y] = static_cast<uint8_t>(tile_distance);
+    }
+  }
+
+  for (int x = x_end - 1; x >= x_begin; --x) {
+    uint8_t* column = &padded[(x - x_begin + 1) * stride + 1];
+    const uint8_t* next = column + stride;
+
+    for (int y = window_height - 1; y >= 0; --y) {
+      if (column[y] == 0) continue;
+
+      const int nearest = std::min({ next[y + 1], next[y], next[y - 1],
+                                     column[y + 1] });
+
+      column[y] = static_cast<uint8_t>(std::min<int>(column[y], nearest + 1));
+    }
+
+    std::copy_n(column, window_height,
+                distances + static_cast<size_t>(x - x_begin) * window_height);
+  }
+}
+
+}  // namespace
+
+DistanceField::DistanceField(const Level& level)
+    : width_(level.Width()),
+      height_(level.Height()),
+      distances_(static_cast<size_t>(level.Width()) * level.Height()) {
+  // The same passes as Transform, but in place, as the window would be the
+  // whole level. At() reads tiles outside the level as walls, which keeps
+  // jumps inside the level.
+  for (int x = 0; x < width_; ++x) {
+    for (int y = 0; y < height_; ++y) {
+      int tile_distance = 0;
+
+      if (!level.IsSolid(x, y)) {
+        const int nearest = std::min({ At(x - 1, y - 1),
+                                       At(x - 1, y),
+                                       At(x - 1, y + 1),
+                                       At(x, y - 1) });
+        tile_distance = std::min(nearest + 1, kMaxDistance);
+      }
+
+      distances_[static_cast<size_t>(x) * height_ + y] =
+          static_cast<uint8_t>(tile_distance);
+    }
+  }
+
+  for (int x = width_ - 1; x >= 0; --x) {
+    for (int y = height_ - 1; y >= 0; --y) {
+      const size_t index = static_cast<size_t>(x) * height_ + y;
+
+      if (distances_[index] == 0) continue;
+
+      const int nearest = std::min({ At(x + 1, y + 1),
+                                     At(x + 1, y),
+                                     At(x + 1, y - 1),
+                                     At(x, y + 1) });
+
+      distances_[index] = static_cast<uint8_t>(
+          std::min<int>(distances_[index], nearest + 1));
+    }
+  }
+}
+
+void DistanceField::Update(const Level& level, int x, int y) {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    return;
+  }
+
+  // Tiles whose distance may change, and the window holding their nearest
+  // walls around them.
+  const int changed_reach = kMaxDistance - 1;
+  const int window_reach = changed_reach + kMaxDistance;
+
+  const int x_begin = std::max(x - window_reach, 0);
+  const int x_end = std::min(x + window_reach + 1, width_);
+  const int y_begin = std::max(y - window_reach, 0);
+  const int y_end = std::min(y + window_reach + 1, height_);
+  const int window_height = y_end - y_begin;
+
+  std::vector<uint8_t> window(static_cast<size_t>(x_end - x_begin) *
+                              window_height);
+  Transform(level, x_begin, x_end, y_begin, y_end, window.data());
+
+  const int changed_x_end = std::min(x + changed_reach + 1, width_);
+  const int changed_y_begin = std::max(y - changed_reach, 0);
+  const int changed_y_end = std::min(y + changed_reach + 1, height_);
+
+  for (int changed_x = std::max(x - changed_reach, 0);
+       changed_x < changed_x_end; ++changed_x) {
+    std::copy_n(window.begin() +
+                    static_cast<size_t>(changed_x - x_begin) * window_height +
+                    (changed_y_begin - y_begin),
+                changed_y_end - changed_y_begin,
+                distances_.begin() +
+                    static_cast<size_t>(changed_x) * height_ +
+                    changed_y_begin);
+  }
+}
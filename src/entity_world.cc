@@ -0,0 +1,137 @@
+#include "entity_world.h"
+
+#include <algorithm>
+
+namespace {
+
+// Number of buckets of an empty world.
+constexpr int kMinBuckets = 64;
+
+int TileOf(float coordinate) {
+  return static_cast<int>(std::floor(coordinate));
+}
+
+}  // namespace
+
+EntityWorld::EntityWorld(const Level& level) : level_(&level) {
+  Rehash(kMinBuckets);
+}
+
+int EntityWorld::Add(const Vector& position, float radius) {
+  const int entity = NumEntities();
+
+  // Larger radii are clamped, as ForEachNear only visits neighboring tiles.
+  positions_.push_back(position);
+  radii_.push_back(std::min(radius, kMaxRadius));
+  tile_x_.push_back(TileOf(position.x));
+  tile_y_.push_back(TileOf(position.y));
+  next_.push_back(kNone);
+  previous_.push_back(kNone);
+
+  // Keeps at most one entity per bucket on average.
+  if (NumEntities() > static_cast<int>(bucket_heads_.size())) {
+    Rehash(2 * static_cast<int>(bucket_heads_.size()));
+  } else {
+    Link(entity);
+  }
+
+  return entity;
+}
+
+int EntityWorld::NumEntities() const {
+  return static_cast<int>(positions_.size());
+}
+
+Vector EntityWorld::Position(int entity) const {
+  return positions_[entity];
+}
+
+float EntityWorld::Radius(int entity) const {
+  return radii_[entity];
+}
+
+int64_t EntityWorld::NumRebins() const {
+  return num_rebins_;
+}
+
+void EntityWorld::Move(int entity, const Vector& offset) {
+  const float radius = radii_[entity];
+  Vector position = collision::MoveCircleWithTileCollision(
+      *level_, positions_[entity], radius, offset);
+
+  // Pushes the entity straight away from every entity it overlaps, by the
+  // depth of the overlap. Entities at the very same position have no
+  // direction to push along and are left overlapping.
+  const Vector moved_position = position;
+
+  ForEachNear(moved_position, radius, [&](int other) {
+    if (other == entity) return;
+
+    const Vector away = position - positions_[other];
+    const float distance = std::sqrt(away.x * away.x + away.y * away.y);
+    const float overlap = radius + radii_[other] - distance;
+
+    if (distance > 0.0f && overlap > 0.0f) {
+      position = collision::MoveCircleWithTileCollision(
+          *level_, position, radius, away * (overlap / distance));
+    }
+  });
+
+  positions_[entity] = position;
+
+  const int tile_x = TileOf(position.x);
+  const int tile_y = TileOf(position.y);
+
+  if (tile_x != tile_x_[entity] || tile_y != tile_y_[entity]) {
+    Unlink(entity);
+    tile_x_[entity] = tile_x;
+    tile_y_[entity] = tile_y;
+    Link(entity);
+    ++num_rebins_;
+  }
+}
+
+int EntityWorld::Bucket(int tile_x, int tile_y) const {
+  uint32_t hash = static_cast<uint32_t>(tile_x) * 0x9e3779b1u ^
+                  static_cast<uint32_t>(tile_y) * 0x85ebca77u;
+  hash ^= hash >> 15;
+
+  return static_cast<int>(hash & bucket_mask_);
+}
+
+void EntityWorld::Link(int entity) {
+  int& head = bucket_heads_[Bucket(tile_x_[entity], tile_y_[entity])];
+
+  previous_[entity] = kNone;
+  next_[entity] = head;
+
+  if (head != kNone) {
+    previous_[head] = entity;
+  }
+
+  head = entity;
+}
+
+void EntityWorld::Unlink(int entity) {
+  const int previous = previous_[entity];
+  const int next = next_[entity];
+
+  if (previous != kNone) {
+    next_[previous] = next;
+  } else {
+    bucket_heads_[Bucket(tile_x_[entity], tile_y_[entity])] = next;
+  }
+
+  if (next != kNone) {
+    previous_[next] = previous;
+  }
+}
+
+void EntityWorld::Rehash(int num_buckets) {
+  bucket_heads_.assign(num_buckets, kNone);
+  bucket_mask_ = static_cast<uint32_t>(num_buckets - 1);
+
+  for (int entity = 0; entity < NumEntities(); ++entity) {
+    Link(entity);
+  }
+}
@@ -0,0 +1,340 @@
+#include "floor_caster.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "ray_packet.h"
+
+namespace {
+
+// Pixels of a lit row whose light is calculated together, into a buffer on
+// the stack. A multiple of the eight pixels drawn at once with AVX2.
+constexpr int kLightBlockSize = 64;
+
+// Texture walk along one row pair, with coordinates and steps in 16.16 fixed
+// point texels of the selected mip level. Coordinates only matter modulo the
+// texture size, so they are allowed to wrap around.
+struct FloorRow {
+  uint32_t u;
+  uint32_t v;
+  uint32_t u_step;
+  uint32_t v_step;
+
+  uint32_t mask;
+  int size_shift;
+
+  const uint32_t* floor_texels;
+  const uint32_t* ceiling_texels;
+
+  // Light of the pixels from light_begin on, shared by the floor and the
+  // ceiling, or null if the row is unlit.
+  const uint32_t* light;
+  int light_begin;
+
+  // Rows of the frame buffer and their Y coordinates.
+  uint32_t* floor_pixels;
+  uint32_t* ceiling_pixels;
+  int floor_y;
+  int ceiling_y;
+};
+
+// Converts a texture coordinate in texels to 16.16 fixed point.
+uint32_t ToFixed(float texels) {
+  return static_cast<uint32_t>(static_cast<int32_t>(texels * 65536.0f));
+}
+
+// Walk of the world position along a row, in 32.32 fixed point floor texels
+// of the lightmap, fine enough not to drift by a pixel across the row, and
+// the light of the texel it is in.
+struct LightWalk {
+  int64_t u;
+  int64_t v;
+  int64_t u_step;
+  int64_t v_step;
+
+  int texel_x;
+  int texel_y;
+  uint32_t texel_light;
+};
+
+// Starts the light walk at the world position under the first pixel of a
+// row.
+LightWalk StartLightWalk(const Lightmap& lightmap,
+                         const Vector& start,
+                         const Vector& step) {
+  constexpr double kScale = Lightmap::kFloorTexels * 4294967296.0;
+
+  LightWalk walk;
+  walk.u = static_cast<int64_t>(std::floor(start.x * kScale));
+  walk.v = static_cast<int64_t>(std::floor(start.y * kScale));
+  walk.u_step = static_cast<int64_t>(step.x * kScale);
+  walk.v_step = static_cast<int64_t>(step.y * kScale);
+  walk.texel_x = static_cast<int>(walk.u >> 32);
+  walk.texel_y = static_cast<int>(walk.v >> 32);
+  walk.texel_light = lightmap.FloorTexelLight(walk.texel_x, walk.texel_y);
+
+  return walk;
+}
+
+// Fills the light of the next count pixels of the row and moves the walk
+// past them. The lightmap is only read again where the walk enters another
+// texel.
+void WalkLight(const Lightmap& lightmap,
+               int count,
+               LightWalk* walk,
+               uint32_t* light) {
+  for (int i = 0; i < count; ++i) {
+    const int texel_x = static_cast<int>(walk->u >> 32);
+    const int texel_y = static_cast<int>(walk->v >> 32);
+
+    if (texel_x != walk->texel_x || texel_y != walk->texel_y) {
+      walk->texel_x = texel_x;
+      walk->texel_y = texel_y;
+      walk->texel_light = lightmap.FloorTexelLight(texel_x, texel_y);
+    }
+    light[i] = walk->texel_light;
+
+    walk->u += walk->u_step;
+    walk->v += walk->v_step;
+  }
+}
+
+// Draws the pixels in the range [x_begin, x_end) of the row pair one at a
+// time. Used without AVX2 and for the columns left over after the last full
+// group of eight.
+void RenderRowPixels(const FloorRow& row,
+                     const rendering::ColumnBuffers& column_buffers,
+                     int x_begin,
+                     int x_end) {
+  uint32_t u = row.u + static_cast<uint32_t>(x_begin) * row.u_step;
+  uint32_t v = row.v + static_cast<uint32_t>(x_begin) * row.v_step;
+
+  for (int x = x_begin; x < x_end; ++x) {
+    const uint32_t texel = (u >> 16 & row.mask) << row.size_shift |
+                           (v >> 16 & row.mask);
+
+    if (row.floor_y > column_buffers.draw_end[x]) {
+      row.floor_pixels[x] =
+          row.light != nullptr
+              ? lighting::Modulate(row.floor_texels[texel],
+                                   row.light[x - row.light_begin])
+              : row.floor_texels[texel];
+    }
+    if (row.ceiling_y < column_buffers.draw_start[x]) {
+      row.ceiling_pixels[x] =
+          row.light != nullptr
+              ? lighting::Modulate(row.ceiling_texels[texel],
+                                   row.light[x - row.light_begin])
+              : row.ceiling_texels[texel];
+    }
+
+    u += row.u_step;
+    v += row.v_step;
+  }
+}
+
+// Multiplies eight colors by their lights exactly like lighting::Modulate,
+// with every channel widened to 16 bits.
+__attribute__((target("avx2")))
+__m256i ModulateAVX2(__m256i color, __m256i light) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi16(1);
+
+  const __m256i low = _mm256_srli_epi16(
+      _mm256_mullo_epi16(
+          _mm256_unpacklo_epi8(color, zero),
+          _mm256_add_epi16(_mm256_unpacklo_epi8(light, zero), one)),
+      8);
+  const __m256i high = _mm256_srli_epi16(
+      _mm256_mullo_epi16(
+          _mm256_unpackhi_epi8(color, zero),
+          _mm256_add_epi16(_mm256_unpackhi_epi8(light, zero), one)),
+      8);
+
+  return _mm256_or_si256(_mm256_packus_epi16(low, high),
+                         _mm256_set1_epi32(static_cast<int>(0xff000000)));
+}
+
+// Draws the pixels in the range [x_begin, x_end) of the row pair eight at a
+// time and returns the first column it did not draw. Groups of pixels that
+// are all covered by walls skip the texture reads.
+__attribute__((target("avx2")))
+int RenderRowPixelsAVX2(const FloorRow& row,
+                        const rendering::ColumnBuffers& column_buffers,
+                        int x_begin,
+                        int x_end) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i u_step = _mm256_set1_epi32(row.u_step * 8);
+  const __m256i v_step = _mm256_set1_epi32(row.v_step * 8);
+  const __m256i mask = _mm256_set1_epi32(row.mask);
+  const __m128i size_shift = _mm_cvtsi32_si128(row.size_shift);
+
+  const __m256i floor_y = _mm256_set1_epi32(row.floor_y);
+  const __m256i ceiling_y = _mm256_set1_epi32(row.ceiling_y);
+
+  // Multiplication wraps like the repeated additions of the scalar loop, so
+  // both produce the same coordinates.
+  __m256i u = _mm256_add_epi32(
+      _mm256_set1_epi32(row.u + static_cast<uint32_t>(x_begin) * row.u_step),
+      _mm256_mullo_epi32(lanes, _mm256_set1_epi32(row.u_step)));
+  __m256i v = _mm256_add_epi32(
+      _mm256_set1_epi32(row.v + static_cast<uint32_t>(x_begin) * row.v_step),
+      _mm256_mullo_epi32(lanes, _mm256_set1_epi32(row.v_step)));
+
+  int x = x_begin;
+
+  for (; x + 8 <= x_end; x += 8) {
+    const __m256i draw_start = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(&column_buffers.draw_start[x]));
+    const __m256i draw_end = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(&column_buffers.draw_end[x]));
+
+    const __m256i floor_visible = _mm256_cmpgt_epi32(floor_y, draw_end);
+    const __m256i ceiling_visible = _mm256_cmpgt_epi32(draw_start, ceiling_y);
+
+    if (!_mm256_testz_si256(_mm256_or_si256(floor_visible, ceiling_visible),
+                            _mm256_set1_epi32(-1))) {
+      const __m256i texel = _mm256_or_si256(
+          _mm256_sll_epi32(
+              _mm256_and_si256(_mm256_srli_epi32(u, 16), mask), size_shift),
+          _mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+
+      __m256i floor_color = _mm256_mask_i32gather_epi32(
+          _mm256_setzero_si256(),
+          reinterpret_cast<const int*>(row.floor_texels),
+          texel, floor_visible, sizeof(uint32_t));
+      __m256i ceiling_color = _mm256_mask_i32gather_epi32(
+          _mm256_setzero_si256(),
+          reinterpret_cast<const int*>(row.ceiling_texels),
+          texel, ceiling_visible, sizeof(uint32_t));
+
+      if (row.light != nullptr) {
+        const __m256i light = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(
+                row.light + (x - row.light_begin)));
+
+        floor_color = ModulateAVX2(floor_color, light);
+        ceiling_color = ModulateAVX2(ceiling_color, light);
+      }
+
+      _mm256_maskstore_epi32(reinterpret_cast<int*>(row.floor_pixels + x),
+                             floor_visible, floor_color);
+      _mm256_maskstore_epi32(reinterpret_cast<int*>(row.ceiling_pixels + x),
+                             ceiling_visible, ceiling_color);
+    }
+
+    u = _mm256_add_epi32(u, u_step);
+    v = _mm256_add_epi32(v, v_step);
+  }
+
+  return x;
+}
+
+}  // namespace
+
+void rendering::RenderFloorAndCeiling(
+    const Camera& camera,
+    const TextureAtlas& texture_atlas,
+    const Lightmap* lightmap,
+    const ColumnBuffers& column_buffers,
+    int y_begin,
+    int y_end,
+    FrameBuffer* frame_buffer) {
+  const int width = frame_buffer->Width();
+  const int max_y = frame_buffer->Height() - 1;
+
+  // A wall at distance d spans max_y / d rows centered on the horizon, so the
+  // floor d away is max_y / (2 * d) rows below it.
+  const float horizon = max_y / 2.0f;
+
+  // Rays through the left and right edges of the screen.
+  const Vector position = camera.Position();
+  const Vector left_ray = camera.Direction() - camera.Plane();
+  const Vector right_ray = camera.Direction() + camera.Plane();
+
+  const bool use_avx2 = raycasting::HasAVX2();
+
+  for (int y = y_begin; y < y_end; ++y) {
+    const int ceiling_y = max_y - y;
+    uint32_t* floor_pixels =
+        frame_buffer->Pixels() + static_cast<size_t>(y) * width;
+    uint32_t* ceiling_pixels =
+        frame_buffer->Pixels() + static_cast<size_t>(ceiling_y) * width;
+
+    const float rows_below_horizon = y - horizon;
+
+    if (rows_below_horizon <= 0.0f) {
+      for (int x = 0; x < width; ++x) {
+        if (y > column_buffers.draw_end[x] ||
+            y < column_buffers.draw_start[x]) {
+          floor_pixels[x] = ToARGB(kFloorColor);
+        }
+      }
+      continue;
+    }
+
+    const float row_distance = horizon / rows_below_horizon;
+
+    // World position under the first pixel and the step between pixels.
+    const Vector start = position + left_ray * row_distance;
+    const Vector step =
+        (right_ray - left_ray) * (row_distance / (width - 1.0f));
+
+    // Selects the mip level by how many texels one pixel covers along the
+    // row, which grows with the distance.
+    const int mip_level = TextureAtlas::MipLevel(
+        std::max(std::abs(step.x), std::abs(step.y)) * TextureAtlas::kSize);
+    const int size_shift = TextureAtlas::kSizeShift - mip_level;
+    const float size = static_cast<float>(1 << size_shift);
+
+    FloorRow row;
+    row.u = ToFixed((start.x - std::floor(start.x)) * size);
+    row.v = ToFixed((start.y - std::floor(start.y)) * size);
+    row.u_step = ToFixed(step.x * size);
+    row.v_step = ToFixed(step.y * size);
+    row.mask = (1u << size_shift) - 1;
+    row.size_shift = size_shift;
+    row.floor_texels =
+        texture_atlas.Texels(TextureAtlas::kFloorTexture, mip_level);
+    row.ceiling_texels =
+        texture_atlas.Texels(TextureAtlas::kCeilingTexture, mip_level);
+    row.light = nullptr;
+    row.light_begin = 0;
+    row.floor_pixels = floor_pixels;
+    row.ceiling_pixels = ceiling_pixels;
+    row.floor_y = y;
+    row.ceiling_y = ceiling_y;
+
+    if (lightmap == nullptr) {
+      const int x_tail =
+          use_avx2 ? RenderRowPixelsAVX2(row, column_buffers, 0, width) : 0;
+
+      RenderRowPixels(row, column_buffers, x_tail, width);
+      continue;
+    }
+
+    // A lit row is drawn a block at a time, after walking the light of the
+    // block.
+    LightWalk light_walk = StartLightWalk(*lightmap, start, step);
+    uint32_t light[kLightBlockSize];
+
+    row.light = light;
+
+    for (int block_begin = 0; block_begin < width;
+         block_begin += kLightBlockSize) {
+      const int block_end = std::min(block_begin + kLightBlockSize, width);
+
+      WalkLight(*lightmap, block_end - block_begin, &light_walk, light);
+      row.light_begin = block_begin;
+
+      const int x_tail =
+          use_avx2 ? RenderRowPixelsAVX2(row, column_buffers, block_begin,
+                                         block_end)
+                   : block_begin;
+
+      RenderRowPixels(row, column_buffers, x_tail, block_end);
+    }
+  }
+}
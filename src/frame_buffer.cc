@@ -0,0 +1,51 @@
+#include "frame_buffer.h"
+
+#include <algorithm>
+
+FrameBuffer::FrameBuffer(int width, int height)
+    : width_(width),
+      height_(height),
+      pixels_(static_cast<size_t>(width) * height) {}
+
+int FrameBuffer::Width() const {
+  return width_;
+}
+
+int FrameBuffer::Height() const {
+  return height_;
+}
+
+uint32_t* FrameBuffer::Pixels() {
+  return pixels_.data();
+}
+
+const uint32_t* FrameBuffer::Pixels() const {
+  return pixels_.data();
+}
+
+int FrameBuffer::Pitch() const {
+  return width_ * static_cast<int>(sizeof(uint32_t));
+}
+
+void FrameBuffer::FillRows(int y_begin, int y_end, uint32_t color) {
+  y_begin = std::max(y_begin, 0);
+  y_end = std::min(y_end, height_);
+
+  if (y_begin >= y_end) return;
+
+  std::fill(pixels_.begin() + static_cast<size_t>(y_begin) * width_,
+            pixels_.begin() + static_cast<size_t>(y_end) * width_,
+            color);
+}
+
+void FrameBuffer::DrawColumn(int x, int y_begin, int y_end, uint32_t color) {
+  y_begin = std::max(y_begin, 0);
+  y_end = std::min(y_end, height_ - 1);
+
+  uint32_t* pixel = pixels_.data() + static_cast<size_t>(y_begin) * width_ + x;
+
+  for (int y = y_begin; y <= y_end; ++y) {
+    *pixel = color;
+    pixel += width_;
+  }
+}
@@ -0,0 +1,441 @@
+#include "frame_capture.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "ray_packet.h"
+#include "trace.h"
+
+namespace {
+
+// Fixed-point BT.601 limited range coefficients, scaled by 256. Chroma is
+// calculated from the sum of four pixels, so its coefficients apply to a
+// scale of 1024.
+constexpr int kYRed = 66;
+constexpr int kYGreen = 129;
+constexpr int kYBlue = 25;
+constexpr int kURed = -38;
+constexpr int kUGreen = -74;
+constexpr int kUBlue = 112;
+constexpr int kVRed = 112;
+constexpr int kVGreen = -94;
+constexpr int kVBlue = -18;
+
+constexpr char kY4MFrameHeader[] = "FRAME\n";
+constexpr size_t kY4MFrameHeaderSize = sizeof(kY4MFrameHeader) - 1;
+
+int Red(uint32_t pixel) { return pixel >> 16 & 0xff; }
+int Green(uint32_t pixel) { return pixel >> 8 & 0xff; }
+int Blue(uint32_t pixel) { return pixel & 0xff; }
+
+uint8_t Luma(uint32_t pixel) {
+  return static_cast<uint8_t>(
+      ((kYRed * Red(pixel) + kYGreen * Green(pixel) + kYBlue * Blue(pixel) +
+        128) >> 8) + 16);
+}
+
+// Converts the sums of the channels of four pixels to chroma. The shift of
+// a negative value is arithmetic, as with _mm256_srai_epi32.
+uint8_t Chroma(int red, int green, int blue,
+               int red_scale, int green_scale, int blue_scale) {
+  return static_cast<uint8_t>(
+      ((red_scale * red + green_scale * green + blue_scale * blue + 512) >>
+       10) + 128);
+}
+
+// Converts the luma of every row from the column luma_x_begin on and the
+// chroma of every row pair from the chroma column chroma_x_begin on, one
+// pixel at a time. The last column and row of an odd size stand in for the
+// missing ones.
+void ConvertRowsScalar(const uint32_t* pixels,
+                       int width,
+                       int height,
+                       int luma_x_begin,
+                       int chroma_x_begin,
+                       uint8_t* out) {
+  const int chroma_width = (width + 1) / 2;
+  const int chroma_height = (height + 1) / 2;
+  uint8_t* y_plane = out;
+  uint8_t* u_plane = out + static_cast<size_t>(width) * height;
+  uint8_t* v_plane =
+      u_plane + static_cast<size_t>(chroma_width) * chroma_height;
+
+  for (int y = 0; y < height; ++y) {
+    const uint32_t* row = pixels + static_cast<size_t>(y) * width;
+    uint8_t* y_row = y_plane + static_cast<size_t>(y) * width;
+
+    for (int x = luma_x_begin; x < width; ++x) {
+      y_row[x] = Luma(row[x]);
+    }
+  }
+
+  for (int chroma_y = 0; chroma_y < chroma_height; ++chroma_y) {
+    const uint32_t* row0 =
+        pixels + static_cast<size_t>(2 * chroma_y) * width;
+    const uint32_t* row1 =
+        pixels + static_cast<size_t>(std::min(2 * chroma_y + 1, height - 1)) *
+                     width;
+    uint8_t* u_row = u_plane + static_cast<size_t>(chroma_y) * chroma_width;
+    uint8_t* v_row = v_plane + static_cast<size_t>(chroma_y) * chroma_width;
+
+    for (int chroma_x = chroma_x_begin; chroma_x < chroma_width; ++chroma_x) {
+      const int x0 = 2 * chroma_x;
+      const int x1 = std::min(x0 + 1, width - 1);
+
+      const int red =
+          Red(row0[x0]) + Red(row0[x1]) + Red(row1[x0]) + Red(row1[x1]);
+      const int green = Green(row0[x0]) + Green(row0[x1]) + Green(row1[x0]) +
+                        Green(row1[x1]);
+      const int blue =
+          Blue(row0[x0]) + Blue(row0[x1]) + Blue(row1[x0]) + Blue(row1[x1]);
+
+      u_row[chroma_x] = Chroma(red, green, blue, kURed, kUGreen, kUBlue);
+      v_row[chroma_x] = Chroma(red, green, blue, kVRed, kVGreen, kVBlue);
+    }
+  }
+}
+
+// Stores the low bytes of the eight 32-bit lanes.
+__attribute__((target("avx2")))
+void StoreBytes(__m256i values, uint8_t* out) {
+  const __m256i words = _mm256_packus_epi32(values, values);
+  const __m256i bytes = _mm256_packus_epi16(words, words);
+
+  // Every 128-bit lane holds its four bytes at the bottom.
+  const __m256i packed = _mm256_permutevar8x32_epi32(
+      bytes, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(out),
+                   _mm256_castsi256_si128(packed));
+}
+
+// Returns the channel of the pixels that starts at the bit shift.
+__attribute__((target("avx2")))
+__m256i Channel(__m256i pixels, __m128i shift) {
+  return _mm256_and_si256(_mm256_srl_epi32(pixels, shift),
+                          _mm256_set1_epi32(0xff));
+}
+
+// Sums every pair of neighboring lanes of the two vectors of eight pixels,
+// in pixel order.
+__attribute__((target("avx2")))
+__m256i SumPairs(__m256i first, __m256i second) {
+  // hadd sums within 128-bit lanes: the 64-bit quarters come out as the
+  // pairs of first 0-3, second 0-3, first 4-7 and second 4-7.
+  return _mm256_permute4x64_epi64(_mm256_hadd_epi32(first, second),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// Returns the weighted sum of the channels, lane by lane.
+__attribute__((target("avx2")))
+__m256i Weigh(__m256i red, __m256i green, __m256i blue,
+              int red_scale, int green_scale, int blue_scale) {
+  return _mm256_add_epi32(
+      _mm256_add_epi32(
+          _mm256_mullo_epi32(red, _mm256_set1_epi32(red_scale)),
+          _mm256_mullo_epi32(green, _mm256_set1_epi32(green_scale))),
+      _mm256_mullo_epi32(blue, _mm256_set1_epi32(blue_scale)));
+}
+
+}  // namespace
+
+size_t capture::I420Size(int width, int height) {
+  const size_t chroma_size = static_cast<size_t>((width + 1) / 2) *
+                             ((height + 1) / 2);
+
+  return static_cast<size_t>(width) * height + 2 * chroma_size;
+}
+
+void capture::ConvertToI420(const uint32_t* pixels,
+                            int width,
+                            int height,
+                            uint8_t* out) {
+  if (raycasting::HasAVX2()) {
+    ConvertToI420AVX2(pixels, width, height, out);
+  } else {
+    ConvertToI420Scalar(pixels, width, height, out);
+  }
+}
+
+void capture::ConvertToI420Scalar(const uint32_t* pixels,
+                                  int width,
+                                  int height,
+                                  uint8_t* out) {
+  ConvertRowsScalar(pixels, width, height, 0, 0, out);
+}
+
+__attribute__((target("avx2")))
+void capture::ConvertToI420AVX2(const uint32_t* pixels,
+                                int width,
+                                int height,
+                                uint8_t* out) {
+  const int chroma_width = (width + 1) / 2;
+  const int chroma_height = (height + 1) / 2;
+  uint8_t* y_plane = out;
+  uint8_t* u_plane = out + static_cast<size_t>(width) * height;
+  uint8_t* v_plane =
+      u_plane + static_cast<size_t>(chroma_width) * chroma_height;
+
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  const __m256i luma_round = _mm256_set1_epi32(128);
+  const __m256i luma_offset = _mm256_set1_epi32(16);
+  const __m256i chroma_round = _mm256_set1_epi32(512);
+  const __m256i chroma_offset = _mm256_set1_epi32(128);
+
+  // Luma eight pixels at a time, up to the last whole group of a row.
+  const int luma_end = width / 8 * 8;
+
+  for (int y = 0; y < height; ++y) {
+    const uint32_t* row = pixels + static_cast<size_t>(y) * width;
+    uint8_t* y_row = y_plane + static_cast<size_t>(y) * width;
+
+    for (int x = 0; x < luma_end; x += 8) {
+      const __m256i pixel =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+
+      const __m256i luma = Weigh(
+          _mm256_and_si256(_mm256_srli_epi32(pixel, 16), byte_mask),
+          _mm256_and_si256(_mm256_srli_epi32(pixel, 8), byte_mask),
+          _mm256_and_si256(pixel, byte_mask),
+          kYRed, kYGreen, kYBlue);
+
+      StoreBytes(
+          _mm256_add_epi32(
+              _mm256_srli_epi32(_mm256_add_epi32(luma, luma_round), 8),
+              luma_offset),
+          y_row + x);
+    }
+  }
+
+  // Chroma eight samples, from 16 x 2 pixels, at a time, up to the last
+  // whole group of a row pair.
+  const int chroma_end = width / 16 * 8;
+
+  for (int chroma_y = 0; chroma_y < chroma_height; ++chroma_y) {
+    const uint32_t* row0 =
+        pixels + static_cast<size_t>(2 * chroma_y) * width;
+    const uint32_t* row1 =
+        pixels + static_cast<size_t>(std::min(2 * chroma_y + 1, height - 1)) *
+                     width;
+    uint8_t* u_row = u_plane + static_cast<size_t>(chroma_y) * chroma_width;
+    uint8_t* v_row = v_plane + static_cast<size_t>(chroma_y) * chroma_width;
+
+    for (int chroma_x = 0; chroma_x < chroma_end; chroma_x += 8) {
+      const int x = 2 * chroma_x;
+
+      const __m256i top_left =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x));
+      const __m256i top_right =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x + 8));
+      const __m256i bottom_left =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x));
+      const __m256i bottom_right =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x + 8));
+
+      // Sums of each channel over every 2 x 2 block.
+      __m256i sums[3];
+
+      for (int channel = 0; channel < 3; ++channel) {
+        const __m128i shift = _mm_cvtsi32_si128(16 - 8 * channel);
+
+        sums[channel] = SumPairs(
+            _mm256_add_epi32(Channel(top_left, shift),
+                             Channel(bottom_left, shift)),
+            _mm256_add_epi32(Channel(top_right, shift),
+                             Channel(bottom_right, shift)));
+      }
+
+      const __m256i u = Weigh(sums[0], sums[1], sums[2],
+                              kURed, kUGreen, kUBlue);
+      const __m256i v = Weigh(sums[0], sums[1], sums[2],
+                              kVRed, kVGreen, kVBlue);
+
+      StoreBytes(
+          _mm256_add_epi32(
+              _mm256_srai_epi32(_mm256_add_epi32(u, chroma_round), 10),
+              chroma_offset),
+          u_row + chroma_x);
+      StoreBytes(
+          _mm256_add_epi32(
+              _mm256_srai_epi32(_mm256_add_epi32(v, chroma_round), 10),
+              chroma_offset),
+          v_row + chroma_x);
+    }
+  }
+
+  // The columns left over are converted one pixel at a time.
+  if (luma_end < width || chroma_end < chroma_width) {
+    ConvertRowsScalar(pixels, width, height, luma_end, chroma_end, out);
+  }
+}
+
+FrameCapture::FrameCapture(int width, int height)
+    : width_(width), height_(height) {
+  for (Slot& slot : slots_) {
+    slot.pixels.resize(static_cast<size_t>(width) * height);
+  }
+
+  scaled_.resize(static_cast<size_t>(width) * height);
+}
+
+FrameCapture::~FrameCapture() {
+  Stop();
+}
+
+bool FrameCapture::Open(const std::string& path, std::string* error) {
+  const std::string kRawRGBExtension = ".rgb";
+
+  format_ = path.size() >= kRawRGBExtension.size() &&
+                    path.compare(path.size() - kRawRGBExtension.size(),
+                                 kRawRGBExtension.size(),
+                                 kRawRGBExtension) == 0
+                ? Format::kRawRGB
+                : Format::kY4M;
+
+  file_.open(path, std::ios::binary | std::ios::trunc);
+
+  if (format_ == Format::kY4M) {
+    file_ << "YUV4MPEG2 W" << width_ << " H" << height_ << " F" << kFrameRate
+          << ":1 Ip A1:1 C420jpeg\n";
+
+    // Every frame is written at once, after its header.
+    output_.resize(kY4MFrameHeaderSize + capture::I420Size(width_, height_));
+    std::memcpy(output_.data(), kY4MFrameHeader, kY4MFrameHeaderSize);
+  } else {
+    output_.resize(static_cast<size_t>(width_) * height_ * 3);
+  }
+
+  if (!file_) {
+    *error = "Could not write capture " + path;
+    return false;
+  }
+
+  return true;
+}
+
+void FrameCapture::Start() {
+  if (running_.exchange(true)) return;
+
+  thread_ = std::thread(&FrameCapture::Run, this);
+}
+
+void FrameCapture::Stop() {
+  running_.store(false, std::memory_order_release);
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool FrameCapture::Close(std::string* error) {
+  Stop();
+
+  file_.close();
+
+  if (write_failed_.load() || file_.fail()) {
+    *error = "Could not write every captured frame";
+    return false;
+  }
+
+  return true;
+}
+
+bool FrameCapture::Submit(const FrameBuffer& frame) {
+  const int64_t frame_index =
+      num_submitted_.load(std::memory_order_relaxed);
+
+  if (frame_index - num_written_.load(std::memory_order_acquire) ==
+          kNumBuffers ||
+      frame.Width() > width_ || frame.Height() > height_) {
+    ++num_dropped_;
+    return false;
+  }
+
+  Slot& slot = slots_[frame_index % kNumBuffers];
+  slot.width = frame.Width();
+  slot.height = frame.Height();
+  std::memcpy(slot.pixels.data(), frame.Pixels(),
+              static_cast<size_t>(frame.Width()) * frame.Height() *
+                  sizeof(uint32_t));
+
+  num_submitted_.store(frame_index + 1, std::memory_order_release);
+  return true;
+}
+
+int64_t FrameCapture::NumWritten() const {
+  return num_written_.load(std::memory_order_acquire);
+}
+
+int64_t FrameCapture::NumDropped() const {
+  return num_dropped_;
+}
+
+void FrameCapture::Run() {
+  tracing::SetThreadName("capture");
+
+  while (true) {
+    // Reading the flag before the counter makes sure every frame submitted
+    // before Stop is seen.
+    const bool running = running_.load(std::memory_order_acquire);
+    const int64_t frame_index = num_written_.load(std::memory_order_relaxed);
+
+    if (frame_index == num_submitted_.load(std::memory_order_acquire)) {
+      if (!running) break;
+
+      std::this_thread::sleep_for(kPollInterval);
+      continue;
+    }
+
+    {
+      tracing::ScopedTrace trace("capture");
+      WriteFrame(slots_[frame_index % kNumBuffers]);
+    }
+
+    num_written_.store(frame_index + 1, std::memory_order_release);
+  }
+}
+
+void FrameCapture::WriteFrame(const Slot& slot) {
+  if (write_failed_.load(std::memory_order_relaxed)) return;
+
+  const uint32_t* pixels = slot.pixels.data();
+
+  // Scales smaller frames up to the capture size, like the window does.
+  if (slot.width != width_ || slot.height != height_) {
+    for (int y = 0; y < height_; ++y) {
+      const uint32_t* row =
+          slot.pixels.data() +
+          static_cast<size_t>(static_cast<int64_t>(y) * slot.height / height_) *
+              slot.width;
+      uint32_t* scaled_row = scaled_.data() + static_cast<size_t>(y) * width_;
+
+      for (int x = 0; x < width_; ++x) {
+        scaled_row[x] = row[static_cast<int64_t>(x) * slot.width / width_];
+      }
+    }
+
+    pixels = scaled_.data();
+  }
+
+  if (format_ == Format::kY4M) {
+    capture::ConvertToI420(pixels, width_, height_,
+                           output_.data() + kY4MFrameHeaderSize);
+  } else {
+    const size_t num_pixels = static_cast<size_t>(width_) * height_;
+
+    for (size_t i = 0; i < num_pixels; ++i) {
+      output_[3 * i] = static_cast<uint8_t>(Red(pixels[i]));
+      output_[3 * i + 1] = static_cast<uint8_t>(Green(pixels[i]));
+      output_[3 * i + 2] = static_cast<uint8_t>(Blue(pixels[i]));
+    }
+  }
+
+  file_.write(reinterpret_cast<const char*>(output_.data()),
+              static_cast<std::streamsize>(output_.size()));
+
+  if (!file_) {
+    write_failed_.store(true, std::memory_order_relaxed);
+  }
+}
@@ -1,28 +1,108 @@
 #include "game_log.h"
 
-std::string escape_codes::CursorUp(int num_cells) {
-  return kCSI + std::to_string(num_cells) + "A";
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include "trace.h"
+
+std::string_view escape_codes::GraphicRendition(DisplayMode display_mode) {
+  switch (display_mode) {
+   case DisplayMode::kBold: return "\033[1m";
+   case DisplayMode::kNotBold: return "\033[22m";
+   case DisplayMode::kRedFg: return "\033[31m";
+   case DisplayMode::kBrightRedFg: return "\033[91m";
+   case DisplayMode::kBrightGreenFg: return "\033[92m";
+   case DisplayMode::kBrightYellowFg: return "\033[93m";
+   case DisplayMode::kBrightBlueFg: return "\033[94m";
+   case DisplayMode::kBrightMagentaFg: return "\033[95m";
+   case DisplayMode::kBrightWhiteFg: return "\033[97m";
+   case DisplayMode::kBlackBg: return "\033[40m";
+   default: return "\033[0m";
+  }
 }
 
 std::string escape_codes::SelectGraphicRendition(DisplayMode display_mode) {
-  return kCSI + std::to_string(static_cast<int>(display_mode)) + "m";
+  return std::string(GraphicRendition(display_mode));
+}
+
+game_log::Snapshot game_log::TakeSnapshot(
+    float frame_time,
+    const Camera& camera,
+    const RenderStats& render_stats) {
+  return Snapshot{
+    frame_time,
+    camera.Position(),
+    camera.Direction(),
+    camera.Plane(),
+    camera.AccelState(),
+    camera.AccelDirection(),
+    camera.MovementSpeed(),
+    camera.RotationSpeed(),
+    render_stats
+  };
+}
+
+void game_log::LogBuffer::Append(std::string_view text) {
+  const size_t length = std::min(text.size(), kCapacity - size_);
+
+  std::memcpy(bytes_.data() + size_, text.data(), length);
+  size_ += length;
+}
+
+void game_log::LogBuffer::AppendFloat(float number) {
+  char digits[32];
+
+  const std::to_chars_result result = std::to_chars(
+      digits, digits + sizeof(digits), number, std::chars_format::fixed,
+      kDecimalPlaces);
+  std::string_view text(digits, result.ptr - digits);
+
+  // Like std::internal, the padding goes between the sign and the digits.
+  const int padding = kNumberFieldWidth - static_cast<int>(text.size());
+
+  if (!text.empty() && text.front() == '-') {
+    Append("-");
+    text.remove_prefix(1);
+  }
+
+  for (int i = 0; i < padding; ++i) {
+    Append(" ");
+  }
+  Append(text);
 }
 
-std::string game_log::FloatToString(float number) {
-  std::ostringstream number_buffer;
+void game_log::LogBuffer::AppendInt(int number) {
+  char digits[16];
 
-  number_buffer << std::fixed << std::setprecision(kDecimalPlaces)
-                << std::setw(kNumberFieldWidth) << std::internal
-                << number;
+  const std::to_chars_result result =
+      std::to_chars(digits, digits + sizeof(digits), number);
 
-  return number_buffer.str();
+  Append(std::string_view(digits, result.ptr - digits));
 }
 
-std::string game_log::VectorToString(const Vector& vector) {
-  return "(" + FloatToString(vector.x) + ", " + FloatToString(vector.y) + ")";
+void game_log::LogBuffer::AppendVector(const Vector& vector) {
+  Append("(");
+  AppendFloat(vector.x);
+  Append(", ");
+  AppendFloat(vector.y);
+  Append(")");
 }
 
-std::string game_log::AccelStateToString(motion::AccelState accel_state) {
+void game_log::LogBuffer::AppendStageSummary(
+    const profiling::StageSummary& summary) {
+  AppendFloat(summary.p50);
+  Append(" / ");
+  AppendFloat(summary.p95);
+  Append(" / ");
+  AppendFloat(summary.p99);
+  Append(" / ");
+  AppendFloat(summary.max);
+  Append(" ms");
+}
+
+std::string_view game_log::AccelStateToString(motion::AccelState accel_state) {
   switch (accel_state) {
    case motion::AccelState::kAccelerate: return "accelerate";
    case motion::AccelState::kDeaccelerate: return "deaccelerate";
@@ -30,7 +110,7 @@ std::string game_log::AccelStateToString(motion::AccelState accel_state) {
   }
 }
 
-std::string game_log::AccelDirectionToString(
+std::string_view game_log::AccelDirectionToString(
     motion::AccelDirection accel_direction) {
   switch (accel_direction) {
    case motion::AccelDirection::kForward: return "forward";
@@ -39,84 +119,194 @@ std::string game_log::AccelDirectionToString(
   }
 }
 
-std::string game_log::GenerateLogEntry(
-    escape_codes::DisplayMode header_color_fg,
-    const game_log::LogEntry& log_entry) {
+namespace {
+
+// Appends the styled header of a log entry, right-aligned, and the separator,
+// leaving the value style selected.
+void AppendHeader(escape_codes::DisplayMode header_color_fg,
+                  std::string_view header,
+                  game_log::LogBuffer* buffer) {
   using escape_codes::DisplayMode;
-  using escape_codes::SelectGraphicRendition;
+  using escape_codes::GraphicRendition;
 
-  std::ostringstream header_buffer;
+  buffer->Append(GraphicRendition(DisplayMode::kBold));
+  buffer->Append(GraphicRendition(header_color_fg));
 
-  header_buffer << std::setw(kHeaderFieldWidth) << std::right
-                << log_entry.header;
+  for (int i = static_cast<int>(header.size());
+       i < game_log::kHeaderFieldWidth; ++i) {
+    buffer->Append(" ");
+  }
+  buffer->Append(header);
 
-  return SelectGraphicRendition(DisplayMode::kBold) +
-         SelectGraphicRendition(header_color_fg) +
-         header_buffer.str() +
-         kLogEntrySeperator + " " +
-         SelectGraphicRendition(DisplayMode::kNotBold) +
-         SelectGraphicRendition(DisplayMode::kBrightWhiteFg) +
-         log_entry.value;
+  buffer->Append(game_log::kLogEntrySeperator);
+  buffer->Append(" ");
+  buffer->Append(GraphicRendition(DisplayMode::kNotBold));
+  buffer->Append(GraphicRendition(DisplayMode::kBrightWhiteFg));
 }
 
-void game_log::OutputGameLog(float frame_time, const Camera& camera) {
+// Ends a log entry and returns the number of lines the log has so far.
+int EndEntry(int num_lines, game_log::LogBuffer* buffer) {
+  buffer->Append(escape_codes::kEraseInLine);
+  buffer->Append("\n");
+
+  return num_lines + 1;
+}
+
+}  // namespace
+
+void game_log::FormatGameLog(const Snapshot& snapshot, LogBuffer* buffer) {
   using escape_codes::DisplayMode;
+  using escape_codes::GraphicRendition;
   using escape_codes::kEraseInLine;
-  using escape_codes::CursorUp;
-  using escape_codes::SelectGraphicRendition;
-
-  const LogEntry log_entries[] =
-  {
-    { "FrameRate", FloatToString(1.0f / frame_time) + " FPS" },
-    { "FrameTime", FloatToString(frame_time * 1000.0f) + " ms" },
-    { "Position", VectorToString(camera.Position()) },
-    { "Direction", VectorToString(camera.Direction()) },
-    { "Plane", VectorToString(camera.Plane()) },
-    { "AccelState", AccelStateToString(camera.AccelState()) },
-    { "AccelDirection", AccelDirectionToString(camera.AccelDirection()) },
-    { "MovementSpeed", FloatToString(camera.MovementSpeed()) },
-    { "RotationSpeed", FloatToString(camera.RotationSpeed()) }
+
+  // Headers of the stage entries, in the order of profiling::Stage.
+  static constexpr std::string_view kStageHeaders[profiling::kNumStages] = {
+    "Events", "Simulation", "Background", "Walls",
+    "Sprites", "Upload", "Present", "Frame"
   };
-  const int num_log_entries = std::size(log_entries);
-
-  DisplayMode header_color_fg;
-
-  std::cout << SelectGraphicRendition(DisplayMode::kBlackBg)
-            << kEraseInLine << '\n';
-
-  for (int i = 0; i < num_log_entries; ++i) {
-    // Determines the header color based on the index of the log entry.
-    switch (i) {
-     case 0:
-     case 1:
-      header_color_fg = DisplayMode::kBrightRedFg;
-      break;
-
-     case 2:
-     case 3:
-     case 4:
-      header_color_fg = DisplayMode::kBrightGreenFg;
-      break;
-
-     case 5:
-     case 6:
-      header_color_fg = DisplayMode::kBrightYellowFg;
-      break;
-
-     default:
-      header_color_fg = DisplayMode::kBrightBlueFg;
-      break;
-    }
 
-    // Outputs the formatted log entry
-    std::cout << GenerateLogEntry(header_color_fg, log_entries[i])
-              << kEraseInLine << '\n';
+  buffer->Clear();
+  buffer->Append(GraphicRendition(DisplayMode::kBlackBg));
+  buffer->Append(kEraseInLine);
+  buffer->Append("\n");
+
+  int num_lines = 0;
+
+  // Frame timing.
+  AppendHeader(DisplayMode::kBrightRedFg, "FrameRate", buffer);
+  buffer->AppendFloat(1.0f / snapshot.frame_time);
+  buffer->Append(" FPS");
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightRedFg, "FrameTime", buffer);
+  buffer->AppendFloat(snapshot.frame_time * 1000.0f);
+  buffer->Append(" ms");
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightRedFg, "Threads", buffer);
+  buffer->AppendInt(snapshot.render_stats.num_threads);
+  num_lines = EndEntry(num_lines, buffer);
+
+  if (snapshot.render_stats.speedup > 0.0f) {
+    AppendHeader(DisplayMode::kBrightRedFg, "Speedup", buffer);
+    buffer->AppendFloat(snapshot.render_stats.speedup);
+    buffer->Append(" x");
+    num_lines = EndEntry(num_lines, buffer);
+  }
+
+  AppendHeader(DisplayMode::kBrightRedFg, "RecastRays", buffer);
+  buffer->AppendFloat(snapshot.render_stats.recast_fraction * 100.0f);
+  buffer->Append(" %");
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightRedFg, "Resolution", buffer);
+  buffer->AppendFloat(snapshot.render_stats.resolution_scale * 100.0f);
+  buffer->Append(" %");
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightRedFg, "DroppedFrames", buffer);
+  buffer->AppendInt(static_cast<int>(snapshot.render_stats.dropped_frames));
+  num_lines = EndEntry(num_lines, buffer);
+
+  // Camera pose.
+  AppendHeader(DisplayMode::kBrightGreenFg, "Position", buffer);
+  buffer->AppendVector(snapshot.position);
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightGreenFg, "Direction", buffer);
+  buffer->AppendVector(snapshot.direction);
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightGreenFg, "Plane", buffer);
+  buffer->AppendVector(snapshot.plane);
+  num_lines = EndEntry(num_lines, buffer);
+
+  // Camera motion.
+  AppendHeader(DisplayMode::kBrightYellowFg, "AccelState", buffer);
+  buffer->Append(AccelStateToString(snapshot.accel_state));
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightYellowFg, "AccelDirection", buffer);
+  buffer->Append(AccelDirectionToString(snapshot.accel_direction));
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightBlueFg, "MovementSpeed", buffer);
+  buffer->AppendFloat(snapshot.movement_speed);
+  num_lines = EndEntry(num_lines, buffer);
+
+  AppendHeader(DisplayMode::kBrightBlueFg, "RotationSpeed", buffer);
+  buffer->AppendFloat(snapshot.rotation_speed);
+  num_lines = EndEntry(num_lines, buffer);
+
+  // Stage latencies.
+  AppendHeader(DisplayMode::kBrightMagentaFg, "Stage", buffer);
+  buffer->Append("  p50 /   p95 /   p99 /   max");
+  num_lines = EndEntry(num_lines, buffer);
+
+  for (int i = 0; i < profiling::kNumStages; ++i) {
+    AppendHeader(DisplayMode::kBrightMagentaFg, kStageHeaders[i], buffer);
+    buffer->AppendStageSummary(snapshot.render_stats.stages[i]);
+    num_lines = EndEntry(num_lines, buffer);
   }
 
   // Resets the terminal display mode and moves the cursor back to the start of
   // the log output area.
-  std::cout << kEraseInLine
-            << SelectGraphicRendition(DisplayMode::kReset)
-            << CursorUp(num_log_entries + 1)
-            << std::flush;
+  buffer->Append(kEraseInLine);
+  buffer->Append(GraphicRendition(DisplayMode::kReset));
+  buffer->Append(escape_codes::kCSI);
+  buffer->AppendInt(num_lines + 1);
+  buffer->Append("A");
+}
+
+GameLogWriter::GameLogWriter(profiling::Profiler* profiler)
+    : snapshots_(game_log::Snapshot()), profiler_(profiler) {}
+
+GameLogWriter::~GameLogWriter() {
+  Stop();
+}
+
+void GameLogWriter::Start() {
+  if (running_.exchange(true)) return;
+
+  thread_ = std::thread(&GameLogWriter::Run, this);
+}
+
+void GameLogWriter::Stop() {
+  running_ = false;
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void GameLogWriter::Post(const game_log::Snapshot& snapshot) {
+  snapshots_.Back() = snapshot;
+  snapshots_.Publish();
+}
+
+void GameLogWriter::Run() {
+  tracing::SetThreadName("game log");
+
+  while (running_.load(std::memory_order_acquire)) {
+    if (snapshots_.HasNew()) {
+      tracing::ScopedTrace trace("game log");
+
+      game_log::Snapshot snapshot = snapshots_.Acquire();
+
+      if (profiler_ != nullptr) {
+        for (int i = 0; i < profiling::kNumStages; ++i) {
+          snapshot.render_stats.stages[i] = profiler_->Summarize(
+              static_cast<profiling::Stage>(i), kProfileFrames);
+        }
+      }
+
+      game_log::FormatGameLog(snapshot, &buffer_);
+
+      const std::string_view log = buffer_.View();
+      std::cout.write(log.data(), log.size());
+      std::cout.flush();
+    }
+
+    std::this_thread::sleep_for(kPollInterval);
+  }
 }
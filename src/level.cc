@@ -0,0 +1,300 @@
+#include "level.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "level_data.h"
+
+namespace {
+
+constexpr char kMagic[4] = { 'R', 'C', 'L', 'V' };
+constexpr uint32_t kFormatVersion = 1;
+
+struct BinaryHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+};
+
+static_assert(sizeof(BinaryHeader) == 16, "Header must be 16 bytes");
+
+// The SIMD traversal reads tiles four bytes at a time from addresses rounded
+// down to a multiple of four, so owned tile storage is padded accordingly.
+size_t PaddedSize(size_t num_tiles) {
+  return (num_tiles + 3) & ~static_cast<size_t>(3);
+}
+
+bool ValidDimensions(int64_t width, int64_t height) {
+  return width > 0 && height > 0 && width * height <= Level::kMaxNumTiles;
+}
+
+}  // namespace
+
+Level::Level(int width, int height, std::vector<uint8_t> tiles)
+    : width_(width),
+      height_(height),
+      owned_tiles_(std::move(tiles)) {
+  owned_tiles_.resize(PaddedSize(static_cast<size_t>(width) * height), 0);
+  tiles_ = owned_tiles_.data();
+}
+
+Level::Level(int width, int height, void* mapping, size_t mapping_size,
+             size_t tiles_offset)
+    : width_(width),
+      height_(height),
+      tiles_(static_cast<const uint8_t*>(mapping) + tiles_offset),
+      mapping_(mapping),
+      mapping_size_(mapping_size) {}
+
+Level::~Level() {
+  Release();
+}
+
+Level::Level(Level&& other) noexcept {
+  *this = std::move(other);
+}
+
+Level& Level::operator=(Level&& other) noexcept {
+  if (this != &other) {
+    Release();
+
+    width_ = std::exchange(other.width_, 0);
+    height_ = std::exchange(other.height_, 0);
+    tiles_ = std::exchange(other.tiles_, nullptr);
+    owned_tiles_ = std::move(other.owned_tiles_);
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    mapping_size_ = std::exchange(other.mapping_size_, 0);
+  }
+
+  return *this;
+}
+
+void Level::SetTile(int x, int y, uint8_t tile) {
+  if (!Contains(x, y)) return;
+
+  if (mapping_ != nullptr) {
+    const size_t num_tiles = static_cast<size_t>(width_) * height_;
+
+    owned_tiles_.assign(tiles_, tiles_ + num_tiles);
+    owned_tiles_.resize(PaddedSize(num_tiles), 0);
+    Release();
+    tiles_ = owned_tiles_.data();
+  }
+
+  owned_tiles_[static_cast<size_t>(x) * height_ + y] = tile;
+}
+
+void Level::Release() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+  }
+}
+
+Level level::BuiltinLevel() {
+  std::vector<uint8_t> tiles(kLevelWidth * kLevelHeight);
+
+  for (int x = 0; x < kLevelWidth; ++x) {
+    for (int y = 0; y < kLevelHeight; ++y) {
+      tiles[x * kLevelHeight + y] = static_cast<uint8_t>(kLevelData[x][y]);
+    }
+  }
+
+  return Level(kLevelWidth, kLevelHeight, std::move(tiles));
+}
+
+bool level::LoadBinaryLevel(const std::string& path,
+                            Level* level,
+                            std::string* error) {
+  const int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0) {
+    *error = "Could not open level " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  struct stat file_stat;
+
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(BinaryHeader)) {
+    *error = "Level " + path + " is too small";
+    close(fd);
+    return false;
+  }
+
+  const size_t file_size = static_cast<size_t>(file_stat.st_size);
+
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    *error = "Could not map level " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  BinaryHeader header;
+  std::memcpy(&header, mapping, sizeof(header));
+
+  const int64_t width = header.width;
+  const int64_t height = header.height;
+
+  const char* format_error = nullptr;
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    format_error = "is not a binary level";
+  } else if (header.version != kFormatVersion) {
+    format_error = "has an unsupported version";
+  } else if (!ValidDimensions(width, height)) {
+    format_error = "has invalid dimensions";
+  } else if (file_size < sizeof(BinaryHeader) + width * height) {
+    format_error = "is truncated";
+  }
+
+  if (format_error != nullptr) {
+    *error = "Level " + path + " " + format_error;
+    munmap(mapping, file_size);
+    return false;
+  }
+
+  *level = Level(static_cast<int>(width), static_cast<int>(height),
+                 mapping, file_size, sizeof(BinaryHeader));
+  return true;
+}
+
+bool level::ImportTextLevel(const std::string& path,
+                            Level* level,
+                            std::string* error) {
+  std::ifstream file(path);
+
+  if (!file) {
+    *error = "Could not open level " + path;
+    return false;
+  }
+
+  std::vector<uint8_t> tiles;
+  int64_t width = 0;
+  int64_t height = 0;
+
+  std::string line;
+
+  while (std::getline(file, line)) {
+    // Braces and commas are treated as whitespace, so rows copied from the
+    // array in level_data.h can be used as they are.
+    for (char& c : line) {
+      if (c == '{' || c == '}' || c == ',') c = ' ';
+    }
+
+    if (line.find('#') != std::string::npos) {
+      line.erase(line.find('#'));
+    }
+
+    std::istringstream row(line);
+    int64_t row_length = 0;
+    std::string token;
+
+    while (row >> token) {
+      char* parse_end = nullptr;
+      const long tile = std::strtol(token.c_str(), &parse_end, 10);
+
+      if (*parse_end != '\0' || tile < 0 || tile > UINT8_MAX) {
+        *error = "Level " + path + " has an invalid tile: " + token;
+        return false;
+      }
+
+      tiles.push_back(static_cast<uint8_t>(tile));
+      ++row_length;
+    }
+
+    if (row_length == 0) continue;
+
+    if (height != 0 && row_length != height) {
+      *error = "Level " + path + " has rows of different lengths";
+      return false;
+    }
+
+    height = row_length;
+    ++width;
+  }
+
+  if (!ValidDimensions(width, height)) {
+    *error = "Level " + path + " has invalid dimensions";
+    return false;
+  }
+
+  *level = Level(static_cast<int>(width), static_cast<int>(height),
+                 std::move(tiles));
+  return true;
+}
+
+bool level::LoadLevel(const std::string& path,
+                      Level* level,
+                      std::string* error) {
+  char magic[sizeof(kMagic)] = {};
+
+  std::ifstream file(path, std::ios::binary);
+  file.read(magic, sizeof(magic));
+
+  if (file && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+    return LoadBinaryLevel(path, level, error);
+  }
+
+  return ImportTextLevel(path, level, error);
+}
+
+bool level::SaveBinaryLevel(const Level& level,
+                            const std::string& path,
+                            std::string* error) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+  BinaryHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.width = static_cast<uint32_t>(level.Width());
+  header.height = static_cast<uint32_t>(level.Height());
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(level.Tiles()),
+             static_cast<std::streamsize>(level.Width()) * level.Height());
+
+  if (!file) {
+    *error = "Could not write level " + path;
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t level::HashLevel(const Level& level) {
+  constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ull;
+  constexpr uint64_t kPrime = 0x100000001b3ull;
+
+  uint64_t hash = kOffsetBasis;
+
+  const auto add_bytes = [&hash](const uint8_t* bytes, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * kPrime;
+    }
+  };
+
+  // The dimensions are hashed as little-endian 32-bit values, as they are
+  // stored in the binary format.
+  const uint32_t dimensions[2] = {
+    static_cast<uint32_t>(level.Width()),
+    static_cast<uint32_t>(level.Height())
+  };
+
+  add_bytes(reinterpret_cast<const uint8_t*>(dimensions), sizeof(dimensions));
+  add_bytes(level.Tiles(), static_cast<size_t>(level.Width()) * level.Height());
+
+  return hash;
+}
@@ -0,0 +1,236 @@
+#include "level_editor.h"
+
+#include <algorithm>
+
+#include "tile_collision.h"
+#include "trace.h"
+
+LevelEditor::LevelEditor(Level* level) : level_(level) {}
+
+void LevelEditor::SetTiledLevel(TiledLevel* tiled_level) {
+  tiled_level_ = tiled_level;
+}
+
+void LevelEditor::SetDistanceField(DistanceField* distance_field) {
+  distance_field_ = distance_field;
+}
+
+void LevelEditor::SetVisibilitySet(VisibilitySet* visibility_set) {
+  visibility_set_ = visibility_set;
+}
+
+void LevelEditor::SetLightmap(Lightmap* lightmap) {
+  lightmap_ = lightmap;
+}
+
+void LevelEditor::SetEntityWorld(const EntityWorld* entity_world) {
+  entity_world_ = entity_world;
+}
+
+void LevelEditor::QueueEdit(const Edit& edit) {
+  std::lock_guard<std::mutex> lock(edit_mutex_);
+  pending_edits_.push_back(edit);
+}
+
+void LevelEditor::SetTile(int x, int y, uint8_t tile) {
+  QueueEdit(Edit{ Edit::Type::kSetTile, x, y, tile });
+}
+
+void LevelEditor::OpenDoor(int x, int y) {
+  QueueEdit(Edit{ Edit::Type::kOpenDoor, x, y, 0 });
+}
+
+void LevelEditor::CloseDoor(int x, int y) {
+  QueueEdit(Edit{ Edit::Type::kCloseDoor, x, y, 0 });
+}
+
+int LevelEditor::FindDoor(int x, int y) const {
+  for (size_t door = 0; door < doors_.size(); ++door) {
+    if (doors_[door].x == x && doors_[door].y == y) {
+      return static_cast<int>(door);
+    }
+  }
+
+  return -1;
+}
+
+bool LevelEditor::Occupied(int x, int y) const {
+  if (entity_world_ == nullptr) return false;
+
+  // The circle around the tile holds every point of it.
+  constexpr float kTileRadius = 0.7072f;
+  bool occupied = false;
+
+  entity_world_->ForEachNear(
+      Vector(x + 0.5f, y + 0.5f), kTileRadius, [&](int entity) {
+        occupied = occupied ||
+                   collision::CircleOverlapsTile(entity_world_->Position(entity),
+                                                 entity_world_->Radius(entity),
+                                                 x, y);
+      });
+
+  return occupied;
+}
+
+int LevelEditor::ApplyEdits(float elapsed_seconds,
+                            std::mutex* level_mutex,
+                            ThreadPool* thread_pool) {
+  tracing::ScopedTrace trace("level edits");
+
+  {
+    std::lock_guard<std::mutex> lock(edit_mutex_);
+    edits_.insert(edits_.end(), pending_edits_.begin(), pending_edits_.end());
+    pending_edits_.clear();
+  }
+
+  changes_.clear();
+
+  // Door edits only change the state of the door, so only tile edits count
+  // toward the changes of this call.
+  size_t num_taken = 0;
+
+  for (; num_taken < edits_.size(); ++num_taken) {
+    const Edit& edit = edits_[num_taken];
+
+    if (!level_->Contains(edit.x, edit.y)) continue;
+
+    int door = FindDoor(edit.x, edit.y);
+
+    if (edit.type == Edit::Type::kSetTile) {
+      if (static_cast<int>(changes_.size()) == kMaxChangesPerApply) break;
+
+      if (door >= 0) {
+        doors_.erase(doors_.begin() + door);
+      }
+
+      changes_.push_back(Change{ edit.x, edit.y, edit.tile, -1 });
+      continue;
+    }
+
+    if (door < 0) {
+      if (edit.type == Edit::Type::kCloseDoor ||
+          !level_->IsSolid(edit.x, edit.y)) {
+        continue;
+      }
+
+      door = static_cast<int>(doors_.size());
+      doors_.push_back(Door{
+        edit.x, edit.y, static_cast<uint8_t>(level_->At(edit.x, edit.y)),
+        0.0f, false
+      });
+    }
+
+    doors_[door].opening = edit.type == Edit::Type::kOpenDoor;
+  }
+
+  edits_.erase(edits_.begin(), edits_.begin() + num_taken);
+
+  // Tile edits may have removed doors, so the doors move once the edits
+  // are taken.
+  opened_doors_.clear();
+  num_moving_doors_ = 0;
+
+  for (size_t door = 0; door < doors_.size(); ++door) {
+    Door& state = doors_[door];
+    const float step = kDoorSpeed * elapsed_seconds;
+    const float previous_fraction = state.open_fraction;
+
+    state.open_fraction = state.opening
+                              ? std::min(state.open_fraction + step, 1.0f)
+                              : std::max(state.open_fraction - step, 0.0f);
+
+    // A door can be seen through from the moment it starts to open.
+    if (previous_fraction == 0.0f && state.open_fraction > 0.0f) {
+      opened_doors_.push_back(static_cast<int>(door));
+    }
+
+    if (state.open_fraction > 0.0f && state.open_fraction < 1.0f) {
+      ++num_moving_doors_;
+    }
+
+    const uint8_t tile = state.open_fraction >= 1.0f ? 0 : state.wall;
+
+    if (level_->At(state.x, state.y) != tile &&
+        static_cast<int>(changes_.size()) < kMaxChangesPerApply) {
+      changes_.push_back(
+          Change{ state.x, state.y, tile, static_cast<int>(door) });
+    }
+  }
+
+  changed_solidity_.clear();
+  int num_changed = 0;
+  size_t num_blocked = 0;
+
+  {
+    std::unique_lock<std::mutex> lock;
+
+    if (level_mutex != nullptr) {
+      lock = std::unique_lock<std::mutex>(*level_mutex);
+    }
+
+    for (const Change& change : changes_) {
+      const bool was_solid = level_->IsSolid(change.x, change.y);
+
+      if (change.tile != 0 && !was_solid && Occupied(change.x, change.y)) {
+        // A door stays open, and a tile edit is retried first next time.
+        if (change.door >= 0) {
+          doors_[change.door].open_fraction = 1.0f;
+        } else {
+          edits_.insert(edits_.begin() + num_blocked++,
+                        Edit{ Edit::Type::kSetTile, change.x, change.y,
+                              change.tile });
+        }
+        continue;
+      }
+
+      level_->SetTile(change.x, change.y, change.tile);
+      ++num_changed;
+
+      if (tiled_level_ != nullptr) {
+        tiled_level_->SetTile(change.x, change.y, change.tile);
+      }
+
+      if (was_solid != (change.tile != 0)) {
+        changed_solidity_.push_back(change);
+      }
+    }
+  }
+
+  if (visibility_set_ != nullptr) {
+    for (const int door : opened_doors_) {
+      visibility_set_->SeeThrough(*level_, doors_[door].x, doors_[door].y,
+                                  thread_pool);
+    }
+  }
+
+  for (const Change& change : changed_solidity_) {
+    if (distance_field_ != nullptr) {
+      distance_field_->Update(*level_, change.x, change.y);
+    }
+
+    if (visibility_set_ != nullptr) {
+      visibility_set_->Update(*level_, change.x, change.y, thread_pool);
+    }
+
+    if (lightmap_ != nullptr) {
+      lightmap_->Update(*level_, change.x, change.y, thread_pool);
+    }
+  }
+
+  num_changes_ += num_changed;
+  return num_changed + static_cast<int>(opened_doors_.size());
+}
+
+float LevelEditor::DoorOpenFraction(int x, int y) const {
+  const int door = FindDoor(x, y);
+
+  return door < 0 ? 0.0f : doors_[door].open_fraction;
+}
+
+int LevelEditor::NumMovingDoors() const {
+  return num_moving_doors_;
+}
+
+int64_t LevelEditor::NumChanges() const {
+  return num_changes_;
+}
@@ -0,0 +1,667 @@
+#include "lightmap.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "line_of_sight.h"
+#include "ray_caster.h"
+
+namespace {
+
+constexpr char kMagic[4] = { 'R', 'C', 'L', 'M' };
+constexpr uint32_t kFormatVersion = 1;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint64_t level_hash;
+  uint64_t lights_hash;
+  uint32_t num_lights;
+  uint32_t num_baked_chunks;
+};
+
+static_assert(sizeof(FileHeader) == 40, "Header must be 40 bytes");
+
+// Floats stored for every light in the cache file.
+constexpr int kLightFloats = 7;
+
+// Most lights a cache file may hold.
+constexpr uint32_t kMaxNumLights = 1 << 20;
+
+// Height of the lights above the floor, in tiles.
+constexpr float kLightHeight = 0.5f;
+
+// Distance of the wall face texels from their face, which puts them in the
+// empty tile in front of it.
+constexpr float kFaceOffset = 1e-3f;
+
+constexpr float kGoldenAngle = 2.39996322973f;
+
+// Mixes the bits of a counter into a pseudo-random value.
+uint32_t Hash(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  value *= 0x846ca68bu;
+  value ^= value >> 16;
+
+  return value;
+}
+
+// Points spread evenly over the unit disk, one per shadow ray, along a
+// golden angle spiral.
+const std::array<Vector, Lightmap::kShadowRays>& DiskSamples() {
+  static const std::array<Vector, Lightmap::kShadowRays> samples = [] {
+    std::array<Vector, Lightmap::kShadowRays> points;
+
+    for (int i = 0; i < Lightmap::kShadowRays; ++i) {
+      const float radius = std::sqrt((i + 0.5f) / Lightmap::kShadowRays);
+      const float angle = i * kGoldenAngle;
+
+      points[i] = Vector(radius * std::cos(angle), radius * std::sin(angle));
+    }
+    return points;
+  }();
+
+  return samples;
+}
+
+// Returns true if the square of tiles the light reaches overlaps the range
+// [x_begin, x_end) x [y_begin, y_end).
+bool Reaches(const PointLight& light,
+             int x_begin,
+             int x_end,
+             int y_begin,
+             int y_end) {
+  return light.position.x + light.range >= x_begin &&
+         light.position.x - light.range <= x_end &&
+         light.position.y + light.range >= y_begin &&
+         light.position.y - light.range <= y_end;
+}
+
+// Adds the light of the lights at the point to the channels, seen from a
+// wall face with the normal, or from the floor if the normal is null.
+void AddLight(const Level& level,
+              const std::vector<PointLight>& lights,
+              const Vector& point,
+              const Vector* normal,
+              float channels[3]) {
+  for (const PointLight& light : lights) {
+    const Vector to_light = light.position - point;
+    const float distance =
+        std::sqrt(to_light.x * to_light.x + to_light.y * to_light.y);
+
+    if (!(distance < light.range)) continue;
+
+    const float cosine =
+        normal != nullptr
+            ? (normal->x * to_light.x + normal->y * to_light.y) /
+                  std::max(distance, 1e-6f)
+            : kLightHeight / std::sqrt(distance * distance +
+                                       kLightHeight * kLightHeight);
+
+    if (!(cosine > 0.0f)) continue;
+
+    const float falloff = (1.0f - distance / light.range) *
+                          (1.0f - distance / light.range);
+
+    // Share of the disk of the light the point sees.
+    int num_visible = 0;
+
+    for (const Vector& sample : DiskSamples()) {
+      if (sensing::HasLineOfSight(level, nullptr, point,
+                                  light.position + sample * light.radius)) {
+        ++num_visible;
+      }
+    }
+
+    const float weight =
+        cosine * falloff * num_visible / Lightmap::kShadowRays;
+
+    channels[0] += light.red * weight;
+    channels[1] += light.green * weight;
+    channels[2] += light.blue * weight;
+  }
+}
+
+// Packs the light of the channels over the ambient light into a texel.
+uint32_t ToTexel(const float channels[3]) {
+  uint32_t texel = 0;
+
+  for (int channel = 0; channel < 3; ++channel) {
+    const float value = Lightmap::kAmbient + channels[channel] * 255.0f;
+    const uint32_t clamped =
+        static_cast<uint32_t>(std::min(value, 255.0f) + 0.5f);
+
+    texel = texel << 8 | clamped;
+  }
+
+  return texel;
+}
+
+// Returns the point of the face at the position along it, as RayData::wall_x,
+// just in front of the face. Faces hit by rays moving toward +X and -Y have
+// wall_x mirrored (see raycasting::CalculateWallX).
+Vector FacePoint(int x, int y, Lightmap::Face face, float wall_x) {
+  switch (face) {
+   case Lightmap::Face::kNegativeX:
+    return Vector(x - kFaceOffset, y + 1.0f - wall_x);
+
+   case Lightmap::Face::kPositiveX:
+    return Vector(x + 1.0f + kFaceOffset, y + wall_x);
+
+   case Lightmap::Face::kNegativeY:
+    return Vector(x + wall_x, y - kFaceOffset);
+
+   default:
+    return Vector(x + 1.0f - wall_x, y + 1.0f + kFaceOffset);
+  }
+}
+
+// Bakes the texels of the tile: the faces in front of empty tiles if it is
+// a wall, and the floor if it is empty.
+void BakeTile(const Level& level,
+              const std::vector<PointLight>& lights,
+              int x,
+              int y,
+              uint32_t* texels) {
+  constexpr int kFaceTexels = Lightmap::kFaceTexels;
+  constexpr int kFloorTexels = Lightmap::kFloorTexels;
+  constexpr uint32_t kAmbientTexel =
+      Lightmap::kAmbient << 16 | Lightmap::kAmbient << 8 | Lightmap::kAmbient;
+
+  static const Vector kNormals[4] = {
+    Vector(-1.0f, 0.0f), Vector(1.0f, 0.0f),
+    Vector(0.0f, -1.0f), Vector(0.0f, 1.0f)
+  };
+
+  uint32_t* floor_texels = texels + 4 * kFaceTexels;
+  std::fill(texels, floor_texels + kFloorTexels * kFloorTexels,
+            kAmbientTexel);
+
+  if (!level.IsSolid(x, y)) {
+    for (int u = 0; u < kFloorTexels; ++u) {
+      for (int v = 0; v < kFloorTexels; ++v) {
+        const Vector point(x + (u + 0.5f) / kFloorTexels,
+                           y + (v + 0.5f) / kFloorTexels);
+        float channels[3] = { 0.0f, 0.0f, 0.0f };
+
+        AddLight(level, lights, point, nullptr, channels);
+        floor_texels[u * kFloorTexels + v] = ToTexel(channels);
+      }
+    }
+    return;
+  }
+
+  for (int face = 0; face < 4; ++face) {
+    const Vector& normal = kNormals[face];
+    const int front_x = x + static_cast<int>(normal.x);
+    const int front_y = y + static_cast<int>(normal.y);
+
+    // Faces against other walls or the level edge are never seen.
+    if (level.IsSolid(front_x, front_y)) continue;
+
+    for (int i = 0; i < kFaceTexels; ++i) {
+      const Vector point = FacePoint(x, y, static_cast<Lightmap::Face>(face),
+                                     (i + 0.5f) / kFaceTexels);
+      float channels[3] = { 0.0f, 0.0f, 0.0f };
+
+      AddLight(level, lights, point, &normal, channels);
+      texels[face * kFaceTexels + i] = ToTexel(channels);
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<PointLight> lighting::ScatterLights(const Level& level,
+                                                int count) {
+  // Warm, cool, green and white lights.
+  static const float kColors[4][3] = {
+    { 1.0f, 0.75f, 0.45f },
+    { 0.45f, 0.65f, 1.0f },
+    { 0.55f, 1.0f, 0.55f },
+    { 0.9f, 0.9f, 0.9f }
+  };
+
+  std::vector<PointLight> lights;
+
+  if (count <= 0 || level.Width() <= 0 || level.Height() <= 0) {
+    return lights;
+  }
+
+  lights.reserve(count);
+
+  // Gives up after a fixed number of attempts on levels that are mostly
+  // walls. The hashes differ from those that scatter sprites, so lights do
+  // not land on the sprites.
+  const uint32_t max_attempts = static_cast<uint32_t>(count) * 64;
+
+  for (uint32_t attempt = 0;
+       attempt < max_attempts && static_cast<int>(lights.size()) < count;
+       ++attempt) {
+    const uint32_t hash = Hash(attempt ^ 0x9e3779b9u);
+    const int x = static_cast<int>(hash % level.Width());
+    const int y = static_cast<int>(Hash(hash) % level.Height());
+
+    if (level.IsSolid(x, y)) continue;
+
+    const float* color = kColors[lights.size() % 4];
+
+    lights.push_back(PointLight{
+      Vector(x + 0.5f, y + 0.5f),
+      0.25f,
+      4.0f + (hash >> 24) / 64.0f,
+      color[0],
+      color[1],
+      color[2]
+    });
+  }
+
+  return lights;
+}
+
+uint64_t lighting::HashLights(const std::vector<PointLight>& lights) {
+  constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ull;
+  constexpr uint64_t kPrime = 0x100000001b3ull;
+
+  uint64_t hash = kOffsetBasis;
+
+  for (const PointLight& light : lights) {
+    const float values[kLightFloats] = {
+      light.position.x, light.position.y, light.radius, light.range,
+      light.red, light.green, light.blue
+    };
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+
+    for (size_t i = 0; i < sizeof(values); ++i) {
+      hash = (hash ^ bytes[i]) * kPrime;
+    }
+  }
+
+  return hash;
+}
+
+Lightmap::Lightmap(const Level& level,
+                   const std::vector<PointLight>& lights,
+                   ThreadPool* thread_pool)
+    : width_(level.Width()),
+      height_(level.Height()),
+      level_hash_(level::HashLevel(level)),
+      lights_hash_(lighting::HashLights(lights)),
+      lights_(lights),
+      chunks_x_((level.Width() + kChunkSize - 1) / kChunkSize),
+      chunks_y_((level.Height() + kChunkSize - 1) / kChunkSize),
+      chunk_indices_(static_cast<size_t>(chunks_x_) * chunks_y_, kNoChunk) {
+  // Marks the chunks within the range of a light, then numbers them in
+  // order.
+  for (const PointLight& light : lights_) {
+    const int first_x = std::max(
+        0, static_cast<int>(std::floor(light.position.x - light.range)) /
+               kChunkSize);
+    const int last_x = std::min(
+        chunks_x_ - 1,
+        static_cast<int>(std::floor(light.position.x + light.range)) /
+            kChunkSize);
+    const int first_y = std::max(
+        0, static_cast<int>(std::floor(light.position.y - light.range)) /
+               kChunkSize);
+    const int last_y = std::min(
+        chunks_y_ - 1,
+        static_cast<int>(std::floor(light.position.y + light.range)) /
+            kChunkSize);
+
+    for (int chunk_x = first_x; chunk_x <= last_x; ++chunk_x) {
+      for (int chunk_y = first_y; chunk_y <= last_y; ++chunk_y) {
+        chunk_indices_[static_cast<size_t>(chunk_x) * chunks_y_ + chunk_y] = 0;
+      }
+    }
+  }
+
+  std::vector<int> baked_chunks;
+
+  for (size_t chunk = 0; chunk < chunk_indices_.size(); ++chunk) {
+    if (chunk_indices_[chunk] != kNoChunk) {
+      chunk_indices_[chunk] = static_cast<uint32_t>(baked_chunks.size());
+      baked_chunks.push_back(static_cast<int>(chunk));
+    }
+  }
+
+  texels_.assign(baked_chunks.size() * kTexelsPerChunk, kAmbientTexel);
+
+  // Chunks near several lights take longer, which the dynamic chunking of
+  // the pool evens out.
+  const auto bake_chunks = [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const int x = baked_chunks[i] / chunks_y_ * kChunkSize;
+      const int y = baked_chunks[i] % chunks_y_ * kChunkSize;
+
+      BakeTiles(level, x, std::min(x + kChunkSize, width_), y,
+                std::min(y + kChunkSize, height_));
+    }
+  };
+
+  const int num_baked_chunks = static_cast<int>(baked_chunks.size());
+
+  if (thread_pool == nullptr) {
+    bake_chunks(0, num_baked_chunks);
+  } else {
+    thread_pool->ParallelFor(0, num_baked_chunks, 1, bake_chunks);
+  }
+}
+
+const uint32_t* Lightmap::TileTexels(int x, int y) const {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    return nullptr;
+  }
+
+  const uint32_t chunk_index =
+      chunk_indices_[static_cast<size_t>(x / kChunkSize) * chunks_y_ +
+                     y / kChunkSize];
+
+  if (chunk_index == kNoChunk) return nullptr;
+
+  const int tile = x % kChunkSize * kChunkSize + y % kChunkSize;
+
+  return texels_.data() + chunk_index * kTexelsPerChunk +
+         static_cast<size_t>(tile) * kTexelsPerTile;
+}
+
+uint32_t* Lightmap::TileTexels(int x, int y) {
+  return const_cast<uint32_t*>(
+      static_cast<const Lightmap*>(this)->TileTexels(x, y));
+}
+
+void Lightmap::BakeTiles(const Level& level,
+                         int x_begin,
+                         int x_end,
+                         int y_begin,
+                         int y_end) {
+  // Only the lights that reach the tiles are tested for every texel.
+  std::vector<PointLight> lights;
+
+  for (const PointLight& light : lights_) {
+    if (Reaches(light, x_begin, x_end, y_begin, y_end)) {
+      lights.push_back(light);
+    }
+  }
+
+  for (int x = x_begin; x < x_end; ++x) {
+    for (int y = y_begin; y < y_end; ++y) {
+      uint32_t* texels = TileTexels(x, y);
+
+      if (texels != nullptr) {
+        BakeTile(level, lights, x, y, texels);
+      }
+    }
+  }
+}
+
+void Lightmap::Update(const Level& level,
+                      int x,
+                      int y,
+                      ThreadPool* thread_pool) {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    return;
+  }
+
+  // The tile and the faces of its neighbors toward it change, and so does
+  // every texel a light reaches whose shadow rays may cross the tile. Those
+  // rays stay within the range plus the radius of the light.
+  int x_begin = x - 1;
+  int x_end = x + 2;
+  int y_begin = y - 1;
+  int y_end = y + 2;
+
+  for (const PointLight& light : lights_) {
+    const float dx = std::max({ x - light.position.x, 0.0f,
+                                light.position.x - (x + 1) });
+    const float dy = std::max({ y - light.position.y, 0.0f,
+                                light.position.y - (y + 1) });
+    const float reach = light.range + light.radius;
+
+    if (dx * dx + dy * dy >= reach * reach) continue;
+
+    x_begin = std::min(
+        x_begin, static_cast<int>(std::floor(light.position.x - light.range)));
+    x_end = std::max(
+        x_end, static_cast<int>(std::floor(light.position.x + light.range)) + 1);
+    y_begin = std::min(
+        y_begin, static_cast<int>(std::floor(light.position.y - light.range)));
+    y_end = std::max(
+        y_end, static_cast<int>(std::floor(light.position.y + light.range)) + 1);
+  }
+
+  x_begin = std::max(x_begin, 0);
+  x_end = std::min(x_end, width_);
+  y_begin = std::max(y_begin, 0);
+  y_end = std::min(y_end, height_);
+
+  const auto bake_columns = [&](int begin, int end) {
+    BakeTiles(level, begin, end, y_begin, y_end);
+  };
+
+  if (thread_pool == nullptr) {
+    bake_columns(x_begin, x_end);
+  } else {
+    thread_pool->ParallelFor(x_begin, x_end, 1, bake_columns);
+  }
+}
+
+int Lightmap::NumBakedChunks() const {
+  return static_cast<int>(texels_.size() / kTexelsPerChunk);
+}
+
+uint32_t Lightmap::FaceLight(int x, int y, Face face, float wall_x) const {
+  const uint32_t* texels = TileTexels(x, y);
+
+  if (texels == nullptr) return kAmbientTexel;
+
+  const int texel = std::min(std::max(static_cast<int>(wall_x * kFaceTexels),
+                                      0),
+                             kFaceTexels - 1);
+
+  return texels[static_cast<int>(face) * kFaceTexels + texel];
+}
+
+uint32_t Lightmap::FloorLight(const Vector& position) const {
+  const float floor_x = std::floor(position.x);
+  const float floor_y = std::floor(position.y);
+  const uint32_t* texels =
+      TileTexels(static_cast<int>(floor_x), static_cast<int>(floor_y));
+
+  if (texels == nullptr) return kAmbientTexel;
+
+  const int u = std::min(
+      static_cast<int>((position.x - floor_x) * kFloorTexels),
+      kFloorTexels - 1);
+  const int v = std::min(
+      static_cast<int>((position.y - floor_y) * kFloorTexels),
+      kFloorTexels - 1);
+
+  return texels[4 * kFaceTexels + u * kFloorTexels + v];
+}
+
+uint32_t Lightmap::FloorTexelLight(int texel_x, int texel_y) const {
+  // Rounds toward negative infinity, so the texels left of and above the
+  // level fall outside it.
+  const int x = texel_x >= 0 ? texel_x / kFloorTexels
+                             : (texel_x + 1) / kFloorTexels - 1;
+  const int y = texel_y >= 0 ? texel_y / kFloorTexels
+                             : (texel_y + 1) / kFloorTexels - 1;
+  const uint32_t* texels = TileTexels(x, y);
+
+  if (texels == nullptr) return kAmbientTexel;
+
+  const int u = texel_x - x * kFloorTexels;
+  const int v = texel_y - y * kFloorTexels;
+
+  return texels[4 * kFaceTexels + u * kFloorTexels + v];
+}
+
+uint32_t Lightmap::WallLight(const Vector& position,
+                             const Vector& ray_direction,
+                             const raycasting::RayData& ray_data) const {
+  const raycasting::HitTile hit_tile =
+      raycasting::RecoverHitTile(position, ray_direction, ray_data);
+
+  if (ray_data.wall_side == raycasting::WallSide::kXSide) {
+    return FaceLight(hit_tile.x, hit_tile.y,
+                     ray_direction.x > 0.0f ? Face::kNegativeX
+                                            : Face::kPositiveX,
+                     ray_data.wall_x);
+  }
+
+  return FaceLight(hit_tile.x, hit_tile.y,
+                   ray_direction.y > 0.0f ? Face::kNegativeY
+                                          : Face::kPositiveY,
+                   ray_data.wall_x);
+}
+
+bool Lightmap::Load(const std::string& path, std::string* error) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file) {
+    *error = "Could not open lightmap " + path;
+    return false;
+  }
+
+  FileHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  const int64_t width = header.width;
+  const int64_t height = header.height;
+
+  if (!file || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kFormatVersion || width <= 0 || height <= 0 ||
+      width * height > Level::kMaxNumTiles ||
+      header.num_lights > kMaxNumLights) {
+    *error = "Lightmap " + path + " has an invalid header";
+    return false;
+  }
+
+  const int chunks_x = static_cast<int>((width + kChunkSize - 1) / kChunkSize);
+  const int chunks_y =
+      static_cast<int>((height + kChunkSize - 1) / kChunkSize);
+  const size_t num_chunks = static_cast<size_t>(chunks_x) * chunks_y;
+
+  if (header.num_baked_chunks > num_chunks) {
+    *error = "Lightmap " + path + " has an invalid header";
+    return false;
+  }
+
+  std::vector<float> values(static_cast<size_t>(header.num_lights) *
+                            kLightFloats);
+  std::vector<uint32_t> chunk_indices(num_chunks);
+  std::vector<uint32_t> texels(header.num_baked_chunks * kTexelsPerChunk);
+
+  file.read(reinterpret_cast<char*>(values.data()),
+            static_cast<std::streamsize>(values.size() * sizeof(float)));
+  file.read(reinterpret_cast<char*>(chunk_indices.data()),
+            static_cast<std::streamsize>(chunk_indices.size() *
+                                         sizeof(uint32_t)));
+  file.read(reinterpret_cast<char*>(texels.data()),
+            static_cast<std::streamsize>(texels.size() * sizeof(uint32_t)));
+
+  bool valid = static_cast<bool>(file);
+
+  for (size_t chunk = 0; valid && chunk < num_chunks; ++chunk) {
+    valid = chunk_indices[chunk] == kNoChunk ||
+            chunk_indices[chunk] < header.num_baked_chunks;
+  }
+
+  if (!valid) {
+    *error = "Lightmap " + path + " is truncated or corrupt";
+    return false;
+  }
+
+  std::vector<PointLight> lights(header.num_lights);
+
+  for (size_t i = 0; i < lights.size(); ++i) {
+    const float* light = values.data() + i * kLightFloats;
+
+    lights[i] = PointLight{
+      Vector(light[0], light[1]), light[2], light[3], light[4], light[5],
+      light[6]
+    };
+  }
+
+  width_ = static_cast<int>(width);
+  height_ = static_cast<int>(height);
+  level_hash_ = header.level_hash;
+  lights_hash_ = header.lights_hash;
+  lights_ = std::move(lights);
+  chunks_x_ = chunks_x;
+  chunks_y_ = chunks_y;
+  chunk_indices_ = std::move(chunk_indices);
+  texels_ = std::move(texels);
+  return true;
+}
+
+bool Lightmap::Save(const std::string& path, std::string* error) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.width = static_cast<uint32_t>(width_);
+  header.height = static_cast<uint32_t>(height_);
+  header.level_hash = level_hash_;
+  header.lights_hash = lights_hash_;
+  header.num_lights = static_cast<uint32_t>(lights_.size());
+  header.num_baked_chunks = static_cast<uint32_t>(NumBakedChunks());
+
+  std::vector<float> values;
+  values.reserve(lights_.size() * kLightFloats);
+
+  for (const PointLight& light : lights_) {
+    values.insert(values.end(), {
+      light.position.x, light.position.y, light.radius, light.range,
+      light.red, light.green, light.blue
+    });
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(values.data()),
+             static_cast<std::streamsize>(values.size() * sizeof(float)));
+  file.write(reinterpret_cast<const char*>(chunk_indices_.data()),
+             static_cast<std::streamsize>(chunk_indices_.size() *
+                                          sizeof(uint32_t)));
+  file.write(reinterpret_cast<const char*>(texels_.data()),
+             static_cast<std::streamsize>(texels_.size() * sizeof(uint32_t)));
+
+  if (!file) {
+    *error = "Could not write lightmap " + path;
+    return false;
+  }
+
+  return true;
+}
+
+bool Lightmap::LoadOrBuild(const Level& level,
+                           const std::vector<PointLight>& lights,
+                           const std::string& path,
+                           ThreadPool* thread_pool,
+                           bool* rebuilt,
+                           std::string* error) {
+  std::string load_error;
+
+  if (Load(path, &load_error) && width_ == level.Width() &&
+      height_ == level.Height() && level_hash_ == level::HashLevel(level) &&
+      lights_hash_ == lighting::HashLights(lights)) {
+    *rebuilt = false;
+    return true;
+  }
+
+  *this = Lightmap(level, lights, thread_pool);
+  *rebuilt = true;
+
+  return Save(path, error);
+}
@@ -0,0 +1,168 @@
+#include "line_of_sight.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "ray_caster.h"
+
+namespace {
+
+// Returns true if the tile lies in the square of empty tiles around the
+// center tile, whose distance to the nearest wall is center_distance.
+bool InsideEmptySquare(int center_x, int center_y, int center_distance,
+                       int tile_x, int tile_y) {
+  return std::max(std::abs(tile_x - center_x), std::abs(tile_y - center_y)) <
+         center_distance;
+}
+
+// Walks the tiles from the source to the target.
+bool TraceSegment(const Level& level,
+                  const DistanceField* distance_field,
+                  const Vector& source,
+                  const Vector& target) {
+  raycasting::DDAData dda_data_x(source.x, target.x - source.x);
+  raycasting::DDAData dda_data_y(source.y, target.y - source.y);
+
+  const int target_tile_x = static_cast<int>(target.x);
+  const int target_tile_y = static_cast<int>(target.y);
+
+  // The segment crosses exactly this many tile sides along each axis. Once an
+  // axis has crossed all of its sides, only the other one steps, so the walk
+  // ends in the target tile even where rounding breaks a tie the other way.
+  int remaining_x = std::abs(target_tile_x - dda_data_x.tile);
+  int remaining_y = std::abs(target_tile_y - dda_data_y.tile);
+
+  while (remaining_x > 0 || remaining_y > 0) {
+    // The segment ends inside the empty square around the current tile if
+    // the target lies in it. Otherwise the walk jumps across the square first,
+    // like raycasting::CastRay. The jump stays short of the target, unless
+    // rounding breaks a tie the other way, in which case the tiles are walked
+    // one by one.
+    if (distance_field != nullptr) {
+      const int distance =
+          distance_field->At(dda_data_x.tile, dda_data_y.tile);
+
+      if (InsideEmptySquare(dda_data_x.tile, dda_data_y.tile, distance,
+                            target_tile_x, target_tile_y)) {
+        return true;
+      }
+
+      const int empty_radius = distance - 1;
+
+      if (empty_radius > 0) {
+        raycasting::DDAData skipped_x = dda_data_x;
+        raycasting::DDAData skipped_y = dda_data_y;
+        raycasting::SkipEmptySpace(empty_radius, &skipped_x, &skipped_y);
+
+        const int crossed_x = skipped_x.num_crossed - dda_data_x.num_crossed;
+        const int crossed_y = skipped_y.num_crossed - dda_data_y.num_crossed;
+
+        if (crossed_x <= remaining_x && crossed_y <= remaining_y &&
+            crossed_x + crossed_y < remaining_x + remaining_y) {
+          dda_data_x = skipped_x;
+          dda_data_y = skipped_y;
+          remaining_x -= crossed_x;
+          remaining_y -= crossed_y;
+        }
+      }
+    }
+
+    // Ties are resolved in favor of Y, as in raycasting::CastRay.
+    if (remaining_y == 0 ||
+        (remaining_x > 0 && dda_data_x.side_dist < dda_data_y.side_dist)) {
+      dda_data_x.Advance();
+      --remaining_x;
+    } else {
+      dda_data_y.Advance();
+      --remaining_y;
+    }
+
+    if (level.IsSolid(dda_data_x.tile, dda_data_y.tile)) return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool sensing::HasLineOfSight(const Level& level,
+                             const DistanceField* distance_field,
+                             const Vector& source,
+                             const Vector& target) {
+  if (distance_field != nullptr) {
+    const int source_tile_x = static_cast<int>(source.x);
+    const int source_tile_y = static_cast<int>(source.y);
+
+    if (InsideEmptySquare(source_tile_x, source_tile_y,
+                          distance_field->At(source_tile_x, source_tile_y),
+                          static_cast<int>(target.x),
+                          static_cast<int>(target.y))) {
+      return true;
+    }
+  }
+
+  return TraceSegment(level, distance_field, source, target);
+}
+
+void sensing::CheckLinesOfSight(const Level& level,
+                                const DistanceField* distance_field,
+                                const SightQueries& queries,
+                                ThreadPool* thread_pool,
+                                uint64_t* visible) {
+  // Every chunk owns whole words, so no two threads write to the same word.
+  const auto check_words = [&](int word_begin, int word_end) {
+    const int query_end =
+        std::min(word_end * kQueriesPerWord, queries.num_queries);
+
+    // Source of the current run of queries and its distance to the nearest
+    // wall, looked up once per run.
+    int source_index = -1;
+    int source_tile_x = 0;
+    int source_tile_y = 0;
+    int source_distance = 0;
+
+    for (int word = word_begin; word < word_end; ++word) {
+      uint64_t bits = 0;
+      const int word_query_end =
+          std::min((word + 1) * kQueriesPerWord, query_end);
+
+      for (int query = word * kQueriesPerWord; query < word_query_end;
+           ++query) {
+        const Vector source(queries.source_x[query], queries.source_y[query]);
+        const Vector target(queries.target_x[query], queries.target_y[query]);
+
+        if (source_index < 0 ||
+            source.x != queries.source_x[source_index] ||
+            source.y != queries.source_y[source_index]) {
+          source_index = query;
+          source_tile_x = static_cast<int>(source.x);
+          source_tile_y = static_cast<int>(source.y);
+          source_distance = distance_field != nullptr
+                                ? distance_field->At(source_tile_x,
+                                                     source_tile_y)
+                                : 0;
+        }
+
+        const bool target_visible =
+            InsideEmptySquare(source_tile_x, source_tile_y, source_distance,
+                              static_cast<int>(target.x),
+                              static_cast<int>(target.y)) ||
+            TraceSegment(level, distance_field, source, target);
+
+        bits |= static_cast<uint64_t>(target_visible)
+                << (query - word * kQueriesPerWord);
+      }
+
+      visible[word] = bits;
+    }
+  };
+
+  const int num_words = NumSightWords(queries.num_queries);
+
+  if (thread_pool == nullptr) {
+    check_words(0, num_words);
+    return;
+  }
+
+  thread_pool->ParallelFor(0, num_words, kMinSightWordChunk, check_words);
+}
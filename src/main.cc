@@ -1,38 +1,109 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <chrono>
 #include <cmath>
 #include <limits>
+#include <memory>
+#include <vector>
 
 #include <SDL2/SDL.h>
 
-#include "level_data.h"
+#include "level.h"
+#include "level_editor.h"
+#include "lightmap.h"
 #include "vector.h"
 #include "camera.h"
+#include "distance_field.h"
+#include "frame_buffer.h"
+#include "frame_capture.h"
 #include "game_log.h"
+#include "options.h"
+#include "profiler.h"
+#include "ray_cache.h"
+#include "renderer.h"
+#include "resolution_scaler.h"
+#include "simulation.h"
+#include "sprite_renderer.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "visibility_set.h"
 
 std::string GenerateSDLErrorMessage(const std::string error_context);
 
 float DegreesToRadians(float degrees);
+Vector FindStartPosition(const Level& level);
 float CalculateFrameTime();
 
-void LogGameActivity(float frame_time, const Camera& camera);
+void LogGameActivity(
+    float frame_time,
+    const Camera& camera,
+    const game_log::RenderStats& render_stats,
+    GameLogWriter* log_writer);
 void HandleKeyboardEvent(
     const SDL_KeyboardEvent& keyboard_event,
-    Camera* camera);
+    Simulation* simulation);
+void ToggleDoorAhead(const Camera& camera, LevelEditor* level_editor);
 
-void RenderBackground(SDL_Renderer* renderer);
+float MeasureSpeedup(float render_time, bool reference_frame);
+
+// Renders a frame with one draw call per screen column. Kept as a fallback to
+// compare against the frame buffer backend.
+void RenderFrame(
+    const Camera& camera,
+    SDL_Renderer* renderer,
+    int screen_width,
+    int screen_height,
+    profiling::Profiler* profiler);
+void RenderBackground(
+    SDL_Renderer* renderer,
+    int screen_width,
+    int screen_height);
 void RenderWallSegment(
     SDL_Renderer* renderer,
     const raycasting::RayData& ray_data,
-    int x);
+    int x,
+    int screen_height);
+
+// Number of frames between two single-threaded reference frames.
+constexpr int kReferenceFrameInterval = 60;
+
+int main(int argc, char* argv[]) {
+  options::Options options;
+  std::string options_error;
 
-// Constants for window dimensions.
-constexpr int kWindowWidth = 1920;
-constexpr int kWindowHeight = 1080;
-constexpr int kMaxWindowY = kWindowHeight - 1;
+  if (!options::ParseOptions(argc, argv, &options, &options_error)) {
+    std::cout << options_error << '\n'
+              << options::GenerateUsageMessage()
+              << std::flush;
+    return 1;
+  }
+
+  Level level = level::BuiltinLevel();
+  std::string level_error;
+
+  if (!options.level_path.empty() &&
+      !level::LoadLevel(options.level_path, &level, &level_error)) {
+    std::cout << level_error << std::endl;
+    return 1;
+  }
+
+  if (!options.save_level_path.empty()) {
+    if (!level::SaveBinaryLevel(level, options.save_level_path,
+                                &level_error)) {
+      std::cout << level_error << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  // Tracing is enabled before any of the threads it names are started.
+  if (!options.trace_path.empty()) {
+    tracing::Enable();
+    tracing::SetThreadName("main");
+  }
 
-int main() {
   // Initialize SDL create window and renderer.
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
     std::cout << GenerateSDLErrorMessage("SDL could not initialize!")
@@ -44,8 +115,8 @@ int main() {
       "ray-casting",
       SDL_WINDOWPOS_CENTERED,
       SDL_WINDOWPOS_CENTERED,
-      kWindowWidth,
-      kWindowHeight,
+      options.screen_width,
+      options.screen_height,
       0);
 
   if (window == nullptr) {
@@ -68,55 +139,390 @@ int main() {
     return 1;
   }
 
+  // The frame buffer backend draws on the CPU and uploads the whole frame to
+  // this streaming texture once per frame.
+  SDL_Texture* texture = nullptr;
+
+  if (options.render_backend == rendering::Backend::kFrameBuffer) {
+    // Frames rendered smaller than the window are scaled up by the copy to
+    // the window, with the filter set when the texture is created.
+    SDL_SetHint(
+        SDL_HINT_RENDER_SCALE_QUALITY,
+        options.upscale_filter == resolution::Filter::kLinear ? "linear"
+                                                              : "nearest");
+
+    texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        options.screen_width,
+        options.screen_height);
+
+    if (texture == nullptr) {
+      std::cout << GenerateSDLErrorMessage("Texture could not be created!")
+                << std::endl;
+      SDL_DestroyRenderer(renderer);
+      SDL_DestroyWindow(window);
+      SDL_Quit();
+      return 1;
+    }
+  }
+
+  // Picks a smaller frame size whenever frames cost more than the target.
+  std::unique_ptr<ResolutionScaler> resolution_scaler;
+
+  if (options.target_frame_ms > 0.0f) {
+    resolution_scaler = std::make_unique<ResolutionScaler>(
+        options.target_frame_ms, options.screen_width, options.screen_height);
+  }
+
+  FrameBuffer frame_buffer(options.screen_width, options.screen_height);
+  rendering::ColumnBuffers column_buffers(options.screen_width);
+  ThreadPool thread_pool(options.num_threads);
+
   // Game variables.
   bool running = true;
+  bool use_requested = false;
   float frame_time = 0.0f;
+  int frames_since_reference = 0;
+  bool last_frame_was_reference = false;
+
+  game_log::RenderStats render_stats = {
+    thread_pool.NumThreads(), 0.0f, 1.0f, 1.0f, 0, {}
+  };
+
+  // Records every finished frame on its own thread. Frames are dropped
+  // rather than waited for when the disk falls behind.
+  std::unique_ptr<FrameCapture> frame_capture;
+
+  if (!options.capture_path.empty() &&
+      options.render_backend == rendering::Backend::kFrameBuffer) {
+    frame_capture = std::make_unique<FrameCapture>(options.screen_width,
+                                                   options.screen_height);
+    std::string capture_error;
+
+    if (frame_capture->Open(options.capture_path, &capture_error)) {
+      frame_capture->Start();
+    } else {
+      std::cout << capture_error << std::endl;
+      frame_capture.reset();
+    }
+  }
+
+  // Times every stage of every frame for the game log and the profile file.
+  profiling::Profiler profiler;
+
+  // Writes the game log to the terminal on its own thread.
+  GameLogWriter log_writer(&profiler);
 
   // Initialize camera.
-  Camera camera(
-      22.0f, 12.0f,
+  const Vector start_position = FindStartPosition(level);
+
+  Camera start_camera(
+      level,
+      start_position.x, start_position.y,
       DegreesToRadians(180.0f),
       DegreesToRadians(90.0f));
 
-  std::cout << escape_codes::kHideTheCursor;
+  // The textures are only generated if the frame buffer renderer uses them.
+  std::unique_ptr<TextureAtlas> texture_atlas;
+
+  if (options.render_backend == rendering::Backend::kFrameBuffer &&
+      options.textures) {
+    texture_atlas = std::make_unique<TextureAtlas>();
+  }
+
+  // Sprites are drawn with textures only.
+  const std::vector<rendering::Sprite> sprites =
+      rendering::ScatterSprites(level, options.num_sprites);
+  rendering::SpriteRenderer sprite_renderer;
+
+  // The visible sets of a level file are cached next to it and rebuilt when
+  // the level changes. Those of the built-in level are built on every run.
+  std::unique_ptr<VisibilitySet> visibility_set;
+
+  if (options.visibility_set) {
+    if (options.level_path.empty()) {
+      visibility_set = std::make_unique<VisibilitySet>(level, &thread_pool);
+    } else {
+      visibility_set = std::make_unique<VisibilitySet>();
+
+      bool rebuilt = false;
+      std::string visibility_error;
+
+      if (!visibility_set->LoadOrBuild(level, options.level_path + ".pvs",
+                                       &thread_pool, &rebuilt,
+                                       &visibility_error)) {
+        std::cout << visibility_error << std::endl;
+      }
+    }
+
+    sprite_renderer.SetVisibilitySet(visibility_set.get());
+  }
+
+  // The lightmap of a level file is cached next to it and baked again when
+  // the level or the lights change. That of the built-in level is baked on
+  // every run.
+  std::unique_ptr<Lightmap> lightmap;
+
+  if (options.num_lights > 0) {
+    const std::vector<PointLight> lights =
+        lighting::ScatterLights(level, options.num_lights);
+
+    if (options.level_path.empty()) {
+      lightmap = std::make_unique<Lightmap>(level, lights, &thread_pool);
+    } else {
+      lightmap = std::make_unique<Lightmap>();
+
+      bool rebuilt = false;
+      std::string lightmap_error;
+
+      if (!lightmap->LoadOrBuild(level, lights, options.level_path + ".light",
+                                 &thread_pool, &rebuilt, &lightmap_error)) {
+        std::cout << lightmap_error << std::endl;
+      }
+    }
+
+    sprite_renderer.SetLightmap(lightmap.get());
+  }
+
+  // Keeps the rays of the last frame, so a still or slowly turning camera
+  // casts only a fraction of them.
+  std::unique_ptr<RayCache> ray_cache;
+
+  if (options.ray_cache) {
+    ray_cache = std::make_unique<RayCache>(options.screen_width);
+  }
+
+  // The distance field is only built if empty-space skipping is enabled.
+  std::unique_ptr<DistanceField> distance_field;
+
+  if (options.distance_field) {
+    distance_field = std::make_unique<DistanceField>(level);
+    start_camera.SetDistanceField(distance_field.get());
+  }
+
+  // The camera moves in fixed time steps, on its own thread by default.
+  Simulation simulation(start_camera, Simulation::Clock::now());
+
+  // Sprites that are drawn block the camera.
+  if (texture_atlas != nullptr) {
+    for (const rendering::Sprite& sprite : sprites) {
+      simulation.AddObstacle(sprite.position, rendering::kSpriteRadius);
+    }
+  }
+
+  // Doors and walls change between frames. The structures derived from the
+  // level are updated around every changed tile.
+  LevelEditor level_editor(&level);
+  level_editor.SetDistanceField(distance_field.get());
+  level_editor.SetVisibilitySet(visibility_set.get());
+  level_editor.SetLightmap(lightmap.get());
+  level_editor.SetEntityWorld(&simulation.Entities());
+
+  if (options.simulation_mode == simulation::Mode::kThread) {
+    simulation.Start();
+  }
+
+  std::cout << escape_codes::kHideTheCursor << std::flush;
+  log_writer.Start();
+
+  using profiling::ScopedTimer;
+  using profiling::Stage;
 
   while (running) {
-    // Calculate frame time and log game activity.
     frame_time = CalculateFrameTime();
-    LogGameActivity(frame_time, camera);
+
+    tracing::ScopedTrace frame_trace("frame");
+
+    // The frame stage spans from one frame start to the next, so it includes
+    // the time spent outside the timed stages. The time of a reference frame
+    // is only known here, at the start of the frame after it.
+    if (frame_time > 0.0f && !last_frame_was_reference) {
+      profiler.Record(Stage::kFrame, frame_time * 1000.0f);
+    }
 
     // Poll for SDL events.
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      switch (event.type) {
-       case SDL_QUIT:
-        running = false;
-        break;
-
-       case SDL_KEYDOWN:
-       case SDL_KEYUP:
-        HandleKeyboardEvent(event.key, &camera);
-        break;
+    {
+      ScopedTimer timer(&profiler, Stage::kEvents);
+
+      SDL_Event event;
+      use_requested = false;
+
+      while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+         case SDL_QUIT:
+          running = false;
+          break;
+
+         case SDL_KEYDOWN:
+         case SDL_KEYUP:
+          HandleKeyboardEvent(event.key, &simulation);
+          use_requested |= event.type == SDL_KEYDOWN && !event.key.repeat &&
+                           event.key.keysym.sym == SDLK_e;
+          break;
+        }
       }
     }
 
-    // Update camera movement based on frame time.
-    camera.SetMovementSpeed(frame_time);
-    camera.HandleMotion(frame_time);
+    // Run the simulation ticks due by now, unless they run on their own
+    // thread, and take the camera interpolated for this frame.
+    const Camera camera = [&] {
+      ScopedTimer timer(&profiler, Stage::kSimulation);
 
-    // Render background (floor and ceiling).
-    RenderBackground(renderer);
+      const Simulation::Clock::time_point now = Simulation::Clock::now();
 
-    // Loop through all screen width pixels and render wall segments.
-    for (int x = 0; x < kWindowWidth; x++) {
-      float plane_scalar = (2.0f * x) / (kWindowWidth - 1.0f) - 1.0f;
+      if (options.simulation_mode == simulation::Mode::kInline) {
+        simulation.Update(now);
+      }
 
-      raycasting::RayData ray_data = camera.CalculateRay(plane_scalar);
+      return simulation.CameraAt(now);
+    }();
 
-      RenderWallSegment(renderer, ray_data, x);
+    // Apply the level edits of this frame before any thread reads the level.
+    if (use_requested) {
+      ToggleDoorAhead(camera, &level_editor);
     }
 
-    SDL_RenderPresent(renderer);
+    if (level_editor.ApplyEdits(frame_time, simulation.LevelMutex(),
+                                &thread_pool) > 0) {
+      if (ray_cache != nullptr) {
+        ray_cache->Invalidate();
+      }
+
+      sprite_renderer.InvalidateVisibility();
+    }
+
+    // Log game activity.
+    LogGameActivity(frame_time, camera, render_stats, &log_writer);
+
+    if (options.render_backend == rendering::Backend::kFrameBuffer) {
+      // With --measure-speedup, every so often a frame is rendered on this
+      // thread only, to measure the speedup of the thread pool against the
+      // single-threaded path. The bench measures the same without hitches.
+      const bool reference_frame =
+          options.measure_speedup && thread_pool.NumThreads() > 1 &&
+          ++frames_since_reference >= kReferenceFrameInterval;
+
+      if (reference_frame) {
+        frames_since_reference = 0;
+      }
+      last_frame_was_reference = reference_frame;
+
+      const auto render_start = std::chrono::steady_clock::now();
+
+      // Reference frames are deliberately slow, so they are kept out of the
+      // stage latencies like out of the resolution scaler.
+      ThreadPool* frame_thread_pool = reference_frame ? nullptr : &thread_pool;
+      profiling::Profiler* frame_profiler =
+          reference_frame ? nullptr : &profiler;
+
+      rendering::RenderFrame(
+          camera,
+          texture_atlas.get(),
+          lightmap.get(),
+          &level_editor,
+          ray_cache.get(),
+          frame_thread_pool,
+          &column_buffers,
+          &frame_buffer,
+          frame_profiler);
+
+      if (texture_atlas != nullptr) {
+        ScopedTimer timer(frame_profiler, Stage::kSprites);
+        sprite_renderer.Render(
+            camera,
+            *texture_atlas,
+            sprites,
+            column_buffers,
+            frame_thread_pool,
+            &frame_buffer);
+      }
+
+      const std::chrono::duration<float> render_time =
+          std::chrono::steady_clock::now() - render_start;
+
+      if (options.measure_speedup) {
+        render_stats.speedup =
+            MeasureSpeedup(render_time.count(), reference_frame);
+      }
+
+      if (ray_cache != nullptr) {
+        render_stats.recast_fraction = ray_cache->RecastFraction();
+      }
+
+      // Upload the finished frame with a single texture update and copy. A
+      // frame smaller than the window fills the top left of the texture and
+      // is scaled up to the whole window by the copy. The capture takes a
+      // copy of the same frame.
+      {
+        ScopedTimer timer(&profiler, Stage::kUpload);
+        const SDL_Rect frame_rect = {
+          0, 0, frame_buffer.Width(), frame_buffer.Height()
+        };
+
+        SDL_UpdateTexture(
+            texture,
+            &frame_rect,
+            frame_buffer.Pixels(),
+            frame_buffer.Pitch());
+        SDL_RenderCopy(renderer, texture, &frame_rect, nullptr);
+
+        if (frame_capture != nullptr) {
+          frame_capture->Submit(frame_buffer);
+          render_stats.dropped_frames = frame_capture->NumDropped();
+        }
+      }
+
+      // Reference frames render on one thread, so their cost says nothing
+      // about the frames in between. The buffers are only reallocated when
+      // the scale steps, which is at most once per settle period.
+      if (resolution_scaler != nullptr && !reference_frame &&
+          resolution_scaler->Update(render_time.count() * 1000.0f)) {
+        const int width = resolution_scaler->Width();
+        const int height = resolution_scaler->Height();
+
+        frame_buffer = FrameBuffer(width, height);
+        column_buffers = rendering::ColumnBuffers(width);
+
+        if (ray_cache != nullptr) {
+          *ray_cache = RayCache(width);
+        }
+
+        render_stats.resolution_scale = resolution_scaler->Scale();
+      }
+    } else {
+      RenderFrame(camera, renderer, options.screen_width,
+                  options.screen_height, &profiler);
+    }
+
+    {
+      ScopedTimer timer(&profiler, Stage::kPresent);
+      SDL_RenderPresent(renderer);
+    }
+  }
+
+  simulation.Stop();
+  log_writer.Stop();
+
+  std::string capture_error;
+
+  if (frame_capture != nullptr && !frame_capture->Close(&capture_error)) {
+    std::cout << escape_codes::kEraseInDisplay << capture_error << std::endl;
+  }
+
+  std::string profile_error;
+
+  if (!options.profile_path.empty() &&
+      !profiler.WriteSummary(options.profile_path, &profile_error)) {
+    std::cout << escape_codes::kEraseInDisplay << profile_error << std::endl;
+  }
+
+  std::string trace_error;
+
+  if (!options.trace_path.empty() &&
+      !tracing::WriteTrace(options.trace_path, &trace_error)) {
+    std::cout << escape_codes::kEraseInDisplay << trace_error << std::endl;
   }
 
   std::cout << escape_codes::kEraseInDisplay
@@ -124,6 +530,9 @@ int main() {
             << std::flush;
 
   // Clean up SDL and resources before exiting.
+  if (texture != nullptr) {
+    SDL_DestroyTexture(texture);
+  }
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
   SDL_Quit();
@@ -136,14 +545,36 @@ float DegreesToRadians(float degrees) {
   return std::fmod(degrees, 360.0f) * (kPi / 180.0f);
 }
 
+Vector FindStartPosition(const Level& level) {
+  // Start position within the built-in level.
+  static const Vector kDefaultPosition(22.0f, 12.0f);
+
+  if (!level.IsSolid(static_cast<int>(kDefaultPosition.x),
+                     static_cast<int>(kDefaultPosition.y))) {
+    return kDefaultPosition;
+  }
+
+  // Otherwise starts in the center of the first walkable tile.
+  for (int x = 0; x < level.Width(); ++x) {
+    for (int y = 0; y < level.Height(); ++y) {
+      if (!level.IsSolid(x, y)) return Vector(x + 0.5f, y + 0.5f);
+    }
+  }
+
+  return kDefaultPosition;
+}
+
 float CalculateFrameTime() {
-  static Uint32 last_time = SDL_GetTicks();
+  static std::chrono::steady_clock::time_point last_time =
+      std::chrono::steady_clock::now();
 
-  const float frame_time = (SDL_GetTicks() - last_time) / 1000.0f;
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  const std::chrono::duration<float> frame_time = now - last_time;
 
-  last_time = SDL_GetTicks();
+  last_time = now;
 
-  return frame_time;
+  return frame_time.count();
 }
 
 std::string GenerateSDLErrorMessage(const std::string error_context) {
@@ -158,20 +589,47 @@ std::string GenerateSDLErrorMessage(const std::string error_context) {
          SDL_GetError();
 }
 
-void LogGameActivity(float frame_time, const Camera& camera) {
-  static Uint32 last_time = SDL_GetTicks();
+float MeasureSpeedup(float render_time, bool reference_frame) {
+  // Weight of the newest sample in the moving averages.
+  static constexpr float kSmoothing = 0.1f;
+
+  static float pooled_time = 0.0f;
+  static float reference_time = 0.0f;
+
+  float& average = reference_frame ? reference_time : pooled_time;
+
+  average = average == 0.0f
+                ? render_time
+                : average + (render_time - average) * kSmoothing;
+
+  if (pooled_time == 0.0f || reference_time == 0.0f) return 1.0f;
+
+  return reference_time / pooled_time;
+}
+
+void LogGameActivity(
+    float frame_time,
+    const Camera& camera,
+    const game_log::RenderStats& render_stats,
+    GameLogWriter* log_writer) {
+  static std::chrono::steady_clock::time_point last_time =
+      std::chrono::steady_clock::now();
   static float sum_frame_time = 0;
   static int frame_count = 0;
 
-  const Uint32 elapsed_time = SDL_GetTicks() - last_time;
+  const std::chrono::steady_clock::duration elapsed_time =
+      std::chrono::steady_clock::now() - last_time;
 
   sum_frame_time += frame_time;
   frame_count++;
 
-  if (elapsed_time > 100) {
-    game_log::OutputGameLog(sum_frame_time / frame_count, camera);
+  if (elapsed_time > std::chrono::milliseconds(100)) {
+    log_writer->Post(game_log::TakeSnapshot(
+        sum_frame_time / frame_count,
+        camera,
+        render_stats));
 
-    last_time = SDL_GetTicks();
+    last_time = std::chrono::steady_clock::now();
     sum_frame_time = 0.0f;
     frame_count = 0;
   }
@@ -179,7 +637,7 @@ void LogGameActivity(float frame_time, const Camera& camera) {
 
 void HandleKeyboardEvent(
     const SDL_KeyboardEvent& keyboard_event,
-    Camera* camera) {
+    Simulation* simulation) {
   if (keyboard_event.repeat) return; // Ignore repeated key events.
 
   motion::AccelState accel_state = motion::AccelState::kNone;
@@ -193,97 +651,99 @@ void HandleKeyboardEvent(
 
   switch (keyboard_event.keysym.sym) {
    case SDLK_w:
-    camera->SetAcceleration(accel_state, motion::AccelDirection::kForward);
+    simulation->SetAcceleration(accel_state, motion::AccelDirection::kForward);
     break;
 
    case SDLK_s:
-    camera->SetAcceleration(accel_state, motion::AccelDirection::kBackward);
+    simulation->SetAcceleration(accel_state, motion::AccelDirection::kBackward);
     break;
 
    case SDLK_a:
     if (keyboard_event.state == SDL_PRESSED) {
       rotation_direction = motion::RotationDirection::kCounterclockwise;
     }
-    camera->SetRotationSpeed(rotation_direction);
+    simulation->SetRotationSpeed(rotation_direction);
     break;
 
    case SDLK_d:
     if (keyboard_event.state == SDL_PRESSED) {
       rotation_direction = motion::RotationDirection::kClockwise;
     }
-    camera->SetRotationSpeed(rotation_direction);
+    simulation->SetRotationSpeed(rotation_direction);
     break;
   }
 }
 
-void RenderBackground(SDL_Renderer* renderer) {
-  static const SDL_Color floor_color = { 0x1c, 0x1c, 0x1c, SDL_ALPHA_OPAQUE };
-  static const SDL_Color ceil_color = { 0x12, 0x12, 0x12, SDL_ALPHA_OPAQUE };
-  static const SDL_Rect ceil_rect = { 0, 0, kWindowWidth, kWindowHeight / 2 };
+void ToggleDoorAhead(const Camera& camera, LevelEditor* level_editor) {
+  const Vector ahead = camera.Position() + camera.Direction();
+  const int x = static_cast<int>(std::floor(ahead.x));
+  const int y = static_cast<int>(std::floor(ahead.y));
+
+  // A shut door or a plain wall opens, an open or moving door closes.
+  if (level_editor->DoorOpenFraction(x, y) > 0.0f) {
+    level_editor->CloseDoor(x, y);
+  } else {
+    level_editor->OpenDoor(x, y);
+  }
+}
+
+void RenderFrame(
+    const Camera& camera,
+    SDL_Renderer* renderer,
+    int screen_width,
+    int screen_height,
+    profiling::Profiler* profiler) {
+  // Render background (floor and ceiling).
+  {
+    profiling::ScopedTimer timer(profiler, profiling::Stage::kBackground);
+    RenderBackground(renderer, screen_width, screen_height);
+  }
+
+  // Loop through all screen width pixels and render wall segments.
+  profiling::ScopedTimer timer(profiler, profiling::Stage::kWalls);
+
+  for (int x = 0; x < screen_width; x++) {
+    raycasting::RayData ray_data =
+        camera.CalculateRay(
+            rendering::CalculatePlaneScalar(x, screen_width));
+
+    RenderWallSegment(renderer, ray_data, x, screen_height);
+  }
+}
+
+void RenderBackground(
+    SDL_Renderer* renderer,
+    int screen_width,
+    int screen_height) {
+  const SDL_Rect ceil_rect = { 0, 0, screen_width, screen_height / 2 };
 
   // Render the floor.
   SDL_SetRenderDrawColor(
       renderer,
-      floor_color.r,
-      floor_color.g,
-      floor_color.b,
-      floor_color.a);
+      rendering::kFloorColor.r,
+      rendering::kFloorColor.g,
+      rendering::kFloorColor.b,
+      rendering::kFloorColor.a);
   SDL_RenderClear(renderer);
 
   // Render the ceiling.
   SDL_SetRenderDrawColor(
       renderer,
-      ceil_color.r,
-      ceil_color.g,
-      ceil_color.b,
-      ceil_color.a);
+      rendering::kCeilColor.r,
+      rendering::kCeilColor.g,
+      rendering::kCeilColor.b,
+      rendering::kCeilColor.a);
   SDL_RenderFillRect(renderer, &ceil_rect);
 }
 
 void RenderWallSegment(
     SDL_Renderer* renderer,
     const raycasting::RayData& ray_data,
-    int x) {
-  int wall_height = static_cast<int>(kMaxWindowY / ray_data.distance);
-
-  // Clamp wall height to maximum window Y.
-  if (wall_height > kMaxWindowY) {
-    wall_height = kMaxWindowY;
-  }
-
-  const int draw_start = (kMaxWindowY - wall_height) / 2;
-  const int draw_end = draw_start + wall_height;
-
-  SDL_Color wall_color = { 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE };
-
-  switch (ray_data.wall_id) {
-   case 1:
-    wall_color.r = 0xff;
-    break;
-
-   case 2:
-    wall_color.g = 0xff;
-    break;
-
-   case 3:
-    wall_color.b = 0xff;
-    break;
-
-   case 4:
-    wall_color.r = wall_color.g = wall_color.b = 0xff;
-    break;
-
-   default:
-    wall_color.r = wall_color.g = 0xff;
-    break;
-  }
-
-  // Adjust wall color if the wall is on the Y side.
-  if (ray_data.wall_side == raycasting::WallSide::kYSide) {
-    wall_color.r /= 2;
-    wall_color.g /= 2;
-    wall_color.b /= 2;
-  }
+    int x,
+    int screen_height) {
+  const rendering::WallSpan wall_span =
+      rendering::CalculateWallSpan(ray_data.distance, screen_height);
+  const rendering::Color wall_color = rendering::WallColor(ray_data);
 
   SDL_SetRenderDrawColor(
       renderer,
@@ -291,5 +751,8 @@ void RenderWallSegment(
       wall_color.g,
       wall_color.b,
       wall_color.a);
-  SDL_RenderDrawLine(renderer, x, draw_start, x, draw_end);
+  SDL_RenderDrawLine(
+      renderer,
+      x, wall_span.draw_start,
+      x, wall_span.draw_end);
 }
@@ -0,0 +1,225 @@
+#include "options.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Splits an argument of the form --name=value into its name and value.
+// Returns false if the argument does not start with two dashes.
+bool SplitArgument(const std::string& argument,
+                   std::string* name,
+                   std::string* value) {
+  if (argument.compare(0, 2, "--") != 0) return false;
+
+  const size_t separator = argument.find('=');
+
+  *name = argument.substr(2, separator - 2);
+  *value = separator == std::string::npos ? "" : argument.substr(separator + 1);
+
+  return true;
+}
+
+bool ParseRenderBackend(const std::string& value, rendering::Backend* backend) {
+  if (value == "framebuffer") {
+    *backend = rendering::Backend::kFrameBuffer;
+  } else if (value == "lines") {
+    *backend = rendering::Backend::kDrawLine;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool ParseSimulationMode(const std::string& value, simulation::Mode* mode) {
+  if (value == "thread") {
+    *mode = simulation::Mode::kThread;
+  } else if (value == "inline") {
+    *mode = simulation::Mode::kInline;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool ParseUpscaleFilter(const std::string& value, resolution::Filter* filter) {
+  if (value == "nearest") {
+    *filter = resolution::Filter::kNearest;
+  } else if (value == "linear") {
+    *filter = resolution::Filter::kLinear;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool ParseSwitch(const std::string& value, bool* result) {
+  if (value == "on") {
+    *result = true;
+  } else if (value == "off") {
+    *result = false;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// Parses a whole decimal number that is at least min_value.
+bool ParseInt(const std::string& value, int min_value, int* result) {
+  if (value.empty()) return false;
+
+  char* parse_end = nullptr;
+  const long parsed = std::strtol(value.c_str(), &parse_end, 10);
+
+  if (*parse_end != '\0' || parsed < min_value || parsed > INT_MAX) {
+    return false;
+  }
+
+  *result = static_cast<int>(parsed);
+  return true;
+}
+
+// Parses a decimal number that is at least zero.
+bool ParseNonNegativeFloat(const std::string& value, float* result) {
+  if (value.empty()) return false;
+
+  char* parse_end = nullptr;
+  const float parsed = std::strtof(value.c_str(), &parse_end);
+
+  if (*parse_end != '\0' || !(parsed >= 0.0f) || std::isinf(parsed)) {
+    return false;
+  }
+
+  *result = parsed;
+  return true;
+}
+
+// Parses a screen size of the form WIDTHxHEIGHT, both at least 2.
+bool ParseResolution(const std::string& value, int* width, int* height) {
+  const size_t separator = value.find('x');
+
+  if (separator == std::string::npos) return false;
+
+  return ParseInt(value.substr(0, separator), 2, width) &&
+         ParseInt(value.substr(separator + 1), 2, height);
+}
+
+}  // namespace
+
+bool options::ParseOptions(int argc,
+                           char* argv[],
+                           Options* options,
+                           std::string* error) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+
+    std::string name;
+    std::string value;
+
+    if (!SplitArgument(argument, &name, &value)) {
+      *error = "Unexpected argument: " + argument;
+      return false;
+    }
+
+    bool valid = false;
+
+    if (name == "renderer") {
+      valid = ParseRenderBackend(value, &options->render_backend);
+    } else if (name == "simulation") {
+      valid = ParseSimulationMode(value, &options->simulation_mode);
+    } else if (name == "resolution") {
+      valid = ParseResolution(value, &options->screen_width,
+                              &options->screen_height);
+    } else if (name == "target-frame-ms") {
+      valid = ParseNonNegativeFloat(value, &options->target_frame_ms);
+    } else if (name == "upscale") {
+      valid = ParseUpscaleFilter(value, &options->upscale_filter);
+    } else if (name == "threads") {
+      valid = ParseInt(value, 1, &options->num_threads);
+    } else if (name == "measure-speedup") {
+      valid = ParseSwitch(value, &options->measure_speedup);
+    } else if (name == "level") {
+      options->level_path = value;
+      valid = !value.empty();
+    } else if (name == "textures") {
+      valid = ParseSwitch(value, &options->textures);
+    } else if (name == "sprites") {
+      valid = ParseInt(value, 0, &options->num_sprites);
+    } else if (name == "distance-field") {
+      valid = ParseSwitch(value, &options->distance_field);
+    } else if (name == "ray-cache") {
+      valid = ParseSwitch(value, &options->ray_cache);
+    } else if (name == "pvs") {
+      valid = ParseSwitch(value, &options->visibility_set);
+    } else if (name == "lights") {
+      valid = ParseInt(value, 0, &options->num_lights);
+    } else if (name == "profile") {
+      options->profile_path = value;
+      valid = !value.empty();
+    } else if (name == "trace") {
+      options->trace_path = value;
+      valid = !value.empty();
+    } else if (name == "capture") {
+      options->capture_path = value;
+      valid = !value.empty();
+    } else if (name == "save-level") {
+      options->save_level_path = value;
+      valid = !value.empty();
+    } else {
+      *error = "Unknown option: " + argument;
+      return false;
+    }
+
+    if (!valid) {
+      *error = "Invalid value for option: " + argument;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::string options::GenerateUsageMessage() {
+  return "Usage: ray-casting [options]\n"
+         "  --renderer=framebuffer|lines  "
+         "CPU frame buffer (default) or one draw call per column\n"
+         "  --simulation=thread|inline    "
+         "simulate motion on its own thread (default) or per frame\n"
+         "  --resolution=WIDTHxHEIGHT     "
+         "window and frame size (default: 1920x1080)\n"
+         "  --target-frame-ms=MS          "
+         "render smaller frames above this cost (default: 0, off)\n"
+         "  --upscale=nearest|linear      "
+         "filter scaling smaller frames up (default: linear)\n"
+         "  --threads=N                   "
+         "threads rendering a frame (default: one per core)\n"
+         "  --measure-speedup=on|off      "
+         "render every 60th frame on one thread (default: off)\n"
+         "  --level=PATH                  "
+         "level to load, binary or text (default: built-in)\n"
+         "  --textures=on|off             "
+         "textured or flat-shaded walls (default: on)\n"
+         "  --sprites=N                   "
+         "sprites scattered over the level (default: 128)\n"
+         "  --distance-field=on|off       "
+         "skip empty space with a distance field (default: off)\n"
+         "  --ray-cache=on|off            "
+         "reuse the rays of the last frame (default: off)\n"
+         "  --pvs=on|off                  "
+         "cull sprites with per-tile visible sets (default: off)\n"
+         "  --lights=N                    "
+         "point lights baked into a lightmap (default: 0, off)\n"
+         "  --profile=PATH                "
+         "write frame stage latencies on exit (.json or .csv)\n"
+         "  --trace=PATH                  "
+         "write a Chrome trace of the frame timeline on exit\n"
+         "  --capture=PATH                "
+         "record frames to a Y4M or .rgb file without waiting\n"
+         "  --save-level=PATH             "
+         "write the level in the binary format and exit\n";
+}
@@ -0,0 +1,158 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+// Returns the index of the nearest-rank percentile among count samples. The
+// rank is rounded up in integers, so it is exact for any count.
+int PercentileRank(int percent, int count) {
+  const int64_t rank = (static_cast<int64_t>(percent) * count + 99) / 100 - 1;
+
+  return static_cast<int>(std::clamp<int64_t>(rank, 0, count - 1));
+}
+
+bool EndsWith(const std::string& text, const std::string& suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+const char* profiling::StageName(Stage stage) {
+  switch (stage) {
+   case Stage::kEvents: return "events";
+   case Stage::kSimulation: return "simulation";
+   case Stage::kBackground: return "background";
+   case Stage::kWalls: return "walls";
+   case Stage::kSprites: return "sprites";
+   case Stage::kUpload: return "upload";
+   case Stage::kPresent: return "present";
+   default: return "frame";
+  }
+}
+
+profiling::Profiler::Profiler() : scratch_(kCapacity) {
+  for (SampleRing& ring : rings_) {
+    ring.samples = std::make_unique<std::atomic<float>[]>(kCapacity);
+  }
+}
+
+void profiling::Profiler::Record(Stage stage, float milliseconds) {
+  SampleRing& ring = rings_[static_cast<int>(stage)];
+
+  // Only this thread writes the count, so it does not need a read-modify-write.
+  const int64_t index = ring.num_recorded.load(std::memory_order_relaxed);
+
+  ring.samples[index & kIndexMask].store(milliseconds,
+                                         std::memory_order_relaxed);
+  if (milliseconds > ring.max.load(std::memory_order_relaxed)) {
+    ring.max.store(milliseconds, std::memory_order_relaxed);
+  }
+  ring.num_recorded.store(index + 1, std::memory_order_release);
+}
+
+profiling::StageSummary profiling::Profiler::Summarize(Stage stage,
+                                                       int max_samples) {
+  const SampleRing& ring = rings_[static_cast<int>(stage)];
+
+  const int64_t num_recorded =
+      ring.num_recorded.load(std::memory_order_acquire);
+  const int count = static_cast<int>(
+      std::min<int64_t>({ num_recorded, kCapacity, max_samples }));
+
+  if (count <= 0) return StageSummary{ 0, 0.0f, 0.0f, 0.0f, 0.0f };
+
+  // The oldest samples copied here may already be overwritten by newer ones,
+  // which only shifts the window slightly.
+  for (int i = 0; i < count; ++i) {
+    scratch_[i] = ring.samples[(num_recorded - count + i) & kIndexMask].load(
+        std::memory_order_relaxed);
+  }
+
+  // Each selection leaves the larger samples behind the percentile, so the
+  // next one only needs to search those, without moving the percentile.
+  const auto begin = scratch_.begin();
+  const auto end = begin + count;
+
+  const auto p50 = begin + PercentileRank(50, count);
+  const auto p95 = begin + PercentileRank(95, count);
+  const auto p99 = begin + PercentileRank(99, count);
+
+  std::nth_element(begin, p50, end);
+  if (p95 > p50) std::nth_element(p50 + 1, p95, end);
+  if (p99 > p95) std::nth_element(p95 + 1, p99, end);
+
+  return StageSummary{
+    count, *p50, *p95, *p99, *std::max_element(p99, end)
+  };
+}
+
+int64_t profiling::Profiler::NumRecorded(Stage stage) const {
+  return rings_[static_cast<int>(stage)].num_recorded.load(
+      std::memory_order_acquire);
+}
+
+bool profiling::Profiler::WriteSummary(const std::string& path,
+                                       std::string* error) {
+  std::ofstream file(path, std::ios::trunc);
+  const bool json = EndsWith(path, ".json");
+
+  if (json) {
+    file << "{\"stages\":[";
+  } else {
+    file << "stage,recorded,samples,p50_ms,p95_ms,p99_ms,max_ms,"
+            "max_ever_ms\n";
+  }
+
+  for (int i = 0; i < kNumStages; ++i) {
+    const Stage stage = static_cast<Stage>(i);
+    const StageSummary summary = Summarize(stage, kCapacity);
+    const float max_ever = rings_[i].max.load(std::memory_order_relaxed);
+
+    if (json) {
+      file << (i > 0 ? "," : "")
+           << "{\"stage\":\"" << StageName(stage) << "\""
+           << ",\"recorded\":" << NumRecorded(stage)
+           << ",\"samples\":" << summary.num_samples
+           << ",\"p50_ms\":" << summary.p50
+           << ",\"p95_ms\":" << summary.p95
+           << ",\"p99_ms\":" << summary.p99
+           << ",\"max_ms\":" << summary.max
+           << ",\"max_ever_ms\":" << max_ever << "}";
+    } else {
+      file << StageName(stage) << ',' << NumRecorded(stage) << ','
+           << summary.num_samples << ',' << summary.p50 << ','
+           << summary.p95 << ',' << summary.p99 << ',' << summary.max << ','
+           << max_ever << '\n';
+    }
+  }
+
+  if (json) {
+    file << "]}\n";
+  }
+
+  if (!file) {
+    *error = "Could not write profile " + path;
+    return false;
+  }
+
+  return true;
+}
+
+profiling::ScopedTimer::ScopedTimer(Profiler* profiler, Stage stage)
+    : profiler_(profiler), stage_(stage), trace_(StageName(stage)) {
+  if (profiler_ != nullptr) {
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+profiling::ScopedTimer::~ScopedTimer() {
+  if (profiler_ == nullptr) return;
+
+  const std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start_;
+
+  profiler_->Record(stage_, elapsed.count());
+}
@@ -0,0 +1,565 @@
+#include "ray_cache.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "ray_packet.h"
+#include "renderer.h"
+
+namespace {
+
+// Hit points closer than this in front of the new camera are not
+// reprojected, as their column would be unstable.
+constexpr float kMinReprojectDepth = 1e-3f;
+
+// Margin around the hit points when collecting the tiles a run of rays
+// crosses, which covers rounding in the hit points.
+constexpr float kHitMargin = 1e-3f;
+
+// Finds the columns whose centers lie in [low, high]. The range is empty if
+// first > last.
+void ColumnRange(float low, float high, int width, int* first, int* last) {
+  low = std::max(low, 0.0f);
+  high = std::min(high, width - 1.0f);
+
+  if (!(low <= high)) {
+    *first = 1;
+    *last = 0;
+    return;
+  }
+
+  *first = static_cast<int>(low);
+  *first += *first < low ? 1 : 0;
+  *last = static_cast<int>(high);
+}
+
+// Finds the column nearest to the column behind whose hit point lies far
+// enough in front of the camera, given that the column in front is such a
+// column and the depth changes monotonically between them. The project
+// function returns the depth of the hit point of a column.
+template <typename Project>
+int NearestInFront(const Project& project, int behind, int in_front) {
+  while (std::abs(in_front - behind) > 1) {
+    const int middle = behind + (in_front - behind) / 2;
+    float column;
+
+    if (project(middle, &column) > kMinReprojectDepth) {
+      in_front = middle;
+    } else {
+      behind = middle;
+    }
+  }
+
+  return in_front;
+}
+
+// Rays that all reach the same side of the same tile without crossing any
+// other wall. Along and across refer to the axis of the side.
+struct SideRays {
+  float along_direction;
+  float along_plane;
+  float across_direction;
+  float across_plane;
+  float across_position;
+
+  // Distance from the camera to the first tile side along the axis, in units
+  // of the along component of a ray, and the number of sides crossed before
+  // the hit side.
+  float init_side;
+  int num_before;
+
+  // Walls are textured from the other end when seen from +X or -Y.
+  bool mirrored;
+};
+
+// Calculates the distances and wall positions of the rays of the columns in
+// the range [x_begin, x_end) exactly as raycasting::CalculateHit does.
+void CalculateSideRays(const SideRays& rays,
+                       const float* plane_scalars,
+                       int x_begin,
+                       int x_end,
+                       float* distance,
+                       float* wall_x) {
+  for (int x = x_begin; x < x_end; ++x) {
+    const float along =
+        rays.along_direction + rays.along_plane * plane_scalars[x];
+    const float across =
+        rays.across_direction + rays.across_plane * plane_scalars[x];
+
+    // Same steps as raycasting::DDAData and its SideDist.
+    const float delta_dist = 1.0f / std::abs(along);
+    const float init_dist = rays.init_side * delta_dist;
+    const float hit_dist = rays.num_before == 0
+                               ? init_dist
+                               : init_dist + rays.num_before * delta_dist;
+
+    float hit_x = rays.across_position + hit_dist * across;
+    hit_x -= std::floor(hit_x);
+
+    distance[x] = hit_dist;
+    wall_x[x] = rays.mirrored ? 1.0f - hit_x : hit_x;
+  }
+}
+
+// Calculates the rays like CalculateSideRays, eight columns at a time, and
+// returns the first column it did not calculate.
+__attribute__((target("avx2")))
+int CalculateSideRaysAVX2(const SideRays& rays,
+                          const float* plane_scalars,
+                          int x_begin,
+                          int x_end,
+                          float* distance,
+                          float* wall_x) {
+  const __m256 along_direction = _mm256_set1_ps(rays.along_direction);
+  const __m256 along_plane = _mm256_set1_ps(rays.along_plane);
+  const __m256 across_direction = _mm256_set1_ps(rays.across_direction);
+  const __m256 across_plane = _mm256_set1_ps(rays.across_plane);
+  const __m256 across_position = _mm256_set1_ps(rays.across_position);
+  const __m256 init_side = _mm256_set1_ps(rays.init_side);
+  const __m256 num_before = _mm256_set1_ps(static_cast<float>(rays.num_before));
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+
+  int x = x_begin;
+
+  for (; x + 8 <= x_end; x += 8) {
+    const __m256 scalars = _mm256_loadu_ps(plane_scalars + x);
+    const __m256 along =
+        _mm256_add_ps(along_direction, _mm256_mul_ps(along_plane, scalars));
+    const __m256 across =
+        _mm256_add_ps(across_direction, _mm256_mul_ps(across_plane, scalars));
+
+    const __m256 delta_dist = _mm256_div_ps(one, _mm256_andnot_ps(sign, along));
+    const __m256 init_dist = _mm256_mul_ps(init_side, delta_dist);
+    const __m256 hit_dist =
+        rays.num_before == 0
+            ? init_dist
+            : _mm256_add_ps(init_dist, _mm256_mul_ps(num_before, delta_dist));
+
+    __m256 hit_x =
+        _mm256_add_ps(across_position, _mm256_mul_ps(hit_dist, across));
+    hit_x = _mm256_sub_ps(hit_x, _mm256_floor_ps(hit_x));
+
+    _mm256_storeu_ps(distance + x, hit_dist);
+    _mm256_storeu_ps(wall_x + x,
+                     rays.mirrored ? _mm256_sub_ps(one, hit_x) : hit_x);
+  }
+
+  return x;
+}
+
+}  // namespace
+
+RayCache::RayCache(int width)
+    : width_(width),
+      distance_(width),
+      wall_id_(width),
+      wall_side_(width),
+      wall_x_(width),
+      num_steps_(width),
+      hit_tile_(width),
+      plane_scalars_(width),
+      predicted_face_(width, kUnknownFace),
+      predicted_depth_(width) {
+  for (int x = 0; x < width; ++x) {
+    plane_scalars_[x] = rendering::CalculatePlaneScalar(x, width);
+  }
+}
+
+void RayCache::Update(const Camera& camera, ThreadPool* thread_pool) {
+  const bool same_view = valid_ &&
+                         level_ == &camera.GetLevel() &&
+                         distance_field_ == camera.GetDistanceField();
+
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  if (same_view &&
+      position.x == position_.x && position.y == position_.y &&
+      direction.x == direction_.x && direction.y == direction_.y &&
+      plane.x == plane_.x && plane.y == plane_.y) {
+    num_cast_ = 0;
+    return;
+  }
+
+  if (same_view) {
+    Reproject(camera);
+  } else {
+    std::fill(predicted_face_.begin(), predicted_face_.end(), kUnknownFace);
+  }
+
+  cast_all_ = same_view && ShouldCastAll();
+
+  valid_ = true;
+  level_ = &camera.GetLevel();
+  distance_field_ = camera.GetDistanceField();
+  position_ = position;
+  direction_ = direction;
+  plane_ = plane;
+
+  if (cast_all_) {
+    num_cast_ = width_;
+
+    if (thread_pool == nullptr) {
+      CastColumns(camera, 0, width_);
+    } else {
+      thread_pool->ParallelFor(
+          0, width_, rendering::kMinColumnChunk,
+          [&](int x_begin, int x_end) {
+            CastColumns(camera, x_begin, x_end);
+          });
+    }
+    return;
+  }
+
+  if (thread_pool == nullptr) {
+    num_cast_ = ResolveColumns(camera, 0, width_);
+    return;
+  }
+
+  // Larger chunks than for shading, as every chunk casts its end columns.
+  std::atomic<int> num_cast{0};
+
+  thread_pool->ParallelFor(
+      0, width_, 4 * rendering::kMinColumnChunk,
+      [&](int x_begin, int x_end) {
+        num_cast.fetch_add(ResolveColumns(camera, x_begin, x_end),
+                           std::memory_order_relaxed);
+      });
+
+  num_cast_ = num_cast.load(std::memory_order_relaxed);
+}
+
+void RayCache::Invalidate() {
+  valid_ = false;
+}
+
+raycasting::RayData RayCache::Ray(int x) const {
+  return raycasting::RayData{
+    distance_[x], wall_id_[x], wall_side_[x], wall_x_[x], num_steps_[x]
+  };
+}
+
+int RayCache::Width() const {
+  return width_;
+}
+
+int RayCache::NumCast() const {
+  return num_cast_;
+}
+
+float RayCache::RecastFraction() const {
+  return static_cast<float>(num_cast_) / width_;
+}
+
+bool RayCache::CastAll() const {
+  return cast_all_;
+}
+
+Vector RayCache::RayDirection(const Vector& direction,
+                              const Vector& plane,
+                              int x) const {
+  return direction + plane * plane_scalars_[x];
+}
+
+int64_t RayCache::FaceKey(int x) const {
+  // Tile coordinates are below 2^31, so the key cannot overflow.
+  const raycasting::HitTile hit_tile = hit_tile_[x];
+
+  return (static_cast<int64_t>(hit_tile.x) * (int64_t{1} << 31) + hit_tile.y) *
+             2 +
+         static_cast<int>(wall_side_[x]);
+}
+
+void RayCache::Reproject(const Camera& camera) {
+  std::fill(predicted_face_.begin(), predicted_face_.end(), kUnknownFace);
+  std::fill(predicted_depth_.begin(), predicted_depth_.end(),
+            std::numeric_limits<float>::infinity());
+
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  // Inverse of the matrix [plane direction], which takes an offset from the
+  // camera to its plane scalar times its depth, and its depth.
+  const float inv_det = 1.0f / (plane.x * direction.y - direction.x * plane.y);
+
+  // Returns the depth of the cached hit point of the column in the new view,
+  // and stores the column it lands in.
+  const auto project = [&](int x, float* column) {
+    const float ray_x = direction_.x + plane_.x * plane_scalars_[x];
+    const float ray_y = direction_.y + plane_.y * plane_scalars_[x];
+    const float offset_x = position_.x + ray_x * distance_[x] - position.x;
+    const float offset_y = position_.y + ray_y * distance_[x] - position.y;
+
+    const float depth = inv_det * (plane.x * offset_y - plane.y * offset_x);
+    const float plane_scalar =
+        inv_det * (direction.y * offset_x - direction.x * offset_y) / depth;
+
+    *column = (plane_scalar + 1.0f) * 0.5f * (width_ - 1);
+    return depth;
+  };
+
+  int run_begin = 0;
+
+  while (run_begin < width_) {
+    // Finds the run of columns whose rays hit the same face.
+    const int64_t face = FaceKey(run_begin);
+    int run_last = run_begin;
+
+    while (run_last + 1 < width_ && FaceKey(run_last + 1) == face) {
+      ++run_last;
+    }
+
+    // The hit points of a run lie on a line, so their depth changes
+    // monotonically along the run, and the points in between land between
+    // its ends. Only the ends are reprojected, after moving them inward past
+    // the points too close to the camera.
+    int first = run_begin;
+    int last = run_last;
+    float first_column;
+    float last_column;
+    float first_depth = project(first, &first_column);
+    float last_depth = project(last, &last_column);
+
+    if (!(first_depth > kMinReprojectDepth) &&
+        last_depth > kMinReprojectDepth) {
+      first = NearestInFront(project, first, last);
+      first_depth = project(first, &first_column);
+    } else if (first_depth > kMinReprojectDepth &&
+               !(last_depth > kMinReprojectDepth)) {
+      last = NearestInFront(project, last, first);
+      last_depth = project(last, &last_column);
+    }
+
+    if (first_depth > kMinReprojectDepth && last_depth > kMinReprojectDepth) {
+      // A run predicts the face for every column between its ends. A hit on
+      // its own predicts only its nearest columns.
+      const float low = first < last ? std::min(first_column, last_column)
+                                     : first_column - 0.5f;
+      const float high = first < last ? std::max(first_column, last_column)
+                                      : first_column + 0.5f;
+      const float depth = std::min(first_depth, last_depth);
+
+      int x_first;
+      int x_last;
+      ColumnRange(low, high, width_, &x_first, &x_last);
+
+      for (int x = x_first; x <= x_last; ++x) {
+        if (depth < predicted_depth_[x]) {
+          predicted_face_[x] = face;
+          predicted_depth_[x] = depth;
+        }
+      }
+    }
+
+    run_begin = run_last + 1;
+  }
+}
+
+bool RayCache::ShouldCastAll() const {
+  // Casting every column recasts all of them, which says nothing about the
+  // prediction, so only an update that resolved the runs is taken as
+  // evidence.
+  if (!cast_all_ && RecastFraction() > kMaxRecastFraction) return true;
+
+  int num_runs = 1;
+
+  for (int x = 1; x < width_; ++x) {
+    num_runs += predicted_face_[x] != predicted_face_[x - 1] ? 1 : 0;
+  }
+
+  return num_runs * kMinMeanRun > width_;
+}
+
+void RayCache::CastColumns(const Camera& camera, int x_begin, int x_end) {
+  raycasting::RayBatch batch = {
+    &distance_[x_begin], &wall_id_[x_begin], &wall_side_[x_begin],
+    &wall_x_[x_begin], &num_steps_[x_begin]
+  };
+
+  camera.CalculateRays(&plane_scalars_[x_begin], x_end - x_begin, &batch);
+
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  for (int x = x_begin; x < x_end; ++x) {
+    hit_tile_[x] = raycasting::RecoverHitTile(
+        position, RayDirection(direction, plane, x), Ray(x));
+  }
+}
+
+int RayCache::ResolveColumns(const Camera& camera, int x_begin, int x_end) {
+  int num_cast = 0;
+  int run_begin = x_begin;
+
+  while (run_begin < x_end) {
+    // Finds the run of columns predicted to see the same face.
+    int run_last = run_begin;
+
+    while (run_last + 1 < x_end &&
+           predicted_face_[run_last + 1] == predicted_face_[run_begin]) {
+      ++run_last;
+    }
+
+    Cast(camera, run_begin);
+    ++num_cast;
+
+    if (run_last > run_begin) {
+      Cast(camera, run_last);
+      num_cast += 1 + ResolveBetween(camera, run_begin, run_last);
+    }
+
+    run_begin = run_last + 1;
+  }
+
+  return num_cast;
+}
+
+int RayCache::ResolveBetween(const Camera& camera, int a, int b) {
+  if (b - a < 2) return 0;
+
+  if (FaceKey(a) == FaceKey(b) && FillBetween(camera, a, b)) return 0;
+
+  const int middle = a + (b - a) / 2;
+  Cast(camera, middle);
+
+  return 1 + ResolveBetween(camera, a, middle) +
+         ResolveBetween(camera, middle, b);
+}
+
+bool RayCache::FillBetween(const Camera& camera, int a, int b) {
+  const Level& level = camera.GetLevel();
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  const raycasting::HitTile hit_tile = hit_tile_[a];
+  const raycasting::WallSide wall_side = wall_side_[a];
+  const bool x_side = wall_side == raycasting::WallSide::kXSide;
+
+  const Vector ray_a = RayDirection(direction, plane, a);
+  const Vector ray_b = RayDirection(direction, plane, b);
+  const Vector hit_a = position + ray_a * distance_[a];
+  const Vector hit_b = position + ray_b * distance_[b];
+
+  // Every ray between a and b runs inside the triangle of the camera and the
+  // two hit points. The triangle is walked tile row by tile row along the
+  // axis of the hit side, from the camera up to the row before the hit tile.
+  // In each row it spans the tiles between the rays a and b at the row's
+  // edges. Coordinates are named along and across that axis.
+  const float along_position = x_side ? position.x : position.y;
+  const float across_position = x_side ? position.y : position.x;
+  const float across_a = x_side ? hit_a.y : hit_a.x;
+  const float across_b = x_side ? hit_b.y : hit_b.x;
+  const float along_hit = x_side ? hit_a.x : hit_a.y;
+
+  // Change of the across coordinate per unit along each ray.
+  const float along_span = along_hit - along_position;
+  const float slope_a = (across_a - across_position) / along_span;
+  const float slope_b = (across_b - across_position) / along_span;
+
+  const int start_x = static_cast<int>(position.x);
+  const int start_y = static_cast<int>(position.y);
+  const int along_first = x_side ? start_x : start_y;
+  const int along_hit_tile = x_side ? hit_tile.x : hit_tile.y;
+  const int step = along_hit_tile > along_first ? 1 : -1;
+
+  // Checking the tiles must cost less than casting the rays, each of which
+  // crosses about as many tile sides as the rays at the ends.
+  int64_t budget = static_cast<int64_t>(b - a - 1) *
+                   (std::abs(hit_tile.x - start_x) +
+                    std::abs(hit_tile.y - start_y));
+
+  for (int along = along_first; along != along_hit_tile; along += step) {
+    // Part of the row between the camera and the hit side.
+    const float row_near =
+        along == along_first ? along_position
+                             : static_cast<float>(step > 0 ? along : along + 1);
+    const float row_far = static_cast<float>(step > 0 ? along + 1 : along);
+
+    const float near_a = across_position + slope_a * (row_near - along_position);
+    const float near_b = across_position + slope_b * (row_near - along_position);
+    const float far_a = across_position + slope_a * (row_far - along_position);
+    const float far_b = across_position + slope_b * (row_far - along_position);
+
+    const float across_min = std::min({ near_a, near_b, far_a, far_b });
+    const float across_max = std::max({ near_a, near_b, far_a, far_b });
+
+    const int across_first =
+        static_cast<int>(std::floor(across_min - kHitMargin));
+    const int across_last =
+        static_cast<int>(std::floor(across_max + kHitMargin));
+
+    budget -= across_last - across_first + 1;
+    if (budget < 0) return false;
+
+    for (int across = across_first; across <= across_last; ++across) {
+      const bool solid = x_side ? level.IsSolid(along, across)
+                                : level.IsSolid(across, along);
+      if (solid) return false;
+    }
+  }
+
+  // Every ray of the run reaches the side the same way, stepping the same
+  // way along its axis as the rays at both ends do.
+  SideRays side_rays;
+  side_rays.along_direction = x_side ? direction.x : direction.y;
+  side_rays.along_plane = x_side ? plane.x : plane.y;
+  side_rays.across_direction = x_side ? direction.y : direction.x;
+  side_rays.across_plane = x_side ? plane.y : plane.x;
+  side_rays.across_position = across_position;
+  side_rays.init_side = step > 0 ? along_first + 1.0f - along_position
+                                 : along_position - along_first;
+  side_rays.num_before = (along_hit_tile - along_first) * step - 1;
+  side_rays.mirrored = x_side == (step > 0);
+
+  int x = a + 1;
+
+  if (raycasting::HasAVX2()) {
+    x = CalculateSideRaysAVX2(side_rays, plane_scalars_.data(), x, b,
+                              distance_.data(), wall_x_.data());
+  }
+
+  CalculateSideRays(side_rays, plane_scalars_.data(), x, b, distance_.data(),
+                    wall_x_.data());
+
+  // The rays cross every side along the axis up to the hit side, and every
+  // side along the other axis between the start tile and the hit tile.
+  const int num_steps =
+      side_rays.num_before + 1 + (x_side ? std::abs(hit_tile.y - start_y)
+                                         : std::abs(hit_tile.x - start_x));
+
+  std::fill(wall_id_.begin() + a + 1, wall_id_.begin() + b, wall_id_[a]);
+  std::fill(wall_side_.begin() + a + 1, wall_side_.begin() + b, wall_side);
+  std::fill(num_steps_.begin() + a + 1, num_steps_.begin() + b, num_steps);
+  std::fill(hit_tile_.begin() + a + 1, hit_tile_.begin() + b, hit_tile);
+
+  return true;
+}
+
+void RayCache::Cast(const Camera& camera, int x) {
+  raycasting::HitTile hit_tile;
+  const raycasting::RayData ray_data = raycasting::CastRay(
+      camera.GetLevel(), camera.GetDistanceField(), camera.Position(),
+      RayDirection(camera.Direction(), camera.Plane(), x), &hit_tile);
+
+  Store(x, ray_data, hit_tile);
+}
+
+void RayCache::Store(int x,
+                     const raycasting::RayData& ray_data,
+                     raycasting::HitTile hit_tile) {
+  distance_[x] = ray_data.distance;
+  wall_id_[x] = ray_data.wall_id;
+  wall_side_[x] = ray_data.wall_side;
+  wall_x_[x] = ray_data.wall_x;
+  num_steps_[x] = ray_data.num_steps;
+  hit_tile_[x] = hit_tile;
+}
@@ -0,0 +1,66 @@
+#include "ray_caster.h"
+
+namespace {
+
+// Returns the smallest number of crossed sides n, starting at the current one,
+// for which the predicate holds for the distance to side n. The predicate must
+// hold for the current count plus max_sides, and distances grow with n.
+template <typename Predicate>
+int FirstSideWhere(const raycasting::DDAData& axis,
+                   int max_sides,
+                   float limit,
+                   Predicate predicate) {
+  const int first = axis.num_crossed;
+  const int last = first + max_sides;
+
+  if (axis.step == 0) return first;
+
+  // Estimates the count from the distance, then corrects rounding errors with
+  // exact comparisons against the same distances the DDA would calculate.
+  const float estimate = (limit - axis.init_dist) / axis.delta_dist;
+  int num_sides = estimate <= first ? first
+                  : estimate >= last ? last
+                  : static_cast<int>(estimate);
+
+  while (num_sides > first && predicate(axis.SideDist(num_sides - 1), limit)) {
+    --num_sides;
+  }
+  while (!predicate(axis.SideDist(num_sides), limit)) {
+    ++num_sides;
+  }
+
+  return num_sides;
+}
+
+}  // namespace
+
+void raycasting::SkipEmptySpace(int empty_radius,
+                                DDAData* dda_data_x,
+                                DDAData* dda_data_y) {
+  // Distances at which the ray crosses the last side inside the square along
+  // each axis. The next crossing along the same axis leaves the square.
+  const float exit_dist_x =
+      dda_data_x->SideDist(dda_data_x->num_crossed + empty_radius);
+  const float exit_dist_y =
+      dda_data_y->SideDist(dda_data_y->num_crossed + empty_radius);
+
+  int num_crossed_x;
+  int num_crossed_y;
+
+  // The DDA steps along X only if the X side is strictly closer, so ties are
+  // resolved in favor of Y, exactly as in the step-by-step loop.
+  if (exit_dist_x < exit_dist_y) {
+    num_crossed_x = dda_data_x->num_crossed + empty_radius;
+    num_crossed_y = FirstSideWhere(
+        *dda_data_y, empty_radius, exit_dist_x,
+        [](float side_dist, float limit) { return side_dist > limit; });
+  } else {
+    num_crossed_y = dda_data_y->num_crossed + empty_radius;
+    num_crossed_x = FirstSideWhere(
+        *dda_data_x, empty_radius, exit_dist_y,
+        [](float side_dist, float limit) { return side_dist >= limit; });
+  }
+
+  dda_data_x->Advance(num_crossed_x - dda_data_x->num_crossed);
+  dda_data_y->Advance(num_crossed_y - dda_data_y->num_crossed);
+}
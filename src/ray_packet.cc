@@ -0,0 +1,222 @@
+#include "ray_packet.h"
+
+#include <immintrin.h>
+
+namespace {
+
+// Per-axis DDA state of a packet. The tile and step are the same for all
+// lanes because every ray starts at the camera position, while the distances
+// depend on the direction of each ray.
+struct PacketAxis {
+  __m256i tile;
+  __m256i step;
+  __m256 delta_dist;
+  __m256 init_dist;
+  __m256i num_crossed;
+  __m256 side_dist;
+};
+
+// Vectorized equivalent of the raycasting::DDAData constructor.
+__attribute__((target("avx2")))
+PacketAxis InitPacketAxis(float position, __m256 ray_direction) {
+  const int tile = static_cast<int>(position);
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 infinity =
+      _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+
+  const __m256 positive = _mm256_cmp_ps(ray_direction, zero, _CMP_GT_OQ);
+  const __m256 negative = _mm256_cmp_ps(ray_direction, zero, _CMP_LT_OQ);
+  const __m256 is_zero = _mm256_cmp_ps(ray_direction, zero, _CMP_EQ_OQ);
+
+  const __m256 delta_dist = _mm256_div_ps(
+      _mm256_set1_ps(1.0f), _mm256_andnot_ps(sign_mask, ray_direction));
+
+  // Distances to the first tile side, evaluated in the same order as the
+  // scalar code so the results are identical.
+  const __m256 positive_init = _mm256_set1_ps(tile + 1.0f - position);
+  const __m256 negative_init = _mm256_set1_ps(position - tile);
+
+  __m256 init_dist = _mm256_mul_ps(
+      _mm256_blendv_ps(negative_init, positive_init, positive), delta_dist);
+
+  PacketAxis axis;
+  axis.tile = _mm256_set1_epi32(tile);
+  axis.step = _mm256_sub_epi32(
+      _mm256_and_si256(_mm256_castps_si256(positive), _mm256_set1_epi32(1)),
+      _mm256_and_si256(_mm256_castps_si256(negative), _mm256_set1_epi32(1)));
+  axis.delta_dist = _mm256_blendv_ps(delta_dist, infinity, is_zero);
+  axis.init_dist = _mm256_blendv_ps(init_dist, infinity, is_zero);
+  axis.num_crossed = _mm256_setzero_si256();
+  axis.side_dist = axis.init_dist;
+
+  return axis;
+}
+
+// Vectorized equivalent of raycasting::DDAData::SideDist for counts of at
+// least one, or of zero if the delta is finite.
+__attribute__((target("avx2")))
+__m256 SideDist(const PacketAxis& axis, __m256i num_sides) {
+  return _mm256_add_ps(
+      axis.init_dist,
+      _mm256_mul_ps(_mm256_cvtepi32_ps(num_sides), axis.delta_dist));
+}
+
+// Moves the lanes selected by the mask to the next tile side along the axis,
+// like raycasting::DDAData::Advance.
+__attribute__((target("avx2")))
+void AdvanceLanes(__m256i mask, PacketAxis* axis) {
+  // Selected lanes are all ones, which is -1 as an integer.
+  axis->tile = _mm256_add_epi32(axis->tile, _mm256_and_si256(mask, axis->step));
+  axis->num_crossed = _mm256_sub_epi32(axis->num_crossed, mask);
+  axis->side_dist = _mm256_blendv_ps(
+      axis->side_dist,
+      SideDist(*axis, axis->num_crossed),
+      _mm256_castsi256_ps(mask));
+}
+
+bool DetectAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+}  // namespace
+
+bool raycasting::HasAVX2() {
+  static const bool has_avx2 = DetectAVX2();
+
+  return has_avx2;
+}
+
+__attribute__((target("avx2")))
+void raycasting::CastRayPacketAVX2(
+    const Level& level,
+    const Vector& position,
+    const Vector& direction,
+    const Vector& plane,
+    const float* plane_scalars,
+    const RayBatch& out) {
+  // Calculates the ray directions by scaling and adding the camera plane to
+  // the direction vector.
+  const __m256 scalars = _mm256_loadu_ps(plane_scalars);
+  const __m256 ray_direction_x = _mm256_add_ps(
+      _mm256_set1_ps(direction.x),
+      _mm256_mul_ps(_mm256_set1_ps(plane.x), scalars));
+  const __m256 ray_direction_y = _mm256_add_ps(
+      _mm256_set1_ps(direction.y),
+      _mm256_mul_ps(_mm256_set1_ps(plane.y), scalars));
+
+  PacketAxis x = InitPacketAxis(position.x, ray_direction_x);
+  PacketAxis y = InitPacketAxis(position.y, ray_direction_y);
+
+  // Index of the current tile in the level data. Stepping along X moves by a
+  // whole row of the array, so the index is updated directly instead of being
+  // recomputed from the tiles with a slow vector multiplication.
+  const __m256i level_height = _mm256_set1_epi32(level.Height());
+  const __m256i index_step_x = _mm256_mullo_epi32(x.step, level_height);
+
+  __m256i tile_index =
+      _mm256_add_epi32(_mm256_mullo_epi32(x.tile, level_height), y.tile);
+
+  // Largest valid tile coordinates, for the bounds check.
+  const __m256i max_tile_x = _mm256_set1_epi32(level.Width() - 1);
+  const __m256i max_tile_y = _mm256_set1_epi32(level.Height() - 1);
+  const int* tile_words = reinterpret_cast<const int*>(level.Tiles());
+
+  __m256i wall_id = _mm256_setzero_si256();
+  __m256i num_steps = _mm256_setzero_si256();
+
+  // All bits set in lanes that are still tracing, and in lanes that hit the
+  // X side of a tile on their last step.
+  __m256i active = _mm256_set1_epi32(-1);
+  __m256i x_side = _mm256_setzero_si256();
+
+  // Performs the DDA algorithm until every lane has hit a wall.
+  while (!_mm256_testz_si256(active, active)) {
+    // Selects the shorter distance to the next tile side in every lane.
+    const __m256i step_x = _mm256_castps_si256(
+        _mm256_cmp_ps(x.side_dist, y.side_dist, _CMP_LT_OQ));
+    const __m256i move_x = _mm256_and_si256(active, step_x);
+    const __m256i move_y = _mm256_andnot_si256(step_x, active);
+
+    AdvanceLanes(move_x, &x);
+    AdvanceLanes(move_y, &y);
+    tile_index = _mm256_add_epi32(
+        tile_index,
+        _mm256_or_si256(_mm256_and_si256(move_x, index_step_x),
+                        _mm256_and_si256(move_y, y.step)));
+
+    x_side = _mm256_blendv_epi8(x_side, step_x, active);
+
+    // Negative coordinates compare as large unsigned values, so a single
+    // unsigned minimum per axis checks both bounds.
+    const __m256i inside = _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_min_epu32(x.tile, max_tile_x), x.tile),
+        _mm256_cmpeq_epi32(_mm256_min_epu32(y.tile, max_tile_y), y.tile));
+    const __m256i gather_mask = _mm256_and_si256(active, inside);
+
+    // Gathers the tiles of the active lanes from the level data. Tiles are
+    // single bytes, so each lane loads the aligned four-byte word holding its
+    // tile and shifts the tile down. Aligned words never cross the end of the
+    // tile storage.
+    const __m256i tile_word = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(),
+        tile_words,
+        _mm256_srli_epi32(tile_index, 2),
+        gather_mask,
+        sizeof(int));
+    const __m256i tile_shift = _mm256_slli_epi32(
+        _mm256_and_si256(tile_index, _mm256_set1_epi32(3)), 3);
+    const __m256i tile_id = _mm256_and_si256(
+        _mm256_srlv_epi32(tile_word, tile_shift), _mm256_set1_epi32(0xff));
+
+    const __m256i outside_id = _mm256_andnot_si256(
+        inside, _mm256_set1_epi32(Level::kOutOfBoundsTile));
+
+    wall_id = _mm256_blendv_epi8(
+        wall_id, _mm256_or_si256(tile_id, outside_id), active);
+
+    // Active lanes are all ones, which is -1 as an integer.
+    num_steps = _mm256_sub_epi32(num_steps, active);
+
+    active = _mm256_and_si256(
+        _mm256_cmpeq_epi32(wall_id, _mm256_setzero_si256()), active);
+  }
+
+  // Selects the distance to the side of the tile that was hit. The axis that
+  // was hit has crossed at least one side, so its delta is finite.
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256 distance = _mm256_blendv_ps(
+      SideDist(y, _mm256_sub_epi32(y.num_crossed, one)),
+      SideDist(x, _mm256_sub_epi32(x.num_crossed, one)),
+      _mm256_castsi256_ps(x_side));
+
+  // WallSide::kXSide is 0 and WallSide::kYSide is 1.
+  const __m256i wall_side = _mm256_andnot_si256(x_side, _mm256_set1_epi32(1));
+
+  // Vectorized equivalent of raycasting::CalculateWallX.
+  const __m256 x_side_mask = _mm256_castsi256_ps(x_side);
+  const __m256 hit_along_wall = _mm256_blendv_ps(
+      _mm256_add_ps(_mm256_set1_ps(position.x),
+                    _mm256_mul_ps(distance, ray_direction_x)),
+      _mm256_add_ps(_mm256_set1_ps(position.y),
+                    _mm256_mul_ps(distance, ray_direction_y)),
+      x_side_mask);
+  const __m256 wall_x =
+      _mm256_sub_ps(hit_along_wall, _mm256_floor_ps(hit_along_wall));
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 mirror = _mm256_blendv_ps(
+      _mm256_cmp_ps(ray_direction_y, zero, _CMP_LT_OQ),
+      _mm256_cmp_ps(ray_direction_x, zero, _CMP_GT_OQ),
+      x_side_mask);
+  const __m256 mirrored_wall_x = _mm256_blendv_ps(
+      wall_x, _mm256_sub_ps(_mm256_set1_ps(1.0f), wall_x), mirror);
+
+  _mm256_storeu_ps(out.distance, distance);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.wall_id), wall_id);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.wall_side), wall_side);
+  _mm256_storeu_ps(out.wall_x, mirrored_wall_x);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.num_steps), num_steps);
+}
@@ -0,0 +1,547 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "floor_caster.h"
+#include "ray_caster.h"
+
+namespace {
+
+// Scale from the texels per row of the full texture to those of every mip
+// level. Powers of two, so scaling is exact.
+constexpr std::array<float, TextureAtlas::kNumMipLevels> kMipScales = [] {
+  std::array<float, TextureAtlas::kNumMipLevels> mip_scales = {};
+
+  for (int mip_level = 0; mip_level < TextureAtlas::kNumMipLevels;
+       ++mip_level) {
+    mip_scales[mip_level] = 1.0f / (1 << mip_level);
+  }
+  return mip_scales;
+}();
+
+// Calculates the rows a wall of the specified height covers, clamped to the
+// screen, as CalculateWallSpan does from the distance.
+rendering::WallSpan WallSpanFromHeight(float wall_height, int max_y) {
+  // Comparing the float value first also covers walls at zero distance,
+  // whose height is infinite.
+  const int clamped_height =
+      wall_height < max_y ? static_cast<int>(wall_height) : max_y;
+
+  const int draw_start = (max_y - clamped_height) / 2;
+
+  return rendering::WallSpan{ draw_start, draw_start + clamped_height };
+}
+
+// Returns the color of a wall based on its ID, before any shading.
+rendering::Color BaseWallColor(int wall_id) {
+  rendering::Color wall_color = { 0x00, 0x00, 0x00, 0xff };
+
+  switch (wall_id) {
+   case 1:
+    wall_color.r = 0xff;
+    break;
+
+   case 2:
+    wall_color.g = 0xff;
+    break;
+
+   case 3:
+    wall_color.b = 0xff;
+    break;
+
+   case 4:
+    wall_color.r = wall_color.g = wall_color.b = 0xff;
+    break;
+
+   default:
+    wall_color.r = wall_color.g = 0xff;
+    break;
+  }
+
+  return wall_color;
+}
+
+// Draws a flat-shaded wall segment. If the light is not null, it modulates
+// the wall color instead of the Y side shading.
+template <typename Screen>
+rendering::WallSpan DrawWallSegment(
+    const Screen& screen,
+    FrameBuffer* frame_buffer,
+    const raycasting::RayData& ray_data,
+    const uint32_t* light,
+    int x) {
+  const rendering::WallSpan wall_span =
+      rendering::CalculateWallSpan(ray_data.distance, screen.Height());
+
+  const uint32_t color =
+      light != nullptr
+          ? lighting::Modulate(
+                rendering::ToARGB(BaseWallColor(ray_data.wall_id)), *light)
+          : rendering::ToARGB(rendering::WallColor(ray_data));
+
+  frame_buffer->DrawColumn(x, wall_span.draw_start, wall_span.draw_end, color);
+
+  return wall_span;
+}
+
+// Draws a textured wall segment with a single division per column. The
+// texels per row follow from the distance times the reciprocal of the
+// largest row, and scale exactly to every mip level. If the light is not
+// null, it modulates every texel instead of the Y side shading.
+template <typename Screen>
+rendering::WallSpan DrawTexturedWallSegment(
+    const Screen& screen,
+    FrameBuffer* frame_buffer,
+    const TextureAtlas& texture_atlas,
+    const raycasting::RayData& ray_data,
+    const uint32_t* light,
+    int x) {
+  const int max_y = screen.Height() - 1;
+  const float distance =
+      std::max(ray_data.distance, rendering::kMinTextureDistance);
+
+  // Height of the whole wall on screen, including the rows cut off by the
+  // screen edges. Walls closer than the minimum texture distance cover the
+  // whole screen either way, so the span is the same as for the distance.
+  // This stays a division rather than a lookup in a table of heights by
+  // distance: the table would round the distance and draw other rows than
+  // CalculateWallSpan.
+  const float wall_height = max_y / distance;
+  const rendering::WallSpan wall_span = WallSpanFromHeight(wall_height, max_y);
+
+  const float texels_per_row =
+      TextureAtlas::kSize * distance * screen.InverseMaxY();
+
+  const int mip_level = TextureAtlas::MipLevel(texels_per_row);
+  const int mip_size = TextureAtlas::kSize >> mip_level;
+
+  const int u = std::min(static_cast<int>(ray_data.wall_x * mip_size),
+                         mip_size - 1);
+  const uint32_t* column = texture_atlas.Column(ray_data.wall_id, mip_level, u);
+
+  // Texture coordinate of the first drawn row and the step per row, in 16.16
+  // fixed point. Wrapping the coordinate with the mask keeps rounding errors
+  // at the bottom of the wall inside the column.
+  const float step = texels_per_row * kMipScales[mip_level];
+  const float wall_top = (max_y - wall_height) / 2.0f;
+  const float first_v =
+      std::max((wall_span.draw_start - wall_top) * step, 0.0f);
+
+  const uint32_t v_step = static_cast<uint32_t>(step * 65536.0f);
+  const uint32_t v_mask = mip_size - 1;
+  uint32_t v = static_cast<uint32_t>(first_v * 65536.0f);
+
+  const int width = screen.Width();
+  uint32_t* pixel = frame_buffer->Pixels() +
+                    static_cast<size_t>(wall_span.draw_start) * width + x;
+
+  // The light of the whole column is looked up once.
+  if (light != nullptr) {
+    const uint32_t column_light = *light;
+
+    for (int y = wall_span.draw_start; y <= wall_span.draw_end; ++y) {
+      *pixel = lighting::Modulate(column[v >> 16 & v_mask], column_light);
+
+      v += v_step;
+      pixel += width;
+    }
+
+    return wall_span;
+  }
+
+  // Walls on the Y side are drawn at half brightness, as in WallColor.
+  const int shade_shift =
+      ray_data.wall_side == raycasting::WallSide::kYSide ? 1 : 0;
+  const uint32_t shade_mask = shade_shift == 1 ? 0x007f7f7f : 0x00ffffff;
+
+  for (int y = wall_span.draw_start; y <= wall_span.draw_end; ++y) {
+    const uint32_t texel = column[v >> 16 & v_mask];
+
+    *pixel = (texel >> shade_shift & shade_mask) | 0xff000000;
+
+    v += v_step;
+    pixel += width;
+  }
+
+  return wall_span;
+}
+
+// Most doors a ray passes through before the wall behind them is drawn as
+// it was hit.
+constexpr int kMaxDoorsPerRay = 4;
+
+// Distance past a door face at which a ray passing through the door goes on,
+// which keeps the DDA from starting in front of the door.
+constexpr float kDoorInset = 1e-3f;
+
+// Follows the ray through the partly open doors it hit. A door is a panel on
+// every face of its tile, slid toward the higher coordinate along the face by
+// its open fraction. A ray through the open part goes on from inside the door
+// tile, and a ray that hits the panel keeps its hit, with the offset of the
+// panel texture stored for wall_x. Without a partly open door the ray stays
+// as it is.
+raycasting::RayData TraceThroughDoors(const LevelEditor& level_editor,
+                                      const Level& level,
+                                      const Vector& position,
+                                      const Vector& ray_direction,
+                                      raycasting::RayData ray_data,
+                                      float* panel_offset) {
+  *panel_offset = 0.0f;
+
+  for (int door = 0; door < kMaxDoorsPerRay; ++door) {
+    const Vector hit = position + ray_direction * ray_data.distance;
+    const bool x_side = ray_data.wall_side == raycasting::WallSide::kXSide;
+    const bool positive = x_side ? ray_direction.x > 0.0f
+                                 : ray_direction.y > 0.0f;
+
+    // Recovers the tile like Lightmap::WallLight, from wall_x unmirrored
+    // (see CalculateWallX).
+    const bool mirrored = x_side == positive;
+    const float along = mirrored ? 1.0f - ray_data.wall_x : ray_data.wall_x;
+    const int x = x_side ? static_cast<int>(std::floor(hit.x + 0.5f)) -
+                               (positive ? 0 : 1)
+                         : static_cast<int>(std::floor(hit.x - along + 0.5f));
+    const int y = x_side ? static_cast<int>(std::floor(hit.y - along + 0.5f))
+                         : static_cast<int>(std::floor(hit.y + 0.5f)) -
+                               (positive ? 0 : 1);
+
+    const float open_fraction = level_editor.DoorOpenFraction(x, y);
+
+    if (open_fraction <= 0.0f) return ray_data;
+
+    if (along >= open_fraction) {
+      *panel_offset = mirrored ? open_fraction : -open_fraction;
+      return ray_data;
+    }
+
+    // The ray goes on from just inside the door tile. Along the axis of the
+    // face, the start is kept inside the tile even for grazing rays.
+    Vector origin = hit + ray_direction * kDoorInset;
+
+    if (x_side) {
+      origin.x = std::min(std::max(origin.x, x + kDoorInset),
+                          x + 1.0f - kDoorInset);
+    } else {
+      origin.y = std::min(std::max(origin.y, y + kDoorInset),
+                          y + 1.0f - kDoorInset);
+    }
+
+    const raycasting::RayData behind =
+        raycasting::CastRay(level, nullptr, origin, ray_direction);
+
+    ray_data = raycasting::RayData{
+      ray_data.distance + kDoorInset + behind.distance, behind.wall_id,
+      behind.wall_side, behind.wall_x, ray_data.num_steps + behind.num_steps
+    };
+  }
+
+  return ray_data;
+}
+
+// Calls the function with the preset screen of the specified size, if it is
+// one of the presets the renderer is built with. Returns false otherwise.
+template <typename Function>
+bool WithPresetScreen(int width, int height, Function function) {
+#ifdef RENDER_PRESET_720p
+  if (width == 1280 && height == 720) {
+    function(rendering::Screen720p());
+    return true;
+  }
+#endif
+#ifdef RENDER_PRESET_1080p
+  if (width == 1920 && height == 1080) {
+    function(rendering::Screen1080p());
+    return true;
+  }
+#endif
+#ifdef RENDER_PRESET_1440p
+  if (width == 2560 && height == 1440) {
+    function(rendering::Screen1440p());
+    return true;
+  }
+#endif
+  static_cast<void>(width);
+  static_cast<void>(height);
+  static_cast<void>(function);
+
+  return false;
+}
+
+}  // namespace
+
+rendering::Color rendering::WallColor(const raycasting::RayData& ray_data) {
+  Color wall_color = BaseWallColor(ray_data.wall_id);
+
+  // Adjust wall color if the wall is on the Y side.
+  if (ray_data.wall_side == raycasting::WallSide::kYSide) {
+    wall_color.r /= 2;
+    wall_color.g /= 2;
+    wall_color.b /= 2;
+  }
+
+  return wall_color;
+}
+
+rendering::WallSpan rendering::CalculateWallSpan(float distance,
+                                                 int screen_height) {
+  const int max_y = screen_height - 1;
+
+  return WallSpanFromHeight(max_y / distance, max_y);
+}
+
+void rendering::RenderBackground(FrameBuffer* frame_buffer) {
+  const int horizon = frame_buffer->Height() / 2;
+
+  frame_buffer->FillRows(0, horizon, ToARGB(kCeilColor));
+  frame_buffer->FillRows(horizon, frame_buffer->Height(), ToARGB(kFloorColor));
+}
+
+rendering::WallSpan rendering::RenderWallSegment(
+    FrameBuffer* frame_buffer,
+    const raycasting::RayData& ray_data,
+    int x) {
+  return DrawWallSegment(
+      RuntimeScreen(frame_buffer->Width(), frame_buffer->Height()),
+      frame_buffer, ray_data, nullptr, x);
+}
+
+rendering::WallSpan rendering::RenderTexturedWallSegment(
+    FrameBuffer* frame_buffer,
+    const TextureAtlas& texture_atlas,
+    const raycasting::RayData& ray_data,
+    int x) {
+  return DrawTexturedWallSegment(
+      RuntimeScreen(frame_buffer->Width(), frame_buffer->Height()),
+      frame_buffer, texture_atlas, ray_data, nullptr, x);
+}
+
+template <typename Screen>
+void rendering::RenderColumns(
+    const Screen& screen,
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    const RayCache* ray_cache,
+    int x_begin,
+    int x_end,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer) {
+  // Rays are cast a block of columns at a time, so the camera can trace them
+  // in SIMD packets.
+  float plane_scalars[kColumnBlockSize];
+  float distance[kColumnBlockSize];
+  int wall_id[kColumnBlockSize];
+  raycasting::WallSide wall_side[kColumnBlockSize];
+  float wall_x[kColumnBlockSize];
+  int num_steps[kColumnBlockSize];
+
+  raycasting::RayBatch ray_batch = {
+    distance, wall_id, wall_side, wall_x, num_steps
+  };
+
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  // Rays are only followed through doors while any is partly open.
+  const bool trace_doors =
+      level_editor != nullptr && level_editor->NumMovingDoors() > 0;
+
+  for (int block_begin = x_begin; block_begin < x_end;
+       block_begin += kColumnBlockSize) {
+    const int block_size = std::min(kColumnBlockSize, x_end - block_begin);
+
+    // The lightmap and the doors recover the wall tiles from the ray
+    // directions, so the plane scalars are needed for cached rays too.
+    const float* block_plane_scalars =
+        ray_cache == nullptr || lightmap != nullptr || trace_doors
+            ? screen.PlaneScalars(block_begin, block_size, plane_scalars)
+            : nullptr;
+
+    if (ray_cache == nullptr) {
+      camera.CalculateRays(block_plane_scalars, block_size, &ray_batch);
+    }
+
+    for (int i = 0; i < block_size; ++i) {
+      const int x = block_begin + i;
+      raycasting::RayData ray_data =
+          ray_cache != nullptr
+              ? ray_cache->Ray(x)
+              : raycasting::RayData{
+                  distance[i], wall_id[i], wall_side[i], wall_x[i],
+                  num_steps[i]
+                };
+
+      float panel_offset = 0.0f;
+
+      if (trace_doors) {
+        ray_data = TraceThroughDoors(
+            *level_editor, camera.GetLevel(), position,
+            direction + plane * block_plane_scalars[i], ray_data,
+            &panel_offset);
+      }
+
+      uint32_t light = 0;
+
+      if (lightmap != nullptr) {
+        light = lightmap->WallLight(
+            position, direction + plane * block_plane_scalars[i], ray_data);
+      }
+
+      // The panel of a door moves its texture along with it, once the light
+      // of the face has been found from where the ray hit.
+      ray_data.wall_x += panel_offset;
+
+      const uint32_t* column_light = lightmap != nullptr ? &light : nullptr;
+
+      const WallSpan wall_span =
+          texture_atlas != nullptr
+              ? DrawTexturedWallSegment(screen, frame_buffer, *texture_atlas,
+                                        ray_data, column_light, x)
+              : DrawWallSegment(screen, frame_buffer, ray_data, column_light,
+                                x);
+
+      column_buffers->depth[x] = ray_data.distance;
+      column_buffers->draw_start[x] = wall_span.draw_start;
+      column_buffers->draw_end[x] = wall_span.draw_end;
+    }
+  }
+}
+
+template void rendering::RenderColumns(
+    const RuntimeScreen&, const Camera&, const TextureAtlas*, const Lightmap*,
+    const LevelEditor*, const RayCache*, int, int, ColumnBuffers*,
+    FrameBuffer*);
+#ifdef RENDER_PRESET_720p
+template void rendering::RenderColumns(
+    const Screen720p&, const Camera&, const TextureAtlas*, const Lightmap*,
+    const LevelEditor*, const RayCache*, int, int, ColumnBuffers*,
+    FrameBuffer*);
+#endif
+#ifdef RENDER_PRESET_1080p
+template void rendering::RenderColumns(
+    const Screen1080p&, const Camera&, const TextureAtlas*, const Lightmap*,
+    const LevelEditor*, const RayCache*, int, int, ColumnBuffers*,
+    FrameBuffer*);
+#endif
+#ifdef RENDER_PRESET_1440p
+template void rendering::RenderColumns(
+    const Screen1440p&, const Camera&, const TextureAtlas*, const Lightmap*,
+    const LevelEditor*, const RayCache*, int, int, ColumnBuffers*,
+    FrameBuffer*);
+#endif
+
+void rendering::RenderColumns(
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    const RayCache* ray_cache,
+    int x_begin,
+    int x_end,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer) {
+  const auto render_columns = [&](const auto& screen) {
+    RenderColumns(screen, camera, texture_atlas, lightmap, level_editor,
+                  ray_cache, x_begin, x_end, column_buffers, frame_buffer);
+  };
+
+  if (!WithPresetScreen(frame_buffer->Width(), frame_buffer->Height(),
+                        render_columns)) {
+    render_columns(RuntimeScreen(frame_buffer->Width(),
+                                 frame_buffer->Height()));
+  }
+}
+
+void rendering::RenderFrame(
+    const Camera& camera,
+    const TextureAtlas* texture_atlas,
+    const Lightmap* lightmap,
+    const LevelEditor* level_editor,
+    RayCache* ray_cache,
+    ThreadPool* thread_pool,
+    ColumnBuffers* column_buffers,
+    FrameBuffer* frame_buffer,
+    profiling::Profiler* profiler) {
+  using profiling::ScopedTimer;
+  using profiling::Stage;
+
+  const int width = frame_buffer->Width();
+  const int height = frame_buffer->Height();
+
+  // With textures, the floor and ceiling are cast after the walls, so they
+  // can skip the pixels the walls cover. Every lower-half row is cast
+  // together with the mirrored upper-half row at the same distance.
+  if (thread_pool == nullptr) {
+    if (texture_atlas == nullptr) {
+      ScopedTimer timer(profiler, Stage::kBackground);
+      RenderBackground(frame_buffer);
+    }
+
+    {
+      ScopedTimer timer(profiler, Stage::kWalls);
+
+      if (ray_cache != nullptr) {
+        ray_cache->Update(camera, nullptr);
+      }
+
+      RenderColumns(camera, texture_atlas, lightmap, level_editor, ray_cache,
+                    0, width, column_buffers, frame_buffer);
+    }
+
+    if (texture_atlas != nullptr) {
+      ScopedTimer timer(profiler, Stage::kBackground);
+      RenderFloorAndCeiling(camera, *texture_atlas, lightmap, *column_buffers,
+                            height / 2, height, frame_buffer);
+    }
+    return;
+  }
+
+  const int horizon = height / 2;
+
+  // Render background (floor and ceiling) row by row.
+  if (texture_atlas == nullptr) {
+    ScopedTimer timer(profiler, Stage::kBackground);
+    thread_pool->ParallelFor(
+        0, height, kMinRowChunk,
+        [&](int y_begin, int y_end) {
+          frame_buffer->FillRows(y_begin, std::min(y_end, horizon),
+                                 ToARGB(kCeilColor));
+          frame_buffer->FillRows(std::max(y_begin, horizon), y_end,
+                                 ToARGB(kFloorColor));
+        });
+  }
+
+  // Render wall segments column range by column range. Columns facing long
+  // corridors take more DDA steps, which the dynamic chunking evens out.
+  {
+    ScopedTimer timer(profiler, Stage::kWalls);
+
+    if (ray_cache != nullptr) {
+      ray_cache->Update(camera, thread_pool);
+    }
+
+    thread_pool->ParallelFor(
+        0, width, kMinColumnChunk,
+        [&](int x_begin, int x_end) {
+          RenderColumns(camera, texture_atlas, lightmap, level_editor,
+                        ray_cache, x_begin, x_end, column_buffers,
+                        frame_buffer);
+        });
+  }
+
+  // Cast the textured floor and ceiling row pair by row pair.
+  if (texture_atlas != nullptr) {
+    ScopedTimer timer(profiler, Stage::kBackground);
+    thread_pool->ParallelFor(
+        horizon, height, kMinRowChunk / 2,
+        [&](int y_begin, int y_end) {
+          RenderFloorAndCeiling(camera, *texture_atlas, lightmap,
+                                *column_buffers, y_begin, y_end,
+                                frame_buffer);
+        });
+  }
+}
@@ -0,0 +1,97 @@
+#include "resolution_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Returns the window size at the scale, at least two pixels.
+int ScaleSize(int window_size, float scale) {
+  return std::max(2, static_cast<int>(std::lround(window_size * scale)));
+}
+
+}  // namespace
+
+ResolutionScaler::ResolutionScaler(float target_ms,
+                                   int window_width,
+                                   int window_height)
+    : target_ms_(target_ms),
+      window_width_(window_width),
+      window_height_(window_height) {}
+
+bool ResolutionScaler::Update(float frame_ms) {
+  average_ms_ = frames_at_scale_ == 0
+                    ? frame_ms
+                    : average_ms_ + (frame_ms - average_ms_) * kSmoothing;
+  ++frames_at_scale_;
+
+  if (frames_at_scale_ >= kMaxStepUpFrames) {
+    step_up_frames_ = kSettleFrames;
+  }
+
+  if (frames_at_scale_ < kSettleFrames) return false;
+
+  if (average_ms_ > target_ms_ * kStepDownMargin &&
+      scale_index_ + 1 < kNumScales) {
+    if (stepped_up_) {
+      step_up_frames_ = std::min(2 * step_up_frames_, kMaxStepUpFrames);
+    }
+
+    // Steps down as far as the cost predicted for the smaller scale needs
+    // to fit the target, in one change.
+    int scale_index = scale_index_ + 1;
+
+    while (scale_index + 1 < kNumScales &&
+           PredictMs(scale_index) > target_ms_) {
+      ++scale_index;
+    }
+
+    SetScaleIndex(scale_index);
+    return true;
+  }
+
+  if (scale_index_ > 0 && frames_at_scale_ >= step_up_frames_ &&
+      PredictMs(scale_index_ - 1) < target_ms_ * kStepUpMargin) {
+    SetScaleIndex(scale_index_ - 1);
+    return true;
+  }
+
+  return false;
+}
+
+float ResolutionScaler::TargetMs() const {
+  return target_ms_;
+}
+
+float ResolutionScaler::Scale() const {
+  return kScales[scale_index_];
+}
+
+int ResolutionScaler::Width() const {
+  return ScaleSize(window_width_, Scale());
+}
+
+int ResolutionScaler::Height() const {
+  return ScaleSize(window_height_, Scale());
+}
+
+float ResolutionScaler::AverageMs() const {
+  return average_ms_;
+}
+
+int ResolutionScaler::NumChanges() const {
+  return num_changes_;
+}
+
+float ResolutionScaler::PredictMs(int scale_index) const {
+  const float ratio = kScales[scale_index] / kScales[scale_index_];
+
+  return average_ms_ * ratio * ratio;
+}
+
+void ResolutionScaler::SetScaleIndex(int scale_index) {
+  stepped_up_ = scale_index < scale_index_;
+  scale_index_ = scale_index;
+  frames_at_scale_ = 0;
+  ++num_changes_;
+}
@@ -0,0 +1,167 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "trace.h"
+
+Simulation::Simulation(const Camera& camera, Clock::time_point start_time)
+    : entity_world_(camera.GetLevel()),
+      camera_(camera),
+      previous_camera_(camera),
+      state_time_(start_time),
+      snapshots_(Snapshot{ camera, camera, start_time }) {
+  camera_.SetEntity(&entity_world_,
+                    entity_world_.Add(camera.Position(), kCameraRadius));
+}
+
+Simulation::~Simulation() {
+  Stop();
+}
+
+void Simulation::AddObstacle(const Vector& position, float radius) {
+  entity_world_.Add(position, radius);
+}
+
+std::mutex* Simulation::LevelMutex() {
+  return &level_mutex_;
+}
+
+const EntityWorld& Simulation::Entities() const {
+  return entity_world_;
+}
+
+void Simulation::Start() {
+  if (running_.exchange(true)) return;
+
+  thread_ = std::thread(&Simulation::Run, this);
+}
+
+void Simulation::Stop() {
+  running_ = false;
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void Simulation::Run() {
+  tracing::SetThreadName("simulation");
+
+  while (running_.load(std::memory_order_acquire)) {
+    Update(Clock::now());
+    std::this_thread::sleep_until(state_time_ + kTickDuration);
+  }
+}
+
+void Simulation::Update(Clock::time_point now) {
+  int num_ticks = 0;
+
+  while (state_time_ + kTickDuration <= now) {
+    if (num_ticks == kMaxTicksPerUpdate) {
+      // Skips the time that could not be caught up.
+      state_time_ = now;
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(level_mutex_);
+      Tick();
+    }
+
+    state_time_ += kTickDuration;
+    ++num_ticks;
+  }
+
+  if (num_ticks == 0) return;
+
+  Snapshot& snapshot = snapshots_.Back();
+  snapshot.previous = previous_camera_;
+  snapshot.current = camera_;
+  snapshot.current_time = state_time_;
+  snapshots_.Publish();
+}
+
+void Simulation::Tick() {
+  tracing::ScopedTrace trace("tick");
+
+  {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    tick_input_.swap(pending_input_);
+  }
+
+  for (const Input& input : tick_input_) {
+    if (input.type == Input::Type::kAcceleration) {
+      camera_.SetAcceleration(input.accel_state, input.accel_direction);
+    } else {
+      camera_.SetRotationSpeed(input.rotation_direction);
+    }
+  }
+  tick_input_.clear();
+
+  previous_camera_ = camera_;
+
+  camera_.SetMovementSpeed(kTimeStep);
+  camera_.HandleMotion(kTimeStep);
+}
+
+void Simulation::QueueInput(const Input& input) {
+  std::lock_guard<std::mutex> lock(input_mutex_);
+  pending_input_.push_back(input);
+}
+
+void Simulation::SetAcceleration(motion::AccelState accel_state,
+                                 motion::AccelDirection accel_direction) {
+  QueueInput(Input{
+    Input::Type::kAcceleration,
+    accel_state,
+    accel_direction,
+    motion::RotationDirection::kNone
+  });
+}
+
+void Simulation::SetRotationSpeed(
+    motion::RotationDirection rotation_direction) {
+  QueueInput(Input{
+    Input::Type::kRotation,
+    motion::AccelState::kNone,
+    motion::AccelDirection::kNone,
+    rotation_direction
+  });
+}
+
+Camera Simulation::CameraAt(Clock::time_point now) {
+  const Snapshot& snapshot = snapshots_.Acquire();
+
+  // Renders one tick in the past, between the previous and current states.
+  const std::chrono::duration<float> since_current = now - snapshot.current_time;
+  const float alpha =
+      std::clamp(since_current.count() / kTimeStep, 0.0f, 1.0f);
+
+  return Interpolate(snapshot.previous, snapshot.current, alpha);
+}
+
+Camera Simulation::Interpolate(const Camera& from,
+                               const Camera& to,
+                               float alpha) {
+  const Vector position =
+      from.Position() + (to.Position() - from.Position()) * alpha;
+
+  // Blends the directions linearly and normalizes the result, which is
+  // accurate for the small rotation of a single tick.
+  Vector direction =
+      from.Direction() + (to.Direction() - from.Direction()) * alpha;
+  const float length =
+      std::sqrt(direction.x * direction.x + direction.y * direction.y);
+
+  if (length > 0.0f) {
+    direction *= 1.0f / length;
+  } else {
+    direction = to.Direction();
+  }
+
+  Camera camera = to;
+  camera.SetPose(position, direction);
+
+  return camera;
+}
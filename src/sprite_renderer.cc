@@ -0,0 +1,320 @@
+#include "sprite_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Mixes the bits of a counter into a pseudo-random value.
+uint32_t Hash(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  value *= 0x846ca68bu;
+  value ^= value >> 16;
+
+  return value;
+}
+
+// Converts a texture coordinate in texels to 16.16 fixed point.
+uint32_t ToFixed(float texels) {
+  return static_cast<uint32_t>(texels * 65536.0f);
+}
+
+// Returns the number of rows after the first, stepping v_step from v_begin in
+// 16.16 fixed point, before the texture coordinate reaches the texel.
+int RowsBelow(int texel, uint32_t v_begin, uint32_t v_step) {
+  const int64_t distance =
+      (static_cast<int64_t>(texel) << 16) - static_cast<int64_t>(v_begin);
+
+  if (distance <= 0) return 0;
+
+  return static_cast<int>((distance + v_step - 1) / v_step);
+}
+
+}  // namespace
+
+std::vector<rendering::Sprite> rendering::ScatterSprites(const Level& level,
+                                                         int count) {
+  std::vector<Sprite> sprites;
+
+  if (count <= 0 || level.Width() <= 0 || level.Height() <= 0) {
+    return sprites;
+  }
+
+  sprites.reserve(count);
+
+  // Gives up after a fixed number of attempts on levels that are mostly
+  // walls.
+  const uint32_t max_attempts = static_cast<uint32_t>(count) * 64;
+
+  for (uint32_t attempt = 0;
+       attempt < max_attempts && static_cast<int>(sprites.size()) < count;
+       ++attempt) {
+    const uint32_t hash = Hash(attempt);
+    const int x = static_cast<int>(hash % level.Width());
+    const int y = static_cast<int>(Hash(hash) % level.Height());
+
+    // Sprites sharing a tile are spread around its center.
+    const float jitter_x = (hash >> 24) / 512.0f;
+    const float jitter_y = (hash >> 16 & 0xff) / 512.0f;
+
+    if (!level.IsSolid(x, y)) {
+      sprites.push_back(Sprite{
+        Vector(x + 0.25f + jitter_x, y + 0.25f + jitter_y),
+        static_cast<int>(sprites.size() % TextureAtlas::kNumSpriteTextures)
+      });
+    }
+  }
+
+  return sprites;
+}
+
+bool rendering::SpriteRenderer::HiddenByVisibilitySet(
+    const Sprite& sprite) const {
+  // The billboard turns to face the camera, so it stays within half a tile
+  // of its position.
+  const int first_x = static_cast<int>(std::floor(sprite.position.x - 0.5f));
+  const int last_x = static_cast<int>(std::floor(sprite.position.x + 0.5f));
+  const int first_y = static_cast<int>(std::floor(sprite.position.y - 0.5f));
+  const int last_y = static_cast<int>(std::floor(sprite.position.y + 0.5f));
+
+  for (int x = first_x; x <= last_x; ++x) {
+    for (int y = first_y; y <= last_y; ++y) {
+      if (camera_tiles_.Contains(x, y)) return false;
+    }
+  }
+
+  return true;
+}
+
+void rendering::SpriteRenderer::Project(const Camera& camera,
+                                        const std::vector<Sprite>& sprites,
+                                        int screen_width,
+                                        int screen_height) {
+  const Vector position = camera.Position();
+  const Vector direction = camera.Direction();
+  const Vector plane = camera.Plane();
+
+  // Camera space expresses a point as depth * direction + offset * plane, so
+  // the depth is measured like the wall distances and the offset divided by
+  // the depth is the plane scalar of the screen column (see
+  // CalculatePlaneScalar). Both come from the inverse of the 2 x 2 matrix
+  // with the direction and plane as columns.
+  const float inverse_determinant =
+      1.0f / (direction.x * plane.y - plane.x * direction.y);
+
+  const int max_y = screen_height - 1;
+  const float half_width = (screen_width - 1) / 2.0f;
+  const float plane_length = std::sqrt(plane.x * plane.x + plane.y * plane.y);
+
+  visible_.clear();
+  num_hidden_ = 0;
+
+  if (visibility_set_ != nullptr) {
+    const int tile_x = static_cast<int>(std::floor(position.x));
+    const int tile_y = static_cast<int>(std::floor(position.y));
+
+    if (!camera_tiles_valid_ || tile_x != camera_tile_x_ ||
+        tile_y != camera_tile_y_) {
+      visibility_set_->Decode(tile_x, tile_y, &camera_tiles_);
+      camera_tiles_valid_ = true;
+      camera_tile_x_ = tile_x;
+      camera_tile_y_ = tile_y;
+    }
+  }
+
+  for (size_t index = 0; index < sprites.size(); ++index) {
+    const Sprite& sprite = sprites[index];
+
+    if (visibility_set_ != nullptr && HiddenByVisibilitySet(sprite)) {
+      ++num_hidden_;
+      continue;
+    }
+
+    const Vector relative = sprite.position - position;
+
+    const float depth =
+        (relative.x * plane.y - plane.x * relative.y) * inverse_determinant;
+
+    // Culls sprites behind the camera.
+    if (!(depth >= kNearDistance)) continue;
+
+    const float offset =
+        (direction.x * relative.y - relative.x * direction.y) *
+        inverse_determinant;
+
+    // A tile is max_y / depth rows tall, as the walls are, and its width in
+    // columns depends on the field of view.
+    const float center_x = half_width * (1.0f + offset / depth);
+    const float width = half_width / (plane_length * depth);
+    const float height = max_y / depth;
+
+    const float left = center_x - width / 2.0f;
+    const float top = (max_y - height) / 2.0f;
+
+    const int x_begin = std::max(0, static_cast<int>(std::ceil(left)));
+    const int x_end = static_cast<int>(
+        std::min<float>(screen_width, std::ceil(left + width)));
+
+    // Culls sprites outside the left and right edges of the screen.
+    if (x_begin >= x_end) continue;
+
+    const int y_begin = std::max(0, static_cast<int>(std::ceil(top)));
+    const int y_end = static_cast<int>(
+        std::min<float>(screen_height, std::ceil(top + height)));
+
+    const int mip_level = TextureAtlas::MipLevel(
+        TextureAtlas::kSize / std::min(width, height));
+    const float size = static_cast<float>(TextureAtlas::kSize >> mip_level);
+
+    // The steps are at least one, so the fixed-point walk always advances.
+    const float u_step = std::max(size / width, 1.0f / 65536.0f);
+    const float v_step = std::max(size / height, 1.0f / 65536.0f);
+
+    visible_.push_back(ProjectedSprite{
+      depth,
+      static_cast<int>(index),
+      sprite.texture,
+      mip_level,
+      lightmap_ != nullptr ? lightmap_->FloorLight(sprite.position)
+                           : 0x00ffffff,
+      x_begin,
+      x_end,
+      y_begin,
+      y_end,
+      ToFixed(std::max((x_begin - left) * u_step, 0.0f)),
+      ToFixed(u_step),
+      ToFixed(std::max((y_begin - top) * v_step, 0.0f)),
+      ToFixed(v_step)
+    });
+  }
+
+  // Sorts in place, so no memory is allocated. Sprites at the same depth are
+  // drawn in the order they are listed in, whichever others are culled.
+  std::sort(visible_.begin(), visible_.end(),
+            [](const ProjectedSprite& a, const ProjectedSprite& b) {
+              if (a.depth != b.depth) return a.depth > b.depth;
+              return a.index < b.index;
+            });
+}
+
+void rendering::SpriteRenderer::RenderColumns(
+    const TextureAtlas& texture_atlas,
+    const ColumnBuffers& column_buffers,
+    int x_begin,
+    int x_end,
+    FrameBuffer* frame_buffer) const {
+  const int width = frame_buffer->Width();
+
+  for (const ProjectedSprite& sprite : visible_) {
+    const int sprite_x_begin = std::max(sprite.x_begin, x_begin);
+    const int sprite_x_end = std::min(sprite.x_end, x_end);
+
+    const int size = TextureAtlas::kSize >> sprite.mip_level;
+    const int texture = TextureAtlas::kFirstSpriteTexture + sprite.texture;
+    const uint32_t* texels = texture_atlas.Texels(texture, sprite.mip_level);
+
+    for (int x = sprite_x_begin; x < sprite_x_end; ++x) {
+      // Rejects columns hidden by a closer wall before reading any texel.
+      if (sprite.depth >= column_buffers.depth[x]) continue;
+
+      const uint32_t u =
+          sprite.u_begin + static_cast<uint32_t>(x - sprite.x_begin) *
+                               sprite.u_step;
+      const int texture_u = std::min(static_cast<int>(u >> 16), size - 1);
+
+      // Clips the rows to the opaque texels of the column. Row y samples
+      // texel (v_begin + (y - y_begin) * v_step) >> 16.
+      const TextureAtlas::OpaqueSpan span =
+          texture_atlas.ColumnOpaqueSpan(texture, sprite.mip_level, texture_u);
+
+      if (span.begin == span.end) continue;
+
+      const int y_begin =
+          sprite.y_begin + RowsBelow(span.begin, sprite.v_begin, sprite.v_step);
+      const int y_end = std::min(
+          sprite.y_end,
+          sprite.y_begin + RowsBelow(span.end, sprite.v_begin, sprite.v_step));
+
+      const uint32_t* column = texels + texture_u * size;
+      uint32_t* pixel = frame_buffer->Pixels() +
+                        static_cast<size_t>(y_begin) * width + x;
+      uint32_t v = sprite.v_begin +
+                   static_cast<uint32_t>(y_begin - sprite.y_begin) *
+                       sprite.v_step;
+
+      if (lightmap_ != nullptr) {
+        for (int y = y_begin; y < y_end; ++y) {
+          const uint32_t texel = column[(v >> 16) & (size - 1)];
+
+          if (texel >> 24 >= TextureAtlas::kOpaqueAlpha) {
+            *pixel = lighting::Modulate(texel, sprite.light);
+          }
+
+          v += sprite.v_step;
+          pixel += width;
+        }
+        continue;
+      }
+
+      for (int y = y_begin; y < y_end; ++y) {
+        const uint32_t texel = column[(v >> 16) & (size - 1)];
+
+        if (texel >> 24 >= TextureAtlas::kOpaqueAlpha) {
+          *pixel = texel | 0xff000000;
+        }
+
+        v += sprite.v_step;
+        pixel += width;
+      }
+    }
+  }
+}
+
+void rendering::SpriteRenderer::Render(const Camera& camera,
+                                       const TextureAtlas& texture_atlas,
+                                       const std::vector<Sprite>& sprites,
+                                       const ColumnBuffers& column_buffers,
+                                       ThreadPool* thread_pool,
+                                       FrameBuffer* frame_buffer) {
+  Project(camera, sprites, frame_buffer->Width(), frame_buffer->Height());
+
+  if (visible_.empty()) return;
+
+  if (thread_pool == nullptr) {
+    RenderColumns(texture_atlas, column_buffers, 0, frame_buffer->Width(),
+                  frame_buffer);
+    return;
+  }
+
+  // Every thread draws all sprites, but only in its own columns.
+  thread_pool->ParallelFor(
+      0, frame_buffer->Width(), kMinColumnChunk,
+      [&](int x_begin, int x_end) {
+        RenderColumns(texture_atlas, column_buffers, x_begin, x_end,
+                      frame_buffer);
+      });
+}
+
+void rendering::SpriteRenderer::SetVisibilitySet(
+    const VisibilitySet* visibility_set) {
+  visibility_set_ = visibility_set;
+  camera_tiles_valid_ = false;
+}
+
+void rendering::SpriteRenderer::InvalidateVisibility() {
+  camera_tiles_valid_ = false;
+}
+
+void rendering::SpriteRenderer::SetLightmap(const Lightmap* lightmap) {
+  lightmap_ = lightmap;
+}
+
+int rendering::SpriteRenderer::NumVisible() const {
+  return static_cast<int>(visible_.size());
+}
+
+int rendering::SpriteRenderer::NumHidden() const {
+  return num_hidden_;
+}
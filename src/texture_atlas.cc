@@ -0,0 +1,298 @@
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "renderer.h"
+
+namespace {
+
+// Returns a pseudo-random value in the range [0, 1) for a texel, so the
+// patterns do not look perfectly flat.
+float Noise(int u, int v, int seed) {
+  uint32_t hash = static_cast<uint32_t>(u) * 0x8da6b343u ^
+                  static_cast<uint32_t>(v) * 0xd8163841u ^
+                  static_cast<uint32_t>(seed) * 0xcb1ab31fu;
+  hash ^= hash >> 13;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 16;
+
+  return (hash & 0xffff) / 65536.0f;
+}
+
+// Red bricks, two per row, with every other row offset by half a brick.
+float BrickPattern(int u, int v) {
+  const int row = v / 16;
+  const int brick_u = (u + (row % 2) * 16) % 32;
+
+  if (v % 16 < 2 || brick_u < 2) return 0.35f;
+
+  return 0.75f + 0.25f * Noise(u / 2, v / 2, row);
+}
+
+// Green stone blocks with rough, uneven faces.
+float StonePattern(int u, int v) {
+  const int row = v / 32;
+  const int block_u = (u + (row % 2) * 20) % 32;
+
+  if (v % 32 < 2 || block_u < 2) return 0.3f;
+
+  return 0.55f + 0.3f * Noise(u / 4, v / 4, row) + 0.15f * Noise(u, v, 7);
+}
+
+// Blue metal panels with bevelled edges and a rivet in each corner.
+float PanelPattern(int u, int v) {
+  const int panel_u = u % 32;
+  const int panel_v = v % 32;
+
+  const bool rivet = (panel_u == 4 || panel_u == 27) &&
+                     (panel_v == 4 || panel_v == 27);
+  if (rivet) return 1.0f;
+
+  if (panel_u < 2 || panel_v < 2) return 0.95f;
+  if (panel_u >= 30 || panel_v >= 30) return 0.4f;
+
+  return 0.7f + 0.05f * Noise(u, v, 3);
+}
+
+// White tiles separated by grout lines.
+float TilePattern(int u, int v) {
+  if (u % 16 == 0 || v % 16 == 0) return 0.45f;
+
+  return 0.85f + 0.15f * Noise(u / 16, v / 16, 5);
+}
+
+// Yellow vertical wooden planks with a wavy grain.
+float WoodPattern(int u, int v) {
+  const int plank = u / 16;
+
+  if (u % 16 == 0) return 0.3f;
+
+  const float grain =
+      std::sin((u + 3.0f * std::sin(v * 0.2f + plank)) * 1.3f) * 0.5f + 0.5f;
+
+  return 0.6f + 0.25f * grain + 0.15f * Noise(plank, v / 8, 11);
+}
+
+// Gray flagstones for the floor, with joints every half tile.
+float FlagstonePattern(int u, int v) {
+  const int stone = (u / 32) * 2 + v / 32;
+
+  if (u % 32 == 0 || v % 32 == 0) return 0.4f;
+
+  return 0.7f + 0.15f * Noise(stone, 0, 13) + 0.15f * Noise(u / 2, v / 2, 17);
+}
+
+// Dark wooden boards for the ceiling, running along the Y axis.
+float BoardPattern(int u, int v) {
+  if (u % 16 == 0) return 0.35f;
+
+  return 0.65f + 0.2f * Noise(u / 16, v / 8, 19) + 0.15f * Noise(u, v, 23);
+}
+
+// Base colors of the floor and ceiling textures, which the walls take from
+// WallColor.
+constexpr rendering::Color kFloorBaseColor = { 0x90, 0x88, 0x80, 0xff };
+constexpr rendering::Color kCeilingBaseColor = { 0x70, 0x58, 0x40, 0xff };
+
+// Returns the pattern of the texture at the atlas index.
+float Pattern(int texture, int u, int v) {
+  switch (texture) {
+   case 1:
+    return BrickPattern(u, v);
+
+   case 2:
+    return StonePattern(u, v);
+
+   case 3:
+    return PanelPattern(u, v);
+
+   case 4:
+    return TilePattern(u, v);
+
+   case TextureAtlas::kFloorTexture:
+    return FlagstonePattern(u, v);
+
+   case TextureAtlas::kCeilingTexture:
+    return BoardPattern(u, v);
+
+   default:
+    return WoodPattern(u, v);
+  }
+}
+
+// Packs a color scaled by an intensity into the frame buffer layout.
+uint32_t ShadedARGB(rendering::Color color, float intensity) {
+  const auto shade = [intensity](uint8_t channel) {
+    return static_cast<uint32_t>(channel * std::clamp(intensity, 0.0f, 1.0f));
+  };
+
+  return static_cast<uint32_t>(color.a) << 24 | shade(color.r) << 16 |
+         shade(color.g) << 8 | shade(color.b);
+}
+
+// Returns true if the texel lies within the radius of the center.
+bool InCircle(int u, int v, float center_u, float center_v, float radius) {
+  const float du = u + 0.5f - center_u;
+  const float dv = v + 0.5f - center_v;
+
+  return du * du + dv * dv <= radius * radius;
+}
+
+// A golden orb floating above the floor, lit from the top left.
+uint32_t OrbTexel(int u, int v) {
+  constexpr rendering::Color kGold = { 0xff, 0xc8, 0x30, 0xff };
+
+  if (!InCircle(u, v, 32.0f, 46.0f, 11.0f)) return 0;
+
+  const float highlight = InCircle(u, v, 28.0f, 42.0f, 4.0f) ? 0.3f : 0.0f;
+  const float shading = 1.0f - (u + v - 70) / 40.0f * 0.3f;
+
+  return ShadedARGB(kGold, shading * 0.8f + highlight);
+}
+
+// A wooden barrel with two iron bands, standing on the floor.
+uint32_t BarrelTexel(int u, int v) {
+  constexpr rendering::Color kWood = { 0x9a, 0x62, 0x2c, 0xff };
+  constexpr rendering::Color kIron = { 0x60, 0x60, 0x68, 0xff };
+
+  // The barrel bulges out in the middle.
+  const float half_width = 12.0f + 3.0f * std::sin((v - 28) / 36.0f * 3.14159f);
+
+  if (v < 28 || std::abs(u + 0.5f - 32.0f) > half_width) return 0;
+
+  const float rounding = 1.0f - std::abs(u + 0.5f - 32.0f) / half_width * 0.5f;
+
+  if ((v >= 34 && v < 37) || (v >= 55 && v < 58)) {
+    return ShadedARGB(kIron, rounding);
+  }
+
+  const float stave = u % 5 == 0 ? 0.75f : 1.0f;
+
+  return ShadedARGB(kWood, rounding * stave * (0.85f + 0.15f * Noise(u, v, 29)));
+}
+
+// A green slime creature with two eyes.
+uint32_t SlimeTexel(int u, int v) {
+  constexpr rendering::Color kSlime = { 0x40, 0xe0, 0x50, 0xff };
+  constexpr rendering::Color kEye = { 0xff, 0xff, 0xff, 0xff };
+  constexpr rendering::Color kPupil = { 0x10, 0x10, 0x10, 0xff };
+
+  const bool body = v >= 36 && InCircle(u, v, 32.0f, 64.0f, 26.0f);
+
+  if (!body) return 0;
+
+  if (InCircle(u, v, 25.0f, 47.0f, 2.0f) || InCircle(u, v, 39.0f, 47.0f, 2.0f)) {
+    return ShadedARGB(kPupil, 1.0f);
+  }
+  if (InCircle(u, v, 25.0f, 46.0f, 4.5f) || InCircle(u, v, 39.0f, 46.0f, 4.5f)) {
+    return ShadedARGB(kEye, 1.0f);
+  }
+
+  return ShadedARGB(kSlime, 0.6f + 0.4f * (1.0f - (v - 36) / 28.0f));
+}
+
+// Averages the four texels of a 2 x 2 square channel by channel.
+uint32_t Average(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+  uint32_t result = 0;
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    const uint32_t sum = (a >> shift & 0xff) + (b >> shift & 0xff) +
+                         (c >> shift & 0xff) + (d >> shift & 0xff);
+    result |= (sum + 2) / 4 << shift;
+  }
+
+  return result;
+}
+
+}  // namespace
+
+TextureAtlas::TextureAtlas()
+    : texels_(static_cast<size_t>(kNumTextures) * kTexelsPerTexture),
+      opaque_spans_(static_cast<size_t>(kNumTextures) * kColumnsPerTexture) {
+  for (int texture = 0; texture < kNumTextures; ++texture) {
+    // Texture 0 belongs to the wall IDs without their own color, which
+    // WallColor maps to the same default color as ID 0.
+    rendering::Color base = rendering::WallColor(raycasting::RayData{
+      0.0f, texture, raycasting::WallSide::kXSide, 0.0f, 0
+    });
+
+    if (texture == kFloorTexture) {
+      base = kFloorBaseColor;
+    } else if (texture == kCeilingTexture) {
+      base = kCeilingBaseColor;
+    }
+
+    uint32_t* full = texels_.data() + ColumnOffset(texture, 0, 0);
+
+    for (int u = 0; u < kSize; ++u) {
+      for (int v = 0; v < kSize; ++v) {
+        uint32_t& texel = full[u * kSize + v];
+
+        switch (texture - kFirstSpriteTexture) {
+         case 0:
+          texel = OrbTexel(u, v);
+          break;
+
+         case 1:
+          texel = BarrelTexel(u, v);
+          break;
+
+         case 2:
+          texel = SlimeTexel(u, v);
+          break;
+
+         default:
+          texel = ShadedARGB(base, Pattern(texture, u, v));
+          break;
+        }
+      }
+    }
+
+    // Builds every mip level from the previous one with a box filter.
+    for (int mip_level = 1; mip_level < kNumMipLevels; ++mip_level) {
+      const int size = kSize >> mip_level;
+      const uint32_t* source =
+          texels_.data() + ColumnOffset(texture, mip_level - 1, 0);
+      uint32_t* target = texels_.data() + ColumnOffset(texture, mip_level, 0);
+
+      for (int u = 0; u < size; ++u) {
+        for (int v = 0; v < size; ++v) {
+          const uint32_t* left = source + (2 * u) * (2 * size) + 2 * v;
+          const uint32_t* right = left + 2 * size;
+
+          target[u * size + v] = Average(left[0], left[1], right[0], right[1]);
+        }
+      }
+    }
+  }
+
+  // Finds the opaque span of every column.
+  for (int texture = 0; texture < kNumTextures; ++texture) {
+    for (int mip_level = 0; mip_level < kNumMipLevels; ++mip_level) {
+      const int size = kSize >> mip_level;
+
+      for (int u = 0; u < size; ++u) {
+        const uint32_t* column =
+            texels_.data() + ColumnOffset(texture, mip_level, u);
+        OpaqueSpan span = { 0, 0 };
+
+        for (int v = 0; v < size; ++v) {
+          if (column[v] >> 24 >= kOpaqueAlpha) {
+            if (span.begin == span.end) span.begin = static_cast<uint8_t>(v);
+            span.end = static_cast<uint8_t>(v + 1);
+          }
+        }
+
+        opaque_spans_[ColumnIndex(texture, mip_level, u)] = span;
+      }
+    }
+  }
+}
+
+int TextureAtlas::MipLevel(float texels_per_pixel) {
+  // Level n is the right one while a pixel covers less than 2^(n + 1) texels.
+  if (!(texels_per_pixel >= 2.0f)) return 0;
+
+  return std::min(std::ilogb(texels_per_pixel), kNumMipLevels - 1);
+}
@@ -0,0 +1,113 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "trace.h"
+
+ThreadPool::ThreadPool(int num_threads) {
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+int ThreadPool::NumThreads() const {
+  return static_cast<int>(workers_.size()) + 1;
+}
+
+int ThreadPool::DefaultNumThreads() {
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void ThreadPool::WorkerLoop(int worker_index) {
+  tracing::SetThreadName("worker " + std::to_string(worker_index));
+
+  unsigned last_generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [&] {
+        return stopping_ || generation_ != last_generation;
+      });
+
+      if (stopping_) return;
+
+      last_generation = generation_;
+    }
+
+    ProcessChunks();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --num_busy_workers_;
+    }
+    work_finished_.notify_one();
+  }
+}
+
+void ThreadPool::ProcessChunks() {
+  const int num_threads = NumThreads();
+
+  int begin = next_index_.load(std::memory_order_relaxed);
+
+  while (begin < end_) {
+    // Guided scheduling: each chunk takes a share of the remaining indices
+    // proportional to the thread count, but never less than the minimum.
+    const int chunk_size =
+        std::max(min_chunk_size_, (end_ - begin) / (2 * num_threads));
+    const int chunk_end = std::min(end_, begin + chunk_size);
+
+    if (next_index_.compare_exchange_weak(begin, chunk_end,
+                                          std::memory_order_relaxed)) {
+      tracing::ScopedTrace trace(trace_scope_ != nullptr ? trace_scope_ : "chunk",
+                                 begin, chunk_end);
+      (*task_)(begin, chunk_end);
+      begin = next_index_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void ThreadPool::ParallelFor(int begin,
+                             int end,
+                             int min_chunk_size,
+                             const Task& task) {
+  if (begin >= end) return;
+
+  // Without workers there is nothing to synchronize with.
+  if (workers_.empty()) {
+    task(begin, end);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    end_ = end;
+    min_chunk_size_ = std::max(1, min_chunk_size);
+    next_index_.store(begin, std::memory_order_relaxed);
+    num_busy_workers_ = static_cast<int>(workers_.size());
+    trace_scope_ = tracing::CurrentScope();
+    ++generation_;
+  }
+  work_available_.notify_all();
+
+  // The calling thread works on the range as well instead of idling.
+  ProcessChunks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_finished_.wait(lock, [this] { return num_busy_workers_ == 0; });
+  task_ = nullptr;
+}
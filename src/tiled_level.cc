@@ -0,0 +1,38 @@
+#include "tiled_level.h"
+
+TiledLevel::TiledLevel(const Level& level)
+    : width_(level.Width()),
+      height_(level.Height()),
+      blocks_y_((level.Height() + kBlockMask) >> kBlockShift) {
+  const size_t blocks_x = (level.Width() + kBlockMask) >> kBlockShift;
+
+  // Padding tiles of partial blocks stay empty, they are never read because
+  // of the bounds checks.
+  blocks_.resize(blocks_x * blocks_y_, Block{});
+  occupancy_.resize(blocks_x * blocks_y_, 0);
+
+  for (int x = 0; x < width_; ++x) {
+    for (int y = 0; y < height_; ++y) {
+      const int tile = level.At(x, y);
+      const size_t block = BlockIndex(x, y);
+      const int offset = MortonOffset(x, y);
+
+      blocks_[block].tiles[offset] = static_cast<uint8_t>(tile);
+
+      if (tile != 0) {
+        occupancy_[block] |= uint64_t{1} << offset;
+      }
+    }
+  }
+}
+
+void TiledLevel::SetTile(int x, int y, uint8_t tile) {
+  if (!Contains(x, y)) return;
+
+  const size_t block = BlockIndex(x, y);
+  const int offset = MortonOffset(x, y);
+
+  blocks_[block].tiles[offset] = tile;
+  occupancy_[block] = (occupancy_[block] & ~(uint64_t{1} << offset)) |
+                      uint64_t{tile != 0} << offset;
+}
@@ -0,0 +1,192 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+  const char* name;
+  tracing::Clock::time_point begin;
+  tracing::Clock::time_point end;
+  int range_begin;
+  int range_end;
+};
+
+// Ring buffer of the events of one thread. Only its thread writes to it, and
+// it lives until the process exits, so it can be written after the thread
+// ended.
+struct ThreadEvents {
+  int thread_id;
+  std::string thread_name;
+  std::vector<Event> events;
+  int64_t num_recorded = 0;
+};
+
+// Buffers of every thread that recorded events.
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadEvents>> threads;
+  tracing::Clock::time_point start_time;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+thread_local ThreadEvents* thread_events = nullptr;
+thread_local const char* current_scope = nullptr;
+
+// Returns the buffer of the calling thread, creating it on first use. Only
+// this first call locks.
+ThreadEvents* GetThreadEvents() {
+  if (thread_events != nullptr) return thread_events;
+
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  auto events = std::make_unique<ThreadEvents>();
+  events->thread_id = static_cast<int>(registry.threads.size()) + 1;
+  events->thread_name = "thread " + std::to_string(events->thread_id);
+  events->events.resize(tracing::kEventsPerThread);
+
+  thread_events = events.get();
+  registry.threads.push_back(std::move(events));
+
+  return thread_events;
+}
+
+// Returns the microseconds from the start of the trace to the time point.
+double Microseconds(tracing::Clock::time_point time_point,
+                    tracing::Clock::time_point start_time) {
+  return std::chrono::duration<double, std::micro>(time_point - start_time)
+      .count();
+}
+
+}  // namespace
+
+void tracing::internal::Record(const char* name,
+                               Clock::time_point begin,
+                               Clock::time_point end,
+                               int range_begin,
+                               int range_end) {
+  ThreadEvents* events = GetThreadEvents();
+
+  events->events[events->num_recorded & (kEventsPerThread - 1)] =
+      Event{ name, begin, end, range_begin, range_end };
+  ++events->num_recorded;
+}
+
+void tracing::Enable() {
+  Registry& registry = GetRegistry();
+
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    if (internal::enabled.load(std::memory_order_relaxed)) return;
+    registry.start_time = Clock::now();
+  }
+
+  internal::enabled.store(true, std::memory_order_release);
+}
+
+void tracing::SetThreadName(const std::string& name) {
+  if (!IsEnabled()) return;
+
+  ThreadEvents* events = GetThreadEvents();
+
+  std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+  events->thread_name = name;
+}
+
+const char* tracing::CurrentScope() {
+  return current_scope;
+}
+
+tracing::ScopedTrace::ScopedTrace(const char* name,
+                                  int range_begin,
+                                  int range_end)
+    : name_(name),
+      outer_scope_(nullptr),
+      range_begin_(range_begin),
+      range_end_(range_end),
+      active_(IsEnabled()) {
+  if (!active_) return;
+
+  outer_scope_ = current_scope;
+  current_scope = name_;
+  begin_ = Clock::now();
+}
+
+tracing::ScopedTrace::~ScopedTrace() {
+  if (!active_) return;
+
+  internal::Record(name_, begin_, Clock::now(), range_begin_, range_end_);
+  current_scope = outer_scope_;
+}
+
+bool tracing::WriteTrace(const std::string& path, std::string* error) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  std::ofstream file(path, std::ios::trunc);
+  file << std::fixed << std::setprecision(3);
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"args\":{\"name\":\"ray-casting\"}}";
+
+  for (const std::unique_ptr<ThreadEvents>& thread : registry.threads) {
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+         << thread->thread_id << ",\"args\":{\"name\":\""
+         << thread->thread_name << "\"}}";
+
+    // The oldest event still in the ring comes first.
+    const int64_t num_events =
+        std::min<int64_t>(thread->num_recorded, kEventsPerThread);
+
+    for (int64_t i = thread->num_recorded - num_events;
+         i < thread->num_recorded; ++i) {
+      const Event& event = thread->events[i & (kEventsPerThread - 1)];
+      const double begin = Microseconds(event.begin, registry.start_time);
+      const double end = Microseconds(event.end, registry.start_time);
+
+      file << ",\n{\"name\":\"" << event.name
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->thread_id
+           << ",\"ts\":" << begin << ",\"dur\":" << end - begin;
+
+      if (event.range_end > event.range_begin) {
+        file << ",\"args\":{\"begin\":" << event.range_begin
+             << ",\"end\":" << event.range_end << "}";
+      }
+      file << "}";
+    }
+  }
+
+  file << "\n]}\n";
+
+  if (!file) {
+    *error = "Could not write trace " + path;
+    return false;
+  }
+
+  return true;
+}
+
+int64_t tracing::NumDroppedEvents() {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  int64_t num_dropped = 0;
+
+  for (const std::unique_ptr<ThreadEvents>& thread : registry.threads) {
+    num_dropped += std::max<int64_t>(0, thread->num_recorded - kEventsPerThread);
+  }
+
+  return num_dropped;
+}
@@ -13,6 +13,10 @@ Vector& Vector::operator+=(const Vector& other) {
   return *this;
 }
 
+Vector Vector::operator-(const Vector& other) const {
+  return Vector(x - other.x, y - other.y);
+}
+
 Vector Vector::operator*(float scalar) const {
   return Vector(x * scalar, y * scalar);
 }
@@ -0,0 +1,676 @@
+#include "visibility_set.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "camera.h"
+
+namespace {
+
+constexpr char kMagic[4] = { 'R', 'C', 'P', 'V' };
+constexpr uint32_t kFormatVersion = 1;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint64_t level_hash;
+};
+
+static_assert(sizeof(FileHeader) == 24, "Header must be 24 bytes");
+
+constexpr float kFullTurn = 6.28318530718f;
+
+// Distance of the sample points from the sides of their tile, which keeps
+// them inside it.
+constexpr float kInset = 1e-3f;
+
+size_t NumWords(size_t num_bits) {
+  return (num_bits + 63) / 64;
+}
+
+void AppendVarint(uint64_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a variable-length integer and advances the cursor past it. Returns
+// false if it runs past the end.
+bool ReadVarint(const uint8_t** cursor, const uint8_t* end, uint64_t* value) {
+  *value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*cursor == end) return false;
+
+    const uint8_t byte = *(*cursor)++;
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) return true;
+  }
+
+  return false;
+}
+
+// Sets the bits in the range [begin, end).
+void SetBits(size_t begin, size_t end, uint64_t* words) {
+  while (begin < end) {
+    const size_t bit = begin % 64;
+    const size_t count = std::min<size_t>(64 - bit, end - begin);
+    const uint64_t mask =
+        count == 64 ? ~uint64_t{0} : ((uint64_t{1} << count) - 1) << bit;
+
+    words[begin / 64] |= mask;
+    begin += count;
+  }
+}
+
+// Compresses the first num_bits bits into alternating run lengths, starting
+// with a run of clear bits, which may be empty. Bits past num_bits must be
+// clear. Words without a change of run are skipped whole.
+void EncodeRuns(const std::vector<uint64_t>& words,
+                size_t num_bits,
+                std::vector<uint8_t>* out) {
+  bool value = false;
+  size_t run_begin = 0;
+  size_t index = 0;
+
+  while (index < num_bits) {
+    const uint64_t changes =
+        (words[index / 64] ^ (value ? ~uint64_t{0} : 0)) >> (index % 64);
+
+    if (changes == 0) {
+      index = (index / 64 + 1) * 64;
+      continue;
+    }
+
+    index += __builtin_ctzll(changes);
+    if (index >= num_bits) break;
+
+    AppendVarint(index - run_begin, out);
+    value = !value;
+    run_begin = index;
+  }
+
+  AppendVarint(num_bits - run_begin, out);
+}
+
+// Reads the runs of set bits of a compressed set one after the other.
+class SetRunReader {
+ private:
+  const uint8_t* cursor_;
+  const uint8_t* end_;
+  uint64_t position_ = 0;
+
+ public:
+  SetRunReader(const uint8_t* begin, const uint8_t* end)
+      : cursor_(begin), end_(end) {}
+
+  // Reads the next run of set bits into [*begin, *end). Returns false after
+  // the last one.
+  bool Next(uint64_t* begin, uint64_t* end) {
+    uint64_t clear_length;
+    uint64_t set_length;
+
+    while (ReadVarint(&cursor_, end_, &clear_length)) {
+      position_ += clear_length;
+      if (!ReadVarint(&cursor_, end_, &set_length)) return false;
+
+      *begin = position_;
+      position_ += set_length;
+      *end = position_;
+
+      if (set_length > 0) return true;
+    }
+
+    return false;
+  }
+};
+
+// Compresses the bits set in either of two compressed sets of num_bits bits,
+// merging their runs without decoding them.
+void UnionRuns(SetRunReader a,
+               SetRunReader b,
+               uint64_t num_bits,
+               std::vector<uint8_t>* out) {
+  uint64_t a_begin = 0;
+  uint64_t a_end = 0;
+  uint64_t b_begin = 0;
+  uint64_t b_end = 0;
+  bool has_a = a.Next(&a_begin, &a_end);
+  bool has_b = b.Next(&b_begin, &b_end);
+
+  // End of the runs written so far and the run of set bits being extended.
+  uint64_t position = 0;
+  uint64_t run_begin = 0;
+  uint64_t run_end = 0;
+  bool has_run = false;
+
+  while (has_a || has_b) {
+    const bool take_a = has_a && (!has_b || a_begin <= b_begin);
+    const uint64_t begin = take_a ? a_begin : b_begin;
+    const uint64_t end = take_a ? a_end : b_end;
+
+    if (has_run && begin <= run_end) {
+      run_end = std::max(run_end, end);
+    } else {
+      if (has_run) {
+        AppendVarint(run_begin - position, out);
+        AppendVarint(run_end - run_begin, out);
+        position = run_end;
+      }
+
+      run_begin = begin;
+      run_end = end;
+      has_run = true;
+    }
+
+    if (take_a) {
+      has_a = a.Next(&a_begin, &a_end);
+    } else {
+      has_b = b.Next(&b_begin, &b_end);
+    }
+  }
+
+  if (has_run) {
+    AppendVarint(run_begin - position, out);
+    AppendVarint(run_end - run_begin, out);
+    position = run_end;
+  }
+
+  if (position < num_bits) {
+    AppendVarint(num_bits - position, out);
+  }
+}
+
+// Returns true if the runs cover exactly num_bits bits and end with the data.
+bool ValidRuns(const uint8_t* begin, const uint8_t* end, uint64_t num_bits) {
+  uint64_t covered = 0;
+
+  while (begin != end) {
+    uint64_t length;
+    if (!ReadVarint(&begin, end, &length) || length > num_bits - covered) {
+      return false;
+    }
+    covered += length;
+  }
+
+  return covered == num_bits;
+}
+
+// Marks every tile of the level the ray enters until it hits a wall,
+// including the wall.
+void MarkRay(const Level& level,
+             const Vector& origin,
+             const Vector& direction,
+             uint64_t* words) {
+  raycasting::DDAData dda_data_x(origin.x, direction.x);
+  raycasting::DDAData dda_data_y(origin.y, direction.y);
+
+  do {
+    if (dda_data_x.side_dist < dda_data_y.side_dist) {
+      dda_data_x.Advance();
+    } else {
+      dda_data_y.Advance();
+    }
+
+    // Tiles outside the level are walls that cannot be marked.
+    if (!level.Contains(dda_data_x.tile, dda_data_y.tile)) return;
+
+    const size_t index =
+        static_cast<size_t>(dda_data_x.tile) * level.Height() +
+        dda_data_y.tile;
+    words[index / 64] |= uint64_t{1} << (index % 64);
+  } while (!level.IsSolid(dda_data_x.tile, dda_data_y.tile));
+}
+
+// Returns the directions of the rays cast from every sample point.
+std::vector<Vector> SampleDirections() {
+  std::vector<Vector> directions(VisibilitySet::kRaysPerSample);
+
+  for (int ray = 0; ray < VisibilitySet::kRaysPerSample; ++ray) {
+    const float angle = kFullTurn * ray / VisibilitySet::kRaysPerSample;
+    directions[ray] = Vector(std::cos(angle), std::sin(angle));
+  }
+
+  return directions;
+}
+
+// Sets the bits of every tile seen from the empty tile, including itself.
+void MarkVisibleTiles(const Level& level,
+                      int x,
+                      int y,
+                      const std::vector<Vector>& directions,
+                      uint64_t* words) {
+  constexpr int kSamplesPerSide = VisibilitySet::kSamplesPerSide;
+
+  const size_t tile = static_cast<size_t>(x) * level.Height() + y;
+  words[tile / 64] |= uint64_t{1} << (tile % 64);
+
+  // The sample points run around the sides of the tile, starting at its
+  // corners.
+  for (int sample = 0; sample < 4 * kSamplesPerSide; ++sample) {
+    const float along = kInset + (1.0f - 2.0f * kInset) *
+                                     (sample % kSamplesPerSide) /
+                                     kSamplesPerSide;
+    const Vector corners[4] = {
+      Vector(x + along, y + kInset),
+      Vector(x + 1.0f - kInset, y + along),
+      Vector(x + 1.0f - along, y + 1.0f - kInset),
+      Vector(x + kInset, y + 1.0f - along)
+    };
+    const Vector& origin = corners[sample / kSamplesPerSide];
+
+    for (const Vector& direction : directions) {
+      MarkRay(level, origin, direction, words);
+    }
+  }
+}
+
+// Sets the bits of the runs, which cover the bitset, in the words.
+void DecodeRuns(const uint8_t* begin, const uint8_t* end, uint64_t* words) {
+  size_t position = 0;
+  bool value = false;
+  uint64_t length;
+
+  while (ReadVarint(&begin, end, &length)) {
+    if (value) {
+      SetBits(position, position + length, words);
+    }
+
+    position += length;
+    value = !value;
+  }
+}
+
+}  // namespace
+
+int64_t VisibleTiles::Count() const {
+  int64_t count = 0;
+
+  for (const uint64_t word : words_) {
+    count += __builtin_popcountll(word);
+  }
+
+  return count;
+}
+
+VisibilitySet::VisibilitySet(const Level& level, ThreadPool* thread_pool)
+    : width_(level.Width()),
+      height_(level.Height()),
+      level_hash_(level::HashLevel(level)) {
+  const size_t num_tiles = static_cast<size_t>(width_) * height_;
+  const std::vector<Vector> directions = SampleDirections();
+
+  // Compressed sets of every tile column and their sizes, concatenated once
+  // all are built.
+  std::vector<std::vector<uint8_t>> columns(width_);
+  offsets_.assign(num_tiles + 1, 0);
+
+  const auto build_columns = [&](int x_begin, int x_end) {
+    std::vector<uint64_t> words(NumWords(num_tiles));
+
+    for (int x = x_begin; x < x_end; ++x) {
+      std::vector<uint8_t>* column = &columns[x];
+
+      for (int y = 0; y < height_; ++y) {
+        const size_t tile = static_cast<size_t>(x) * height_ + y;
+        const size_t column_size = column->size();
+
+        if (level.IsSolid(x, y)) {
+          AppendVarint(0, column);
+          AppendVarint(num_tiles, column);
+        } else {
+          std::fill(words.begin(), words.end(), 0);
+          MarkVisibleTiles(level, x, y, directions, words.data());
+          EncodeRuns(words, num_tiles, column);
+        }
+
+        offsets_[tile + 1] = column->size() - column_size;
+      }
+    }
+  };
+
+  if (thread_pool == nullptr) {
+    build_columns(0, width_);
+  } else {
+    thread_pool->ParallelFor(0, width_, 1, build_columns);
+  }
+
+  for (size_t tile = 0; tile < num_tiles; ++tile) {
+    offsets_[tile + 1] += offsets_[tile];
+  }
+
+  data_.reserve(offsets_.back());
+
+  for (const std::vector<uint8_t>& column : columns) {
+    data_.insert(data_.end(), column.begin(), column.end());
+  }
+}
+
+void VisibilitySet::SetRange(size_t tile,
+                             const uint8_t** begin,
+                             const uint8_t** end) const {
+  if (!updated_sets_.empty()) {
+    const auto updated = updated_sets_.find(tile);
+
+    if (updated != updated_sets_.end()) {
+      *begin = updated->second.data();
+      *end = updated->second.data() + updated->second.size();
+      return;
+    }
+  }
+
+  *begin = data_.data() + offsets_[tile];
+  *end = data_.data() + offsets_[tile + 1];
+}
+
+size_t VisibilitySet::CompressedSize() const {
+  size_t size = data_.size();
+
+  for (const auto& updated : updated_sets_) {
+    size += updated.second.size();
+    size -= offsets_[updated.first + 1] - offsets_[updated.first];
+  }
+
+  return size;
+}
+
+int VisibilitySet::Update(const Level& level,
+                          int x,
+                          int y,
+                          ThreadPool* thread_pool) {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    return 0;
+  }
+
+  const size_t num_tiles = static_cast<size_t>(width_) * height_;
+  const size_t tile = static_cast<size_t>(x) * height_ + y;
+  std::vector<uint8_t> set;
+
+  if (level.IsSolid(x, y)) {
+    // A new wall only hides tiles, so the other sets stay complete, if
+    // larger than they need to be.
+    AppendVarint(0, &set);
+    AppendVarint(num_tiles, &set);
+    updated_sets_[tile] = std::move(set);
+    return 1;
+  }
+
+  return SeeThrough(level, x, y, thread_pool);
+}
+
+int VisibilitySet::SeeThrough(const Level& level,
+                              int x,
+                              int y,
+                              ThreadPool* thread_pool) {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    return 0;
+  }
+
+  const size_t num_tiles = static_cast<size_t>(width_) * height_;
+  const size_t tile = static_cast<size_t>(x) * height_ + y;
+  std::vector<uint8_t> set;
+
+  std::vector<uint64_t> opened(NumWords(num_tiles));
+  MarkVisibleTiles(level, x, y, SampleDirections(), opened.data());
+  EncodeRuns(opened, num_tiles, &set);
+
+  // Whatever a tile sees through the opened tile is seen from inside the
+  // opened tile too, so its set is added to the set of every tile that sees
+  // it. A ray from such a tile reaches the opened tile through one of the
+  // empty tiles beside it, so the tiles that see it are looked for among the
+  // tiles seen from those and from the opened tile itself. The sets of walls
+  // already hold every tile.
+  std::vector<uint64_t> candidates = opened;
+  constexpr int kNeighbors[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+  for (const auto& neighbor : kNeighbors) {
+    const int neighbor_x = x + neighbor[0];
+    const int neighbor_y = y + neighbor[1];
+
+    if (level.Contains(neighbor_x, neighbor_y) &&
+        !level.IsSolid(neighbor_x, neighbor_y)) {
+      const uint8_t* begin;
+      const uint8_t* end;
+      SetRange(static_cast<size_t>(neighbor_x) * height_ + neighbor_y, &begin,
+               &end);
+      DecodeRuns(begin, end, candidates.data());
+    }
+  }
+
+  std::vector<size_t> sources;
+
+  for (size_t word = 0; word < candidates.size(); ++word) {
+    for (uint64_t bits = candidates[word]; bits != 0; bits &= bits - 1) {
+      const size_t source = word * 64 + __builtin_ctzll(bits);
+      const int source_x = static_cast<int>(source / height_);
+      const int source_y = static_cast<int>(source % height_);
+
+      if (source != tile && !level.IsSolid(source_x, source_y)) {
+        sources.push_back(source);
+      }
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> source_sets(sources.size());
+
+  const auto update_sources = [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const size_t source = sources[i];
+
+      if (!IsVisible(static_cast<int>(source / height_),
+                     static_cast<int>(source % height_), x, y)) {
+        continue;
+      }
+
+      const uint8_t* source_begin;
+      const uint8_t* source_end;
+      SetRange(source, &source_begin, &source_end);
+
+      UnionRuns(SetRunReader(source_begin, source_end),
+                SetRunReader(set.data(), set.data() + set.size()), num_tiles,
+                &source_sets[i]);
+    }
+  };
+
+  const int num_sources = static_cast<int>(sources.size());
+
+  if (thread_pool == nullptr) {
+    update_sources(0, num_sources);
+  } else {
+    thread_pool->ParallelFor(0, num_sources, 64, update_sources);
+  }
+
+  int num_updated = 0;
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (!source_sets[i].empty()) {
+      updated_sets_[sources[i]] = std::move(source_sets[i]);
+      ++num_updated;
+    }
+  }
+
+  // A wall seen through, such as an opening door, keeps every tile in its
+  // set.
+  if (!level.IsSolid(x, y)) {
+    updated_sets_[tile] = std::move(set);
+    ++num_updated;
+  }
+
+  return num_updated;
+}
+
+void VisibilitySet::Decode(int x, int y, VisibleTiles* out) const {
+  const size_t num_tiles = static_cast<size_t>(width_) * height_;
+
+  out->width_ = width_;
+  out->height_ = height_;
+  out->words_.assign(NumWords(num_tiles), 0);
+
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) {
+    SetBits(0, num_tiles, out->words_.data());
+    return;
+  }
+
+  const uint8_t* begin;
+  const uint8_t* end;
+  SetRange(static_cast<size_t>(x) * height_ + y, &begin, &end);
+  DecodeRuns(begin, end, out->words_.data());
+}
+
+bool VisibilitySet::IsVisible(int from_x, int from_y, int to_x, int to_y) const {
+  if (static_cast<unsigned>(from_x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(from_y) >= static_cast<unsigned>(height_)) {
+    return true;
+  }
+
+  if (static_cast<unsigned>(to_x) >= static_cast<unsigned>(width_) ||
+      static_cast<unsigned>(to_y) >= static_cast<unsigned>(height_)) {
+    return false;
+  }
+
+  const size_t tile = static_cast<size_t>(from_x) * height_ + from_y;
+  const size_t target = static_cast<size_t>(to_x) * height_ + to_y;
+  const uint8_t* cursor;
+  const uint8_t* end;
+  SetRange(tile, &cursor, &end);
+
+  size_t position = 0;
+  bool value = false;
+  uint64_t length;
+
+  while (ReadVarint(&cursor, end, &length)) {
+    position += length;
+    if (target < position) return value;
+    value = !value;
+  }
+
+  return false;
+}
+
+bool VisibilitySet::Load(const std::string& path, std::string* error) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file) {
+    *error = "Could not open visibility sets " + path;
+    return false;
+  }
+
+  FileHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  const int64_t width = header.width;
+  const int64_t height = header.height;
+
+  if (!file || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kFormatVersion || width <= 0 || height <= 0 ||
+      width * height > Level::kMaxNumTiles) {
+    *error = "Visibility sets " + path + " have an invalid header";
+    return false;
+  }
+
+  const size_t num_tiles = static_cast<size_t>(width * height);
+
+  std::vector<uint64_t> offsets(num_tiles + 1);
+  file.read(reinterpret_cast<char*>(offsets.data()),
+            static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+
+  std::vector<uint8_t> data;
+
+  if (file && offsets[0] == 0) {
+    data.resize(offsets.back());
+    file.read(reinterpret_cast<char*>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+  }
+
+  bool valid = file && offsets[0] == 0;
+
+  for (size_t tile = 0; valid && tile < num_tiles; ++tile) {
+    valid = offsets[tile] <= offsets[tile + 1] &&
+            ValidRuns(data.data() + offsets[tile],
+                      data.data() + offsets[tile + 1], num_tiles);
+  }
+
+  if (!valid) {
+    *error = "Visibility sets " + path + " are truncated or corrupt";
+    return false;
+  }
+
+  width_ = static_cast<int>(width);
+  height_ = static_cast<int>(height);
+  level_hash_ = header.level_hash;
+  offsets_ = std::move(offsets);
+  data_ = std::move(data);
+  updated_sets_.clear();
+  return true;
+}
+
+bool VisibilitySet::Save(const std::string& path, std::string* error) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.width = static_cast<uint32_t>(width_);
+  header.height = static_cast<uint32_t>(height_);
+  header.level_hash = level_hash_;
+
+  // Updated sets are merged with the others as they are written.
+  const size_t num_tiles = offsets_.empty() ? 0 : offsets_.size() - 1;
+  std::vector<uint64_t> offsets(offsets_.size(), 0);
+
+  for (size_t tile = 0; tile < num_tiles; ++tile) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    SetRange(tile, &begin, &end);
+    offsets[tile + 1] = offsets[tile] + (end - begin);
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(offsets.data()),
+             static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+
+  for (size_t tile = 0; tile < num_tiles; ++tile) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    SetRange(tile, &begin, &end);
+    file.write(reinterpret_cast<const char*>(begin),
+               static_cast<std::streamsize>(end - begin));
+  }
+
+  if (!file) {
+    *error = "Could not write visibility sets " + path;
+    return false;
+  }
+
+  return true;
+}
+
+bool VisibilitySet::LoadOrBuild(const Level& level,
+                                const std::string& path,
+                                ThreadPool* thread_pool,
+                                bool* rebuilt,
+                                std::string* error) {
+  std::string load_error;
+
+  if (Load(path, &load_error) && width_ == level.Width() &&
+      height_ == level.Height() && level_hash_ == level::HashLevel(level)) {
+    *rebuilt = false;
+    return true;
+  }
+
+  *this = VisibilitySet(level, thread_pool);
+  *rebuilt = true;
+
+  return Save(path, error);
+}